@@ -98,6 +98,7 @@ int main (int argc, char **argv) {
 	int *erased;
 	int *matrix;
 	int *bitmatrix;
+	jerasure_schedule_cache_t *scache;
 	
 	/* Parameters */
 	int k, m, w, packetsize, buffersize;
@@ -128,6 +129,7 @@ int main (int argc, char **argv) {
 
 	matrix = NULL;
 	bitmatrix = NULL;
+	scache = NULL;
 	totalsec = 0.0;
 	
 	/* Start timing */
@@ -247,6 +249,10 @@ int main (int argc, char **argv) {
 		case Liber8tion:
 			bitmatrix = liber8tion_coding_bitmatrix(k);
 	}
+	/* Every block has the same erasures, so its schedule is only built once */
+	if (bitmatrix != NULL) {
+		scache = jerasure_create_lazy_schedule_cache(k, m, w, bitmatrix, 1, 1024*1024);
+	}
 	timing_set(&t4);
 	totalsec += timing_delta(&t3, &t4);
 	
@@ -318,11 +324,14 @@ int main (int argc, char **argv) {
 		timing_set(&t3);
 	
 		/* Choose proper decoding method */
-		if (tech == Reed_Sol_Van || tech == Reed_Sol_R6_Op) {
+		if (tech == Reed_Sol_Van) {
 			i = jerasure_matrix_decode(k, m, w, matrix, 1, erasures, data, coding, blocksize);
 		}
+		else if (tech == Reed_Sol_R6_Op) {
+			i = reed_sol_r6_decode(k, w, erasures, data, coding, blocksize);
+		}
 		else if (tech == Cauchy_Orig || tech == Cauchy_Good || tech == Liberation || tech == Blaum_Roth || tech == Liber8tion) {
-			i = jerasure_schedule_decode_lazy(k, m, w, bitmatrix, erasures, data, coding, blocksize, packetsize, 1);
+			i = jerasure_schedule_decode_lazy_cache(scache, erasures, data, coding, blocksize, packetsize);
 		}
 		else {
 			fprintf(stderr, "Not a valid coding technique.\n");
@@ -375,6 +384,7 @@ int main (int argc, char **argv) {
 	free(coding);
 	free(erasures);
 	free(erased);
+	jerasure_free_lazy_schedule_cache(scache);
 	
 	/* Stop timing and print time */
 	timing_set(&t2);
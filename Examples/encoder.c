@@ -116,7 +116,8 @@ int main (int argc, char **argv) {
 	char **coding;
 	int *matrix;
 	int *bitmatrix;
-	int **schedule;
+	jerasure_flat_schedule_t *schedule;
+	jerasure_jit_schedule_t *jit;
 	
 	/* Creation of file name variables */
 	char temp[5];
@@ -143,6 +144,7 @@ int main (int argc, char **argv) {
 	matrix = NULL;
 	bitmatrix = NULL;
 	schedule = NULL;
+	jit = NULL;
 	
 	/* Error check Arguments*/
 	if (argc != 8) {
@@ -445,29 +447,32 @@ int main (int argc, char **argv) {
 		case Cauchy_Orig:
 			matrix = cauchy_original_coding_matrix(k, m, w);
 			bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
-			schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+			schedule = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
 			break;
 		case Cauchy_Good:
 			matrix = cauchy_good_general_coding_matrix(k, m, w);
 			bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
-			schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+			schedule = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
 			break;	
 		case Liberation:
 			bitmatrix = liberation_coding_bitmatrix(k, w);
-			schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+			schedule = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
 			break;
 		case Blaum_Roth:
 			bitmatrix = blaum_roth_coding_bitmatrix(k, w);
-			schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+			schedule = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
 			break;
 		case Liber8tion:
 			bitmatrix = liber8tion_coding_bitmatrix(k);
-			schedule = jerasure_smart_bitmatrix_to_schedule(k, m, w, bitmatrix);
+			schedule = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
 			break;
 		case RDP:
 		case EVENODD:
 			assert(0);
 	}
+	/* Without memory for the compiled schedule, the flat schedule is run
+	   instead. */
+	if (schedule != NULL) jit = jerasure_jit_compile_flat_schedule(schedule, packetsize);
 	timing_set(&start);
 	timing_set(&t4);
 	totalsec += timing_delta(&t3, &t4);
@@ -513,19 +518,15 @@ int main (int argc, char **argv) {
 				reed_sol_r6_encode(k, w, data, coding, blocksize);
 				break;
 			case Cauchy_Orig:
-				jerasure_schedule_encode(k, m, w, schedule, data, coding, blocksize, packetsize);
-				break;
 			case Cauchy_Good:
-				jerasure_schedule_encode(k, m, w, schedule, data, coding, blocksize, packetsize);
-				break;
 			case Liberation:
-				jerasure_schedule_encode(k, m, w, schedule, data, coding, blocksize, packetsize);
-				break;
 			case Blaum_Roth:
-				jerasure_schedule_encode(k, m, w, schedule, data, coding, blocksize, packetsize);
-				break;
 			case Liber8tion:
-				jerasure_schedule_encode(k, m, w, schedule, data, coding, blocksize, packetsize);
+				if (jit != NULL) {
+					jerasure_jit_schedule_encode(k, m, w, jit, data, coding, blocksize);
+				} else {
+					jerasure_flat_schedule_encode(k, m, w, schedule, data, coding, blocksize, packetsize);
+				}
 				break;
 			case RDP:
 			case EVENODD:
@@ -0,0 +1,125 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Jerasure's authors:
+
+   Revision 2.x - 2014: James S. Plank and Kevin M. Greenan.
+   Revision 1.2 - 2008: James S. Plank, Scott Simmerman and Catherine D. Schuman.
+   Revision 1.0 - 2007: James S. Plank.
+ */
+
+/* Times jerasure_invert_matrix() with and without the fast inversion
+   (log tables and region kernels), for k = 8 .. 128 and w = 8 and 16.
+   The matrix to invert is a k X k Cauchy matrix, as when all of the data
+   of a stripe is decoded from coding devices, and it is inverted for at
+   least 0.2 seconds each way. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "timing.h"
+
+static double time_invert(int *matrix, int k, int w, int fast, int *inv)
+{
+  int *copy;
+  double start, elapsed;
+  int n;
+
+  copy = malloc(sizeof(int)*k*k);
+  jerasure_set_fast_invert(fast);
+  n = 0;
+  start = timing_now();
+  do {
+    memcpy(copy, matrix, sizeof(int)*k*k);
+    if (jerasure_invert_matrix(copy, inv, k, w) != 0) {
+      fprintf(stderr, "k=%d w=%d: matrix is not invertible\n", k, w);
+      exit(1);
+    }
+    n++;
+    elapsed = timing_now() - start;
+  } while (elapsed < 0.2);
+  free(copy);
+  return elapsed / n;
+}
+
+static void usage(char *s)
+{
+  fprintf(stderr, "usage: invert_time [w] - Time matrix inversion for k = 8 .. 128.\n");
+  fprintf(stderr, "       w must be 8 or 16.  Without it, both are timed.\n");
+  if (s != NULL) fprintf(stderr, "%s\n", s);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int ws[2] = { 8, 16 };
+  int *matrix, *inv, *fast_inv;
+  int i, k, nw;
+  double told, tfast;
+
+  nw = 2;
+  if (argc > 2) usage(NULL);
+  if (argc == 2) {
+    if (sscanf(argv[1], "%d", ws) != 1 || (ws[0] != 8 && ws[0] != 16)) usage("Bad w");
+    nw = 1;
+  }
+
+  printf("%4s %4s %14s %14s %8s\n", "w", "k", "generic (ms)", "fast (ms)", "speedup");
+  for (i = 0; i < nw; i++) {
+    for (k = 8; k <= 128; k *= 2) {
+      matrix = cauchy_original_coding_matrix(k, k, ws[i]);
+      inv = malloc(sizeof(int)*k*k);
+      fast_inv = malloc(sizeof(int)*k*k);
+      told = time_invert(matrix, k, ws[i], 0, inv);
+      tfast = time_invert(matrix, k, ws[i], 1, fast_inv);
+      if (memcmp(inv, fast_inv, sizeof(int)*k*k) != 0) {
+        fprintf(stderr, "k=%d w=%d: the inverses differ\n", k, ws[i]);
+        exit(1);
+      }
+      printf("%4d %4d %14.4f %14.4f %7.1fx\n", ws[i], k, told*1000, tfast*1000, told/tfast);
+      free(matrix);
+      free(inv);
+      free(fast_inv);
+    }
+  }
+  jerasure_set_fast_invert(1);
+  return 0;
+}
@@ -0,0 +1,114 @@
+/* Test of jerasure_plan_encode_batch().
+
+   Batches of many small stripes and a few big ones, which are cut into
+   slices, are encoded with plans of a Cauchy code for each technique,
+   and every stripe must have the coding devices of jerasure_plan_encode()
+   of that stripe.  One stripe has a negative size, and must be the only
+   one that fails.  The batches are encoded with 4 threads and with 1. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "cauchy.h"
+
+#define K 6
+#define M 3
+#define W 8
+#define PS 64
+#define SMALL 300
+#define BIG 3
+#define POOL (1100*1024)
+
+static char *pool;
+
+static int test_batch(jerasure_plan_t *plan, int unit, const char *name)
+{
+  jerasure_stripe_t stripes[SMALL+BIG+1];
+  char *want[M];
+  int i, j, n, size, bad, failed, fails;
+
+  n = SMALL+BIG+1;
+  bad = SMALL/2;
+  for (i = 0; i < n; i++) {
+    if (i == bad) {
+      size = -1;
+    } else if (i < SMALL) {
+      size = unit * (1 + rand() % (16384/unit));
+    } else {
+      size = unit * (((i == SMALL) ? 1000*1024 : 200*1024+rand() % (100*1024)) / unit);
+    }
+    stripes[i].size = size;
+    stripes[i].data_ptrs = malloc(sizeof(char *)*K);
+    stripes[i].coding_ptrs = malloc(sizeof(char *)*M);
+    for (j = 0; j < K; j++) stripes[i].data_ptrs[j] = pool + unit * (rand() % ((POOL-size)/unit));
+    for (j = 0; j < M; j++) stripes[i].coding_ptrs[j] = malloc((size > 0) ? size : 1);
+  }
+
+  fails = 0;
+  failed = jerasure_plan_encode_batch(plan, stripes, n);
+  if (failed != 1 || stripes[bad].status != -1) {
+    fprintf(stderr, "%s: %d stripes failed\n", name, failed);
+    fails++;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (i == bad) continue;
+    if (stripes[i].status != 0) fails++;
+    for (j = 0; j < M; j++) want[j] = malloc(stripes[i].size);
+    jerasure_plan_encode(plan, stripes[i].data_ptrs, want, stripes[i].size);
+    for (j = 0; j < M; j++) {
+      if (memcmp(want[j], stripes[i].coding_ptrs[j], stripes[i].size) != 0) {
+        fprintf(stderr, "%s: stripe %d of %d bytes is wrong\n", name, i, stripes[i].size);
+        fails++;
+      }
+      free(want[j]);
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < M; j++) free(stripes[i].coding_ptrs[j]);
+    free(stripes[i].data_ptrs);
+    free(stripes[i].coding_ptrs);
+  }
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int threads[] = { 4, 1 };
+  jerasure_plan_t *plan;
+  int *matrix, *bitmatrix;
+  int i, t, f, fails;
+  const char *names[] = { "matrix", "bitmatrix", "schedule" };
+
+  srand(1425);
+  pool = malloc(POOL);
+  for (i = 0; i < POOL; i++) pool[i] = rand() & 0xff;
+  matrix = cauchy_good_general_coding_matrix(K, M, W);
+  bitmatrix = jerasure_matrix_to_bitmatrix(K, M, W, matrix);
+
+  fails = 0;
+  for (i = 0; i < 2; i++) {
+    jerasure_set_threads(threads[i]);
+    for (t = 0; t < 3; t++) {
+      plan = jerasure_plan_create(K, M, W, t, matrix, bitmatrix, PS);
+      if (plan == NULL) {
+        fprintf(stderr, "%s: cannot create the plan\n", names[t]);
+        fails++;
+        continue;
+      }
+      f = test_batch(plan, (t == JERASURE_PLAN_MATRIX) ? 64 : W*PS, names[t]);
+      printf("%d thread%s, %-9s: %s\n", threads[i], (threads[i] == 1) ? "" : "s", names[t],
+             (f == 0) ? "ok" : "FAILED");
+      fails += f;
+      jerasure_plan_free(plan);
+    }
+  }
+  jerasure_set_threads(0);
+
+  free(bitmatrix);
+  free(matrix);
+  free(pool);
+  return (fails == 0) ? 0 : 1;
+}
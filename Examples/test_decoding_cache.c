@@ -0,0 +1,270 @@
+/* Test of the decoding matrix cache in jerasure.c.
+
+   Decoding the same erasures again must hit the cache, for both
+   jerasure_matrix_decode() and jerasure_bitmatrix_decode(), and must still
+   restore the stripe.  With a cache that only holds a couple of matrices,
+   the least recently used one must be evicted and the cache must stay
+   within its size.  A lazy schedule cache of a Cauchy code must build each
+   schedule once, whatever the order of the erasures, and stay within its
+   budget.  When Jerasure is built with pthreads, several threads then
+   decode random erasures at once through small caches, so that entries
+   are evicted while the other threads use them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef JERASURE_PTHREADS
+#include <pthread.h>
+#endif
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "cauchy.h"
+
+#define K 8
+#define M 3
+#define W 8
+#define PACKETSIZE 32
+#define SIZE (W*PACKETSIZE*4)
+#define THREADS 4
+#define ROUNDS 400
+
+/* How a stripe is decoded, and the coding devices of each. */
+
+#define MATRIX 0
+#define BITMATRIX 1
+#define SCHEDULE 2
+
+static int *matrix, *bitmatrix, *cauchy_bitmatrix;
+static jerasure_schedule_cache_t *scache;
+static char *orig[K], *expect[3][M];
+
+typedef struct {
+  char *data[K], *coding[M];
+  unsigned int seed;
+  int fails;
+} stripe;
+
+static void stripe_init(stripe *s, unsigned int seed)
+{
+  int i;
+
+  for (i = 0; i < K; i++) s->data[i] = malloc(SIZE);
+  for (i = 0; i < M; i++) s->coding[i] = malloc(SIZE);
+  s->seed = seed;
+  s->fails = 0;
+}
+
+static void stripe_free(stripe *s)
+{
+  int i;
+
+  for (i = 0; i < K; i++) free(s->data[i]);
+  for (i = 0; i < M; i++) free(s->coding[i]);
+}
+
+/* Erases the devices in erasures, decodes them, and checks the stripe. */
+
+static int decode(stripe *s, int *erasures, int how)
+{
+  int i, rc;
+
+  for (i = 0; i < K; i++) memcpy(s->data[i], orig[i], SIZE);
+  for (i = 0; i < M; i++) memcpy(s->coding[i], expect[how][i], SIZE);
+  for (i = 0; erasures[i] != -1; i++) {
+    memset((erasures[i] < K) ? s->data[erasures[i]] : s->coding[erasures[i]-K], 0x5a, SIZE);
+  }
+  if (how == SCHEDULE) {
+    rc = jerasure_schedule_decode_lazy_cache(scache, erasures, s->data, s->coding, SIZE, PACKETSIZE);
+  } else if (how == BITMATRIX) {
+    rc = jerasure_bitmatrix_decode(K, M, W, bitmatrix, 0, erasures, s->data, s->coding, SIZE, PACKETSIZE);
+  } else {
+    rc = jerasure_matrix_decode(K, M, W, matrix, 0, erasures, s->data, s->coding, SIZE);
+  }
+  if (rc != 0) return 1;
+  for (i = 0; i < K; i++) if (memcmp(s->data[i], orig[i], SIZE) != 0) return 1;
+  for (i = 0; i < M; i++) if (memcmp(s->coding[i], expect[how][i], SIZE) != 0) return 1;
+  return 0;
+}
+
+/* Checks the stats of the decoding matrix cache, or of scache if
+   limit is not 0. */
+
+static int expect_stats(const char *what, double hits, double misses, long limit)
+{
+  double stats[3];
+
+  if (limit == 0) {
+    jerasure_get_decoding_cache_stats(stats);
+    limit = jerasure_get_decoding_cache_size();
+  } else {
+    jerasure_get_lazy_schedule_cache_stats(scache, stats);
+  }
+  if (stats[0] != hits || stats[1] != misses) {
+    fprintf(stderr, "%s: %.0f hits and %.0f misses, expected %.0f and %.0f\n",
+            what, stats[0], stats[1], hits, misses);
+    return 1;
+  }
+  if (stats[2] > limit) {
+    fprintf(stderr, "%s: the cache holds %.0f bytes, more than its size\n", what, stats[2]);
+    return 1;
+  }
+  return 0;
+}
+
+#ifdef JERASURE_PTHREADS
+static void *decode_thread(void *arg)
+{
+  stripe *s;
+  int erasures[M+1];
+  int r, i, j, n, e;
+
+  s = (stripe *) arg;
+  for (r = 0; r < ROUNDS && s->fails < 10; r++) {
+    n = 1 + rand_r(&s->seed) % M;
+    i = 0;
+    while (i < n) {
+      e = rand_r(&s->seed) % (K+M);
+      for (j = 0; j < i && erasures[j] != e; j++) ;
+      if (j == i) erasures[i++] = e;
+    }
+    erasures[n] = -1;
+    s->fails += decode(s, erasures, r % 3);
+  }
+  return NULL;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+  stripe s;
+  double stats[3];
+  int a[] = { 1, 9, -1 }, b[] = { 0, 4, -1 }, c[] = { 2, 3, 5, -1 }, ra[] = { 9, 1, -1 };
+  int erasures[M+1], e[3];
+  int *cauchy;
+  int i, j, n, fails, entry, patterns;
+#ifdef JERASURE_PTHREADS
+  pthread_t tids[THREADS];
+  stripe ts[THREADS];
+#endif
+
+  srand(1390);
+  matrix = reed_sol_vandermonde_coding_matrix(K, M, W);
+  bitmatrix = jerasure_matrix_to_bitmatrix(K, M, W, matrix);
+  for (i = 0; i < K; i++) {
+    orig[i] = malloc(SIZE);
+    for (j = 0; j < SIZE; j++) orig[i][j] = rand() & 0xff;
+  }
+  cauchy = cauchy_good_general_coding_matrix(K, M, W);
+  cauchy_bitmatrix = jerasure_matrix_to_bitmatrix(K, M, W, cauchy);
+  for (i = 0; i < M; i++) {
+    for (j = 0; j < 3; j++) expect[j][i] = malloc(SIZE);
+  }
+  jerasure_matrix_encode(K, M, W, matrix, orig, expect[MATRIX], SIZE);
+  jerasure_bitmatrix_encode(K, M, W, bitmatrix, orig, expect[BITMATRIX], SIZE, PACKETSIZE);
+  jerasure_bitmatrix_encode(K, M, W, cauchy_bitmatrix, orig, expect[SCHEDULE], SIZE, PACKETSIZE);
+  stripe_init(&s, 1);
+  fails = 0;
+
+  /* The same erasures hit the cache after the first decode. */
+
+  jerasure_get_decoding_cache_stats(stats);
+  for (i = 0; i < 5; i++) fails += decode(&s, a, MATRIX);
+  fails += expect_stats("matrix", 4, 1, 0);
+  for (i = 0; i < 5; i++) fails += decode(&s, a, BITMATRIX);
+  fails += expect_stats("bitmatrix", 4, 1, 0);
+  for (i = 0; i < 3; i++) fails += decode(&s, b, MATRIX);
+  fails += decode(&s, a, MATRIX);
+  fails += expect_stats("two patterns", 3, 1, 0);
+
+  /* Room for about two matrices:  a, b, c evicts a, and b was used last. */
+
+  jerasure_clear_decoding_cache();
+  entry = (K*K + 2*K + M) * sizeof(int) + 128;
+  jerasure_set_decoding_cache_size(2*entry + K*M*sizeof(int) + 64 + entry/2);
+  fails += decode(&s, a, MATRIX);
+  fails += decode(&s, b, MATRIX);
+  fails += decode(&s, c, MATRIX);
+  fails += decode(&s, b, MATRIX);
+  fails += decode(&s, a, MATRIX);
+  fails += expect_stats("lru", 1, 4, 0);
+
+  /* A size of 0 disables the cache. */
+
+  jerasure_set_decoding_cache_size(0);
+  jerasure_get_decoding_cache_stats(stats);
+  for (i = 0; i < 3; i++) fails += decode(&s, a, MATRIX);
+  fails += expect_stats("disabled", 0, 0, 0);
+  printf("decoding cache %s\n", (fails == 0) ? "ok" : "FAILED");
+
+  /* Lazy schedule cache:  one miss per set of erasures, in any order.
+     Every set of up to M erasures is given as e[0] <= e[1] <= e[2], with
+     repeats meaning fewer erasures, so most sets are decoded more than
+     once.  a was decoded already. */
+
+  i = fails;
+  scache = jerasure_create_lazy_schedule_cache(K, M, W, cauchy_bitmatrix, 1, 1 << 30);
+  fails += decode(&s, a, SCHEDULE);
+  fails += decode(&s, ra, SCHEDULE);
+  fails += expect_stats("schedule order", 1, 1, 1 << 30);
+  patterns = 0;
+  for (e[0] = 0; e[0] < K+M; e[0]++) {
+    for (e[1] = e[0]; e[1] < K+M; e[1]++) {
+      for (e[2] = e[1]; e[2] < K+M; e[2]++) {
+        n = 0;
+        for (j = 0; j < 3; j++) {
+          if (j == 0 || e[j] != e[j-1]) erasures[n++] = e[j];
+        }
+        erasures[n] = -1;
+        fails += decode(&s, erasures, SCHEDULE);
+        patterns++;
+      }
+    }
+  }
+  n = (K+M) + (K+M)*(K+M-1)/2 + (K+M)*(K+M-1)*(K+M-2)/6;
+  fails += expect_stats("schedule patterns", patterns-n+1, n-1, 1 << 30);
+  jerasure_free_lazy_schedule_cache(scache);
+
+  /* With a small budget, the same decodes still work. */
+
+  scache = jerasure_create_lazy_schedule_cache(K, M, W, cauchy_bitmatrix, 1, 8*1024);
+  for (j = 0; j < 2*(K+M); j++) {
+    erasures[0] = j % (K+M);
+    erasures[1] = (j*7+1) % (K+M);
+    erasures[2] = -1;
+    if (erasures[1] == erasures[0]) erasures[1] = -1;
+    fails += decode(&s, erasures, SCHEDULE);
+  }
+  jerasure_get_lazy_schedule_cache_stats(scache, stats);
+  if (stats[2] > 8*1024) fails++;
+  printf("lazy schedule cache %s\n", (fails == i) ? "ok" : "FAILED");
+
+#ifdef JERASURE_PTHREADS
+  i = fails;
+  jerasure_set_decoding_cache_size(16*1024);
+  jerasure_free_lazy_schedule_cache(scache);
+  scache = jerasure_create_lazy_schedule_cache(K, M, W, cauchy_bitmatrix, 1, 16*1024);
+  for (j = 0; j < THREADS; j++) {
+    stripe_init(ts+j, 100+j);
+    pthread_create(tids+j, NULL, decode_thread, ts+j);
+  }
+  for (j = 0; j < THREADS; j++) {
+    pthread_join(tids[j], NULL);
+    fails += ts[j].fails;
+    stripe_free(ts+j);
+  }
+  printf("decoding cache with %d threads %s\n", THREADS, (fails == i) ? "ok" : "FAILED");
+#endif
+
+  jerasure_clear_decoding_cache();
+  jerasure_free_lazy_schedule_cache(scache);
+  stripe_free(&s);
+  for (i = 0; i < K; i++) free(orig[i]);
+  for (i = 0; i < M; i++) {
+    for (j = 0; j < 3; j++) free(expect[j][i]);
+  }
+  free(matrix);
+  free(bitmatrix);
+  free(cauchy);
+  free(cauchy_bitmatrix);
+  return (fails == 0) ? 0 : 1;
+}
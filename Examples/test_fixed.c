@@ -0,0 +1,139 @@
+/* Test of libJerasure_fixed.
+
+   Every code that was fixed at build time must encode like
+   jerasure_bitmatrix_encode() with its bitmatrix, over several blocks, and
+   must decode every set of up to m erasures.  More than m erasures,
+   erasures that repeat or are out of range, and sizes that are not a
+   multiple of w*packetsize must fail, and jerasure_fixed_find must find
+   each code, and nothing else. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "jerasure_fixed.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+#define BLOCKS 3
+
+/* Erases the devices in erasures (terminated by -1), decodes and checks
+   that the data and coding are back. */
+
+static int test_decode(const jerasure_fixed_code_t *c, int *erasures, char **data, char **coding,
+                       char **orig, char **expect, int size)
+{
+  int i;
+
+  for (i = 0; erasures[i] != -1; i++) {
+    memset((erasures[i] < c->k) ? data[erasures[i]] : coding[erasures[i]-c->k], 0x5a, size);
+  }
+  if (c->decode(erasures, data, coding, size) != 0) return 1;
+  for (i = 0; i < c->k; i++) if (memcmp(data[i], orig[i], size) != 0) return 1;
+  for (i = 0; i < c->m; i++) if (memcmp(coding[i], expect[i], size) != 0) return 1;
+  return 0;
+}
+
+static int test_code(const jerasure_fixed_code_t *c)
+{
+  char **data, **coding, **orig, **expect;
+  int *erasures;
+  int i, j, n, size, fails;
+
+  size = BLOCKS*c->w*c->packetsize;
+  data = talloc(char *, c->k);
+  orig = talloc(char *, c->k);
+  coding = talloc(char *, c->m);
+  expect = talloc(char *, c->m);
+  erasures = talloc(int, c->k+c->m+2);
+  for (i = 0; i < c->k; i++) {
+    data[i] = malloc(size);
+    orig[i] = malloc(size);
+    for (j = 0; j < size; j++) orig[i][j] = rand() & 0xff;
+    memcpy(data[i], orig[i], size);
+  }
+  for (i = 0; i < c->m; i++) {
+    coding[i] = malloc(size);
+    expect[i] = malloc(size);
+  }
+
+  fails = 0;
+  jerasure_bitmatrix_encode(c->k, c->m, c->w, (int *) c->bitmatrix, data, expect, size,
+                            c->packetsize);
+  if (c->encode(data, coding, size) != 0) fails++;
+  for (i = 0; i < c->m; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "%s: encode mismatch on coding device %d\n", c->technique, i);
+      fails++;
+    }
+  }
+
+  /* Every set of up to m erasures, as an odometer over ascending ids. */
+
+  n = c->k + c->m;
+  for (j = 1; j <= c->m; j++) {
+    for (i = 0; i < j; i++) erasures[i] = i;
+    erasures[j] = -1;
+    while (1) {
+      if (test_decode(c, erasures, data, coding, orig, expect, size) != 0) {
+        fprintf(stderr, "%s: decode failed, erasures", c->technique);
+        for (i = 0; i < j; i++) fprintf(stderr, " %d", erasures[i]);
+        fprintf(stderr, "\n");
+        fails++;
+      }
+      for (i = j-1; i >= 0 && erasures[i] == n-j+i; i--) ;
+      if (i < 0) break;
+      erasures[i]++;
+      for (i++; i < j; i++) erasures[i] = erasures[i-1]+1;
+    }
+  }
+
+  for (i = 0; i <= c->m; i++) erasures[i] = i;
+  erasures[c->m+1] = -1;
+  if (c->decode(erasures, data, coding, size) != -1) fails++;
+  erasures[0] = 1;
+  erasures[1] = 1;
+  erasures[2] = -1;
+  if (c->decode(erasures, data, coding, size) != -1) fails++;
+  erasures[0] = n;
+  erasures[1] = -1;
+  if (c->decode(erasures, data, coding, size) != -1) fails++;
+  if (c->encode(data, coding, size + c->packetsize) != -1) fails++;
+  if (c->encode(data, coding, -c->w*c->packetsize) != -1) fails++;
+  for (i = 0; i < c->k; i++) if (memcmp(data[i], orig[i], size) != 0) fails++;
+
+  if (jerasure_fixed_find(c->technique, c->k, c->m, c->w, c->packetsize) != c) fails++;
+  if (jerasure_fixed_find(c->technique, c->k, c->m, c->w, c->packetsize*2) != NULL) fails++;
+  if (jerasure_fixed_find("no_such_technique", c->k, c->m, c->w, c->packetsize) != NULL) fails++;
+
+  for (i = 0; i < c->k; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < c->m; i++) {
+    free(coding[i]);
+    free(expect[i]);
+  }
+  free(data);
+  free(orig);
+  free(coding);
+  free(expect);
+  free(erasures);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int i, f, fails;
+
+  srand(1418);
+  fails = 0;
+  for (i = 0; i < jerasure_fixed_ncodes; i++) {
+    f = test_code(&jerasure_fixed_codes[i]);
+    printf("%s k=%d m=%d w=%d packetsize %d: %s\n", jerasure_fixed_codes[i].technique,
+           jerasure_fixed_codes[i].k, jerasure_fixed_codes[i].m, jerasure_fixed_codes[i].w,
+           jerasure_fixed_codes[i].packetsize, (f == 0) ? "ok" : "FAILED");
+    fails += f;
+  }
+  return (fails == 0) ? 0 : 1;
+}
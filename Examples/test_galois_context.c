@@ -0,0 +1,230 @@
+/* Test of Galois field contexts.
+
+   For w=8 and w=16, a context is given a field with another polynomial
+   than the default one.  Its products and dot products must be those of
+   that field, while the process keeps the default field.  A matrix plan of
+   a Cauchy matrix built in the context must encode like the dot products
+   of the context, and must decode every pair of erasures, taking turns
+   with a plan of the same matrix in the process's field, so that the
+   decoding matrix cache must keep the decoding matrices of the two
+   apart.  Last, a decoding in the process's field is repeated after
+   galois_change_technique(), and must not get the decoding matrix of the
+   old field from the cache. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+
+#define K 6
+#define M 3
+#define SIZE 4096
+
+static char *data[K], *coding[M], *orig[K], *expect[M], *pexpect[M];
+
+static int word(char *p, int i, int w)
+{
+  return (w == 8) ? ((unsigned char *) p)[i] : ((uint16_t *) p)[i];
+}
+
+/* Checks the arithmetic of ctx against ref, and that of the process against
+   def. */
+
+static int test_arithmetic(galois_context_t *ctx, gf_t *ref, gf_t *def, int w)
+{
+  char *srcs[K], *dest;
+  int coeffs[K];
+  int i, j, x, y, p, differ, fails;
+
+  fails = 0;
+  differ = 0;
+  for (i = 0; i < 1000; i++) {
+    x = 1 + rand() % ((1 << w) - 1);
+    y = 1 + rand() % ((1 << w) - 1);
+    p = ref->multiply.w32(ref, x, y);
+    if (galois_context_single_multiply(ctx, x, y, w) != p) fails++;
+    if (galois_context_single_divide(ctx, p, y, w) != x) fails++;
+    if (galois_single_multiply(x, y, w) != (int) def->multiply.w32(def, x, y)) fails++;
+    if (galois_single_multiply(x, y, w) != p) differ = 1;
+  }
+  if (!differ) fails++;
+
+  dest = malloc(SIZE);
+  for (j = 0; j < K; j++) {
+    srcs[j] = data[j];
+    coeffs[j] = rand() % (1 << w);
+  }
+  galois_context_region_dotprod(ctx, w, srcs, coeffs, K, dest, SIZE);
+  for (i = 0; i < SIZE/(w/8); i++) {
+    p = 0;
+    for (j = 0; j < K; j++) p ^= ref->multiply.w32(ref, coeffs[j], word(srcs[j], i, w));
+    if (word(dest, i, w) != p) {
+      fails++;
+      break;
+    }
+  }
+  free(dest);
+  if (fails > 0) fprintf(stderr, "w=%d: arithmetic of the context is wrong\n", w);
+  return fails;
+}
+
+static int decode_all(jerasure_plan_t *plan, char **want)
+{
+  int erasures[3];
+  int i, fails;
+
+  fails = 0;
+  for (erasures[0] = 0; erasures[0] < K+M; erasures[0]++) {
+    for (erasures[1] = erasures[0]+1; erasures[1] < K+M; erasures[1]++) {
+      erasures[2] = -1;
+      for (i = 0; i < K; i++) memcpy(data[i], orig[i], SIZE);
+      for (i = 0; i < M; i++) memcpy(coding[i], want[i], SIZE);
+      for (i = 0; i < 2; i++) {
+        memset((erasures[i] < K) ? data[erasures[i]] : coding[erasures[i]-K], 0x5a, SIZE);
+      }
+      if (jerasure_plan_decode(plan, erasures, data, coding, SIZE) != 0) fails++;
+      for (i = 0; i < K; i++) if (memcmp(data[i], orig[i], SIZE) != 0) fails++;
+      for (i = 0; i < M; i++) if (memcmp(coding[i], want[i], SIZE) != 0) fails++;
+    }
+  }
+  return fails;
+}
+
+/* Encodes and decodes with a plan of a Cauchy matrix of ctx, and with a
+   plan of the same matrix in the process's field. */
+
+static int test_plan(galois_context_t *ctx, int w)
+{
+  jerasure_plan_t *plan, *pplan;
+  char *srcs[K];
+  int matrix[K*M];
+  int i, j, fails;
+
+  for (i = 0; i < M; i++) {
+    for (j = 0; j < K; j++) matrix[i*K+j] = galois_context_single_divide(ctx, 1, i ^ (M+j), w);
+  }
+  plan = jerasure_plan_create_with_context(ctx, K, M, w, JERASURE_PLAN_MATRIX, matrix, NULL, 0);
+  pplan = jerasure_plan_create(K, M, w, JERASURE_PLAN_MATRIX, matrix, NULL, 0);
+  if (plan == NULL || pplan == NULL) return 1;
+
+  fails = 0;
+  for (i = 0; i < K; i++) {
+    memcpy(data[i], orig[i], SIZE);
+    srcs[i] = data[i];
+  }
+  for (i = 0; i < M; i++) galois_context_region_dotprod(ctx, w, srcs, matrix+i*K, K, expect[i], SIZE);
+  jerasure_plan_encode(plan, data, coding, SIZE);
+  for (i = 0; i < M; i++) if (memcmp(coding[i], expect[i], SIZE) != 0) fails++;
+  jerasure_plan_encode(pplan, data, pexpect, SIZE);
+  if (memcmp(pexpect[0], expect[0], SIZE) == 0) fails++;
+  if (fails > 0) fprintf(stderr, "w=%d: the plan of the context does not encode in its field\n", w);
+
+  for (i = 0; i < 2; i++) {
+    fails += decode_all(plan, expect);
+    fails += decode_all(pplan, pexpect);
+  }
+  if (fails > 0) fprintf(stderr, "w=%d: decoding failed\n", w);
+  jerasure_plan_free(plan);
+  jerasure_plan_free(pplan);
+  return fails;
+}
+
+/* Decodes data devices 0 and 1 in the default field of w=8, changes the
+   field to another polynomial, and decodes them again.  Rows 0 and 1 of
+   the matrix make the decoding matrix invertible in both fields, but
+   different. */
+
+static int test_change_technique()
+{
+  int matrix[K*M];
+  int erasures[3];
+  int i, j, t, fails;
+
+  for (j = 0; j < K; j++) {
+    matrix[j] = 1;
+    matrix[K+j] = j+1;
+    matrix[2*K+j] = 1 << j;
+  }
+  erasures[0] = 0;
+  erasures[1] = 1;
+  erasures[2] = -1;
+
+  fails = 0;
+  for (t = 0; t < 2; t++) {
+    if (t == 1) {
+      galois_change_technique(galois_init_field(8, GF_MULT_DEFAULT, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT,
+                                                0x11b, 0, 0), 8);
+    }
+    for (i = 0; i < K; i++) memcpy(data[i], orig[i], SIZE);
+    jerasure_matrix_encode(K, M, 8, matrix, data, coding, SIZE);
+    memset(data[0], 0x5a, SIZE);
+    memset(data[1], 0x5a, SIZE);
+    if (jerasure_matrix_decode(K, M, 8, matrix, 0, erasures, data, coding, SIZE) != 0) fails++;
+    for (i = 0; i < K; i++) if (memcmp(data[i], orig[i], SIZE) != 0) fails++;
+  }
+  galois_uninit_field(8);
+  if (fails > 0) fprintf(stderr, "decoding after galois_change_technique() failed\n");
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int ws[] = { 8, 16 };
+  uint64_t polys[] = { 0x11b, 0x1002d };
+  galois_context_t *ctx;
+  gf_t *ref, def;
+  int i, j, fails, f;
+
+  srand(1422);
+  for (i = 0; i < K; i++) {
+    data[i] = malloc(SIZE);
+    orig[i] = malloc(SIZE);
+    for (j = 0; j < SIZE; j++) orig[i][j] = rand() & 0xff;
+    memcpy(data[i], orig[i], SIZE);
+  }
+  for (i = 0; i < M; i++) {
+    coding[i] = malloc(SIZE);
+    expect[i] = malloc(SIZE);
+    pexpect[i] = malloc(SIZE);
+  }
+
+  fails = 0;
+  ctx = galois_context_create();
+  for (i = 0; i < 2; i++) {
+    if (galois_context_set_field(ctx, ws[i], galois_init_field(ws[i], GF_MULT_DEFAULT, GF_REGION_DEFAULT,
+                                                               GF_DIVIDE_DEFAULT, polys[i], 0, 0)) != 0) {
+      fails++;
+      continue;
+    }
+    ref = galois_init_field(ws[i], GF_MULT_DEFAULT, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT, polys[i], 0, 0);
+    gf_init_easy(&def, ws[i]);
+    f = test_arithmetic(ctx, ref, &def, ws[i]);
+    f += test_plan(ctx, ws[i]);
+    printf("w=%d context: %s\n", ws[i], (f == 0) ? "ok" : "FAILED");
+    fails += f;
+  }
+
+  /* Without a field of its own, a context uses the process's. */
+
+  if (galois_context_set_field(ctx, 8, NULL) != 0 ||
+      galois_context_single_multiply(ctx, 0x53, 0xca, 8) != galois_single_multiply(0x53, 0xca, 8)) {
+    fprintf(stderr, "a context without a field does not use the process's\n");
+    fails++;
+  }
+  galois_context_free(ctx);
+
+  f = test_change_technique();
+  printf("w=8 galois_change_technique(): %s\n", (f == 0) ? "ok" : "FAILED");
+  fails += f;
+
+  for (i = 0; i < K; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < M; i++) {
+    free(coding[i]);
+    free(expect[i]);
+    free(pexpect[i]);
+  }
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+/* Differential test of the native region kernels in galois.c.
+
+   Every kernel that this CPU supports is compared byte for byte against
+   galois_single_multiply(), for all 256 multipliers, with and without add,
+   in place, and for sizes and offsets that leave unaligned heads and tails.
+   The w=16 and w=32 region multiplies are checked the same way, with random
+   multipliers (whose split tables come from the log tables for w=16).
+   The dot product kernels are checked the same way for w=8, 16 and 32, and
+   the multi-destination dot products against the single-destination ones.
+   galois_region_xor_n() is checked on small regions, and on regions large
+   enough to take its streaming-store path. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "galois.h"
+
+#define MAXSIZE 4200
+
+static const char *kernel_names[] = { "gf_complete", "ssse3", "avx2", "avx512" };
+static int sizes[] = { 0, 1, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 1000, 4096+13 };
+
+static unsigned char src_buf[MAXSIZE+64], dest_buf[MAXSIZE+64], orig_buf[MAXSIZE+64];
+static unsigned char expect[MAXSIZE];
+
+static int check(const char *what, int kernel, int c, int size, int soff, int doff,
+                 unsigned char *got)
+{
+  if (memcmp(got, expect, size) != 0) {
+    fprintf(stderr, "%s mismatch: kernel=%s multby=%d size=%d src_off=%d dest_off=%d\n",
+            what, kernel_names[kernel], c, size, soff, doff);
+    return 1;
+  }
+  return 0;
+}
+
+static int test_w08(int kernel)
+{
+  int c, s, size, soff, doff, add, i, fails;
+  unsigned char *src, *dest;
+
+  fails = 0;
+  for (c = 0; c < 256; c++) {
+    for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+      size = sizes[s];
+      for (soff = 0; soff < 4; soff++) {
+        /* GF-Complete requires src and dest to share their alignment */
+        for (doff = (kernel == GALOIS_KERNEL_GF_COMPLETE) ? soff : 0; doff < 4; doff++) {
+          src = src_buf + soff;
+          dest = dest_buf + doff;
+          for (add = 0; add < 2; add++) {
+            memcpy(dest, orig_buf, size);
+            for (i = 0; i < size; i++) {
+              expect[i] = galois_single_multiply(src[i], c, 8);
+              if (add) expect[i] ^= orig_buf[i];
+            }
+            galois_w08_region_multiply((char *) src, c, size, (char *) dest, add);
+            fails += check("region", kernel, c, size, soff, doff, dest);
+            if (kernel == GALOIS_KERNEL_GF_COMPLETE) break;
+          }
+          if (kernel == GALOIS_KERNEL_GF_COMPLETE) break;
+        }
+
+        /* In place: r2 == NULL */
+        memcpy(dest_buf + soff, src, size);
+        for (i = 0; i < size; i++) expect[i] = galois_single_multiply(src[i], c, 8);
+        galois_w08_region_multiply((char *) dest_buf + soff, c, size, NULL, 0);
+        fails += check("in-place", kernel, c, size, soff, soff, dest_buf + soff);
+      }
+      if (fails > 10) return fails;
+    }
+  }
+  return fails;
+}
+
+#define DP_SRCS 20
+
+/* malloc()'d, so that all of these share their alignment, as GF-Complete
+   needs. */
+
+#define DP_DESTS 9
+
+static unsigned char *dp_buf[DP_SRCS], *dp_dest, *dp_mdest[DP_DESTS];
+
+static uint32_t get_word(unsigned char *p, int w)
+{
+  uint32_t x;
+  int b;
+
+  x = 0;
+  for (b = 0; b < w/8; b++) x |= ((uint32_t) p[b]) << (8*b);
+  return x;
+}
+
+static int test_wxx_multiply(int kernel, int w)
+{
+  int s, size, soff, doff, add, i, b, r, c, fails;
+  uint32_t p;
+  unsigned char *src, *dest;
+
+  fails = 0;
+  for (r = 0; r < 40; r++) {
+    switch (r) {
+      case 0:  c = 0; break;
+      case 1:  c = 1; break;
+      default: c = (w == 32) ? (uint32_t) rand() * 2654435761U : rand() & ((1 << w) - 1);
+    }
+    for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+      size = sizes[s] - sizes[s] % (w/8);
+      soff = rand() % 4;
+      doff = (kernel == GALOIS_KERNEL_GF_COMPLETE) ? soff : rand() % 4;
+      src = dp_buf[0] + soff;
+      dest = dp_dest + doff;
+      for (add = 0; add < 3; add++) {
+        for (i = 0; i < size; i += w/8) {
+          p = (uint32_t) galois_single_multiply(get_word(src+i, w), c, w);
+          if (add == 1) p ^= get_word(orig_buf+i, w);
+          for (b = 0; b < w/8; b++) expect[i+b] = (p >> (8*b)) & 0xff;
+        }
+
+        /* add == 2 is in place: r2 == NULL */
+        if (add == 2) dest = dp_dest + soff;
+        memcpy(dest, (add == 2) ? src : orig_buf, size);
+        if (w == 16) {
+          galois_w16_region_multiply((char *) ((add == 2) ? dest : src), c, size,
+                                     (add == 2) ? NULL : (char *) dest, add);
+        } else {
+          galois_w32_region_multiply((char *) ((add == 2) ? dest : src), c, size,
+                                     (add == 2) ? NULL : (char *) dest, add);
+        }
+        fails += check((add == 2) ? "in-place" : "region", kernel, c, size, soff, doff, dest);
+      }
+      if (fails > 10) return fails;
+    }
+  }
+  return fails;
+}
+
+static int test_dotprod(int kernel, int w)
+{
+  static int nsrcs[] = { 0, 1, 2, 5, 16, 17, DP_SRCS };
+  char *srcs[DP_SRCS];
+  int coeffs[DP_SRCS];
+  int s, size, n, ni, off, i, j, b, fails;
+  uint32_t p;
+  unsigned char *dest;
+
+  fails = 0;
+  for (ni = 0; ni < sizeof(nsrcs)/sizeof(int); ni++) {
+    n = nsrcs[ni];
+    for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+      size = sizes[s] - sizes[s] % (w/8);
+      for (off = 0; off < 4; off++) {
+        for (j = 0; j < n; j++) {
+          /* Unaligned sources only for the native kernels */
+          srcs[j] = (char *) dp_buf[j] + ((kernel == GALOIS_KERNEL_GF_COMPLETE) ? off : (off+j) % 5);
+          switch (rand() % 4) {
+            case 0:  coeffs[j] = 0; break;
+            case 1:  coeffs[j] = 1; break;
+            default: coeffs[j] = (w == 32) ? (uint32_t) rand() * 2654435761U : rand() & ((1 << w) - 1);
+          }
+        }
+        for (i = 0; i < size; i += w/8) {
+          p = 0;
+          for (j = 0; j < n; j++) {
+            p ^= (uint32_t) galois_single_multiply(get_word((unsigned char *) srcs[j]+i, w), coeffs[j], w);
+          }
+          for (b = 0; b < w/8; b++) expect[i+b] = (p >> (8*b)) & 0xff;
+        }
+        dest = dp_dest + off;
+        memcpy(dest, orig_buf, size);
+        switch (w) {
+          case 8:  galois_w08_region_dotprod(srcs, coeffs, n, (char *) dest, size); break;
+          case 16: galois_w16_region_dotprod(srcs, coeffs, n, (char *) dest, size); break;
+          case 32: galois_w32_region_dotprod(srcs, coeffs, n, (char *) dest, size); break;
+        }
+        fails += check("dotprod", kernel, n, size, off, off, dest);
+        if (fails > 10) return fails;
+      }
+    }
+  }
+  return fails;
+}
+
+static int test_dotprod_multi(int kernel, int w)
+{
+  static int nsrcs[] = { 1, 5, 16, DP_SRCS };
+  static int ndests[] = { 1, 3, 8, DP_DESTS };
+  char *srcs[DP_SRCS], *dests[DP_DESTS];
+  int coeffs[DP_DESTS*DP_SRCS];
+  int s, size, n, ni, nd, di, d, j, fails;
+
+  fails = 0;
+  for (ni = 0; ni < sizeof(nsrcs)/sizeof(int); ni++) {
+    n = nsrcs[ni];
+    for (di = 0; di < sizeof(ndests)/sizeof(int); di++) {
+      nd = ndests[di];
+      for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+        size = sizes[s] - sizes[s] % (w/8);
+        for (j = 0; j < n; j++) srcs[j] = (char *) dp_buf[j];
+        for (j = 0; j < n*nd; j++) {
+          switch (rand() % 4) {
+            case 0:  coeffs[j] = 0; break;
+            case 1:  coeffs[j] = 1; break;
+            default: coeffs[j] = (w == 32) ? (uint32_t) rand() * 2654435761U : rand() & ((1 << w) - 1);
+          }
+        }
+        for (d = 0; d < nd; d++) dests[d] = (char *) dp_mdest[d];
+        switch (w) {
+          case 8:  galois_w08_region_dotprod_multi(srcs, coeffs, n, dests, nd, size); break;
+          case 16: galois_w16_region_dotprod_multi(srcs, coeffs, n, dests, nd, size); break;
+          case 32: galois_w32_region_dotprod_multi(srcs, coeffs, n, dests, nd, size); break;
+        }
+        for (d = 0; d < nd; d++) {
+          switch (w) {
+            case 8:  galois_w08_region_dotprod(srcs, coeffs+d*n, n, (char *) dp_dest, size); break;
+            case 16: galois_w16_region_dotprod(srcs, coeffs+d*n, n, (char *) dp_dest, size); break;
+            case 32: galois_w32_region_dotprod(srcs, coeffs+d*n, n, (char *) dp_dest, size); break;
+          }
+          memcpy(expect, dp_dest, size);
+          fails += check("dotprod_multi", kernel, nd, size, n, d, dp_mdest[d]);
+        }
+        if (fails > 10) return fails;
+      }
+    }
+  }
+  return fails;
+}
+
+#define XOR_SRCS 5
+#define XOR_BIG (1024*1024 + 1000)
+
+static unsigned char *xor_buf[XOR_SRCS], *xor_dest, *xor_expect;
+
+static int test_xor_n(int kernel)
+{
+  static int nsrcs[] = { 1, 2, XOR_SRCS };
+  int xsizes[sizeof(sizes)/sizeof(int) + 2];
+  char *srcs[XOR_SRCS];
+  int s, size, ns, n, off, i, j, b, fails;
+
+  fails = 0;
+  for (s = 0; s < sizeof(sizes)/sizeof(int); s++) xsizes[s] = sizes[s];
+  xsizes[s++] = 1024*1024;
+  xsizes[s++] = XOR_BIG - XOR_SRCS;
+  ns = s;
+
+  for (i = 0; i < sizeof(nsrcs)/sizeof(int); i++) {
+    n = nsrcs[i];
+    for (s = 0; s < ns; s++) {
+      size = xsizes[s];
+      /* galois_region_xor() goes through w=32 regions in GF-Complete */
+      if (kernel == GALOIS_KERNEL_GF_COMPLETE && size >= 16) size -= size % 4;
+      for (off = 0; off < 3; off++) {
+        for (j = 0; j < n; j++) srcs[j] = (char *) xor_buf[j] + ((kernel == GALOIS_KERNEL_GF_COMPLETE) ? off : j);
+        memset(xor_expect, 0, size);
+        for (j = 0; j < n; j++) {
+          for (b = 0; b < size; b++) xor_expect[b] ^= (unsigned char) srcs[j][b];
+        }
+        galois_region_xor_n(srcs, n, (char *) xor_dest + off, size);
+        if (memcmp(xor_dest + off, xor_expect, size) != 0) {
+          fprintf(stderr, "xor_n mismatch: kernel=%s n=%d size=%d off=%d\n",
+                  kernel_names[kernel], n, size, off);
+          fails++;
+        }
+      }
+      if (fails > 10) return fails;
+    }
+  }
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int kernel, i, w, fails, tested;
+  uint16_t *log16, *exp16;
+
+  srand(1370);
+  for (w = 0; w < DP_SRCS; w++) dp_buf[w] = malloc(MAXSIZE+64);
+  dp_dest = malloc(MAXSIZE+64);
+  for (w = 0; w < DP_DESTS; w++) dp_mdest[w] = malloc(MAXSIZE+64);
+  for (w = 0; w < XOR_SRCS; w++) {
+    xor_buf[w] = malloc(XOR_BIG);
+    for (i = 0; i < XOR_BIG; i++) xor_buf[w][i] = rand() & 0xff;
+  }
+  xor_dest = malloc(XOR_BIG);
+  xor_expect = malloc(XOR_BIG);
+  for (i = 0; i < MAXSIZE+64; i++) {
+    src_buf[i] = rand() & 0xff;
+    orig_buf[i] = rand() & 0xff;
+    for (w = 0; w < DP_SRCS; w++) dp_buf[w][i] = rand() & 0xff;
+  }
+
+  for (w = 8; w <= 32; w *= 2) {
+    if (galois_init_default_field(w) != 0) {
+      fprintf(stderr, "Cannot initialize the default field for w=%d\n", w);
+      exit(1);
+    }
+  }
+  if (galois_log_tables(16, &log16, &exp16) != 0) {
+    fprintf(stderr, "Cannot build the log tables for w=16\n");
+    exit(1);
+  }
+
+  fails = 0;
+  tested = 0;
+  for (kernel = GALOIS_KERNEL_GF_COMPLETE; kernel <= GALOIS_KERNEL_AVX512; kernel++) {
+    if (galois_set_region_kernel(kernel) < 0) {
+      printf("w=8 %-12s not supported, skipped\n", kernel_names[kernel]);
+      continue;
+    }
+    i = test_w08(kernel);
+    printf("w=8 %-12s %s\n", kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+    fails += i;
+    for (w = 16; w <= 32; w *= 2) {
+      i = test_wxx_multiply(kernel, w);
+      printf("w=%d %-12s region %s\n", w, kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+      fails += i;
+    }
+    for (w = 8; w <= 32; w *= 2) {
+      i = test_dotprod(kernel, w);
+      printf("w=%d %-12s dotprod %s\n", w, kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+      fails += i;
+      i = test_dotprod_multi(kernel, w);
+      printf("w=%d %-12s dotprod_multi %s\n", w, kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+      fails += i;
+    }
+    i = test_xor_n(kernel);
+    printf("    %-12s xor_n %s\n", kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+    fails += i;
+    tested++;
+  }
+
+  for (w = 8; w <= 32; w *= 2) galois_uninit_field(w);
+  for (w = 0; w < DP_SRCS; w++) free(dp_buf[w]);
+  for (w = 0; w < DP_DESTS; w++) free(dp_mdest[w]);
+  for (w = 0; w < XOR_SRCS; w++) free(xor_buf[w]);
+  free(xor_dest);
+  free(xor_expect);
+  free(dp_dest);
+  return (fails == 0 && tested > 0) ? 0 : 1;
+}
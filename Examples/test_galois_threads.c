@@ -0,0 +1,146 @@
+/* Test of the Galois field registry in galois.c.
+
+   Worker threads multiply and divide single words, multiply regions and
+   look products up in the log tables for w=8 and w=16, and check them
+   against fields of their own, while the main thread keeps replacing the
+   fields of Jerasure with galois_change_technique() (with the same
+   polynomial, so that the products do not change) and removing them with
+   galois_uninit_field(), so that the workers set them up again.  Without
+   pthreads, the rounds of one worker are run between the changes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef JERASURE_PTHREADS
+#include <pthread.h>
+#endif
+#include "galois.h"
+
+#define THREADS 6
+#define CHANGES 300
+#define SIZE 4096
+
+typedef struct {
+  unsigned int seed;
+  int rounds;
+  int fails;
+  unsigned char *src, *got, *want;
+} worker;
+
+static gf_t ref[2];
+static int ws[2] = { 8, 16 };
+static int stop = 0;
+
+static int rnd(worker *t, int w)
+{
+  return 1 + rand_r(&t->seed) % ((1 << w) - 1);
+}
+
+static void round_of(worker *t)
+{
+  uint16_t *lg, *ex;
+  int i, w, x, y, c, p;
+
+  for (i = 0; i < 2; i++) {
+    w = ws[i];
+    x = rnd(t, w);
+    y = rnd(t, w);
+    p = ref[i].multiply.w32(&ref[i], x, y);
+    if (galois_single_multiply(x, y, w) != p) t->fails++;
+    if (galois_single_divide(p, y, w) != x) t->fails++;
+
+    galois_read_lock();
+    if (galois_log_tables(w, &lg, &ex) != 0 || ex[lg[x]+lg[y]] != p) t->fails++;
+    galois_read_unlock();
+
+    c = rnd(t, w);
+    ref[i].multiply_region.w32(&ref[i], t->src, t->want, c, SIZE, 0);
+    if (w == 8) {
+      galois_w08_region_multiply((char *) t->src, c, SIZE, (char *) t->got, 0);
+    } else {
+      galois_w16_region_multiply((char *) t->src, c, SIZE, (char *) t->got, 0);
+    }
+    if (memcmp(t->got, t->want, SIZE) != 0) t->fails++;
+  }
+  t->rounds++;
+}
+
+static void worker_init(worker *t, int seed)
+{
+  int i;
+
+  t->seed = seed;
+  t->rounds = 0;
+  t->fails = 0;
+  t->src = malloc(SIZE);
+  t->got = malloc(SIZE);
+  t->want = malloc(SIZE);
+  for (i = 0; i < SIZE; i++) t->src[i] = rand_r(&t->seed) & 0xff;
+}
+
+#ifdef JERASURE_PTHREADS
+static void *worker_thread(void *arg)
+{
+  worker *t;
+
+  t = (worker *) arg;
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED) && t->fails < 10) round_of(t);
+  return NULL;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+  worker ts[THREADS];
+  int i, j, n, fails, rounds;
+#ifdef JERASURE_PTHREADS
+  pthread_t tids[THREADS];
+#endif
+
+  for (i = 0; i < 2; i++) {
+    if (!gf_init_easy(&ref[i], ws[i])) {
+      fprintf(stderr, "cannot set up the reference field for w=%d\n", ws[i]);
+      return 1;
+    }
+  }
+
+  n = 1;
+  for (j = 0; j < THREADS; j++) worker_init(ts+j, 1421+j);
+#ifdef JERASURE_PTHREADS
+  n = THREADS;
+  for (j = 0; j < n; j++) pthread_create(tids+j, NULL, worker_thread, ts+j);
+#endif
+
+  for (i = 0; i < CHANGES; i++) {
+    for (j = 0; j < 2; j++) {
+      if (i % 3 == 2) {
+        galois_uninit_field(ws[j]);
+      } else {
+        galois_change_technique(galois_init_field(ws[j], GF_MULT_DEFAULT, GF_REGION_DEFAULT,
+                                                  GF_DIVIDE_DEFAULT, 0, 0, 0), ws[j]);
+      }
+    }
+#ifndef JERASURE_PTHREADS
+    round_of(ts);
+#endif
+  }
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+  fails = 0;
+  rounds = 0;
+  for (j = 0; j < n; j++) {
+#ifdef JERASURE_PTHREADS
+    pthread_join(tids[j], NULL);
+#endif
+    fails += ts[j].fails;
+    rounds += ts[j].rounds;
+  }
+  for (j = 0; j < THREADS; j++) {
+    free(ts[j].src);
+    free(ts[j].got);
+    free(ts[j].want);
+  }
+  printf("%d field changes, %d rounds in %d thread%s: %s\n", CHANGES, rounds, n,
+         (n == 1) ? "" : "s", (fails == 0) ? "ok" : "FAILED");
+  return (fails == 0) ? 0 : 1;
+}
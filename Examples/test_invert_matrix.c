@@ -0,0 +1,114 @@
+/* Test of the fast matrix inversion in jerasure.c.
+
+   The log tables of galois.c must multiply and invert like
+   galois_single_multiply(), for w = 4, 8 and 16, and must follow the field
+   when it is changed to one whose polynomial is not primitive.  Random
+   matrices (and singular ones) must then be inverted, and tested for
+   invertibility, exactly as the generic code does, with sizes on both sides
+   of where the region kernels take over. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+
+static int test_logs(int w)
+{
+  uint16_t *lg, *ex;
+  int i, a, b, q, fails;
+
+  if (galois_log_tables(w, &lg, &ex) != 0) return 1;
+  q = (1 << w) - 1;
+  fails = 0;
+  for (i = 0; i < q; i++) if (lg[ex[i]] != i || ex[i+q] != ex[i]) fails++;
+  for (i = 0; i < 10000; i++) {
+    a = 1 + rand() % q;
+    b = 1 + rand() % q;
+    if (ex[lg[a]+lg[b]] != galois_single_multiply(a, b, w)) fails++;
+    if (ex[q-lg[a]] != galois_single_divide(1, a, w)) fails++;
+  }
+  if (fails) fprintf(stderr, "log tables w=%d failed\n", w);
+  return fails;
+}
+
+/* Inverts a random rows X rows matrix, made singular if singular is set,
+   with the generic and the fast code, which must agree. */
+
+static int test_invert(int rows, int w, int singular)
+{
+  int *mat, *m1, *m2, *inv1, *inv2;
+  int i, r1, r2, fails;
+
+  mat = malloc(sizeof(int)*rows*rows);
+  m1 = malloc(sizeof(int)*rows*rows);
+  m2 = malloc(sizeof(int)*rows*rows);
+  inv1 = malloc(sizeof(int)*rows*rows);
+  inv2 = malloc(sizeof(int)*rows*rows);
+  for (i = 0; i < rows*rows; i++) mat[i] = rand() & ((1 << w) - 1);
+  if (singular) {
+    for (i = 0; i < rows; i++) {
+      mat[(rows-1)*rows+i] = galois_single_multiply(mat[i], 3, w) ^ ((rows > 2) ? mat[rows+i] : 0);
+    }
+  }
+
+  fails = 0;
+  memcpy(m1, mat, sizeof(int)*rows*rows);
+  memcpy(m2, mat, sizeof(int)*rows*rows);
+  jerasure_set_fast_invert(0);
+  r1 = jerasure_invert_matrix(m1, inv1, rows, w);
+  jerasure_set_fast_invert(1);
+  r2 = jerasure_invert_matrix(m2, inv2, rows, w);
+  if (r1 != r2 || (singular && r2 != -1)) fails++;
+  if (r1 == 0 && r2 == 0 && memcmp(inv1, inv2, sizeof(int)*rows*rows) != 0) fails++;
+
+  memcpy(m1, mat, sizeof(int)*rows*rows);
+  memcpy(m2, mat, sizeof(int)*rows*rows);
+  jerasure_set_fast_invert(0);
+  r1 = jerasure_invertible_matrix(m1, rows, w);
+  jerasure_set_fast_invert(1);
+  r2 = jerasure_invertible_matrix(m2, rows, w);
+  if (r1 != r2 || (singular && r2 != 0)) fails++;
+
+  if (fails) fprintf(stderr, "invert %d X %d, w=%d%s failed\n", rows, rows, w,
+                     singular ? ", singular," : "");
+  free(mat);
+  free(m1);
+  free(m2);
+  free(inv1);
+  free(inv2);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int sizes[] = { 1, 2, 5, 31, 63, 64, 100, 256, 300 };
+  int ws[] = { 4, 8, 16 };
+  gf_t *gf;
+  int i, j, s, fails;
+
+  srand(1420);
+  fails = 0;
+  for (i = 0; i < 3; i++) fails += test_logs(ws[i]);
+
+  /* x^8+x^4+x^3+x+1 is irreducible, but 2 does not generate its field. */
+
+  gf = galois_init_field(8, GF_MULT_DEFAULT, GF_REGION_DEFAULT, GF_DIVIDE_DEFAULT, 0x11b, 0, 0);
+  galois_change_technique(gf, 8);
+  fails += test_logs(8);
+  fails += test_invert(20, 8, 0);
+  galois_uninit_field(8);
+  fails += test_logs(8);
+  printf("log tables: %s\n", (fails == 0) ? "ok" : "FAILED");
+
+  for (i = 0; i < 3; i++) {
+    j = 0;
+    for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+      if (ws[i] == 4 && sizes[s] > 16) continue;
+      j += test_invert(sizes[s], ws[i], 0);
+      if (sizes[s] > 1) j += test_invert(sizes[s], ws[i], 1);
+    }
+    printf("inversion w=%d: %s\n", ws[i], (j == 0) ? "ok" : "FAILED");
+    fails += j;
+  }
+  return (fails == 0) ? 0 : 1;
+}
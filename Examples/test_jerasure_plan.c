@@ -0,0 +1,462 @@
+/* Test of the codec plans in jerasure.c.
+
+   For each plan technique, jerasure_plan_encode() is compared byte for
+   byte against the routine that it replaces (jerasure_matrix_encode(),
+   jerasure_bitmatrix_encode() or jerasure_schedule_encode()), and
+   jerasure_plan_decode() is run on every combination of up to m erasures,
+   twice in a row so that the second decode uses the kept decoding state.
+   The matrix technique is tested with every region kernel that this CPU
+   supports, and with a small tile so that each call spans several tiles.
+   Flat schedules must hold the same operations as int ** schedules,
+   convert back and forth, and encode the same bytes with the same XOR
+   count.  Common subexpression schedules, and reordered smart schedules,
+   must encode and decode the same bytes as the others, and common
+   subexpression schedules may not do more XORs than smart schedules.
+   Random schedules, with long chains on one packet, copies in the middle
+   of chains and packets XORed with themselves, must do the same as
+   doing their operations one at a time, before and after they are
+   reordered. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "cauchy.h"
+
+#define K 6
+#define M 3
+#define MAXSIZE (32*1024)
+
+static const char *kernel_names[] = { "gf_complete", "ssse3", "avx2", "avx512" };
+static const char *technique_names[] = { "matrix", "bitmatrix", "schedule" };
+
+static char *data[K], *coding[M], *expect[M], *orig[K];
+
+static int check_stripe(const char *what, int k, int m, int size, int *e)
+{
+  int i;
+
+  for (i = 0; i < k+m; i++) {
+    if (memcmp((i < k) ? data[i] : coding[i-k], (i < k) ? orig[i] : expect[i-k], size) != 0) {
+      fprintf(stderr, "%s: mismatch: size=%d erasures=%d,%d,%d device=%d\n",
+              what, size, e[0], e[1], e[2], i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Decodes every set of up to m erasures, given as e[0] <= e[1] <= e[2]
+   with repeats meaning fewer erasures. */
+
+static int test_decode(const char *what, jerasure_plan_t *plan, int k, int m, int size)
+{
+  int erasures[M+2], e[3];
+  int i, n, rep, fails;
+
+  fails = 0;
+  for (e[0] = 0; e[0] < k+m; e[0]++) {
+    for (e[1] = e[0]; e[1] < k+m; e[1]++) {
+      for (e[2] = e[1]; e[2] < k+m; e[2]++) {
+        if (m == 2 && e[2] != e[1]) break;
+        n = 0;
+        for (i = 0; i < 3; i++) {
+          if (i == 0 || e[i] != e[i-1]) erasures[n++] = e[i];
+        }
+        erasures[n] = -1;
+        for (rep = 0; rep < 2; rep++) {
+          for (i = 0; i < m; i++) memcpy(coding[i], expect[i], size);
+          for (i = 0; i < n; i++) {
+            memset((erasures[i] < k) ? data[erasures[i]] : coding[erasures[i]-k], 0x5a, size);
+          }
+          if (jerasure_plan_decode(plan, erasures, data, coding, size) != 0) {
+            fprintf(stderr, "%s: decode failed: erasures=%d,%d,%d\n", what, e[0], e[1], e[2]);
+            fails++;
+          }
+          fails += check_stripe(what, k, m, size, e);
+          for (i = 0; i < k; i++) memcpy(data[i], orig[i], size);
+          if (fails > 10) return fails;
+        }
+      }
+    }
+  }
+
+  /* m+1 erasures cannot be decoded */
+
+  for (i = 0; i <= m; i++) erasures[i] = i;
+  erasures[m+1] = -1;
+  if (jerasure_plan_decode(plan, erasures, data, coding, size) != -1) {
+    fprintf(stderr, "%s: decode accepted %d erasures\n", what, m+1);
+    fails++;
+  }
+  return fails;
+}
+
+static int test_matrix(int w, int *matrix, int size)
+{
+  jerasure_plan_t *plan;
+  char what[64];
+  int i, fails;
+
+  sprintf(what, "matrix w=%d size=%d", w, size);
+  plan = jerasure_plan_create(K, M, w, JERASURE_PLAN_MATRIX, matrix, NULL, 0);
+  if (plan == NULL) {
+    fprintf(stderr, "%s: jerasure_plan_create failed\n", what);
+    return 1;
+  }
+
+  fails = 0;
+  jerasure_matrix_encode(K, M, w, matrix, data, expect, size);
+  for (i = 0; i < M; i++) memset(coding[i], 0, size);
+  if (jerasure_plan_encode(plan, data, coding, size) != 0) fails++;
+  for (i = 0; i < M; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "%s: encode mismatch on coding device %d\n", what, i);
+      fails++;
+    }
+  }
+  if (fails == 0) fails += test_decode(what, plan, K, M, size);
+  jerasure_plan_free(plan);
+  return fails;
+}
+
+static int test_bitmatrix(int technique, int m, int w, int *matrix, int packetsize, int size)
+{
+  jerasure_plan_t *plan;
+  int *bitmatrix, **schedule;
+  char what[64];
+  int i, fails;
+
+  sprintf(what, "%s m=%d w=%d", technique_names[technique], m, w);
+  bitmatrix = jerasure_matrix_to_bitmatrix(K, m, w, matrix);
+  plan = jerasure_plan_create(K, m, w, technique, NULL, bitmatrix, packetsize);
+  if (plan == NULL) {
+    fprintf(stderr, "%s: jerasure_plan_create failed\n", what);
+    free(bitmatrix);
+    return 1;
+  }
+
+  fails = 0;
+  if (technique == JERASURE_PLAN_SCHEDULE) {
+    schedule = jerasure_smart_bitmatrix_to_schedule(K, m, w, bitmatrix);
+    jerasure_schedule_encode(K, m, w, schedule, data, expect, size, packetsize);
+    jerasure_free_schedule(schedule);
+  } else {
+    jerasure_bitmatrix_encode(K, m, w, bitmatrix, data, expect, size, packetsize);
+  }
+  for (i = 0; i < m; i++) memset(coding[i], 0, size);
+  if (jerasure_plan_encode(plan, data, coding, size) != 0) fails++;
+  for (i = 0; i < m; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "%s: encode mismatch on coding device %d\n", what, i);
+      fails++;
+    }
+  }
+  if (jerasure_plan_encode(plan, data, coding, size+1) != -1) {
+    fprintf(stderr, "%s: encode accepted a bad size\n", what);
+    fails++;
+  }
+  if (fails == 0) fails += test_decode(what, plan, K, m, size);
+  jerasure_plan_free(plan);
+  free(bitmatrix);
+  return fails;
+}
+
+/* Compares the dumb (smart = 0) or smart flat schedule of bitmatrix with
+   the int ** one, and flat schedule encoding with bitmatrix encoding. */
+
+static int test_flat_schedule(int smart, int m, int w, int *bitmatrix, int packetsize, int size)
+{
+  jerasure_flat_schedule_t *flat, *back;
+  int **schedule;
+  double stats[3], flat_stats[3];
+  int i, fails;
+
+  if (smart) {
+    flat = jerasure_smart_bitmatrix_to_flat_schedule(K, m, w, bitmatrix);
+    schedule = jerasure_smart_bitmatrix_to_schedule(K, m, w, bitmatrix);
+  } else {
+    flat = jerasure_dumb_bitmatrix_to_flat_schedule(K, m, w, bitmatrix);
+    schedule = jerasure_dumb_bitmatrix_to_schedule(K, m, w, bitmatrix);
+  }
+  if (flat == NULL || schedule == NULL) return 1;
+
+  fails = 0;
+  for (i = 0; i < flat->nops && schedule[i][0] >= 0; i++) {
+    if (flat->ops[i].from_dev != schedule[i][0] || flat->ops[i].from_pkt != schedule[i][1] ||
+        flat->ops[i].to_dev != schedule[i][2] || flat->ops[i].to_pkt != schedule[i][3] ||
+        flat->ops[i].op != schedule[i][4]) break;
+  }
+  if (i != flat->nops || schedule[i][0] != -1) {
+    fprintf(stderr, "flat schedule: operation %d differs\n", i);
+    fails++;
+  }
+  back = jerasure_schedule_to_flat_schedule(schedule);
+  if (back == NULL || back->nops != flat->nops ||
+      memcmp(back->ops, flat->ops, sizeof(jerasure_schedule_op_t)*flat->nops) != 0) {
+    fprintf(stderr, "flat schedule: conversion from int ** differs\n");
+    fails++;
+  }
+
+  jerasure_bitmatrix_encode(K, m, w, bitmatrix, data, expect, size, packetsize);
+  jerasure_get_stats(stats);
+  jerasure_schedule_encode(K, m, w, schedule, data, coding, size, packetsize);
+  jerasure_get_stats(stats);
+  for (i = 0; i < m; i++) memset(coding[i], 0, size);
+  jerasure_flat_schedule_encode(K, m, w, flat, data, coding, size, packetsize);
+  jerasure_get_stats(flat_stats);
+  for (i = 0; i < m; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "flat schedule: encode mismatch on coding device %d\n", i);
+      fails++;
+    }
+  }
+  if (flat_stats[0] != stats[0] || flat_stats[2] != stats[2]) {
+    fprintf(stderr, "flat schedule: counted %.0f XOR'd bytes, expected %.0f\n",
+            flat_stats[0], stats[0]);
+    fails++;
+  }
+
+  jerasure_free_flat_schedule(flat);
+  jerasure_free_flat_schedule(back);
+  jerasure_free_schedule(schedule);
+  return fails;
+}
+
+/* Encodes with the common subexpression schedule of bitmatrix, and decodes
+   every pair of erasures with the same kind of decoding schedules. */
+
+static int test_cse_schedule(int m, int w, int *bitmatrix, int packetsize, int size)
+{
+  jerasure_flat_schedule_t *cse, *smart;
+  int erasures[3];
+  int i, fails;
+
+  cse = jerasure_cse_bitmatrix_to_flat_schedule(K, m, w, bitmatrix);
+  smart = jerasure_smart_bitmatrix_to_flat_schedule(K, m, w, bitmatrix);
+  if (cse == NULL || smart == NULL) return 1;
+
+  fails = 0;
+  if (cse->nops > smart->nops) {
+    fprintf(stderr, "cse schedule: %d operations, more than the smart schedule's %d\n",
+            cse->nops, smart->nops);
+    fails++;
+  }
+  if (cse->ntdevs > 0 && jerasure_flat_schedule_to_schedule(cse) != NULL) {
+    fprintf(stderr, "cse schedule: converted temporaries to an int ** schedule\n");
+    fails++;
+  }
+  jerasure_bitmatrix_encode(K, m, w, bitmatrix, data, expect, size, packetsize);
+  for (i = 0; i < m; i++) memset(coding[i], 0, size);
+  jerasure_flat_schedule_encode(K, m, w, cse, data, coding, size, packetsize);
+  for (i = 0; i < m; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "cse schedule: encode mismatch on coding device %d\n", i);
+      fails++;
+    }
+  }
+  printf("w=%d cse schedule: %d operations, %d temporary devices, smart: %d\n",
+         w, cse->nops, cse->ntdevs, smart->nops);
+
+  i = smart->nops;
+  if (jerasure_reorder_flat_schedule(smart) != 0 || smart->nops != i) fails++;
+  for (i = 0; i < m; i++) memset(coding[i], 0, size);
+  jerasure_flat_schedule_encode(K, m, w, smart, data, coding, size, packetsize);
+  for (i = 0; i < m; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "reordered schedule: encode mismatch on coding device %d\n", i);
+      fails++;
+    }
+  }
+
+  for (erasures[0] = 0; erasures[0] < K+m && fails < 10; erasures[0]++) {
+    for (erasures[1] = erasures[0]+1; erasures[1] < K+m; erasures[1]++) {
+      erasures[2] = -1;
+      for (i = 0; i < 2; i++) {
+        memset((erasures[i] < K) ? data[erasures[i]] : coding[erasures[i]-K], 0x5a, size);
+      }
+      if (jerasure_schedule_decode_lazy(K, m, w, bitmatrix, erasures, data, coding, size, packetsize,
+                                        JERASURE_SCHEDULE_CSE) != 0) {
+        fails++;
+      }
+      fails += check_stripe("cse schedule", K, m, size, erasures);
+    }
+  }
+  jerasure_free_flat_schedule(cse);
+  jerasure_free_flat_schedule(smart);
+  return fails;
+}
+
+/* Does a random schedule of nops operations with both executors, which
+   fuse the operations on a packet, and one operation at a time, and
+   reordered, and compares the results. */
+
+#define FUSED_DEVS 4
+#define FUSED_PKTS 4
+#define FUSED_PACKETSIZE 48
+
+static int test_fused_chains(int nops)
+{
+  char *ptrs[FUSED_DEVS], *got[FUSED_DEVS], *want[FUSED_DEVS], *sptr, *dptr;
+  jerasure_flat_schedule_t *flat;
+  int **schedule;
+  int i, j, op, len, to_dev, to_pkt, fails;
+
+  schedule = malloc(sizeof(int *) * (nops+1));
+  op = 0;
+  while (op < nops) {
+    to_dev = rand() % FUSED_DEVS;
+    to_pkt = rand() % FUSED_PKTS;
+    len = (rand() % 4 == 0) ? 1 + rand() % 300 : 1 + rand() % 8;
+    for (i = 0; i < len && op < nops; i++, op++) {
+      schedule[op] = malloc(sizeof(int) * 5);
+      schedule[op][0] = rand() % FUSED_DEVS;
+      schedule[op][1] = rand() % FUSED_PKTS;
+      schedule[op][2] = to_dev;
+      schedule[op][3] = to_pkt;
+      schedule[op][4] = (rand() % 10 != 0);
+      if (rand() % 20 == 0) {
+        schedule[op][0] = to_dev;
+        schedule[op][1] = to_pkt;
+      }
+    }
+  }
+  schedule[op] = malloc(sizeof(int) * 5);
+  schedule[op][0] = -1;
+  flat = jerasure_schedule_to_flat_schedule(schedule);
+  if (flat == NULL) return 1;
+
+  for (i = 0; i < FUSED_DEVS; i++) {
+    ptrs[i] = malloc(FUSED_PKTS*FUSED_PACKETSIZE);
+    got[i] = malloc(FUSED_PKTS*FUSED_PACKETSIZE);
+    want[i] = malloc(FUSED_PKTS*FUSED_PACKETSIZE);
+    for (j = 0; j < FUSED_PKTS*FUSED_PACKETSIZE; j++) ptrs[i][j] = rand() & 0xff;
+    memcpy(want[i], ptrs[i], FUSED_PKTS*FUSED_PACKETSIZE);
+  }
+  for (op = 0; schedule[op][0] >= 0; op++) {
+    sptr = want[schedule[op][0]] + schedule[op][1]*FUSED_PACKETSIZE;
+    dptr = want[schedule[op][2]] + schedule[op][3]*FUSED_PACKETSIZE;
+    if (schedule[op][4]) {
+      for (j = 0; j < FUSED_PACKETSIZE; j++) dptr[j] ^= sptr[j];
+    } else {
+      memmove(dptr, sptr, FUSED_PACKETSIZE);
+    }
+  }
+
+  fails = 0;
+  for (i = 0; i < FUSED_DEVS; i++) memcpy(got[i], ptrs[i], FUSED_PKTS*FUSED_PACKETSIZE);
+  jerasure_do_flat_scheduled_operations(got, flat, FUSED_PACKETSIZE);
+  for (i = 0; i < FUSED_DEVS; i++) {
+    if (memcmp(got[i], want[i], FUSED_PKTS*FUSED_PACKETSIZE) != 0) {
+      fprintf(stderr, "fused flat schedule: mismatch on device %d\n", i);
+      fails++;
+    }
+  }
+  for (i = 0; i < FUSED_DEVS; i++) memcpy(got[i], ptrs[i], FUSED_PKTS*FUSED_PACKETSIZE);
+  jerasure_do_scheduled_operations(got, schedule, FUSED_PACKETSIZE);
+  for (i = 0; i < FUSED_DEVS; i++) {
+    if (memcmp(got[i], want[i], FUSED_PKTS*FUSED_PACKETSIZE) != 0) {
+      fprintf(stderr, "fused schedule: mismatch on device %d\n", i);
+      fails++;
+    }
+  }
+  if (jerasure_reorder_flat_schedule(flat) != 0) fails++;
+  for (i = 0; i < FUSED_DEVS; i++) memcpy(got[i], ptrs[i], FUSED_PKTS*FUSED_PACKETSIZE);
+  jerasure_do_flat_scheduled_operations(got, flat, FUSED_PACKETSIZE);
+  for (i = 0; i < FUSED_DEVS; i++) {
+    if (memcmp(got[i], want[i], FUSED_PKTS*FUSED_PACKETSIZE) != 0) {
+      fprintf(stderr, "reordered random schedule: mismatch on device %d\n", i);
+      fails++;
+    }
+  }
+
+  for (i = 0; i < FUSED_DEVS; i++) {
+    free(ptrs[i]);
+    free(got[i]);
+    free(want[i]);
+  }
+  jerasure_free_schedule(schedule);
+  jerasure_free_flat_schedule(flat);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int *matrix, *bitmatrix;
+  int kernel, i, j, m, w, fails, tested, f;
+
+  srand(1381);
+  for (i = 0; i < K; i++) {
+    data[i] = malloc(MAXSIZE);
+    orig[i] = malloc(MAXSIZE);
+    for (j = 0; j < MAXSIZE; j++) data[i][j] = rand() & 0xff;
+    memcpy(orig[i], data[i], MAXSIZE);
+  }
+  for (i = 0; i < M; i++) {
+    coding[i] = malloc(MAXSIZE);
+    expect[i] = malloc(MAXSIZE);
+  }
+
+  fails = 0;
+  tested = 0;
+  for (kernel = GALOIS_KERNEL_GF_COMPLETE; kernel <= GALOIS_KERNEL_AVX512; kernel++) {
+    if (galois_set_region_kernel(kernel) < 0) {
+      printf("%-12s not supported, skipped\n", kernel_names[kernel]);
+      continue;
+    }
+    for (w = 8; w <= 32; w *= 2) {
+      f = 0;
+      matrix = reed_sol_vandermonde_coding_matrix(K, M, w);
+      f += test_matrix(w, matrix, 1000);
+      jerasure_set_tile_size(256);
+      f += test_matrix(w, matrix, MAXSIZE);
+      jerasure_set_tile_size(0);
+      free(matrix);
+      matrix = cauchy_original_coding_matrix(K, M, w);
+      f += test_matrix(w, matrix, 4096);
+      free(matrix);
+      printf("w=%d %-12s matrix %s\n", w, kernel_names[kernel], (f == 0) ? "ok" : "FAILED");
+      fails += f;
+    }
+    tested++;
+  }
+
+  for (m = 2; m <= M; m++) {
+    for (i = JERASURE_PLAN_BITMATRIX; i <= JERASURE_PLAN_SCHEDULE; i++) {
+      w = 4;
+      matrix = cauchy_good_general_coding_matrix(K, m, w);
+      f = test_bitmatrix(i, m, w, matrix, 16, 16*w*8);
+      free(matrix);
+      printf("m=%d w=%d %-9s %s\n", m, w, technique_names[i], (f == 0) ? "ok" : "FAILED");
+      fails += f;
+    }
+  }
+
+  for (w = 4; w <= 8; w += 4) {
+    matrix = cauchy_good_general_coding_matrix(K, M, w);
+    bitmatrix = jerasure_matrix_to_bitmatrix(K, M, w, matrix);
+    f = test_flat_schedule(0, M, w, bitmatrix, 16, 16*w*8);
+    f += test_flat_schedule(1, M, w, bitmatrix, 16, 16*w*8);
+    f += test_cse_schedule(M, w, bitmatrix, 16, 16*w*8);
+    free(bitmatrix);
+    free(matrix);
+    printf("w=%d flat schedules %s\n", w, (f == 0) ? "ok" : "FAILED");
+    fails += f;
+  }
+
+  f = 0;
+  for (i = 0; i < 20; i++) f += test_fused_chains(1 + rand() % 2000);
+  printf("fused chains %s\n", (f == 0) ? "ok" : "FAILED");
+  fails += f;
+
+  for (i = 0; i < K; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < M; i++) {
+    free(coding[i]);
+    free(expect[i]);
+  }
+  return (fails == 0 && tested > 0) ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+/* Test of compiled schedules in jerasure.c.
+
+   Random flat schedules, with long runs of operations on one packet,
+   copies in the middle of runs, packets XORed with themselves and more
+   source devices than the compiled code keeps in registers, are compiled
+   for several packetsizes, with the compiler on and off, and must do the
+   same as doing their operations one at a time.  The schedules of the
+   XOR codes (Liberation, Blaum-Roth and Liber8tion) and of a Cauchy code
+   must encode like jerasure_bitmatrix_encode(), with the same stats, and
+   a schedule plan must decode every pair of erasures with its compiled
+   decoding schedules.  Whether the schedules run as machine code depends
+   on the CPU, so this is printed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "cauchy.h"
+#include "liberation.h"
+
+#define DEVS 8
+#define PKTS 4
+#define MAXPACKETSIZE 1024
+#define K 6
+#define M 2
+#define STRIPES 3
+
+static char *data[K], *coding[M], *expect[M], *orig[K];
+
+/* Does a random schedule of nops operations, compiled for packetsize, and
+   compares it with doing the operations one at a time. */
+
+static int test_random(int nops, int packetsize)
+{
+  char *ptrs[DEVS], *got[DEVS], *want[DEVS], *sptr, *dptr;
+  jerasure_flat_schedule_t *flat;
+  jerasure_jit_schedule_t *jit;
+  int **schedule;
+  int i, j, op, len, to_dev, to_pkt, fails;
+
+  schedule = malloc(sizeof(int *) * (nops+1));
+  op = 0;
+  while (op < nops) {
+    to_dev = rand() % DEVS;
+    to_pkt = rand() % PKTS;
+    len = (rand() % 4 == 0) ? 1 + rand() % 300 : 1 + rand() % 8;
+    for (i = 0; i < len && op < nops; i++, op++) {
+      schedule[op] = malloc(sizeof(int) * 5);
+      schedule[op][0] = rand() % DEVS;
+      schedule[op][1] = rand() % PKTS;
+      schedule[op][2] = to_dev;
+      schedule[op][3] = to_pkt;
+      schedule[op][4] = (rand() % 10 != 0);
+      if (rand() % 20 == 0) {
+        schedule[op][0] = to_dev;
+        schedule[op][1] = to_pkt;
+      }
+    }
+  }
+  schedule[op] = malloc(sizeof(int) * 5);
+  schedule[op][0] = -1;
+  flat = jerasure_schedule_to_flat_schedule(schedule);
+  jit = (flat == NULL) ? NULL : jerasure_jit_compile_flat_schedule(flat, packetsize);
+  if (jit == NULL) return 1;
+
+  for (i = 0; i < DEVS; i++) {
+    ptrs[i] = malloc(PKTS*packetsize);
+    got[i] = malloc(PKTS*packetsize);
+    want[i] = malloc(PKTS*packetsize);
+    for (j = 0; j < PKTS*packetsize; j++) ptrs[i][j] = rand() & 0xff;
+    memcpy(want[i], ptrs[i], PKTS*packetsize);
+    memcpy(got[i], ptrs[i], PKTS*packetsize);
+  }
+  for (op = 0; schedule[op][0] >= 0; op++) {
+    sptr = want[schedule[op][0]] + schedule[op][1]*packetsize;
+    dptr = want[schedule[op][2]] + schedule[op][3]*packetsize;
+    if (schedule[op][4]) {
+      for (j = 0; j < packetsize; j++) dptr[j] ^= sptr[j];
+    } else {
+      memmove(dptr, sptr, packetsize);
+    }
+  }
+  jerasure_do_jit_scheduled_operations(got, jit);
+
+  fails = 0;
+  for (i = 0; i < DEVS; i++) {
+    if (memcmp(got[i], want[i], PKTS*packetsize) != 0) {
+      fprintf(stderr, "random schedule of %d operations, packetsize %d, %s: mismatch on device %d\n",
+              nops, packetsize, jerasure_jit_schedule_is_native(jit) ? "native" : "interpreted", i);
+      fails++;
+    }
+    free(ptrs[i]);
+    free(got[i]);
+    free(want[i]);
+  }
+  jerasure_free_schedule(schedule);
+  jerasure_free_flat_schedule(flat);
+  jerasure_free_jit_schedule(jit);
+  return fails;
+}
+
+/* Encodes with bitmatrix's smart or common subexpression schedule,
+   compiled, and compares it with jerasure_bitmatrix_encode().  Returns the
+   number of failures, and sets *native. */
+
+static int test_code(const char *name, int k, int w, int *bitmatrix, int cse, int packetsize,
+                     int *native)
+{
+  jerasure_flat_schedule_t *schedule;
+  jerasure_jit_schedule_t *jit;
+  double stats[3], expect_stats[3];
+  int i, size, fails;
+
+  schedule = cse ? jerasure_cse_bitmatrix_to_flat_schedule(k, M, w, bitmatrix)
+                 : jerasure_smart_bitmatrix_to_flat_schedule(k, M, w, bitmatrix);
+  jit = (schedule == NULL) ? NULL : jerasure_jit_compile_flat_schedule(schedule, packetsize);
+  if (jit == NULL) return 1;
+  *native = jerasure_jit_schedule_is_native(jit);
+
+  size = STRIPES*w*packetsize;
+  fails = 0;
+  jerasure_get_stats(stats);
+  jerasure_flat_schedule_encode(k, M, w, schedule, data, expect, size, packetsize);
+  jerasure_get_stats(expect_stats);
+  jerasure_bitmatrix_encode(k, M, w, bitmatrix, data, coding, size, packetsize);
+  for (i = 0; i < M; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) fails++;
+    memset(coding[i], 0, size);
+  }
+  jerasure_get_stats(stats);
+  jerasure_jit_schedule_encode(k, M, w, jit, data, coding, size);
+  jerasure_get_stats(stats);
+  for (i = 0; i < M; i++) {
+    if (memcmp(coding[i], expect[i], size) != 0) {
+      fprintf(stderr, "%s w=%d packetsize %d: encode mismatch on coding device %d\n",
+              name, w, packetsize, i);
+      fails++;
+    }
+  }
+  if (stats[0] != expect_stats[0] || stats[1] != expect_stats[1]) {
+    fprintf(stderr, "%s w=%d packetsize %d: stats differ\n", name, w, packetsize);
+    fails++;
+  }
+  jerasure_free_jit_schedule(jit);
+  jerasure_free_flat_schedule(schedule);
+  return fails;
+}
+
+/* Decodes every pair of erasures with a schedule plan of bitmatrix. */
+
+static int test_plan(int k, int w, int *bitmatrix, int packetsize)
+{
+  jerasure_plan_t *plan;
+  int erasures[3];
+  int i, size, fails;
+
+  size = STRIPES*w*packetsize;
+  plan = jerasure_plan_create(k, M, w, JERASURE_PLAN_SCHEDULE, NULL, bitmatrix, packetsize);
+  if (plan == NULL) return 1;
+  fails = 0;
+  jerasure_plan_encode(plan, data, coding, size);
+  for (i = 0; i < M; i++) memcpy(expect[i], coding[i], size);
+  for (erasures[0] = 0; erasures[0] < k+M; erasures[0]++) {
+    for (erasures[1] = erasures[0]+1; erasures[1] < k+M; erasures[1]++) {
+      erasures[2] = -1;
+      for (i = 0; i < 2; i++) {
+        memset((erasures[i] < k) ? data[erasures[i]] : coding[erasures[i]-k], 0x5a, size);
+      }
+      if (jerasure_plan_decode(plan, erasures, data, coding, size) != 0) fails++;
+      for (i = 0; i < k; i++) if (memcmp(data[i], orig[i], size) != 0) fails++;
+      for (i = 0; i < M; i++) if (memcmp(coding[i], expect[i], size) != 0) fails++;
+    }
+  }
+  if (fails > 0) fprintf(stderr, "plan w=%d packetsize %d: decode failed\n", w, packetsize);
+  jerasure_plan_free(plan);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int packetsizes[] = { 32, 96, 320, 1024, 48 };
+  int *matrix, *bitmatrix;
+  int i, j, p, on, native, fails, f;
+
+  srand(1417);
+  for (i = 0; i < K; i++) {
+    data[i] = malloc(STRIPES*8*MAXPACKETSIZE);
+    orig[i] = malloc(STRIPES*8*MAXPACKETSIZE);
+    for (j = 0; j < STRIPES*8*MAXPACKETSIZE; j++) orig[i][j] = rand() & 0xff;
+    memcpy(data[i], orig[i], STRIPES*8*MAXPACKETSIZE);
+  }
+  for (i = 0; i < M; i++) {
+    coding[i] = malloc(STRIPES*8*MAXPACKETSIZE);
+    expect[i] = malloc(STRIPES*8*MAXPACKETSIZE);
+  }
+
+  fails = 0;
+  for (on = 1; on >= 0; on--) {
+    jerasure_set_jit(on);
+    f = 0;
+    for (p = 0; p < sizeof(packetsizes)/sizeof(int); p++) {
+      for (i = 0; i < 10; i++) f += test_random(1 + rand() % 2000, packetsizes[p]);
+    }
+    printf("random schedules, compiler %s: %s\n", on ? "on" : "off", (f == 0) ? "ok" : "FAILED");
+    fails += f;
+  }
+  jerasure_set_jit(1);
+
+  native = 0;
+  for (p = 0; p < sizeof(packetsizes)/sizeof(int); p++) {
+    f = 0;
+    bitmatrix = liberation_coding_bitmatrix(K, 7);
+    f += test_code("liberation", K, 7, bitmatrix, 0, packetsizes[p], &native);
+    free(bitmatrix);
+    bitmatrix = blaum_roth_coding_bitmatrix(K, 6);
+    f += test_code("blaum_roth", K, 6, bitmatrix, 0, packetsizes[p], &native);
+    free(bitmatrix);
+    bitmatrix = liber8tion_coding_bitmatrix(K);
+    f += test_code("liber8tion", K, 8, bitmatrix, 0, packetsizes[p], &native);
+    matrix = cauchy_good_general_coding_matrix(K, M, 8);
+    free(bitmatrix);
+    bitmatrix = jerasure_matrix_to_bitmatrix(K, M, 8, matrix);
+    f += test_code("cauchy", K, 8, bitmatrix, 1, packetsizes[p], &native);
+    f += test_plan(K, 8, bitmatrix, packetsizes[p]);
+    free(matrix);
+    free(bitmatrix);
+    printf("packetsize %4d (%s): %s\n", packetsizes[p], native ? "native" : "interpreted",
+           (f == 0) ? "ok" : "FAILED");
+    fails += f;
+  }
+
+  for (i = 0; i < K; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < M; i++) {
+    free(coding[i]);
+    free(expect[i]);
+  }
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+/* Test of packed bitmatrices in jerasure.c.
+
+   Random bitmatrices, with widths on both sides of a multiple of 64 bits,
+   must survive packing and unpacking, and jerasure_matrix_to_packed_bitmatrix
+   must pack jerasure_matrix_to_bitmatrix.  Random square bitmatrices must
+   be inverted (packed, and through jerasure_invert_bitmatrix) into their
+   inverse, and singular ones must be refused.  The packed schedules of a
+   Cauchy code whose rows span several words must be the int ones, must
+   encode like jerasure_bitmatrix_encode(), and must decode every pair of
+   erasures. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "cauchy.h"
+
+#define K 10
+#define M 3
+#define W 16
+#define PACKETSIZE 32
+#define SIZE (W*PACKETSIZE*2)
+
+/* Returns whether inv is the inverse of mat, in GF(2). */
+
+static int is_inverse(int *mat, int *inv, int rows)
+{
+  int i, j, l, x;
+
+  for (i = 0; i < rows; i++) {
+    for (j = 0; j < rows; j++) {
+      x = 0;
+      for (l = 0; l < rows; l++) x ^= mat[i*rows+l] & inv[l*rows+j];
+      if (x != (i == j)) return 0;
+    }
+  }
+  return 1;
+}
+
+static int test_pack(int rows, int cols)
+{
+  jerasure_packed_bitmatrix_t *p;
+  int *b, *u;
+  int i, j, fails;
+
+  b = malloc(sizeof(int)*rows*cols);
+  for (i = 0; i < rows*cols; i++) b[i] = rand() & 1;
+  p = jerasure_pack_bitmatrix(b, rows, cols);
+  u = jerasure_unpack_bitmatrix(p);
+  fails = (memcmp(b, u, sizeof(int)*rows*cols) != 0);
+  for (i = 0; i < rows; i++) {
+    for (j = 0; j < cols; j++) if (JERASURE_PACKED_BIT(p, i, j) != b[i*cols+j]) fails++;
+    for (j = cols; j < p->words*64; j++) if (JERASURE_PACKED_BIT(p, i, j)) fails++;
+  }
+  if (fails) fprintf(stderr, "pack %d X %d failed\n", rows, cols);
+  jerasure_free_packed_bitmatrix(p);
+  free(b);
+  free(u);
+  return fails;
+}
+
+/* Inverts random rows X rows bitmatrices until one is invertible, and
+   then makes it singular by repeating a row. */
+
+static int test_invert(int rows)
+{
+  jerasure_packed_bitmatrix_t *p, *pinv;
+  int *mat, *copy, *inv;
+  int i, rv, fails;
+
+  mat = malloc(sizeof(int)*rows*rows);
+  copy = malloc(sizeof(int)*rows*rows);
+  inv = malloc(sizeof(int)*rows*rows);
+  fails = 0;
+  do {
+    for (i = 0; i < rows*rows; i++) mat[i] = rand() & 1;
+    p = jerasure_pack_bitmatrix(mat, rows, rows);
+    rv = jerasure_invertible_packed_bitmatrix(p);
+    jerasure_free_packed_bitmatrix(p);
+    memcpy(copy, mat, sizeof(int)*rows*rows);
+    if (jerasure_invertible_bitmatrix(copy, rows) != rv) fails++;
+  } while (!rv);
+
+  memcpy(copy, mat, sizeof(int)*rows*rows);
+  if (jerasure_invert_bitmatrix(copy, inv, rows) != 0 || !is_inverse(mat, inv, rows)) fails++;
+
+  p = jerasure_pack_bitmatrix(mat, rows, rows);
+  pinv = jerasure_new_packed_bitmatrix(rows, rows);
+  if (jerasure_invert_packed_bitmatrix(p, pinv) != 0) fails++;
+  free(copy);
+  copy = jerasure_unpack_bitmatrix(pinv);
+  if (memcmp(copy, inv, sizeof(int)*rows*rows) != 0) fails++;
+  jerasure_free_packed_bitmatrix(p);
+
+  memcpy(mat + (rows-1)*rows, mat, sizeof(int)*rows);
+  p = jerasure_pack_bitmatrix(mat, rows, rows);
+  if (jerasure_invert_packed_bitmatrix(p, pinv) != -1) fails++;
+  jerasure_free_packed_bitmatrix(p);
+  if (jerasure_invert_bitmatrix(mat, inv, rows) != -1) fails++;
+
+  if (fails) fprintf(stderr, "invert %d X %d failed\n", rows, rows);
+  jerasure_free_packed_bitmatrix(pinv);
+  free(mat);
+  free(copy);
+  free(inv);
+  return fails;
+}
+
+static int same_schedule(jerasure_flat_schedule_t *a, jerasure_flat_schedule_t *b)
+{
+  if (a == NULL || b == NULL || a->nops != b->nops) return 0;
+  return memcmp(a->ops, b->ops, sizeof(jerasure_schedule_op_t)*a->nops) == 0;
+}
+
+static int test_code()
+{
+  jerasure_packed_bitmatrix_t *packed;
+  jerasure_flat_schedule_t *s1, *s2;
+  char *data[K], *coding[M], *orig[K], *expect[M];
+  int *matrix, *bitmatrix, *unpacked;
+  int erasures[3];
+  int i, j, fails;
+
+  matrix = cauchy_good_general_coding_matrix(K, M, W);
+  bitmatrix = jerasure_matrix_to_bitmatrix(K, M, W, matrix);
+  packed = jerasure_matrix_to_packed_bitmatrix(K, M, W, matrix);
+  unpacked = jerasure_unpack_bitmatrix(packed);
+  fails = (memcmp(unpacked, bitmatrix, sizeof(int)*K*M*W*W) != 0);
+
+  s1 = jerasure_smart_bitmatrix_to_flat_schedule(K, M, W, bitmatrix);
+  s2 = jerasure_smart_packed_bitmatrix_to_flat_schedule(K, M, W, packed);
+  if (!same_schedule(s1, s2)) fails++;
+  jerasure_free_flat_schedule(s2);
+  s2 = jerasure_dumb_packed_bitmatrix_to_flat_schedule(K, M, W, packed);
+  if (s2 == NULL) {
+    fails++;
+  } else {
+    j = 0;
+    for (i = 0; i < K*M*W*W; i++) j += bitmatrix[i];
+    if (s2->nops != j) fails++;
+    jerasure_free_flat_schedule(s2);
+  }
+
+  for (i = 0; i < K; i++) {
+    data[i] = malloc(SIZE);
+    orig[i] = malloc(SIZE);
+    for (j = 0; j < SIZE; j++) orig[i][j] = rand() & 0xff;
+    memcpy(data[i], orig[i], SIZE);
+  }
+  for (i = 0; i < M; i++) {
+    coding[i] = malloc(SIZE);
+    expect[i] = malloc(SIZE);
+  }
+  jerasure_bitmatrix_encode(K, M, W, bitmatrix, data, expect, SIZE, PACKETSIZE);
+  jerasure_flat_schedule_encode(K, M, W, s1, data, coding, SIZE, PACKETSIZE);
+  for (i = 0; i < M; i++) if (memcmp(coding[i], expect[i], SIZE) != 0) fails++;
+
+  for (erasures[0] = 0; erasures[0] < K+M; erasures[0]++) {
+    for (erasures[1] = erasures[0]+1; erasures[1] < K+M; erasures[1]++) {
+      erasures[2] = -1;
+      for (i = 0; i < 2; i++) {
+        memset((erasures[i] < K) ? data[erasures[i]] : coding[erasures[i]-K], 0x5a, SIZE);
+      }
+      if (jerasure_schedule_decode_lazy(K, M, W, bitmatrix, erasures, data, coding, SIZE,
+                                        PACKETSIZE, 1) != 0) fails++;
+      for (i = 0; i < K; i++) if (memcmp(data[i], orig[i], SIZE) != 0) fails++;
+      for (i = 0; i < M; i++) if (memcmp(coding[i], expect[i], SIZE) != 0) fails++;
+    }
+  }
+  if (fails) fprintf(stderr, "cauchy k=%d m=%d w=%d failed\n", K, M, W);
+
+  for (i = 0; i < K; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < M; i++) {
+    free(coding[i]);
+    free(expect[i]);
+  }
+  jerasure_free_flat_schedule(s1);
+  jerasure_free_packed_bitmatrix(packed);
+  free(unpacked);
+  free(bitmatrix);
+  free(matrix);
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int sizes[] = { 2, 7, 63, 64, 65, 128, 130 };
+  int i, fails;
+
+  srand(1419);
+  fails = 0;
+  for (i = 0; i < sizeof(sizes)/sizeof(int); i++) {
+    fails += test_pack(sizes[i], sizes[i]);
+    fails += test_pack(3, sizes[i]);
+    fails += test_invert(sizes[i]);
+  }
+  printf("pack and invert: %s\n", (fails == 0) ? "ok" : "FAILED");
+  i = test_code();
+  printf("schedules: %s\n", (i == 0) ? "ok" : "FAILED");
+  fails += i;
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+/* Test of the jerasure_parallel_* routines.
+
+   A Cauchy code is encoded with its matrix, its bitmatrix and its smart
+   schedule, by the parallel routines and by the ones that they stand for,
+   which must give the same coding devices.  Then every pair of erasures
+   is decoded in parallel with each of the three, and the devices must
+   come back.  The size is not a multiple of the slices, so that the last
+   slice is short.  The whole test is run with 4 threads at once by the
+   main thread and a second caller, and then again with the pool resized
+   to 3 threads and to 1. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef JERASURE_PTHREADS
+#include <pthread.h>
+#endif
+#include "jerasure.h"
+#include "cauchy.h"
+
+#define K 6
+#define M 3
+#define W 8
+#define PS 64
+#define SIZE (513*1024)
+
+typedef struct {
+  char *data[K], *coding[M], *orig[K], *want[M];
+  int fails;
+} stripe;
+
+static int *matrix, *bitmatrix, **schedule;
+
+static void erase(stripe *s, int *erasures)
+{
+  int i;
+
+  for (i = 0; i < K; i++) memcpy(s->data[i], s->orig[i], SIZE);
+  for (i = 0; i < M; i++) memcpy(s->coding[i], s->want[i], SIZE);
+  for (i = 0; erasures[i] != -1; i++) {
+    memset((erasures[i] < K) ? s->data[erasures[i]] : s->coding[erasures[i]-K], 0x5a, SIZE);
+  }
+}
+
+static int differ(stripe *s)
+{
+  int i, n;
+
+  n = 0;
+  for (i = 0; i < K; i++) if (memcmp(s->data[i], s->orig[i], SIZE) != 0) n++;
+  for (i = 0; i < M; i++) if (memcmp(s->coding[i], s->want[i], SIZE) != 0) n++;
+  return n;
+}
+
+static void test_stripe(stripe *s)
+{
+  int erasures[3];
+  int t, rc;
+
+  for (t = 0; t < 3; t++) {
+    if (t == 0) {
+      jerasure_matrix_encode(K, M, W, matrix, s->orig, s->want, SIZE);
+      jerasure_parallel_matrix_encode(K, M, W, matrix, s->data, s->coding, SIZE);
+    } else if (t == 1) {
+      jerasure_bitmatrix_encode(K, M, W, bitmatrix, s->orig, s->want, SIZE, PS);
+      jerasure_parallel_bitmatrix_encode(K, M, W, bitmatrix, s->data, s->coding, SIZE, PS);
+    } else {
+      jerasure_schedule_encode(K, M, W, schedule, s->orig, s->want, SIZE, PS);
+      jerasure_parallel_schedule_encode(K, M, W, schedule, s->data, s->coding, SIZE, PS);
+    }
+    if (differ(s) != 0) {
+      fprintf(stderr, "technique %d: parallel encoding differs\n", t);
+      s->fails++;
+    }
+
+    erasures[2] = -1;
+    for (erasures[0] = 0; erasures[0] < K+M; erasures[0]++) {
+      for (erasures[1] = erasures[0]+1; erasures[1] < K+M; erasures[1]++) {
+        erase(s, erasures);
+        if (t == 0) {
+          rc = jerasure_parallel_matrix_decode(K, M, W, matrix, 1, erasures, s->data, s->coding, SIZE);
+        } else if (t == 1) {
+          rc = jerasure_parallel_bitmatrix_decode(K, M, W, bitmatrix, 1, erasures, s->data, s->coding,
+                                                  SIZE, PS);
+        } else {
+          rc = jerasure_parallel_schedule_decode_lazy(K, M, W, bitmatrix, erasures, s->data, s->coding,
+                                                      SIZE, PS, 1);
+        }
+        if (rc != 0 || differ(s) != 0) {
+          fprintf(stderr, "technique %d: parallel decoding of %d and %d failed\n", t,
+                  erasures[0], erasures[1]);
+          s->fails++;
+        }
+      }
+    }
+  }
+}
+
+#ifdef JERASURE_PTHREADS
+static void *test_thread(void *arg)
+{
+  test_stripe((stripe *) arg);
+  return NULL;
+}
+#endif
+
+static void stripe_init(stripe *s)
+{
+  int i, j;
+
+  for (i = 0; i < K; i++) {
+    s->data[i] = malloc(SIZE);
+    s->orig[i] = malloc(SIZE);
+    for (j = 0; j < SIZE; j++) s->orig[i][j] = rand() & 0xff;
+    memcpy(s->data[i], s->orig[i], SIZE);
+  }
+  for (i = 0; i < M; i++) {
+    s->coding[i] = malloc(SIZE);
+    s->want[i] = malloc(SIZE);
+  }
+  s->fails = 0;
+}
+
+static void stripe_free(stripe *s)
+{
+  int i;
+
+  for (i = 0; i < K; i++) {
+    free(s->data[i]);
+    free(s->orig[i]);
+  }
+  for (i = 0; i < M; i++) {
+    free(s->coding[i]);
+    free(s->want[i]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  stripe s[2];
+  int threads[] = { 4, 3, 1 };
+  int i, fails;
+#ifdef JERASURE_PTHREADS
+  pthread_t tid;
+#endif
+
+  srand(1424);
+  matrix = cauchy_good_general_coding_matrix(K, M, W);
+  bitmatrix = jerasure_matrix_to_bitmatrix(K, M, W, matrix);
+  schedule = jerasure_smart_bitmatrix_to_schedule(K, M, W, bitmatrix);
+  stripe_init(s);
+  stripe_init(s+1);
+
+  fails = 0;
+  for (i = 0; i < 3; i++) {
+    jerasure_set_threads(threads[i]);
+#ifdef JERASURE_PTHREADS
+    if (i == 0 && pthread_create(&tid, NULL, test_thread, s+1) == 0) {
+      test_stripe(s);
+      pthread_join(tid, NULL);
+    } else {
+      test_stripe(s);
+    }
+#else
+    test_stripe(s);
+#endif
+    printf("%d thread%s: %s\n", jerasure_get_threads(), (jerasure_get_threads() == 1) ? "" : "s",
+           (s[0].fails + s[1].fails == 0) ? "ok" : "FAILED");
+    fails += s[0].fails + s[1].fails;
+    s[0].fails = 0;
+    s[1].fails = 0;
+  }
+  jerasure_set_threads(0);
+
+  stripe_free(s);
+  stripe_free(s+1);
+  jerasure_free_schedule(schedule);
+  free(bitmatrix);
+  free(matrix);
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+/* Test of profiles in jerasure.c.
+
+   A profile of a Reed-Solomon code, with both its matrix and its
+   bitmatrix, and common subexpression schedules, is written and mapped.  Its matrices must be the ones that
+   were written, its encoding schedule must encode like
+   jerasure_bitmatrix_encode(), and its decoding schedules and decoding
+   matrices must restore every set of up to m erasures.  A profile with
+   fewer precomputed erasures must refuse the others, and profiles that
+   are truncated or have another version must not be mapped.  A profile
+   with a bad operation in its encoding schedule, a number of operations
+   that overflows, or a matrix coefficient outside of GF(2^w) must not be
+   mapped, and one with a bad operation in a decoding schedule must refuse
+   to decode that pattern. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "jerasure.h"
+#include "reed_sol.h"
+
+#define K 6
+#define M 3
+#define W 8
+#define PACKETSIZE 16
+#define SIZE (W*PACKETSIZE*4)
+#define PROFILE "test_profile.jrp"
+#define BAD_PROFILE "test_profile_bad.jrp"
+
+static char *data[K], *coding[M], *orig[K], *expect[2][M];
+
+/* Erases the devices in erasures, decodes them with the profile's
+   schedules (bitmatrix = 1) or decoding matrices, and checks the stripe. */
+
+static int decode(jerasure_profile_t *p, int *erasures, int bitmatrix)
+{
+  int i, rc;
+
+  for (i = 0; i < K; i++) memcpy(data[i], orig[i], SIZE);
+  for (i = 0; i < M; i++) memcpy(coding[i], expect[bitmatrix][i], SIZE);
+  for (i = 0; erasures[i] != -1; i++) {
+    memset((erasures[i] < K) ? data[erasures[i]] : coding[erasures[i]-K], 0x5a, SIZE);
+  }
+  if (bitmatrix) {
+    rc = jerasure_profile_schedule_decode(p, erasures, data, coding, SIZE, PACKETSIZE);
+  } else {
+    rc = jerasure_profile_matrix_decode(p, erasures, data, coding, SIZE);
+  }
+  if (rc != 0) return 1;
+  for (i = 0; i < K; i++) if (memcmp(data[i], orig[i], SIZE) != 0) return 1;
+  for (i = 0; i < M; i++) if (memcmp(coding[i], expect[bitmatrix][i], SIZE) != 0) return 1;
+  return 0;
+}
+
+/* Copies the first bytes of PROFILE to BAD_PROFILE, with byte at XORed
+   with x, and maps it. */
+
+static jerasure_profile_t *map_damaged(long bytes, long at, int x)
+{
+  jerasure_profile_t *p;
+  FILE *f;
+  char *buf;
+  long n;
+
+  f = fopen(PROFILE, "rb");
+  buf = malloc(bytes);
+  n = fread(buf, 1, bytes, f);
+  fclose(f);
+  if (at >= 0 && at < n) buf[at] ^= x;
+  f = fopen(BAD_PROFILE, "wb");
+  fwrite(buf, 1, n, f);
+  fclose(f);
+  free(buf);
+  p = jerasure_map_profile(BAD_PROFILE);
+  unlink(BAD_PROFILE);
+  return p;
+}
+
+/* Returns whether PROFILE can be mapped with byte at XORed with x. */
+
+static int maps_when_damaged(long bytes, long at, int x)
+{
+  jerasure_profile_t *p;
+
+  p = map_damaged(bytes, at, x);
+  if (p == NULL) return 0;
+  jerasure_unmap_profile(p);
+  return 1;
+}
+
+/* Returns the offset of the first (or the last) copy of the len bytes of
+   what at an 8 byte boundary of PROFILE, or -1. */
+
+static long find_bytes(long bytes, void *what, long len, int last)
+{
+  FILE *f;
+  char *buf;
+  long off, found, n;
+
+  f = fopen(PROFILE, "rb");
+  buf = malloc(bytes);
+  n = fread(buf, 1, bytes, f);
+  fclose(f);
+  found = -1;
+  for (off = 0; off + len <= n && (last || found < 0); off += 8) {
+    if (memcmp(buf+off, what, len) == 0) found = off;
+  }
+  free(buf);
+  return found;
+}
+
+/* Returns the offset of the last copy of the operations of schedule in
+   PROFILE, or -1.  (A decoding schedule may also be the start of the
+   encoding schedule, which comes first.) */
+
+static long find_ops(long bytes, jerasure_flat_schedule_t *schedule)
+{
+  return find_bytes(bytes, schedule->ops, sizeof(jerasure_schedule_op_t) * schedule->nops, 1);
+}
+
+/* Returns the size of PROFILE. */
+
+static long profile_bytes()
+{
+  FILE *f;
+  long bytes;
+
+  f = fopen(PROFILE, "rb");
+  fseek(f, 0, SEEK_END);
+  bytes = ftell(f);
+  fclose(f);
+  return bytes;
+}
+
+int main(int argc, char **argv)
+{
+  jerasure_profile_t *p;
+  jerasure_flat_schedule_t schedule;
+  int *matrix, *bitmatrix, info[4];
+  int erasures[M+1], e[3];
+  int i, j, n, fails;
+  long bytes, enc, dec, at;
+  uint64_t nops;
+  int x, little;
+
+  srand(1413);
+  matrix = reed_sol_vandermonde_coding_matrix(K, M, W);
+  bitmatrix = jerasure_matrix_to_bitmatrix(K, M, W, matrix);
+  for (i = 0; i < K; i++) {
+    data[i] = malloc(SIZE);
+    orig[i] = malloc(SIZE);
+    for (j = 0; j < SIZE; j++) orig[i][j] = rand() & 0xff;
+  }
+  for (i = 0; i < M; i++) {
+    coding[i] = malloc(SIZE);
+    expect[0][i] = malloc(SIZE);
+    expect[1][i] = malloc(SIZE);
+  }
+  jerasure_matrix_encode(K, M, W, matrix, orig, expect[0], SIZE);
+  jerasure_bitmatrix_encode(K, M, W, bitmatrix, orig, expect[1], SIZE, PACKETSIZE);
+
+  fails = 0;
+  if (jerasure_write_profile(PROFILE, K, M, W, matrix, bitmatrix, JERASURE_SCHEDULE_CSE, M) != 0) {
+    fprintf(stderr, "jerasure_write_profile failed\n");
+    return 1;
+  }
+  p = jerasure_map_profile(PROFILE);
+  if (p == NULL) {
+    fprintf(stderr, "jerasure_map_profile failed\n");
+    unlink(PROFILE);
+    return 1;
+  }
+  jerasure_get_profile_info(p, info);
+  if (info[0] != K || info[1] != M || info[2] != W || info[3] != M) fails++;
+  if (memcmp(jerasure_profile_matrix(p), matrix, sizeof(int)*K*M) != 0) fails++;
+  if (memcmp(jerasure_profile_bitmatrix(p), bitmatrix, sizeof(int)*K*M*W*W) != 0) fails++;
+
+  for (i = 0; i < K; i++) memcpy(data[i], orig[i], SIZE);
+  jerasure_profile_schedule_encode(p, data, coding, SIZE, PACKETSIZE);
+  for (i = 0; i < M; i++) {
+    if (memcmp(coding[i], expect[1][i], SIZE) != 0) {
+      fprintf(stderr, "profile encode mismatch on coding device %d\n", i);
+      fails++;
+    }
+  }
+  printf("profile encode %s\n", (fails == 0) ? "ok" : "FAILED");
+
+  /* Every set of up to M erasures, given as e[0] <= e[1] <= e[2], with
+     repeats meaning fewer erasures. */
+
+  i = fails;
+  for (e[0] = 0; e[0] < K+M; e[0]++) {
+    for (e[1] = e[0]; e[1] < K+M; e[1]++) {
+      for (e[2] = e[1]; e[2] < K+M; e[2]++) {
+        n = 0;
+        for (j = 0; j < 3; j++) {
+          if (j == 0 || e[j] != e[j-1]) erasures[n++] = e[j];
+        }
+        erasures[n] = -1;
+        if (decode(p, erasures, 1) != 0 || decode(p, erasures, 0) != 0) {
+          fprintf(stderr, "profile decode failed: erasures=%d,%d,%d\n", e[0], e[1], e[2]);
+          fails++;
+        }
+      }
+    }
+  }
+  erasures[0] = 8;
+  erasures[1] = 0;
+  erasures[2] = 4;
+  erasures[3] = -1;
+  if (decode(p, erasures, 1) != 0 || decode(p, erasures, 0) != 0) fails++;
+  jerasure_unmap_profile(p);
+  printf("profile decode %s\n", (fails == i) ? "ok" : "FAILED");
+
+  /* Only single erasures, and no matrix */
+
+  i = fails;
+  if (jerasure_write_profile(PROFILE, K, M, W, NULL, bitmatrix, 0, 1) != 0) fails++;
+  p = jerasure_map_profile(PROFILE);
+  if (p == NULL) {
+    fails++;
+  } else {
+    erasures[0] = 2;
+    erasures[1] = -1;
+    if (decode(p, erasures, 1) != 0) fails++;
+    if (jerasure_profile_decoding_schedule(p, erasures, &schedule) != 0) fails++;
+    erasures[1] = 7;
+    erasures[2] = -1;
+    if (jerasure_profile_decoding_schedule(p, erasures, &schedule) != -1) fails++;
+    if (jerasure_profile_schedule_decode(p, erasures, data, coding, SIZE, PACKETSIZE) != -1) fails++;
+    if (jerasure_profile_matrix_decode(p, erasures, data, coding, SIZE) != -1) fails++;
+    jerasure_unmap_profile(p);
+  }
+
+  /* Damaged profiles */
+
+  bytes = profile_bytes();
+  if (!maps_when_damaged(bytes, -1, 1)) fails++;
+  if (maps_when_damaged(bytes, 8, 1)) fails++;
+  if (maps_when_damaged(bytes-8, -1, 1)) fails++;
+  if (maps_when_damaged(16, -1, 1)) fails++;
+
+  /* A bad operation:  an XOR of packet 128 in the decoding schedule of
+     the erasure of device 8, and operation 2 in the encoding schedule. */
+
+  enc = -1;
+  dec = -1;
+  erasures[0] = 8;
+  erasures[1] = -1;
+  p = jerasure_map_profile(PROFILE);
+  if (p != NULL) {
+    if (jerasure_profile_encoding_schedule(p, &schedule) == 0) {
+      enc = find_ops(bytes, &schedule);
+      nops = schedule.nops;
+    }
+    if (jerasure_profile_decoding_schedule(p, erasures, &schedule) == 0) dec = find_ops(bytes, &schedule);
+    jerasure_unmap_profile(p);
+  }
+  if (enc < 0 || dec < 0) {
+    fails++;
+  } else {
+    if (maps_when_damaged(bytes, enc + 6, 2)) fails++;
+    p = map_damaged(bytes, dec + 4, 0x80);
+    if (p == NULL) {
+      fails++;
+    } else {
+      if (jerasure_profile_decoding_schedule(p, erasures, &schedule) != -1) fails++;
+      if (jerasure_profile_schedule_decode(p, erasures, data, coding, SIZE, PACKETSIZE) != -1) fails++;
+      erasures[0] = 2;
+      if (decode(p, erasures, 1) != 0) fails++;
+      jerasure_unmap_profile(p);
+    }
+  }
+
+  /* A number of encoding operations that overflows when it is multiplied
+     by their size, which is the first copy of nops in the file (in the
+     header), plus 2^61. */
+
+  x = 1;
+  little = *((char *) &x);
+  at = (enc < 0) ? -1 : find_bytes(bytes, &nops, sizeof(nops), 0);
+  if (at < 0 || maps_when_damaged(bytes, at + (little ? 7 : 0), 0x20)) fails++;
+
+  /* A coefficient of the matrix that is not in GF(2^8). */
+
+  if (jerasure_write_profile(PROFILE, K, M, W, matrix, NULL, 0, 1) != 0) {
+    fails++;
+  } else {
+    bytes = profile_bytes();
+    at = find_bytes(bytes, matrix, sizeof(int)*K*M, 0);
+    if (at < 0 || maps_when_damaged(bytes, at + (little ? 1 : sizeof(int)-2), 1)) fails++;
+  }
+  unlink(PROFILE);
+  printf("profile checks %s\n", (fails == i) ? "ok" : "FAILED");
+
+  for (i = 0; i < K; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < M; i++) {
+    free(coding[i]);
+    free(expect[0][i]);
+    free(expect[1][i]);
+  }
+  free(matrix);
+  free(bitmatrix);
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+/* Test of the RAID-6 (m=2) and triple-parity (m=3) routines in reed_sol.c.
+
+   For w=8, 16 and 32, and for every region kernel that this CPU supports,
+   reed_sol_r6_encode() and reed_sol_r7_encode() are compared byte for byte
+   against jerasure_matrix_encode() with reed_sol_r6_coding_matrix() and
+   reed_sol_r7_coding_matrix(), for a range of k and of sizes that leave a
+   scalar tail.  reed_sol_r6_decode() and reed_sol_r7_decode() are then run
+   on every combination of up to m erasures, and must restore the stripe
+   exactly, without writing the devices that are not erased. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "reed_sol.h"
+
+#define MAXK 20
+#define MAXSIZE (4096+40)
+
+static const char *kernel_names[] = { "gf_complete", "ssse3", "avx2", "avx512" };
+static int ks[] = { 1, 2, 3, 8, MAXK };
+static int sizes[] = { 8, 16, 40, 64, 136, 1000, MAXSIZE };
+
+static char *data[MAXK], *coding[3], *expect[3], *orig[MAXK];
+
+static int *coding_matrix(int m, int k, int w)
+{
+  return (m == 2) ? reed_sol_r6_coding_matrix(k, w) : reed_sol_r7_coding_matrix(k, w);
+}
+
+static int encode(int m, int k, int w, char **coding_ptrs, int size)
+{
+  return (m == 2) ? reed_sol_r6_encode(k, w, data, coding_ptrs, size)
+                  : reed_sol_r7_encode(k, w, data, coding_ptrs, size);
+}
+
+static int decode(int m, int k, int w, int *erasures, int size)
+{
+  return (m == 2) ? reed_sol_r6_decode(k, w, erasures, data, coding, size)
+                  : reed_sol_r7_decode(k, w, erasures, data, coding, size);
+}
+
+static int test_encode(int kernel, int m, int w)
+{
+  int *matrix;
+  int ki, s, k, size, i, fails;
+
+  fails = 0;
+  for (ki = 0; ki < sizeof(ks)/sizeof(int); ki++) {
+    k = ks[ki];
+    matrix = coding_matrix(m, k, w);
+    for (s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+      size = sizes[s];
+      jerasure_matrix_encode(k, m, w, matrix, data, expect, size);
+      for (i = 0; i < m; i++) memset(coding[i], 0, size);
+      if (!encode(m, k, w, coding, size)) {
+        fprintf(stderr, "m=%d encode failed: w=%d k=%d\n", m, w, k);
+        fails++;
+      }
+      for (i = 0; i < m; i++) {
+        if (memcmp(coding[i], expect[i], size) != 0) {
+          fprintf(stderr, "m=%d encode mismatch: kernel=%s w=%d k=%d size=%d %c\n",
+                  m, kernel_names[kernel], w, k, size, "PQR"[i]);
+          fails++;
+        }
+      }
+    }
+    free(matrix);
+  }
+  return fails;
+}
+
+static int check_stripe(int kernel, int m, int w, int k, int size, int *erasures)
+{
+  int i;
+
+  for (i = 0; i < k+m; i++) {
+    if (memcmp((i < k) ? data[i] : coding[i-k], (i < k) ? orig[i] : expect[i-k], size) != 0) {
+      fprintf(stderr, "m=%d decode mismatch: kernel=%s w=%d k=%d size=%d erasures=%d,%d,%d device=%d\n",
+              m, kernel_names[kernel], w, k, size, erasures[0], erasures[1], erasures[2], i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Decodes every set of up to m erasures, given as e[0] <= e[1] <= e[2]
+   with repeats meaning fewer erasures. */
+
+static int test_decode(int kernel, int m, int w)
+{
+  int erasures[5], e[3];
+  int ki, s, k, size, i, n, fails;
+
+  fails = 0;
+  for (ki = 0; ki < sizeof(ks)/sizeof(int); ki++) {
+    k = ks[ki];
+    for (s = 0; s < sizeof(sizes)/sizeof(int); s += 2) {
+      size = sizes[s];
+      if (m == 3 && k == MAXK && s < sizeof(sizes)/sizeof(int) - 1) continue;
+      for (i = 0; i < k; i++) memcpy(orig[i], data[i], size);
+      encode(m, k, w, expect, size);
+      for (e[0] = 0; e[0] < k+m; e[0]++) {
+        for (e[1] = e[0]; e[1] < k+m; e[1]++) {
+          for (e[2] = e[1]; e[2] < k+m; e[2]++) {
+            if (m == 2 && e[2] != e[1]) break;
+            n = 0;
+            for (i = 0; i < 3; i++) {
+              if (i == 0 || e[i] != e[i-1]) erasures[n++] = e[i];
+            }
+            erasures[n] = -1;
+            for (i = 0; i < m; i++) memcpy(coding[i], expect[i], size);
+            for (i = 0; i < n; i++) {
+              memset((erasures[i] < k) ? data[erasures[i]] : coding[erasures[i]-k], 0x5a, size);
+            }
+            if (decode(m, k, w, erasures, size) != 0) {
+              fprintf(stderr, "m=%d decode failed: w=%d k=%d erasures=%d,%d,%d\n", m, w, k, e[0], e[1], e[2]);
+              fails++;
+            }
+            fails += check_stripe(kernel, m, w, k, size, e);
+            for (i = 0; i < k; i++) memcpy(data[i], orig[i], size);
+            if (fails > 10) return fails;
+          }
+        }
+      }
+    }
+  }
+
+  /* Decoding only writes the erased devices:  with one coding device
+     erased, the others are left as they are, even if they are wrong. */
+
+  k = 4;
+  size = 64;
+  for (e[0] = k; e[0] < k+m; e[0]++) {
+    for (i = 0; i < m; i++) memset(coding[i], 0x5a + i, size);
+    erasures[0] = e[0];
+    erasures[1] = -1;
+    if (decode(m, k, w, erasures, size) != 0) fails++;
+    for (i = 0; i < m; i++) {
+      if (i != e[0]-k && coding[i][0] != 0x5a + i) {
+        fprintf(stderr, "m=%d w=%d decode of %c wrote %c\n", m, w, "PQR"[e[0]-k], "PQR"[i]);
+        fails++;
+      }
+    }
+  }
+
+  /* m+1 erasures cannot be decoded */
+
+  for (i = 0; i <= m; i++) erasures[i] = i;
+  erasures[m+1] = -1;
+  if (decode(m, 4, w, erasures, 8) != -1) {
+    fprintf(stderr, "m=%d decode accepted %d erasures\n", m, m+1);
+    fails++;
+  }
+  return fails;
+}
+
+int main(int argc, char **argv)
+{
+  int kernel, i, j, m, w, fails, tested;
+
+  srand(1370);
+  for (i = 0; i < MAXK; i++) {
+    data[i] = malloc(MAXSIZE);
+    orig[i] = malloc(MAXSIZE);
+  }
+  for (i = 0; i < 3; i++) {
+    coding[i] = malloc(MAXSIZE);
+    expect[i] = malloc(MAXSIZE);
+  }
+
+  fails = 0;
+  tested = 0;
+  for (kernel = GALOIS_KERNEL_GF_COMPLETE; kernel <= GALOIS_KERNEL_AVX512; kernel++) {
+    if (galois_set_region_kernel(kernel) < 0) {
+      printf("%-12s not supported, skipped\n", kernel_names[kernel]);
+      continue;
+    }
+    for (m = 2; m <= 3; m++) {
+      for (w = 8; w <= 32; w *= 2) {
+        for (i = 0; i < MAXK; i++) {
+          for (j = 0; j < MAXSIZE; j++) data[i][j] = rand() & 0xff;
+        }
+        i = test_encode(kernel, m, w);
+        printf("m=%d w=%d %-12s encode %s\n", m, w, kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+        fails += i;
+        i = test_decode(kernel, m, w);
+        printf("m=%d w=%d %-12s decode %s\n", m, w, kernel_names[kernel], (i == 0) ? "ok" : "FAILED");
+        fails += i;
+      }
+    }
+    tested++;
+  }
+
+  for (i = 0; i < MAXK; i++) {
+    free(data[i]);
+    free(orig[i]);
+  }
+  for (i = 0; i < 3; i++) {
+    free(coding[i]);
+    free(expect[i]);
+  }
+  return (fails == 0 && tested > 0) ? 0 : 1;
+}
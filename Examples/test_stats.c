@@ -0,0 +1,162 @@
+/* Test of the stats of jerasure_get_stats() and
+   jerasure_get_detailed_stats().
+
+   Worker threads encode with a matrix whose rows have known numbers of
+   copies, XORs and multiplications, and then decode with the decoding
+   matrix cache turned off, so that every decoding inverts a matrix.  The
+   stats, which each thread counts on its own, must add up to the counts
+   of all of the threads, those that have exited and the main thread, and
+   must be 0 once they have been read.  Without pthreads, the workers are
+   run one after another.  If the library was built without stats, they
+   must all be 0. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef JERASURE_PTHREADS
+#include <pthread.h>
+#endif
+#include "jerasure.h"
+
+#define THREADS 4
+#define ROUNDS 50
+#define K 4
+#define M 2
+#define W 8
+#define SIZE 1024
+
+/* Row 0 is a copy and 3 XORs, and row 1 a copy and 3 multiplications. */
+
+static int matrix[M*K] = { 1, 1, 1, 1,
+                           1, 2, 3, 4 };
+
+typedef struct {
+  char *data[K], *coding[M], *orig[K];
+  int decode;
+  int fails;
+} worker;
+
+static void worker_round(worker *t)
+{
+  int erasures[3];
+  int i;
+
+  if (!t->decode) {
+    jerasure_matrix_encode(K, M, W, matrix, t->data, t->coding, SIZE);
+    jerasure_do_parity(K, t->data, t->coding[0], SIZE);
+    return;
+  }
+  erasures[0] = 0;
+  erasures[1] = 1;
+  erasures[2] = -1;
+  memset(t->data[0], 0, SIZE);
+  memset(t->data[1], 0, SIZE);
+  if (jerasure_matrix_decode(K, M, W, matrix, 0, erasures, t->data, t->coding, SIZE) != 0) t->fails++;
+  for (i = 0; i < K; i++) if (memcmp(t->data[i], t->orig[i], SIZE) != 0) t->fails++;
+}
+
+static void *worker_run(void *arg)
+{
+  worker *t;
+  int i;
+
+  t = (worker *) arg;
+  for (i = 0; i < ROUNDS; i++) worker_round(t);
+  return NULL;
+}
+
+/* Runs a round in every worker, in threads of their own if there are
+   pthreads. */
+
+static void run_workers(worker *ts)
+{
+  int j;
+#ifdef JERASURE_PTHREADS
+  pthread_t tids[THREADS];
+
+  for (j = 0; j < THREADS; j++) pthread_create(tids+j, NULL, worker_run, ts+j);
+  for (j = 0; j < THREADS; j++) pthread_join(tids[j], NULL);
+#else
+  for (j = 0; j < THREADS; j++) worker_run(ts+j);
+#endif
+}
+
+static int check(double *got, int stat, double want, const char *name)
+{
+  if (got[stat] == want) return 0;
+  fprintf(stderr, "%s is %.0lf rather than %.0lf\n", name, got[stat], want);
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  worker ts[THREADS];
+  double stats[JERASURE_NSTATS], three[3], n;
+  int i, j, x, fails, enabled;
+
+  srand(1423);
+  for (j = 0; j < THREADS; j++) {
+    for (i = 0; i < K; i++) {
+      ts[j].data[i] = malloc(SIZE);
+      ts[j].orig[i] = malloc(SIZE);
+      for (x = 0; x < SIZE; x++) ts[j].orig[i][x] = rand() & 0xff;
+      memcpy(ts[j].data[i], ts[j].orig[i], SIZE);
+    }
+    for (i = 0; i < M; i++) ts[j].coding[i] = malloc(SIZE);
+    ts[j].decode = 0;
+    ts[j].fails = 0;
+  }
+  enabled = jerasure_get_stats_enabled();
+  jerasure_get_detailed_stats(stats);
+  fails = 0;
+
+  /* Encoding, in the workers and once in the main thread. */
+
+  run_workers(ts);
+  worker_round(ts);
+  n = (enabled) ? THREADS*ROUNDS+1 : 0;
+  jerasure_get_detailed_stats(stats);
+  fails += check(stats, JERASURE_STAT_XOR_BYTES, n*6*SIZE, "XOR_BYTES");
+  fails += check(stats, JERASURE_STAT_GF_BYTES, n*3*SIZE, "GF_BYTES");
+  fails += check(stats, JERASURE_STAT_COPY_BYTES, n*3*SIZE, "COPY_BYTES");
+  fails += check(stats, JERASURE_STAT_XOR_CALLS, n*6, "XOR_CALLS");
+  fails += check(stats, JERASURE_STAT_GF_CALLS, n*3, "GF_CALLS");
+  fails += check(stats, JERASURE_STAT_COPY_CALLS, n*3, "COPY_CALLS");
+  fails += check(stats, JERASURE_STAT_GF08_BYTES, n*3*SIZE, "GF08_BYTES");
+  fails += check(stats, JERASURE_STAT_GF16_BYTES, 0, "GF16_BYTES");
+  fails += check(stats, JERASURE_STAT_DECODING_MATRICES, 0, "DECODING_MATRICES");
+
+  /* Decoding, where every round inverts a decoding matrix. */
+
+  jerasure_set_decoding_cache_size(0);
+  for (j = 0; j < THREADS; j++) ts[j].decode = 1;
+  run_workers(ts);
+  jerasure_get_detailed_stats(stats);
+  n = (enabled) ? THREADS*ROUNDS : 0;
+  fails += check(stats, JERASURE_STAT_DECODING_MATRICES, n, "DECODING_MATRICES");
+  if (stats[JERASURE_STAT_INVERT_SECONDS] < 0 || (!enabled && stats[JERASURE_STAT_INVERT_SECONDS] != 0)) {
+    fprintf(stderr, "INVERT_SECONDS is %lf\n", stats[JERASURE_STAT_INVERT_SECONDS]);
+    fails++;
+  }
+  if (enabled && stats[JERASURE_STAT_GF_BYTES] == 0) {
+    fprintf(stderr, "decoding was not counted\n");
+    fails++;
+  }
+
+  /* The stats have been reset. */
+
+  jerasure_get_stats(three);
+  for (i = 0; i < 3; i++) fails += check(three, i, 0, "a reset stat");
+
+  for (j = 0; j < THREADS; j++) {
+    fails += ts[j].fails;
+    for (i = 0; i < K; i++) {
+      free(ts[j].data[i]);
+      free(ts[j].orig[i]);
+    }
+    for (i = 0; i < M; i++) free(ts[j].coding[i]);
+  }
+  printf("stats %s in %d thread%s: %s\n", (enabled) ? "counted" : "disabled", THREADS,
+         (THREADS == 1) ? "" : "s", (fails == 0) ? "ok" : "FAILED");
+  return (fails == 0) ? 0 : 1;
+}
@@ -58,6 +58,17 @@ void galois_region_xor(           char *src,         /* Source Region */
                                   char *dest,        /* Dest Region (holds result) */
                                   int nbytes);      /* Number of bytes in region */
 
+/* This XORs n regions into dest, which is written once:
+   dest = srcs[0] ^ ... ^ srcs[n-1].  Large regions are written with
+   non-temporal stores, so dest does not displace the sources in cache.
+   dest may be srcs[0], to XOR the other sources into it, but no other
+   source may overlap dest. */
+
+void galois_region_xor_n(         char **srcs,       /* Source Regions */
+                                  int n,             /* Number of sources */
+                                  char *dest,        /* Dest Region (holds result) */
+                                  int nbytes);       /* Number of bytes in each region */
+
 /* These multiply regions in w=8, w=16 and w=32.  They are much faster
    than calling galois_single_multiply.  The regions must be long word aligned. */
 
@@ -82,6 +93,49 @@ void galois_w32_region_multiply(char *region,       /* Region to multiply */
                                                        Otherwise region is overwritten */
                                   int add);         /* If (r2 != NULL && add) the produce is XOR'd with r2 */
 
+/* These compute the dot product of n regions with n constants in w=8, w=16
+   and w=32:  dest = coeffs[0]*srcs[0] + ... + coeffs[n-1]*srcs[n-1].
+   dest is written once, instead of once per source, and zero coefficients
+   are skipped.  For w=16 and w=32, size must be a multiple of 2 and 4. */
+
+void galois_w08_region_dotprod(char **srcs,         /* Source regions */
+                                  int *coeffs,      /* One constant per source */
+                                  int n,            /* Number of sources */
+                                  char *dest,       /* Dest region (holds result) */
+                                  int size);        /* Number of bytes in each region */
+
+void galois_w16_region_dotprod(char **srcs, int *coeffs, int n, char *dest, int size);
+void galois_w32_region_dotprod(char **srcs, int *coeffs, int n, char *dest, int size);
+
+/* The same for ndests destinations at once:
+   dests[d] = coeffs[d*n]*srcs[0] + ... + coeffs[d*n+n-1]*srcs[n-1].
+   coeffs is an ndests x n matrix, stored by rows, like a Jerasure coding
+   matrix.  The sources are read once for all of the destinations (w=8), or
+   once per cache-sized chunk (w=16 and w=32), rather than once per dest. */
+
+void galois_w08_region_dotprod_multi(char **srcs,   /* Source regions */
+                                  int *coeffs,      /* ndests rows of n constants */
+                                  int n,            /* Number of sources */
+                                  char **dests,     /* Dest regions (hold results) */
+                                  int ndests,       /* Number of dests */
+                                  int size);        /* Number of bytes in each region */
+
+void galois_w16_region_dotprod_multi(char **srcs, int *coeffs, int n, char **dests, int ndests, int size);
+void galois_w32_region_dotprod_multi(char **srcs, int *coeffs, int n, char **dests, int ndests, int size);
+
+/* Callers that apply the same coefficients many times can build the split
+   tables of the w=16 and w=32 kernels once, instead of on every call.
+   galois_region_dotprod_table_bytes returns the bytes of tables that n
+   coefficients need (0 for w=8, whose tables are global), and
+   galois_region_dotprod_build_tables fills them in.  The tables stay valid
+   until the field of w is changed.  galois_region_dotprod_multi_tables is
+   galois_wXX_region_dotprod_multi with prebuilt tables. */
+
+int galois_region_dotprod_table_bytes(int w, int n);
+void galois_region_dotprod_build_tables(int w, int *coeffs, int n, unsigned char *tables);
+void galois_region_dotprod_multi_tables(int w, char **srcs, int *coeffs, unsigned char *tables,
+                                        int n, char **dests, int ndests, int size);
+
 gf_t* galois_init_field(int w,
                              int mult_type,
                              int region_type,
@@ -98,6 +152,111 @@ gf_t* galois_init_composite_field(int w,
 
 gf_t * galois_get_field_ptr(int w);
 
+/* Threads.  The galois_* calls may be made from any number of threads.
+   The default field of each w is set up once, by the first call that
+   needs it, and galois_change_technique() and galois_uninit_field() may be
+   called while other threads are using the field:  calls that have
+   already started finish with the old field, which is freed once no
+   thread can still be using it.  Looking up a field takes no lock.
+
+   What the calls return about a field (galois_get_field_ptr(),
+   galois_log_tables()) belongs to the field, so if another thread may
+   change it, use it between galois_read_lock() and galois_read_unlock().
+   This delays freeing old fields, and never blocks.  Read sections nest,
+   and are per thread; a thread must not change the field of w while it
+   uses what it got from that field. */
+
+extern void galois_read_lock(void);
+extern void galois_read_unlock(void);
+
+/* Contexts.  galois_change_technique() changes the field of w for the
+   whole process.  A context instead holds fields of its own, so that
+   different codes in one process can each use the field implementation
+   that is fastest for them (for example SPLIT 8 4 for one, and COMPOSITE
+   ALTMAP for another).  A context uses the fields of the process for the
+   values of w that it has not been given a field for, so a new context
+   behaves like the process.  A context can be attached to a codec plan
+   (jerasure_plan_create_with_context()), or passed to the
+   galois_context_* routines, which are the galois_* routines in the
+   context's fields.  A NULL context means the fields of the process.
+
+   galois_context_set_field() gives the context gf, set up with
+             galois_init_field() or galois_init_composite_field(), for w,
+             or with gf == NULL, goes back to the field of the process.
+             As with galois_change_technique(), the context takes gf over,
+             and gf_free()s it when it is replaced or the context is freed.
+             It returns 0, or -1 if w or gf is bad, or memory runs out.
+             The fields of a context may only be changed, and the context
+             freed, while no other thread is using it.
+
+   galois_context_id() returns a number that identifies the field that
+             ctx (or the process, for NULL) uses for w, in caches of what
+             was computed in it.  It changes whenever that field changes:
+             with galois_context_set_field() for a field of the context,
+             and with galois_change_technique() or galois_uninit_field()
+             for a field of the process.  Numbers are never reused.
+
+   Fields in contexts always go through GF-Complete, like those installed
+   with galois_change_technique(). */
+
+typedef struct galois_context galois_context_t;
+
+extern galois_context_t *galois_context_create(void);
+extern void galois_context_free(galois_context_t *ctx);
+extern int galois_context_set_field(galois_context_t *ctx, int w, gf_t *gf);
+extern gf_t *galois_context_get_field_ptr(galois_context_t *ctx, int w);
+extern unsigned long galois_context_id(galois_context_t *ctx, int w);
+
+extern int galois_context_single_multiply(galois_context_t *ctx, int a, int b, int w);
+extern int galois_context_single_divide(galois_context_t *ctx, int a, int b, int w);
+extern int galois_context_log_tables(galois_context_t *ctx, int w, uint16_t **log, uint16_t **exp);
+
+/* w is 8, 16 or 32, and the arguments are those of galois_wXX_region_multiply,
+   galois_wXX_region_dotprod, galois_wXX_region_dotprod_multi,
+   galois_region_dotprod_build_tables and galois_region_dotprod_multi_tables. */
+
+void galois_context_region_multiply(galois_context_t *ctx, int w, char *region, int multby,
+                                    int nbytes, char *r2, int add);
+void galois_context_region_dotprod(galois_context_t *ctx, int w, char **srcs, int *coeffs, int n,
+                                   char *dest, int size);
+void galois_context_region_dotprod_multi(galois_context_t *ctx, int w, char **srcs, int *coeffs,
+                                         int n, char **dests, int ndests, int size);
+void galois_context_region_dotprod_build_tables(galois_context_t *ctx, int w, int *coeffs, int n,
+                                                unsigned char *tables);
+void galois_context_region_dotprod_multi_tables(galois_context_t *ctx, int w, char **srcs,
+                                                int *coeffs, unsigned char *tables, int n,
+                                                char **dests, int ndests, int size);
+
+/* For w <= 16, galois_log_tables() returns logarithm and antilogarithm
+   tables of the field of w:  for nonzero a and b, a*b is
+   exp[log[a]+log[b]], and 1/a is exp[(2^w-1)-log[a]].  exp has 2(2^w-1)
+   entries, so the sums never need a modulus.  The tables are built when
+   the field of w is set up, and stay valid until it is changed (see
+   galois_read_lock()).  It returns 0, or -1 if w > 16 or there was no
+   memory for them. */
+
+extern int galois_log_tables(int w, uint16_t **log, uint16_t **exp);
+
+/* Native region kernels.  When the default field is used for w=8, 16 and
+   32, galois_wXX_region_multiply() runs split-nibble shuffle kernels inside
+   Jerasure instead of calling through GF-Complete.  The best kernel that
+   the CPU supports is chosen with cpuid the first time a field is set up.
+   Fields installed with galois_change_technique() always go through
+   GF-Complete.
+
+   galois_set_region_kernel() overrides the choice (mostly for testing and
+   benchmarking), and returns -1 if the kernel is not supported by this
+   CPU or build.  GALOIS_KERNEL_GF_COMPLETE disables the native kernels. */
+
+#define GALOIS_KERNEL_GF_COMPLETE 0
+#define GALOIS_KERNEL_SSSE3       1
+#define GALOIS_KERNEL_AVX2        2
+#define GALOIS_KERNEL_AVX512      3
+
+extern int galois_region_kernel_supported(int kernel);
+extern int galois_get_region_kernel(void);
+extern int galois_set_region_kernel(int kernel);
+
 #ifdef __cplusplus
 }
 #endif
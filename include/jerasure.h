@@ -44,6 +44,8 @@
 
 /* This uses procedures from the Galois Field arithmetic library */
 
+#include <stddef.h>
+#include <stdint.h>
 #include "galois.h"
 
 #ifdef __cplusplus
@@ -93,8 +95,43 @@ extern "C" {
           2 = source packet (0 - w-1)
           3 = destination device (0 - k+m-1)
           4 = destination packet (0 - w-1)
+
+   flat schedule = the same operations, packed in one array of
+              jerasure_schedule_op_t.  There is no end marker:  the
+              schedule holds nops operations.  Devices must be below
+              JERASURE_FLAT_MAX_DEVICES, and packets (so w) below
+              JERASURE_FLAT_MAX_PACKETS.  A flat schedule is a single
+              allocation, so executing one does not chase a pointer per
+              operation.  A flat schedule may also use temporary packets,
+              which are packets of ntdevs extra devices, numbered from
+              tdev:  the caller's devices, 0 to tdev-1, come first.
  */
 
+#define JERASURE_FLAT_MAX_DEVICES 65536
+#define JERASURE_FLAT_MAX_PACKETS 256
+
+/* The smart argument of the routines that make decoding schedules */
+
+#define JERASURE_SCHEDULE_DUMB 0
+#define JERASURE_SCHEDULE_SMART 1
+#define JERASURE_SCHEDULE_CSE 2
+
+typedef struct {
+  uint16_t from_dev;        /* Source device */
+  uint16_t to_dev;          /* Destination device */
+  uint8_t from_pkt;         /* Source packet */
+  uint8_t to_pkt;           /* Destination packet */
+  uint8_t op;               /* 0 for copy, 1 for xor */
+  uint8_t pad;
+} jerasure_schedule_op_t;
+
+typedef struct {
+  int nops;
+  int tdev;                 /* First temporary device */
+  int ntdevs;               /* Number of temporary devices (0 for none) */
+  jerasure_schedule_op_t *ops;
+} jerasure_flat_schedule_t;
+
 /* ---------------------------------------------------------------  */
 /* Bitmatrices / schedules ---------------------------------------- */
 /*
@@ -102,6 +139,8 @@ extern "C" {
                               wm X wk bitmatrix (in GF(2)).  This is
                               explained in the Cauchy Reed-Solomon coding
                               paper.
+   jerasure_context_matrix_to_bitmatrix does the same with the field of w
+                              in a galois context (see galois.h).
 
  - jerasure_dumb_bitmatrix_to_schedule turns a bitmatrix into a schedule 
                               using the straightforward algorithm -- just
@@ -113,6 +152,53 @@ extern "C" {
                               calculate new ones.  This is the optimization
                               explained in the original Liberation code paper.
 
+ - jerasure_dumb_bitmatrix_to_flat_schedule and
+   jerasure_smart_bitmatrix_to_flat_schedule make the same schedules as
+                              flat schedules.  They return NULL if k+m or
+                              w is too big for one.  The two above are made
+                              by converting these.
+
+ - jerasure_cse_bitmatrix_to_flat_schedule turns a bitmatrix into a flat
+                              schedule by common subexpression elimination:
+                              pairs of packets that are XOR'd into several
+                              rows are XOR'd once into a temporary packet,
+                              which those rows then use.  This often saves
+                              a fifth or more of the XORs of smart
+                              schedules.  When it does not save any, the
+                              smart schedule is returned.  Temporary
+                              devices are numbered from k+m.  The schedule
+                              is reordered, as below.
+
+ - jerasure_reorder_flat_schedule reorders a flat schedule in place, for
+                              locality:  the operations on each destination
+                              packet stay together, and packets that were
+                              just read are read again while they are in
+                              cache.  Dependences between operations are
+                              kept, so the result does not change.  Returns
+                              0, or -1 (leaving the schedule as it was) if
+                              memory runs out.
+
+ - jerasure_flat_schedule_to_schedule and jerasure_schedule_to_flat_schedule
+                              convert between the two forms.  Neither frees
+                              its argument.  Schedules with temporaries have
+                              no int ** form:  for those, the first returns
+                              NULL.
+
+ - jerasure_free_flat_schedule frees a flat schedule.
+
+ - jerasure_generate_flat_decoding_schedule makes the flat schedule that
+                              jerasure_schedule_decode_lazy runs to decode
+                              erasures, with the same smart argument.  Its
+                              devices are not the data and coding devices
+                              in order:  device i < k is data device i if
+                              that is not erased, and otherwise the lowest
+                              coding device that is neither erased nor used
+                              for a lower data device.  The devices from k
+                              on are the erased data devices, and then the
+                              erased coding devices, each in order of id.
+                              Returns NULL if the erasures cannot be
+                              decoded.
+
  - jerasure_generate_schedule_cache precalcalculate all the schedule for the
                               given distribution bitmatrix.  M must equal 2.
  
@@ -121,16 +207,51 @@ extern "C" {
  
  - jerasure_free_schedule_cache frees a schedule cache that was created with 
                               jerasure_generate_schedule_cache.
+
+ - jerasure_create_lazy_schedule_cache creates a schedule cache for any m.
+                              It copies the bitmatrix, but builds no
+                              schedules:  the decoding schedule of a set of
+                              erasures is built when it is first decoded
+                              with jerasure_schedule_decode_lazy_cache, and
+                              kept for the same erasures in any order.  The
+                              least recently used schedules are freed once
+                              the cache holds more than max_bytes.  The
+                              cache may be used by several threads at once
+                              when Jerasure is built with pthreads.
+
+ - jerasure_get_lazy_schedule_cache_stats fills in three doubles, like
+                              jerasure_get_decoding_cache_stats:  hits,
+                              misses (and resets both), and bytes held.
+
+ - jerasure_free_lazy_schedule_cache frees a lazy schedule cache.
  */
 
 int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix);
+int *jerasure_context_matrix_to_bitmatrix(galois_context_t *ctx, int k, int m, int w, int *matrix);
 int **jerasure_dumb_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix);
 int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix);
 int ***jerasure_generate_schedule_cache(int k, int m, int w, int *bitmatrix, int smart);
 
+jerasure_flat_schedule_t *jerasure_dumb_bitmatrix_to_flat_schedule(int k, int m, int w, int *bitmatrix);
+jerasure_flat_schedule_t *jerasure_smart_bitmatrix_to_flat_schedule(int k, int m, int w, int *bitmatrix);
+jerasure_flat_schedule_t *jerasure_cse_bitmatrix_to_flat_schedule(int k, int m, int w, int *bitmatrix);
+int jerasure_reorder_flat_schedule(jerasure_flat_schedule_t *schedule);
+int **jerasure_flat_schedule_to_schedule(jerasure_flat_schedule_t *schedule);
+jerasure_flat_schedule_t *jerasure_schedule_to_flat_schedule(int **schedule);
+void jerasure_free_flat_schedule(jerasure_flat_schedule_t *schedule);
+jerasure_flat_schedule_t *jerasure_generate_flat_decoding_schedule(int k, int m, int w, int *bitmatrix,
+                                                                   int *erasures, int smart);
+
 void jerasure_free_schedule(int **schedule);
 void jerasure_free_schedule_cache(int k, int m, int ***cache);
 
+typedef struct jerasure_schedule_cache jerasure_schedule_cache_t;
+
+jerasure_schedule_cache_t *jerasure_create_lazy_schedule_cache(int k, int m, int w, int *bitmatrix,
+                                                               int smart, long max_bytes);
+void jerasure_get_lazy_schedule_cache_stats(jerasure_schedule_cache_t *cache, double *fill_in);
+void jerasure_free_lazy_schedule_cache(jerasure_schedule_cache_t *cache);
+
 
 /* ------------------------------------------------------------ */
 /* Encoding - these are all straightforward.  jerasure_matrix_encode only 
@@ -147,6 +268,9 @@ void jerasure_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
 void jerasure_schedule_encode(int k, int m, int w, int **schedule,
                                   char **data_ptrs, char **coding_ptrs, int size, int packetsize);
 
+void jerasure_flat_schedule_encode(int k, int m, int w, jerasure_flat_schedule_t *schedule,
+                                   char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
 /* ------------------------------------------------------------ */
 /* Decoding. -------------------------------------------------- */
 
@@ -160,7 +284,16 @@ void jerasure_schedule_encode(int k, int m, int w, int **schedule,
    devices, and then decoding the last data device from the data devices
    and the parity device.
 
-   jerasure_schedule_decode_lazy generates the schedule on the fly.
+   jerasure_schedule_decode_lazy generates the schedule on the fly.  smart is
+         JERASURE_SCHEDULE_DUMB, _SMART or _CSE (see
+         jerasure_cse_bitmatrix_to_flat_schedule), here and in
+         jerasure_create_lazy_schedule_cache and jerasure_write_profile.
+         jerasure_generate_schedule_cache treats _CSE as _SMART.
+
+   jerasure_schedule_decode_cache uses a schedule cache from
+         jerasure_generate_schedule_cache (m = 2, at most two erasures), and
+         jerasure_schedule_decode_lazy_cache one from
+         jerasure_create_lazy_schedule_cache (any m).
 
    jerasure_matrix_decode only works when w = 8|16|32.
 
@@ -180,6 +313,35 @@ void jerasure_schedule_encode(int k, int m, int w, int **schedule,
          each device's id, according to whether the device is erased.
  
    jerasure_erasures_to_erased allocates and returns erased from erasures.
+
+   The decoding matrices made by jerasure_make_decoding_matrix/bitmatrix
+   (and so by the decoders that call them) are kept in a cache, keyed by
+   the coding matrix and erased, so that decoding many stripes with the
+   same erasures only inverts the matrix once.  The cache is shared by all
+   threads (it is thread-safe when Jerasure is built with pthreads), and
+   evicts the least recently used matrices once it holds more than its
+   size in bytes.
+
+   A cached decoding matrix is tied to the Galois field that it was
+   inverted in (see galois_context_id()):  it is only used to decode in
+   that same field.  Once galois_change_technique() or galois_uninit_field()
+   changes the field of w, or a context is given another field, the
+   matrices of the old field are never used again, and age out of the
+   cache.  Decoding bitmatrices are inverted in GF(2), so they do not
+   depend on the field.
+
+   jerasure_set_decoding_cache_size sets that size.  0 disables the cache
+         and frees it.  The default is 1 MB.
+
+   jerasure_get_decoding_cache_size returns it.
+
+   jerasure_clear_decoding_cache frees all of the cached matrices.
+
+   jerasure_get_decoding_cache_stats fills in a vector of three doubles:
+         fill_in[0] is the number of lookups that hit the cache,
+         fill_in[1] is the number that missed, and fill_in[2] is the number
+         of bytes in the cache.  Like jerasure_get_stats(), it resets the
+         hit and miss counts.
     
  */
 
@@ -198,6 +360,9 @@ int jerasure_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *eras
 int jerasure_schedule_decode_cache(int k, int m, int w, int ***scache, int *erasures,
                             char **data_ptrs, char **coding_ptrs, int size, int packetsize);
 
+int jerasure_schedule_decode_lazy_cache(jerasure_schedule_cache_t *cache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
 int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased, 
                                   int *decoding_matrix, int *dm_ids);
 
@@ -206,6 +371,11 @@ int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *eras
 
 int *jerasure_erasures_to_erased(int k, int m, int *erasures);
 
+void jerasure_set_decoding_cache_size(long bytes);
+long jerasure_get_decoding_cache_size();
+void jerasure_clear_decoding_cache();
+void jerasure_get_decoding_cache_stats(double *fill_in);
+
 /* ------------------------------------------------------------ */
 /* These perform dot products and schedules. -------------------*/
 /*
@@ -218,6 +388,10 @@ int *jerasure_erasures_to_erased(int k, int m, int *erasures);
    jerasure_do_scheduled_operations executes the schedule on w*packetsize worth of
    bytes from each device.  ptrs is an array of pointers which should have as many
    elements as the highest referenced device in the schedule.
+   jerasure_do_flat_scheduled_operations does the same with a flat schedule.
+   If the schedule has temporaries, ptrs must also have tdev+ntdevs elements,
+   and ptrs[tdev] to ptrs[tdev+ntdevs-1] must each point to w*packetsize
+   bytes of scratch.
 
  */
  
@@ -230,6 +404,8 @@ void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
                              char **data_ptrs, char **coding_ptrs, int size, int packetsize);
 
 void jerasure_do_scheduled_operations(char **ptrs, int **schedule, int packetsize);
+void jerasure_do_flat_scheduled_operations(char **ptrs, jerasure_flat_schedule_t *schedule,
+                                           int packetsize);
 
 /* ------------------------------------------------------------ */
 /* Matrix Inversion ------------------------------------------- */
@@ -253,12 +429,82 @@ void jerasure_do_scheduled_operations(char **ptrs, int **schedule, int packetsiz
 
    The two invertible function simply return whether the matrix is
    invertible.  (0 or 1). Mat will be destroyed.
+
+   For w <= 16, jerasure_invert_matrix and jerasure_invertible_matrix look
+   products up in the log tables of the field (see galois_log_tables), and
+   for w = 8 with 64 or more rows, or w = 16 with 256 or more, they add
+   multiples of rows with the region multiply kernels.  jerasure_set_fast_invert(0) makes them use
+   galois_single_multiply and galois_single_divide instead, as they did
+   before (for testing and benchmarking), and jerasure_set_fast_invert(1),
+   the default, turns the fast code back on.  The results are the same.
+
+   jerasure_context_invert_matrix is jerasure_invert_matrix with the field
+   of w in a galois context (see galois.h).
  */
 
 int jerasure_invert_matrix(int *mat, int *inv, int rows, int w);
+int jerasure_context_invert_matrix(galois_context_t *ctx, int *mat, int *inv, int rows, int w);
 int jerasure_invert_bitmatrix(int *mat, int *inv, int rows);
 int jerasure_invertible_matrix(int *mat, int rows, int w);
 int jerasure_invertible_bitmatrix(int *mat, int rows);
+void jerasure_set_fast_invert(int enable);
+int jerasure_get_fast_invert();
+
+/* ------------------------------------------------------------ */
+/* Packed bitmatrices ----------------------------------------- */
+/*
+   A packed bitmatrix holds each row of a bitmatrix in (cols+63)/64 words
+   of 64 bits:  element i,j is bit j%64 of bits[i*words+j/64], and the
+   bits past cols are zero.  That is 1/32 of the memory of the int layout,
+   and rows are XOR'd, compared and counted (with popcount) a word at a
+   time.  The routines above that take an int bitmatrix and invert it or
+   make schedules from it pack it, and use the packed routines below.
+
+   jerasure_new_packed_bitmatrix allocates a rows X cols packed bitmatrix
+          of zeros.  jerasure_free_packed_bitmatrix frees one.
+
+   jerasure_pack_bitmatrix and jerasure_unpack_bitmatrix convert from and
+          to the int layout.  Both allocate the result.
+
+   jerasure_matrix_to_packed_bitmatrix is jerasure_matrix_to_bitmatrix
+          without the int layout in between.
+
+   jerasure_invert_packed_bitmatrix and jerasure_invertible_packed_bitmatrix
+          work like jerasure_invert_bitmatrix and
+          jerasure_invertible_bitmatrix.  inv must be allocated with the
+          size of mat, and mat is destroyed.
+
+   jerasure_dumb_packed_bitmatrix_to_flat_schedule and
+   jerasure_smart_packed_bitmatrix_to_flat_schedule make the same schedules
+          as jerasure_dumb_bitmatrix_to_flat_schedule and
+          jerasure_smart_bitmatrix_to_flat_schedule, from an mw X kw
+          packed bitmatrix.
+
+   JERASURE_PACKED_BIT(p, i, j) is element i,j of p.
+ */
+
+typedef struct {
+  int rows;
+  int cols;
+  int words;                        /* Words in each row */
+  uint64_t *bits;
+} jerasure_packed_bitmatrix_t;
+
+#define JERASURE_PACKED_BIT(p, i, j) \
+  ((int) (((p)->bits[(size_t) (i)*(p)->words + ((j) >> 6)] >> ((j) & 63)) & 1))
+
+jerasure_packed_bitmatrix_t *jerasure_new_packed_bitmatrix(int rows, int cols);
+void jerasure_free_packed_bitmatrix(jerasure_packed_bitmatrix_t *packed);
+jerasure_packed_bitmatrix_t *jerasure_pack_bitmatrix(int *bitmatrix, int rows, int cols);
+int *jerasure_unpack_bitmatrix(jerasure_packed_bitmatrix_t *packed);
+jerasure_packed_bitmatrix_t *jerasure_matrix_to_packed_bitmatrix(int k, int m, int w, int *matrix);
+int jerasure_invert_packed_bitmatrix(jerasure_packed_bitmatrix_t *mat,
+                                     jerasure_packed_bitmatrix_t *inv);
+int jerasure_invertible_packed_bitmatrix(jerasure_packed_bitmatrix_t *mat);
+jerasure_flat_schedule_t *jerasure_dumb_packed_bitmatrix_to_flat_schedule(int k, int m, int w,
+                                                                    jerasure_packed_bitmatrix_t *bitmatrix);
+jerasure_flat_schedule_t *jerasure_smart_packed_bitmatrix_to_flat_schedule(int k, int m, int w,
+                                                                     jerasure_packed_bitmatrix_t *bitmatrix);
 
 /* ------------------------------------------------------------ */
 /* Basic matrix operations -------------------------------------*/
@@ -285,14 +531,314 @@ int *jerasure_matrix_multiply(int *m1, int *m2, int r1, int c1, int r2, int c2,
   jerasure_get_stats fills in a vector of three doubles:
 
       fill_in[0] is the number of bytes that have been XOR'd
-      fill_in[1] is the number of bytes that have been copied
-      fill_in[2] is the number of bytes that have been multiplied
+      fill_in[1] is the number of bytes that have been multiplied
                  by a constant in GF(2^w)
+      fill_in[2] is the number of bytes that have been copied
 
   When jerasure_get_stats() is called, it resets its values.
+
+  jerasure_get_detailed_stats fills in a vector of JERASURE_NSTATS
+  doubles, indexed by the JERASURE_STAT_ constants below, and resets them.
+  Its first three are those of jerasure_get_stats.  The calls are the
+  number of regions that have been XOR'd, multiplied or copied, which are
+  done packetsize bytes at a time by the bitmatrix and schedule routines.
+  The bytes multiplied are also broken down by w.  DECODING_MATRICES is
+  the number of decoding matrices and bitmatrices that have been
+  inverted (those found in the decoding matrix cache are not), and
+  INVERT_SECONDS is the time that those inversions took.
+
+  The stats are counted by every thread on its own and summed when they
+  are read, so they cost the threads no locks or shared cache lines.
+  They are for the whole process, and one thread's reset resets them for
+  all.  Built with JERASURE_NO_STATS (configure --disable-stats), the
+  library does no counting, all of the stats are 0, and
+  jerasure_get_stats_enabled() returns 0 rather than 1.
  */
 
+#define JERASURE_STAT_XOR_BYTES          0
+#define JERASURE_STAT_GF_BYTES           1
+#define JERASURE_STAT_COPY_BYTES         2
+#define JERASURE_STAT_XOR_CALLS          3
+#define JERASURE_STAT_GF_CALLS           4
+#define JERASURE_STAT_COPY_CALLS         5
+#define JERASURE_STAT_GF08_BYTES         6
+#define JERASURE_STAT_GF16_BYTES         7
+#define JERASURE_STAT_GF32_BYTES         8
+#define JERASURE_STAT_DECODING_MATRICES  9
+#define JERASURE_STAT_INVERT_SECONDS    10
+#define JERASURE_NSTATS                 11
+
 void jerasure_get_stats(double *fill_in);
+void jerasure_get_detailed_stats(double *fill_in);
+int jerasure_get_stats_enabled();
+
+/* ------------------------------------------------------------ */
+/* Tiling ----------------------------------------------------- */
+/*
+  jerasure_matrix_encode/decode and jerasure_bitmatrix_encode/decode
+  work on the devices one tile at a time:  every row is applied to a
+  tile before the next tile is started, so that the tile is still in
+  cache for each row.  The results do not depend on the tile size.
+
+  jerasure_set_tile_size sets the number of bytes of each device in a
+  tile.  It is rounded down to a multiple of 64 bytes (of w*packetsize
+  for the bitmatrix routines).  With 0, the default, the tile is picked
+  so that a tile of all k+m devices fills half of the L2 cache.
+
+  jerasure_get_tile_size returns the value that was set (0 for the default).
+ */
+
+void jerasure_set_tile_size(int bytes);
+int jerasure_get_tile_size();
+
+/* ------------------------------------------------------------ */
+/* Parallel encoding and decoding ----------------------------- */
+/*
+  The jerasure_parallel_* routines take the same arguments, and have the
+  same results and return values, as the routines without "parallel_",
+  but split size into slices that are run on a pool of threads.  Slices
+  are multiples of 64 bytes (of w*packetsize for the bitmatrix and
+  schedule routines), and at least 64K.  The decoding matrix or schedule
+  is made once, by the calling thread, which then works on the slices
+  with the pool.  They return once every slice is done, so the devices
+  may be used as soon as they return.  Any number of threads may call
+  them at once; their slices share the pool.  Without pthreads, the
+  slices are run one after another by the calling thread.
+
+  jerasure_set_threads sets the number of threads that work on a call,
+  counting the caller, so the pool has threads-1 workers.  With 0, the
+  default, there is one thread for each online processor.  The workers
+  are started by the first call that needs them, and jerasure_set_threads
+  stops them, waiting for those that are working to finish their slices.
+
+  jerasure_get_threads returns the number of threads that work on a call
+  (always 1 without pthreads).
+ */
+
+void jerasure_set_threads(int threads);
+int jerasure_get_threads();
+
+void jerasure_parallel_matrix_encode(int k, int m, int w, int *matrix,
+                                     char **data_ptrs, char **coding_ptrs, int size);
+void jerasure_parallel_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
+                                        char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+void jerasure_parallel_schedule_encode(int k, int m, int w, int **schedule,
+                                       char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+
+int jerasure_parallel_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int *erasures,
+                                    char **data_ptrs, char **coding_ptrs, int size);
+int jerasure_parallel_bitmatrix_decode(int k, int m, int w, int *bitmatrix, int row_k_ones, int *erasures,
+                                       char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+int jerasure_parallel_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *erasures,
+                                           char **data_ptrs, char **coding_ptrs, int size, int packetsize,
+                                           int smart);
+
+/* ------------------------------------------------------------ */
+/* Compiled schedules ----------------------------------------- */
+/*
+  On x86-64 CPUs with AVX2, a flat schedule may be compiled, for one
+  packetsize, into machine code that runs it without interpreting it.
+  Each run of operations on one destination packet becomes a loop that
+  keeps up to 256 bytes of the packet in registers, loads or XORs every
+  source into them, and stores them once.  Where the schedule cannot be
+  compiled (on other CPUs or with --disable-sse, when the region kernel
+  is set below GALOIS_KERNEL_AVX2, when packetsize is not a multiple of
+  32, or when executable memory cannot be mapped), a compiled schedule is
+  simply interpreted.  Either way, the results and stats are the same as
+  jerasure_do_flat_scheduled_operations.
+
+  jerasure_jit_compile_flat_schedule compiles a copy of schedule for
+         packetsize.  It returns NULL only if memory runs out.
+
+  jerasure_jit_schedule_is_native returns 1 if the schedule was compiled
+         to machine code, and 0 if it is interpreted.
+
+  jerasure_jit_schedule_encode works like jerasure_flat_schedule_encode,
+         with the packetsize of the compiled schedule.
+
+  jerasure_do_jit_scheduled_operations works like
+         jerasure_do_flat_scheduled_operations.
+
+  jerasure_free_jit_schedule frees a compiled schedule.
+
+  jerasure_set_jit(0) makes jerasure_jit_compile_flat_schedule interpret
+         the schedules that it compiles from then on (for testing and
+         benchmarking), and jerasure_set_jit(1), the default, turns the
+         compiler back on.  jerasure_get_jit returns the setting.
+
+  Plans of the schedule technique compile their encoding schedule, and
+  lazy schedule caches compile each decoding schedule for the packetsize
+  of the decode that builds it.  A compiled schedule may be run by any
+  number of threads at once.
+ */
+
+typedef struct jerasure_jit_schedule jerasure_jit_schedule_t;
+
+jerasure_jit_schedule_t *jerasure_jit_compile_flat_schedule(jerasure_flat_schedule_t *schedule,
+                                                            int packetsize);
+int jerasure_jit_schedule_is_native(jerasure_jit_schedule_t *jit);
+void jerasure_jit_schedule_encode(int k, int m, int w, jerasure_jit_schedule_t *jit,
+                                  char **data_ptrs, char **coding_ptrs, int size);
+void jerasure_do_jit_scheduled_operations(char **ptrs, jerasure_jit_schedule_t *jit);
+void jerasure_free_jit_schedule(jerasure_jit_schedule_t *jit);
+void jerasure_set_jit(int enable);
+int jerasure_get_jit();
+
+/* ------------------------------------------------------------ */
+/* Codec plans ------------------------------------------------ */
+/*
+  A plan is built once for a code, and does all of the set-up of encoding
+  and decoding up front:  it copies the matrix or bitmatrix, builds the
+  schedules and the multiplication tables, and allocates all of the
+  scratch.  jerasure_plan_encode and jerasure_plan_decode then allocate
+  no memory, except to add the decoding matrix of a new erasure pattern
+  to the decoding matrix cache.  The decoding matrix (or schedule) of the
+  last erasure pattern is also kept in the plan, so a run of decodes with
+  the same erasures does no set-up at all.
+
+  technique is one of:
+
+     JERASURE_PLAN_MATRIX    - matrix is an m X k matrix, w = 8|16|32.
+     JERASURE_PLAN_BITMATRIX - bitmatrix, or if it is NULL, matrix
+                               converted to a bitmatrix.
+     JERASURE_PLAN_SCHEDULE  - the same, coded with schedules:  common
+                               subexpression schedules to encode, and
+                               smart schedules to decode, compiled (see
+                               above) for packetsize.
+                               The decoding schedule of an erasure pattern
+                               is built (and allocated) by the first decode
+                               that sees it, and kept in a lazy schedule
+                               cache (see above) of the plan.
+
+  packetsize is only used by the bitmatrix techniques.  Whether the first
+  row is all ones (identity matrices) is detected by the plan.
+
+  jerasure_plan_create returns NULL if the parameters are bad or memory
+  runs out.  jerasure_plan_encode and jerasure_plan_decode return 0, or -1
+  if size does not suit the plan, there are too many erasures, or the
+  decoding matrix is not invertible.
+
+  A plan may only be used by one thread at a time.
+
+  jerasure_plan_create_with_context makes a plan that does all of its
+  arithmetic in the fields of a galois context (see galois.h):  encoding,
+  inverting decoding matrices, and turning matrix into a bitmatrix, so
+  that matrix must be a coding matrix in those fields.  With ctx == NULL,
+  it is jerasure_plan_create.  The context must not be freed, or its
+  fields changed, while the plan exists.
+
+  jerasure_plan_encode_batch encodes nstripes independent stripes with
+  the plan, on the threads of jerasure_set_threads (see "Parallel encoding
+  and decoding" above).  Each jerasure_stripe_t has its own data_ptrs,
+  coding_ptrs and size.  Stripes of up to 64K are encoded whole, several
+  at a time by one thread, and bigger ones are cut into slices of about
+  64K;
+  idle threads steal work from busy ones.  It returns once every stripe
+  is done, with the status of each in its status field:  0, or -1 if its
+  size does not suit the plan or memory ran out.  The return value is
+  the number of stripes that failed.  While it runs, the plan may not be
+  used by any other thread.
+ */
+
+#define JERASURE_PLAN_MATRIX 0
+#define JERASURE_PLAN_BITMATRIX 1
+#define JERASURE_PLAN_SCHEDULE 2
+
+typedef struct jerasure_plan jerasure_plan_t;
+
+jerasure_plan_t *jerasure_plan_create(int k, int m, int w, int technique,
+                                      int *matrix, int *bitmatrix, int packetsize);
+
+jerasure_plan_t *jerasure_plan_create_with_context(galois_context_t *ctx, int k, int m, int w,
+                                                   int technique, int *matrix, int *bitmatrix,
+                                                   int packetsize);
+
+int jerasure_plan_encode(jerasure_plan_t *plan, char **data_ptrs, char **coding_ptrs, int size);
+
+typedef struct {
+  char **data_ptrs;
+  char **coding_ptrs;
+  int size;
+  int status;               /* Set by jerasure_plan_encode_batch */
+} jerasure_stripe_t;
+
+int jerasure_plan_encode_batch(jerasure_plan_t *plan, jerasure_stripe_t *stripes, int nstripes);
+
+int jerasure_plan_decode(jerasure_plan_t *plan, int *erasures,
+                         char **data_ptrs, char **coding_ptrs, int size);
+
+void jerasure_plan_free(jerasure_plan_t *plan);
+
+/* ------------------------------------------------------------ */
+/* Profiles --------------------------------------------------- */
+/*
+  A profile is a file with everything that a (k, m, w) code needs to
+  encode and decode, computed ahead of time:  the matrix and/or bitmatrix,
+  the encoding schedule, and for every set of up to max_erasures
+  erasures, the decoding schedule (if there is a bitmatrix) and the
+  decoding matrix (if there is a matrix and w = 8|16|32).  A profile is
+  loaded with one read-only mmap and no parsing, so loading is instant,
+  and every process that maps it shares the same pages.  The format is
+  versioned; profiles of another version or byte order are rejected.
+
+  jerasure_write_profile writes a profile to path (by way of path.tmp,
+         which is renamed when complete).  Either matrix or bitmatrix may
+         be NULL.  smart picks the kind of schedules.  max_erasures
+         (0 to m) bounds the patterns that are precomputed:  there are
+         C(k+m, 1) + ... + C(k+m, max_erasures) of them.  Returns 0 or -1.
+
+  jerasure_map_profile maps a profile, and returns NULL if it cannot be
+         read or is not a valid profile, which includes an encoding
+         schedule with an operation outside of the code's devices and
+         packets, and a matrix with a coefficient outside of GF(2^w).  The patterns are only checked the first time they are
+         used:  one that is damaged is refused like one that the profile
+         does not hold.  jerasure_unmap_profile unmaps it.
+
+  jerasure_get_profile_info fills in four ints:  k, m, w, max_erasures.
+
+  jerasure_profile_matrix and jerasure_profile_bitmatrix return the
+         profile's matrices, or NULL.  These, and the schedules below,
+         point into the mapping:  they are read-only, and must not be
+         freed.
+
+  jerasure_profile_encoding_schedule and jerasure_profile_decoding_schedule
+         fill in a flat schedule, and return 0, or -1 if the profile does
+         not hold it (no bitmatrix, more than max_erasures erasures, or
+         the erasures cannot be decoded).
+
+  jerasure_profile_schedule_encode and jerasure_profile_schedule_decode
+         work like jerasure_flat_schedule_encode and
+         jerasure_schedule_decode_lazy, with the profile's schedules.
+
+  jerasure_profile_matrix_decode works like jerasure_matrix_decode with
+         row_k_ones = 0, with the profile's decoding matrices.
+
+  The decoders return -1 if the profile does not hold the erasures, so
+  that the caller may fall back to the regular decoders.  A mapped
+  profile may be used by any number of threads at once.
+ */
+
+typedef struct jerasure_profile jerasure_profile_t;
+
+int jerasure_write_profile(const char *path, int k, int m, int w, int *matrix, int *bitmatrix,
+                           int smart, int max_erasures);
+
+jerasure_profile_t *jerasure_map_profile(const char *path);
+void jerasure_unmap_profile(jerasure_profile_t *profile);
+void jerasure_get_profile_info(jerasure_profile_t *profile, int *fill_in);
+
+int *jerasure_profile_matrix(jerasure_profile_t *profile);
+int *jerasure_profile_bitmatrix(jerasure_profile_t *profile);
+int jerasure_profile_encoding_schedule(jerasure_profile_t *profile, jerasure_flat_schedule_t *fill_in);
+int jerasure_profile_decoding_schedule(jerasure_profile_t *profile, int *erasures,
+                                       jerasure_flat_schedule_t *fill_in);
+
+void jerasure_profile_schedule_encode(jerasure_profile_t *profile, char **data_ptrs, char **coding_ptrs,
+                                      int size, int packetsize);
+int jerasure_profile_schedule_decode(jerasure_profile_t *profile, int *erasures,
+                                     char **data_ptrs, char **coding_ptrs, int size, int packetsize);
+int jerasure_profile_matrix_decode(jerasure_profile_t *profile, int *erasures,
+                                   char **data_ptrs, char **coding_ptrs, int size);
 
 int jerasure_autoconf_test();
 
@@ -0,0 +1,99 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifndef _JERASURE_FIXED_H
+#define _JERASURE_FIXED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fixed codes ------------------------------------------------ */
+/*
+  libJerasure_fixed holds codes whose technique, k, m, w and packetsize
+  were fixed when Jerasure was built, with
+
+      ./configure --with-fixed-codes="technique:k:m:w:packetsize ..."
+
+  At build time, jerasure_codegen turns the smart schedules of each code
+  (the encoding schedule, and the decoding schedule of every set of up to
+  m erasures) into C, with one loop of constant length for each packet
+  that a schedule writes, which the compiler unrolls and vectorizes.
+  There is nothing left to interpret or look up when a fixed code runs,
+  and the library does not need libJerasure or gf_complete.
+
+  The techniques are those of the encoder example:  reed_sol_van (whose
+  matrix is turned into a bitmatrix), cauchy_orig, cauchy_good,
+  liberation, blaum_roth and liber8tion.
+
+  jerasure_fixed_codes is the array of the jerasure_fixed_ncodes codes.
+
+  jerasure_fixed_find returns the code with these parameters, or NULL.
+
+  encode and decode work like jerasure_schedule_encode and
+         jerasure_schedule_decode_lazy, and produce the same bytes.  size
+         must be a multiple of w*packetsize.  They return 0, or -1 if size
+         is not, if the erasures are not valid, or there are more than m
+         of them, or they cannot be decoded.  They do not add to
+         jerasure_get_stats().
+
+  bitmatrix is the code's mw X kw coding bitmatrix, for use with the rest
+         of Jerasure.
+ */
+
+typedef struct {
+  const char *technique;
+  int k, m, w, packetsize;
+  const int *bitmatrix;
+  int (*encode)(char **data_ptrs, char **coding_ptrs, int size);
+  int (*decode)(int *erasures, char **data_ptrs, char **coding_ptrs, int size);
+} jerasure_fixed_code_t;
+
+extern const jerasure_fixed_code_t jerasure_fixed_codes[];
+extern const int jerasure_fixed_ncodes;
+
+const jerasure_fixed_code_t *jerasure_fixed_find(const char *technique, int k, int m, int w,
+                                                 int packetsize);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -48,6 +48,22 @@ extern int *reed_sol_extended_vandermonde_matrix(int rows, int cols, int w);
 extern int *reed_sol_big_vandermonde_distribution_matrix(int rows, int cols, int w);
 
 extern int reed_sol_r6_encode(int k, int w, char **data_ptrs, char **coding_ptrs, int size);
+
+/* Decodes up to two erasures of a reed_sol_r6_encode() stripe, in closed
+   form, without matrix inversion or allocation.  erasures is terminated
+   by -1, as in jerasure_matrix_decode, and ids k and k+1 are P and Q.
+   Returns 0 on success, and -1 if the erasures cannot be decoded. */
+
+extern int reed_sol_r6_decode(int k, int w, int *erasures, char **data_ptrs, char **coding_ptrs, int size);
+
+/* Triple parity (m = 3), with coding rows 1, 2^i and 4^i, for k < 2^w.
+   Encoding is a single pass over the data, and reed_sol_r7_decode
+   decodes any three erasures (ids k, k+1 and k+2 are P, Q and R) without
+   allocation, returning 0 on success and -1 otherwise. */
+
+extern int *reed_sol_r7_coding_matrix(int k, int w);
+extern int reed_sol_r7_encode(int k, int w, char **data_ptrs, char **coding_ptrs, int size);
+extern int reed_sol_r7_decode(int k, int w, int *erasures, char **data_ptrs, char **coding_ptrs, int size);
 extern int *reed_sol_r6_coding_matrix(int k, int w);
 
 extern void reed_sol_galois_w08_region_multby_2(char *region, int nbytes);
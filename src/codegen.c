@@ -0,0 +1,401 @@
+/* *
+ * Copyright (c) 2014, James S. Plank and Kevin Greenan
+ * All rights reserved.
+ *
+ * Jerasure - A C/C++ Library for a Variety of Reed-Solomon and RAID-6 Erasure
+ * Coding Techniques
+ *
+ * Revision 2.0: Galois Field backend now links to GF-Complete
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  - Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  - Neither the name of the University of Tennessee nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* jerasure_codegen generates the C of libJerasure_fixed (see
+   jerasure_fixed.h):
+
+     jerasure_codegen output.c technique:k:m:w:packetsize ...
+
+   Each code becomes static functions named after it, such as
+   cauchy_good_6_3_8_2048_encode_block.  The _block functions run one
+   schedule on one w*packetsize block of each device, d[] and c[]:
+   _encode_block runs the smart encoding schedule, and _decode_r runs the
+   smart decoding schedule of the set of erasures with rank r.  The
+   operations on one packet become one loop, which XORs all of the sources
+   of the packet into it.  The sets of erasures are ranked like the
+   patterns of profiles:  the sets of fewer erasures first, and then the
+   sorted set c[0] < ... < c[e-1] at sum C(c[i], i+1).  _encode and
+   _decode loop over the blocks, and are the functions of the code in
+   jerasure_fixed_codes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jerasure.h"
+#include "reed_sol.h"
+#include "cauchy.h"
+#include "liberation.h"
+
+#define talloc(type, num) (type *) malloc(sizeof(type)*(num))
+
+#define CODEGEN_MAX_NAME 128
+
+typedef struct {
+  char technique[32];
+  char name[CODEGEN_MAX_NAME];
+  int k, m, w, packetsize;
+  int *bitmatrix;
+} codegen_code;
+
+static int codegen_is_prime(int w)
+{
+  int i;
+
+  if (w < 2) return 0;
+  for (i = 2; i*i <= w; i++) if (w % i == 0) return 0;
+  return 1;
+}
+
+/* Makes the coding bitmatrix of c, or returns NULL if the technique does
+   not exist or does not allow c's parameters. */
+
+static int *codegen_bitmatrix(codegen_code *c)
+{
+  int *matrix, *bitmatrix;
+  int k, m, w;
+
+  k = c->k;
+  m = c->m;
+  w = c->w;
+  if (k <= 0 || m <= 0 || w <= 0 || w > 32) return NULL;
+  if (w < 32 && k+m > (1 << w)) return NULL;
+  if (strcmp(c->technique, "reed_sol_van") == 0) {
+    matrix = reed_sol_vandermonde_coding_matrix(k, m, w);
+  } else if (strcmp(c->technique, "cauchy_orig") == 0) {
+    matrix = cauchy_original_coding_matrix(k, m, w);
+  } else if (strcmp(c->technique, "cauchy_good") == 0) {
+    matrix = cauchy_good_general_coding_matrix(k, m, w);
+  } else if (strcmp(c->technique, "liberation") == 0) {
+    if (m != 2 || k > w || w <= 2 || !codegen_is_prime(w)) return NULL;
+    return liberation_coding_bitmatrix(k, w);
+  } else if (strcmp(c->technique, "blaum_roth") == 0) {
+    if (m != 2 || k > w || w <= 2 || !codegen_is_prime(w+1)) return NULL;
+    return blaum_roth_coding_bitmatrix(k, w);
+  } else if (strcmp(c->technique, "liber8tion") == 0) {
+    if (m != 2 || k > w || w != 8) return NULL;
+    return liber8tion_coding_bitmatrix(k);
+  } else {
+    return NULL;
+  }
+  if (matrix == NULL) return NULL;
+  bitmatrix = jerasure_matrix_to_bitmatrix(k, m, w, matrix);
+  free(matrix);
+  return bitmatrix;
+}
+
+static long codegen_binomial(int n, int r)
+{
+  long b;
+  int i;
+
+  if (r < 0 || r > n) return 0;
+  b = 1;
+  for (i = 1; i <= r; i++) b = b * (n-r+i) / i;
+  return b;
+}
+
+/* The loop of one run of operations on the packet dest.  If assign is 0,
+   the sources are XOR'd into it. */
+
+static void codegen_loop(FILE *f, const char *dest, int assign, char **srcs, int n, int packetsize)
+{
+  int i;
+
+  if (n == 0) return;
+  fprintf(f, "  {\n");
+  fprintf(f, "    unsigned char *restrict o = (unsigned char *) %s;\n", dest);
+  for (i = 0; i < n; i++) {
+    fprintf(f, "    const unsigned char *s%d = (const unsigned char *) %s;\n", i, srcs[i]);
+  }
+  fprintf(f, "\n    for (i = 0; i < %d; i++) o[i] %s s0[i]", packetsize, assign ? "=" : "^=");
+  for (i = 1; i < n; i++) fprintf(f, " ^ s%d[i]", i);
+  fprintf(f, ";\n  }\n");
+}
+
+/* Emits fname(d, c), which runs schedule on one block.  devs[i] is the
+   pointer expression of device i of the schedule. */
+
+static void codegen_schedule(FILE *f, const char *fname, jerasure_flat_schedule_t *s,
+                             char (*devs)[16], int packetsize)
+{
+  jerasure_schedule_op_t *o, *end;
+  char dest[48], **srcs;
+  int i, n, assign;
+
+  srcs = talloc(char *, s->nops);
+  for (i = 0; i < s->nops; i++) srcs[i] = talloc(char, 48);
+  fprintf(f, "static void %s(char **d, char **c)\n{\n  int i;\n\n", fname);
+  end = s->ops + s->nops;
+  o = s->ops;
+  while (o < end) {
+    sprintf(dest, "%s + %d", devs[o->to_dev], o->to_pkt*packetsize);
+    n = 0;
+    assign = 0;
+    for (i = 0; o+i < end && o[i].to_dev == o->to_dev && o[i].to_pkt == o->to_pkt; i++) {
+      if (o[i].from_dev == o[i].to_dev && o[i].from_pkt == o[i].to_pkt) {
+        codegen_loop(f, dest, assign, srcs, n, packetsize);
+        if (o[i].op) fprintf(f, "  memset(%s, 0, %d);\n", dest, packetsize);
+        n = 0;
+        assign = 0;
+        continue;
+      }
+      if (!o[i].op) {
+        n = 0;
+        assign = 1;
+      }
+      sprintf(srcs[n++], "%s + %d", devs[o[i].from_dev], o[i].from_pkt*packetsize);
+    }
+    codegen_loop(f, dest, assign, srcs, n, packetsize);
+    o += i;
+  }
+  fprintf(f, "}\n\n");
+  for (i = 0; i < s->nops; i++) free(srcs[i]);
+  free(srcs);
+}
+
+/* Emits the functions of code c, or returns -1 if its schedules cannot be
+   made. */
+
+static int codegen_code_functions(FILE *f, codegen_code *c)
+{
+  jerasure_flat_schedule_t *s;
+  char (*devs)[16];
+  char fname[CODEGEN_MAX_NAME+32];
+  int *list, *erased, *ok;
+  int k, m, n, e, i, j, x;
+  long rank, npatterns, base;
+
+  k = c->k;
+  m = c->m;
+  n = k+m;
+  fprintf(f, "/* %s k=%d m=%d w=%d packetsize=%d */\n\n", c->technique, k, m, c->w, c->packetsize);
+  fprintf(f, "static const int %s_bitmatrix[%d] = {", c->name, k*m*c->w*c->w);
+  for (i = 0; i < k*m*c->w*c->w; i++) {
+    fprintf(f, "%s%d,", (i % 32 == 0) ? "\n  " : " ", c->bitmatrix[i]);
+  }
+  fprintf(f, "\n};\n\n");
+
+  devs = (char (*)[16]) malloc(16*n);
+  for (i = 0; i < k; i++) sprintf(devs[i], "d[%d]", i);
+  for (i = 0; i < m; i++) sprintf(devs[k+i], "c[%d]", i);
+  s = jerasure_smart_bitmatrix_to_flat_schedule(k, m, c->w, c->bitmatrix);
+  if (s == NULL || s->ntdevs > 0) return -1;
+  sprintf(fname, "%s_encode_block", c->name);
+  codegen_schedule(f, fname, s, devs, c->packetsize);
+  jerasure_free_flat_schedule(s);
+
+  /* Every set of up to m erasures, in order of rank:  list holds the
+     erasures, and is advanced like an odometer, in colex order. */
+
+  npatterns = 0;
+  for (e = 1; e <= m; e++) npatterns += codegen_binomial(n, e);
+  ok = talloc(int, npatterns);
+  list = talloc(int, m+1);
+  erased = talloc(int, n);
+  rank = 0;
+  for (e = 1; e <= m; e++) {
+    base = rank;
+    for (i = 0; i < e; i++) list[i] = i;
+    while (1) {
+      list[e] = -1;
+      for (i = 0; i < n; i++) erased[i] = 0;
+      for (i = 0; i < e; i++) erased[list[i]] = 1;
+      j = k;
+      x = k;
+      for (i = 0; i < k; i++) {
+        if (!erased[i]) {
+          sprintf(devs[i], "d[%d]", i);
+        } else {
+          while (j < n && erased[j]) j++;
+          sprintf(devs[i], "c[%d]", j-k);
+          j++;
+          sprintf(devs[x++], "d[%d]", i);
+        }
+      }
+      for (i = k; i < n; i++) if (erased[i]) sprintf(devs[x++], "c[%d]", i-k);
+
+      ok[rank] = 0;
+      if (j <= n) {
+        s = jerasure_generate_flat_decoding_schedule(k, m, c->w, c->bitmatrix, list, JERASURE_SCHEDULE_SMART);
+        if (s != NULL && s->ntdevs == 0) {
+          sprintf(fname, "%s_decode_%ld", c->name, rank);
+          codegen_schedule(f, fname, s, devs, c->packetsize);
+          ok[rank] = 1;
+        }
+        if (s != NULL) jerasure_free_flat_schedule(s);
+      }
+      rank++;
+
+      for (i = 0; i < e-1 && list[i]+1 == list[i+1]; i++) list[i] = i;
+      if (i == e-1 && list[i]+1 == n) break;
+      list[i]++;
+    }
+    if (rank - base != codegen_binomial(n, e)) return -1;
+  }
+
+  fprintf(f, "static void (*const %s_decoders[%ld])(char **d, char **c) = {\n", c->name, npatterns);
+  for (rank = 0; rank < npatterns; rank++) {
+    if (ok[rank]) {
+      fprintf(f, "  %s_decode_%ld,\n", c->name, rank);
+    } else {
+      fprintf(f, "  NULL,\n");
+    }
+  }
+  fprintf(f, "};\n\n");
+
+  fprintf(f, "static int %s_encode(char **data_ptrs, char **coding_ptrs, int size)\n", c->name);
+  fprintf(f, "{\n  char *d[%d], *c[%d];\n  int i, off;\n\n", k, m);
+  fprintf(f, "  if (size < 0 || size %% %d != 0) return -1;\n", c->w*c->packetsize);
+  fprintf(f, "  for (off = 0; off < size; off += %d) {\n", c->w*c->packetsize);
+  fprintf(f, "    for (i = 0; i < %d; i++) d[i] = data_ptrs[i] + off;\n", k);
+  fprintf(f, "    for (i = 0; i < %d; i++) c[i] = coding_ptrs[i] + off;\n", m);
+  fprintf(f, "    %s_encode_block(d, c);\n  }\n  return 0;\n}\n\n", c->name);
+
+  fprintf(f, "static int %s_decode(int *erasures, char **data_ptrs, char **coding_ptrs, int size)\n", c->name);
+  fprintf(f, "{\n  void (*block)(char **d, char **c);\n  char *d[%d], *c[%d];\n  long r;\n  int i, off;\n\n", k, m);
+  fprintf(f, "  if (size < 0 || size %% %d != 0) return -1;\n", c->w*c->packetsize);
+  fprintf(f, "  if (erasures[0] == -1) return 0;\n");
+  fprintf(f, "  r = jerasure_fixed_rank(%d, %d, erasures);\n", n, m);
+  fprintf(f, "  if (r < 0 || %s_decoders[r] == NULL) return -1;\n", c->name);
+  fprintf(f, "  block = %s_decoders[r];\n", c->name);
+  fprintf(f, "  for (off = 0; off < size; off += %d) {\n", c->w*c->packetsize);
+  fprintf(f, "    for (i = 0; i < %d; i++) d[i] = data_ptrs[i] + off;\n", k);
+  fprintf(f, "    for (i = 0; i < %d; i++) c[i] = coding_ptrs[i] + off;\n", m);
+  fprintf(f, "    block(d, c);\n  }\n  return 0;\n}\n\n");
+
+  free(ok);
+  free(list);
+  free(erased);
+  free(devs);
+  return 0;
+}
+
+static const char *codegen_rank =
+  "/* Returns the rank of the erasures among the sets of 1 to m of the n\n"
+  "   devices, or -1 if they are not valid or there are more than m. */\n"
+  "\n"
+  "static long jerasure_fixed_rank(int n, int m, int *erasures)\n"
+  "{\n"
+  "  int c[JERASURE_FIXED_MAX_M];\n"
+  "  long rank, b;\n"
+  "  int e, i, t;\n"
+  "\n"
+  "  for (e = 0; erasures[e] != -1; e++) {\n"
+  "    if (e == m || erasures[e] < 0 || erasures[e] >= n) return -1;\n"
+  "    for (i = e; i > 0 && c[i-1] > erasures[e]; i--) c[i] = c[i-1];\n"
+  "    if (i > 0 && c[i-1] == erasures[e]) return -1;\n"
+  "    c[i] = erasures[e];\n"
+  "  }\n"
+  "  rank = 0;\n"
+  "  for (i = 1; i < e; i++) {\n"
+  "    for (b = 1, t = 1; t <= i; t++) b = b * (n-i+t) / t;\n"
+  "    rank += b;\n"
+  "  }\n"
+  "  for (i = 0; i < e; i++) {\n"
+  "    if (c[i] < i+1) continue;\n"
+  "    for (b = 1, t = 1; t <= i+1; t++) b = b * (c[i]-i-1+t) / t;\n"
+  "    rank += b;\n"
+  "  }\n"
+  "  return rank;\n"
+  "}\n\n";
+
+int main(int argc, char **argv)
+{
+  codegen_code *codes;
+  FILE *f;
+  int i, ncodes, maxm;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: jerasure_codegen output.c technique:k:m:w:packetsize ...\n");
+    exit(1);
+  }
+  ncodes = argc-2;
+  codes = talloc(codegen_code, ncodes);
+  maxm = 0;
+  for (i = 0; i < ncodes; i++) {
+    if (sscanf(argv[i+2], "%31[a-z_0-9]:%d:%d:%d:%d", codes[i].technique, &codes[i].k, &codes[i].m,
+               &codes[i].w, &codes[i].packetsize) != 5 ||
+        codes[i].packetsize <= 0 || codes[i].packetsize % sizeof(long) != 0 ||
+        (codes[i].bitmatrix = codegen_bitmatrix(codes + i)) == NULL) {
+      fprintf(stderr, "jerasure_codegen: bad code %s\n", argv[i+2]);
+      exit(1);
+    }
+    sprintf(codes[i].name, "%s_%d_%d_%d_%d", codes[i].technique, codes[i].k, codes[i].m,
+            codes[i].w, codes[i].packetsize);
+    if (codes[i].m > maxm) maxm = codes[i].m;
+  }
+
+  f = fopen(argv[1], "w");
+  if (f == NULL) {
+    perror(argv[1]);
+    exit(1);
+  }
+  fprintf(f, "/* Generated by jerasure_codegen.  Do not edit. */\n\n");
+  fprintf(f, "#include <stddef.h>\n#include <string.h>\n#include \"jerasure_fixed.h\"\n\n");
+  fprintf(f, "#define JERASURE_FIXED_MAX_M %d\n\n", maxm);
+  fputs(codegen_rank, f);
+  for (i = 0; i < ncodes; i++) {
+    if (codegen_code_functions(f, codes + i) < 0) {
+      fprintf(stderr, "jerasure_codegen: cannot make the schedules of %s\n", argv[i+2]);
+      fclose(f);
+      remove(argv[1]);
+      exit(1);
+    }
+  }
+
+  fprintf(f, "const jerasure_fixed_code_t jerasure_fixed_codes[%d] = {\n", ncodes);
+  for (i = 0; i < ncodes; i++) {
+    fprintf(f, "  { \"%s\", %d, %d, %d, %d,\n    %s_bitmatrix, %s_encode, %s_decode },\n",
+            codes[i].technique, codes[i].k, codes[i].m, codes[i].w, codes[i].packetsize,
+            codes[i].name, codes[i].name, codes[i].name);
+  }
+  fprintf(f, "};\n\nconst int jerasure_fixed_ncodes = %d;\n\n", ncodes);
+  fprintf(f, "const jerasure_fixed_code_t *jerasure_fixed_find(const char *technique, int k, int m, int w,\n");
+  fprintf(f, "                                                 int packetsize)\n{\n");
+  fprintf(f, "  const jerasure_fixed_code_t *c;\n  int i;\n\n");
+  fprintf(f, "  for (i = 0; i < jerasure_fixed_ncodes; i++) {\n");
+  fprintf(f, "    c = jerasure_fixed_codes + i;\n");
+  fprintf(f, "    if (strcmp(c->technique, technique) == 0 && c->k == k && c->m == m && c->w == w &&\n");
+  fprintf(f, "        c->packetsize == packetsize) return c;\n  }\n  return NULL;\n}\n");
+  if (fclose(f) != 0) {
+    perror(argv[1]);
+    exit(1);
+  }
+  return 0;
+}
@@ -52,14 +52,277 @@
 
 #include "galois.h"
 
+#if !defined(JERASURE_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GALOIS_X86_KERNELS
+#define GALOIS_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
+#ifdef JERASURE_PTHREADS
+#include <pthread.h>
+#endif
+
 #define MAX_GF_INSTANCES 64
-gf_t *gfp_array[MAX_GF_INSTANCES] = { 0 };
 int  gfp_is_composite[MAX_GF_INSTANCES] = { 0 };
 
+/* Native region kernels.  galois_kernel is the instruction set picked by
+   cpuid the first time a default field is set up (-1 until then).  The
+   native kernels for a given w are only used while the field of w is the
+   default field (native == 1 in its galois_field_t), because fields
+   installed with galois_change_technique() may use a different region
+   layout (ALTMAP, CAUCHY).
+
+   galois_w08_tables[c] holds the split-nibble products of c: bytes 0-15
+   are c*x for x = 0..15, and bytes 16-31 are c*(x<<4).  They only depend
+   on the default field, so they are built once, the first time that it is
+   set up, and never change after that. */
+
+static int galois_kernel = -1;
+static int galois_w08_tables_built = 0;
+static unsigned char galois_w08_tables[256][32];
+
+/* Logarithm tables, for w <= 16.  exp[i] is g^i, where g generates the
+   nonzero elements of the field, for i up to 2(2^w-1)-1, so that the sum
+   of two logarithms needs no modulus, and log[x] is the i with g^i = x.
+   They belong to the galois_field_t that they were built from. */
+
+#define GALOIS_MAX_LOG_W 16
+
+/* The field registry.
+
+   galois_fields[w] is the field used for w, together with everything that
+   is built from it.  A field is set up completely before it is published
+   in galois_fields[w] with a release store, so finding it is one acquire
+   load.  The default field of w is set up once, under
+   galois_registry_mutex, by the first thread that finds it missing.
+
+   galois_change_technique() and galois_uninit_field() replace
+   galois_fields[w], and the old field is freed with epoch-based
+   reclamation.  Every galois_* call that uses a field does so inside a
+   read section (galois_read_lock()), which records the global epoch in the
+   thread's galois_reader_t.  A field that is replaced goes on the retired
+   list, tagged with the current epoch, and the epoch is advanced.  Read
+   sections that start after that can only see the new field, so the old
+   one is freed, by a later change, once no thread is in a read section
+   that started in or before its epoch.  Readers never take a lock or wait;
+   only changes of field, and the first use of a field or by a thread,
+   take galois_registry_mutex.
+
+   galois_kernel may also be changed while other threads are using it, so
+   it is read and written with relaxed atomics:  every kernel gives the
+   same products, so a call that sees the old one is still right.
+
+   Without GCC's atomic builtins, the loads and stores are plain ones, and
+   the registry is only safe in one thread. */
+
+#if defined(__GNUC__)
+#define GALOIS_LOAD(x)      __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define GALOIS_STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define GALOIS_FENCE()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define GALOIS_ADD(x, v)    __atomic_add_fetch(&(x), (v), __ATOMIC_RELAXED)
+#define GALOIS_RELAXED_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define GALOIS_RELAXED_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define GALOIS_THREAD_LOCAL __thread
+#else
+#define GALOIS_LOAD(x)      (x)
+#define GALOIS_STORE(x, v)  ((x) = (v))
+#define GALOIS_FENCE()
+#define GALOIS_ADD(x, v)    ((x) += (v))
+#define GALOIS_RELAXED_LOAD(x)     (x)
+#define GALOIS_RELAXED_STORE(x, v) ((x) = (v))
+#define GALOIS_THREAD_LOCAL
+#endif
+
+#ifdef JERASURE_PTHREADS
+static pthread_mutex_t galois_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t galois_reader_key;
+static int galois_reader_key_made = 0;
+#define GALOIS_LOCK() pthread_mutex_lock(&galois_registry_mutex)
+#define GALOIS_UNLOCK() pthread_mutex_unlock(&galois_registry_mutex)
+#else
+#define GALOIS_LOCK()
+#define GALOIS_UNLOCK()
+#endif
+
+typedef struct galois_field {
+  gf_t *gf;
+  int w;
+  int recursive;              /* gf_free()'s recursive argument */
+  int owned;                  /* gf was allocated by galois_init_default_field() */
+  int native;                 /* The default field:  native kernels may be used */
+  uint16_t *log, *exp;        /* NULL if there are no log tables */
+  unsigned long epoch;        /* Epoch in which it was retired */
+  struct galois_field *next;  /* On the retired list */
+} galois_field_t;
+
+/* One for each thread that has used a field.  epoch is 0 outside read
+   sections, and depth (the nesting of read sections) is only used by the
+   thread itself.  The padding keeps the epochs of two threads out of one
+   cache line.  The readers of threads that have exited are reused. */
+
+typedef struct galois_reader {
+  unsigned long epoch;
+  int depth;
+  int in_use;
+  struct galois_reader *next;
+  char pad[64];
+} galois_reader_t;
+
+static galois_field_t *galois_fields[MAX_GF_INSTANCES];
+static galois_field_t *galois_retired = NULL;
+static galois_reader_t *galois_readers = NULL;
+static unsigned long galois_epoch = 1;
+static GALOIS_THREAD_LOCAL galois_reader_t *galois_self = NULL;
+
+#ifdef JERASURE_PTHREADS
+static void galois_reader_exit(void *arg)
+{
+  galois_reader_t *r;
+
+  r = (galois_reader_t *) arg;
+  GALOIS_LOCK();
+  r->depth = 0;
+  GALOIS_STORE(r->epoch, 0);
+  r->in_use = 0;
+  GALOIS_UNLOCK();
+  galois_self = NULL;
+}
+#endif
+
+static galois_reader_t *galois_reader_register(void)
+{
+  galois_reader_t *r;
+
+  GALOIS_LOCK();
+#ifdef JERASURE_PTHREADS
+  if (!galois_reader_key_made) {
+    if (pthread_key_create(&galois_reader_key, galois_reader_exit) != 0) {
+      fprintf(stderr, "ERROR -- cannot create the Galois field reader key\n");
+      assert(0);
+    }
+    galois_reader_key_made = 1;
+  }
+#endif
+  for (r = galois_readers; r != NULL && r->in_use; r = r->next) ;
+  if (r == NULL) {
+    r = (galois_reader_t *) malloc(sizeof(galois_reader_t));
+    if (r == NULL) {
+      fprintf(stderr, "ERROR -- cannot allocate memory for a Galois field reader\n");
+      assert(0);
+    }
+    r->epoch = 0;
+    r->next = galois_readers;
+    galois_readers = r;
+  }
+  r->in_use = 1;
+  r->depth = 0;
+  GALOIS_UNLOCK();
+#ifdef JERASURE_PTHREADS
+  pthread_setspecific(galois_reader_key, r);
+#endif
+  galois_self = r;
+  return r;
+}
+
+/* The fence orders the store of the reader's epoch before its loads of
+   galois_fields[]:  either a change that scans the readers sees the
+   epoch, or this thread sees the field that the change published. */
+
+void galois_read_lock(void)
+{
+  galois_reader_t *r;
+
+  r = galois_self;
+  if (r == NULL) r = galois_reader_register();
+  if (r->depth++ > 0) return;
+  GALOIS_STORE(r->epoch, GALOIS_LOAD(galois_epoch));
+  GALOIS_FENCE();
+}
+
+void galois_read_unlock(void)
+{
+  galois_reader_t *r;
+
+  r = galois_self;
+  if (r == NULL || r->depth <= 0) {
+    fprintf(stderr, "ERROR -- galois_read_unlock() called outside of a read section\n");
+    assert(0);
+    return;
+  }
+  if (--r->depth == 0) GALOIS_STORE(r->epoch, 0);
+}
+
+static void galois_free_field(galois_field_t *f)
+{
+  gf_free(f->gf, f->recursive);
+  if (f->owned) free(f->gf);
+  free(f->log);
+  free(f->exp);
+  free(f);
+}
+
+/* Frees the retired fields that no read section can still be using.
+   Called with galois_registry_mutex held. */
+
+static void galois_reclaim(void)
+{
+  galois_field_t *f, **prev;
+  galois_reader_t *r;
+  unsigned long oldest, e;
+
+  if (galois_retired == NULL) return;
+  GALOIS_FENCE();
+  oldest = galois_epoch;
+  for (r = galois_readers; r != NULL; r = r->next) {
+    e = GALOIS_LOAD(r->epoch);
+    if (e != 0 && e < oldest) oldest = e;
+  }
+  prev = &galois_retired;
+  while ((f = *prev) != NULL) {
+    if (f->epoch < oldest) {
+      *prev = f->next;
+      galois_free_field(f);
+    } else {
+      prev = &f->next;
+    }
+  }
+}
+
+/* The ids of galois_context_id().  galois_field_ids[w] identifies the
+   field of w of the process:  it is given a new id whenever a field is
+   replaced or removed (but not when the default field is first set up, so
+   that it stays the same until the field changes).  The ids of contexts
+   come from the same counter, so they never equal those of the process. */
+
+static unsigned long galois_context_ids = 0;
+static unsigned long galois_field_ids[MAX_GF_INSTANCES];
+
+/* Makes f (which may be NULL) the field of w, and retires the old one.
+   Called with galois_registry_mutex held. */
+
+static void galois_publish_field(int w, galois_field_t *f)
+{
+  galois_field_t *old;
+
+  old = galois_fields[w];
+  GALOIS_STORE(galois_fields[w], f);
+  if (old != NULL) {
+    GALOIS_STORE(galois_field_ids[w], GALOIS_ADD(galois_context_ids, 1));
+    old->epoch = galois_epoch;
+    old->next = galois_retired;
+    galois_retired = old;
+    GALOIS_STORE(galois_epoch, galois_epoch + 1);
+  }
+  galois_reclaim();
+}
+
 gf_t *galois_get_field_ptr(int w)
 {
-  if (gfp_array[w] != NULL) {
-    return gfp_array[w];
+  galois_field_t *f;
+
+  f = GALOIS_LOAD(galois_fields[w]);
+  if (f != NULL) {
+    return f->gf;
   }
 
   return NULL;
@@ -170,28 +433,173 @@ gf_t* galois_init_composite_field(int w,
   return gfp;
 }
 
-int galois_init_default_field(int w)
+static int galois_detect_kernel(void)
 {
-  if (gfp_array[w] == NULL) {
-    gfp_array[w] = (gf_t*)malloc(sizeof(gf_t));
-    if(gfp_array[w] == NULL)
-      return ENOMEM;
-    if (!gf_init_easy(gfp_array[w], w))
-      return EINVAL;
+#ifdef GALOIS_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) return GALOIS_KERNEL_AVX512;
+  if (__builtin_cpu_supports("avx2")) return GALOIS_KERNEL_AVX2;
+  if (__builtin_cpu_supports("ssse3")) return GALOIS_KERNEL_SSSE3;
+#endif
+  return GALOIS_KERNEL_GF_COMPLETE;
+}
+
+static void galois_w08_build_tables(gf_t *gf)
+{
+  int c, x;
+
+  for (c = 0; c < 256; c++) {
+    for (x = 0; x < 16; x++) {
+      galois_w08_tables[c][x] = gf->multiply.w32(gf, c, x);
+      galois_w08_tables[c][16+x] = gf->multiply.w32(gf, c, x << 4);
+    }
+  }
+}
+
+/* Looks for a generator g of f's field, trying 2 first (which is one when
+   the polynomial is primitive), and fills in the tables from it.  If
+   there is no memory, f has no tables. */
+
+static void galois_build_log_tables(galois_field_t *f)
+{
+  uint16_t *lg, *ex;
+  uint32_t x;
+  int q, g, i;
+
+  if (f->w > GALOIS_MAX_LOG_W) return;
+  q = (1 << f->w) - 1;
+  lg = (uint16_t *) malloc(sizeof(uint16_t)*(q+1));
+  ex = (uint16_t *) malloc(sizeof(uint16_t)*2*q);
+  if (lg == NULL || ex == NULL) {
+    free(lg);
+    free(ex);
+    return;
+  }
+  for (g = (q == 1) ? 1 : 2; g <= q; g++) {
+    x = 1;
+    for (i = 0; i < q; i++) {
+      if (i > 0 && x == 1) break;
+      ex[i] = x;
+      lg[x] = i;
+      x = f->gf->multiply.w32(f->gf, x, g);
+    }
+    if (i == q && x == 1) break;
+  }
+  if (g > q) {
+    free(lg);
+    free(ex);
+    return;
+  }
+  lg[0] = 0;
+  for (i = q; i < 2*q; i++) ex[i] = ex[i-q];
+  f->log = lg;
+  f->exp = ex;
+}
+
+/* Wraps gf in a galois_field_t, with its log tables, or returns NULL if
+   there is no memory. */
+
+static galois_field_t *galois_new_field(gf_t *gf, int w, int recursive, int owned, int native)
+{
+  galois_field_t *f;
+
+  f = (galois_field_t *) malloc(sizeof(galois_field_t));
+  if (f == NULL) return NULL;
+  f->gf = gf;
+  f->w = w;
+  f->recursive = recursive;
+  f->owned = owned;
+  f->native = native;
+  f->log = NULL;
+  f->exp = NULL;
+  f->epoch = 0;
+  f->next = NULL;
+  galois_build_log_tables(f);
+  return f;
+}
+
+int galois_region_kernel_supported(int kernel)
+{
+#ifdef GALOIS_X86_KERNELS
+  __builtin_cpu_init();
+  switch (kernel) {
+    case GALOIS_KERNEL_GF_COMPLETE: return 1;
+    case GALOIS_KERNEL_SSSE3:       return __builtin_cpu_supports("ssse3");
+    case GALOIS_KERNEL_AVX2:        return __builtin_cpu_supports("avx2");
+    case GALOIS_KERNEL_AVX512:      return __builtin_cpu_supports("avx512bw");
   }
   return 0;
+#else
+  return (kernel == GALOIS_KERNEL_GF_COMPLETE);
+#endif
 }
 
-int galois_uninit_field(int w)
+int galois_get_region_kernel(void)
 {
-  int ret = 0;
-  if (gfp_array[w] != NULL) {
-    int recursive = 1;
-    ret = gf_free(gfp_array[w], recursive);
-    free(gfp_array[w]);
-    gfp_array[w] = NULL;
+  if (GALOIS_RELAXED_LOAD(galois_kernel) < 0) {
+    GALOIS_LOCK();
+    if (galois_kernel < 0) GALOIS_RELAXED_STORE(galois_kernel, galois_detect_kernel());
+    GALOIS_UNLOCK();
   }
-  return ret;
+  return GALOIS_RELAXED_LOAD(galois_kernel);
+}
+
+int galois_set_region_kernel(int kernel)
+{
+  if (!galois_region_kernel_supported(kernel)) return -1;
+  GALOIS_LOCK();
+  GALOIS_RELAXED_STORE(galois_kernel, kernel);
+  GALOIS_UNLOCK();
+  return 0;
+}
+
+int galois_init_default_field(int w)
+{
+  galois_field_t *f;
+  gf_t *gf;
+  int rv;
+
+  if (w <= 0 || w >= MAX_GF_INSTANCES) return EINVAL;
+  if (GALOIS_LOAD(galois_fields[w]) != NULL) return 0;
+
+  rv = 0;
+  GALOIS_LOCK();
+  if (galois_fields[w] == NULL) {
+    gf = (gf_t*)malloc(sizeof(gf_t));
+    if (gf == NULL) {
+      rv = ENOMEM;
+    } else if (!gf_init_easy(gf, w)) {
+      free(gf);
+      rv = EINVAL;
+    } else {
+      if (galois_kernel < 0) GALOIS_RELAXED_STORE(galois_kernel, galois_detect_kernel());
+      if (w == 8 && !galois_w08_tables_built) {
+        galois_w08_build_tables(gf);
+        galois_w08_tables_built = 1;
+      }
+      f = galois_new_field(gf, w, 1, 1, 1);
+      if (f == NULL) {
+        gf_free(gf, 1);
+        free(gf);
+        rv = ENOMEM;
+      } else {
+        galois_publish_field(w, f);
+      }
+    }
+  }
+  GALOIS_UNLOCK();
+  return rv;
+}
+
+/* The field is freed once no read section can be using it. */
+
+int galois_uninit_field(int w)
+{
+  if (w <= 0 || w >= MAX_GF_INSTANCES) return 0;
+  GALOIS_LOCK();
+  if (galois_fields[w] != NULL) galois_publish_field(w, NULL);
+  GALOIS_UNLOCK();
+  return 0;
 }
 
 static void galois_init(int w)
@@ -213,6 +621,42 @@ static void galois_init(int w)
   }
 }
 
+/* Starts a read section and returns the field of w, which stays valid
+   until galois_read_unlock().  The loop is for another thread that
+   uninitializes the field right after it was set up. */
+
+static galois_field_t *galois_enter(int w)
+{
+  galois_field_t *f;
+
+  galois_read_lock();
+  while ((f = GALOIS_LOAD(galois_fields[w])) == NULL) galois_init(w);
+  return f;
+}
+
+/* Contexts.  A context holds fields of its own for some values of w, and
+   uses the fields of the registry for the rest.  Its fields are only
+   changed by its owner, when nobody is using the context, so they need no
+   reclamation, and are freed right away.  id is new every time a field
+   changes, so that what is cached about a context (such as decoding
+   matrices) is not mixed up with what was computed in its old fields, or
+   in another context at the same address. */
+
+struct galois_context {
+  galois_field_t *fields[MAX_GF_INSTANCES];
+  unsigned long id;
+};
+
+/* galois_enter(), with the field of w in ctx if it has one. */
+
+static galois_field_t *galois_enter_context(galois_context_t *ctx, int w)
+{
+  if (ctx != NULL && w > 0 && w < MAX_GF_INSTANCES && ctx->fields[w] != NULL) {
+    galois_read_lock();
+    return ctx->fields[w];
+  }
+  return galois_enter(w);
+}
 
 static int is_valid_gf(gf_t *gf, int w)
 {
@@ -245,6 +689,8 @@ static int is_valid_gf(gf_t *gf, int w)
 
 void galois_change_technique(gf_t *gf, int w)
 {
+  galois_field_t *f;
+
   if (w <= 0 || w > 32) {
     fprintf(stderr, "ERROR -- cannot support Galois field for w=%d\n", w);
     assert(0);
@@ -255,56 +701,991 @@ void galois_change_technique(gf_t *gf, int w)
     assert(0);
   }
 
-  if (gfp_array[w] != NULL) {
-    gf_free(gfp_array[w], gfp_is_composite[w]);
+  f = galois_new_field(gf, w, gfp_is_composite[w], 0, 0);
+  if (f == NULL) {
+    fprintf(stderr, "ERROR -- cannot allocate memory for Galois field w=%d\n", w);
+    assert(0);
   }
 
-  gfp_array[w] = gf;
+  GALOIS_LOCK();
+  galois_publish_field(w, f);
+  GALOIS_UNLOCK();
+}
+
+galois_context_t *galois_context_create(void)
+{
+  galois_context_t *ctx;
+
+  ctx = (galois_context_t *) malloc(sizeof(galois_context_t));
+  if (ctx == NULL) return NULL;
+  memset(ctx->fields, 0, sizeof(ctx->fields));
+  ctx->id = GALOIS_ADD(galois_context_ids, 1);
+  return ctx;
+}
+
+void galois_context_free(galois_context_t *ctx)
+{
+  int w;
+
+  if (ctx == NULL) return;
+  for (w = 0; w < MAX_GF_INSTANCES; w++) {
+    if (ctx->fields[w] != NULL) galois_free_field(ctx->fields[w]);
+  }
+  free(ctx);
+}
+
+int galois_context_set_field(galois_context_t *ctx, int w, gf_t *gf)
+{
+  galois_field_t *f;
+
+  if (ctx == NULL || w <= 0 || w > 32) return -1;
+  if (gf != NULL && !is_valid_gf(gf, w)) return -1;
+
+  f = NULL;
+  if (gf != NULL) {
+    f = galois_new_field(gf, w, gfp_is_composite[w], 0, 0);
+    if (f == NULL) return -1;
+  }
+  if (ctx->fields[w] != NULL) galois_free_field(ctx->fields[w]);
+  ctx->fields[w] = f;
+  ctx->id = GALOIS_ADD(galois_context_ids, 1);
+  return 0;
+}
+
+gf_t *galois_context_get_field_ptr(galois_context_t *ctx, int w)
+{
+  if (ctx != NULL && w > 0 && w < MAX_GF_INSTANCES && ctx->fields[w] != NULL) {
+    return ctx->fields[w]->gf;
+  }
+  return galois_get_field_ptr(w);
+}
+
+unsigned long galois_context_id(galois_context_t *ctx, int w)
+{
+  if (w <= 0 || w >= MAX_GF_INSTANCES) return 0;
+  if (ctx != NULL && ctx->fields[w] != NULL) return ctx->id;
+  return GALOIS_LOAD(galois_field_ids[w]);
 }
 
 int galois_single_multiply(int x, int y, int w)
 {
+  return galois_context_single_multiply(NULL, x, y, w);
+}
+
+int galois_single_divide(int x, int y, int w)
+{
+  return galois_context_single_divide(NULL, x, y, w);
+}
+
+int galois_context_single_multiply(galois_context_t *ctx, int x, int y, int w)
+{
+  galois_field_t *f;
+  int p;
+
   if (x == 0 || y == 0) return 0;
-  
-  if (gfp_array[w] == NULL) {
-    galois_init(w);
-  }
 
   if (w <= 32) {
-    return gfp_array[w]->multiply.w32(gfp_array[w], x, y);
+    f = galois_enter_context(ctx, w);
+    p = f->gf->multiply.w32(f->gf, x, y);
+    galois_read_unlock();
+    return p;
   } else {
     fprintf(stderr, "ERROR -- Galois field not implemented for w=%d\n", w);
     return 0;
   }
 }
 
-int galois_single_divide(int x, int y, int w)
+int galois_context_single_divide(galois_context_t *ctx, int x, int y, int w)
 {
+  galois_field_t *f;
+  int q;
+
   if (x == 0) return 0;
   if (y == 0) return -1;
 
-  if (gfp_array[w] == NULL) {
-    galois_init(w);
-  }
-
   if (w <= 32) {
-    return gfp_array[w]->divide.w32(gfp_array[w], x, y);
+    f = galois_enter_context(ctx, w);
+    q = f->gf->divide.w32(f->gf, x, y);
+    galois_read_unlock();
+    return q;
   } else {
     fprintf(stderr, "ERROR -- Galois field not implemented for w=%d\n", w);
     return 0;
   }
 }
 
+int galois_log_tables(int w, uint16_t **log, uint16_t **exp)
+{
+  return galois_context_log_tables(NULL, w, log, exp);
+}
+
+int galois_context_log_tables(galois_context_t *ctx, int w, uint16_t **log, uint16_t **exp)
+{
+  galois_field_t *f;
+  int rv;
+
+  if (w <= 0 || w > GALOIS_MAX_LOG_W) return -1;
+  f = galois_enter_context(ctx, w);
+  rv = -1;
+  if (f->exp != NULL) {
+    *log = f->log;
+    *exp = f->exp;
+    rv = 0;
+  }
+  galois_read_unlock();
+  return rv;
+}
+
+/* Split-nibble kernels for w=8: each byte is split into its low and high
+   nibble, and the two 16-entry product tables are looked up with a byte
+   shuffle.  The vector loops do not care about alignment, and whatever is
+   left over at the end goes through galois_w08_region_multiply_scalar(). */
+
+static void galois_w08_region_multiply_scalar(unsigned char *src, unsigned char *dest,
+                                              unsigned char *tbl, int nbytes, int add)
+{
+  int i;
+  unsigned char p;
+
+  for (i = 0; i < nbytes; i++) {
+    p = tbl[src[i] & 0xf] ^ tbl[16 + (src[i] >> 4)];
+    dest[i] = (add) ? dest[i] ^ p : p;
+  }
+}
+
+#ifdef GALOIS_X86_KERNELS
+
+GALOIS_TARGET("ssse3")
+static void galois_w08_region_multiply_ssse3(unsigned char *src, unsigned char *dest,
+                                             unsigned char *tbl, int nbytes, int add)
+{
+  __m128i tlo, thi, mask, v, p;
+  int i;
+
+  tlo = _mm_loadu_si128((__m128i *) tbl);
+  thi = _mm_loadu_si128((__m128i *) (tbl+16));
+  mask = _mm_set1_epi8(0xf);
+
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    v = _mm_loadu_si128((__m128i *) (src+i));
+    p = _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(v, mask)),
+                      _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(v, 4), mask)));
+    if (add) p = _mm_xor_si128(p, _mm_loadu_si128((__m128i *) (dest+i)));
+    _mm_storeu_si128((__m128i *) (dest+i), p);
+  }
+  galois_w08_region_multiply_scalar(src+i, dest+i, tbl, nbytes-i, add);
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w08_region_multiply_avx2(unsigned char *src, unsigned char *dest,
+                                            unsigned char *tbl, int nbytes, int add)
+{
+  __m256i tlo, thi, mask, v, p;
+  int i;
+
+  tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) tbl));
+  thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) (tbl+16)));
+  mask = _mm256_set1_epi8(0xf);
+
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    v = _mm256_loadu_si256((__m256i *) (src+i));
+    p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(v, mask)),
+                         _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask)));
+    if (add) p = _mm256_xor_si256(p, _mm256_loadu_si256((__m256i *) (dest+i)));
+    _mm256_storeu_si256((__m256i *) (dest+i), p);
+  }
+  galois_w08_region_multiply_scalar(src+i, dest+i, tbl, nbytes-i, add);
+}
+
+GALOIS_TARGET("avx512f,avx512bw")
+static void galois_w08_region_multiply_avx512(unsigned char *src, unsigned char *dest,
+                                              unsigned char *tbl, int nbytes, int add)
+{
+  __m512i tlo, thi, mask, v, p;
+  int i;
+
+  tlo = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) tbl));
+  thi = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) (tbl+16)));
+  mask = _mm512_set1_epi8(0xf);
+
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    v = _mm512_loadu_si512((void *) (src+i));
+    p = _mm512_xor_si512(_mm512_shuffle_epi8(tlo, _mm512_and_si512(v, mask)),
+                         _mm512_shuffle_epi8(thi, _mm512_and_si512(_mm512_srli_epi64(v, 4), mask)));
+    if (add) p = _mm512_xor_si512(p, _mm512_loadu_si512((void *) (dest+i)));
+    _mm512_storeu_si512((void *) (dest+i), p);
+  }
+  galois_w08_region_multiply_scalar(src+i, dest+i, tbl, nbytes-i, add);
+}
+
+#endif
+
+/* Whether the native kernels can be used with field f. */
+
+static int galois_native(galois_field_t *f)
+{
+  return (f->native && GALOIS_RELAXED_LOAD(galois_kernel) != GALOIS_KERNEL_GF_COMPLETE);
+}
+
+static void galois_w08_field_multiply(galois_field_t *f, char *region, int multby, int nbytes,
+                                      char *r2, int add)
+{
+  unsigned char *src, *dest, *tbl;
+
+  if (galois_native(f)) {
+    src = (unsigned char *) region;
+    dest = (r2 == NULL) ? src : (unsigned char *) r2;
+    if (r2 == NULL) add = 0;
+    tbl = galois_w08_tables[multby & 0xff];
+    switch (GALOIS_RELAXED_LOAD(galois_kernel)) {
+#ifdef GALOIS_X86_KERNELS
+      case GALOIS_KERNEL_AVX512: galois_w08_region_multiply_avx512(src, dest, tbl, nbytes, add); break;
+      case GALOIS_KERNEL_AVX2:   galois_w08_region_multiply_avx2(src, dest, tbl, nbytes, add); break;
+      case GALOIS_KERNEL_SSSE3:  galois_w08_region_multiply_ssse3(src, dest, tbl, nbytes, add); break;
+#endif
+      default: galois_w08_region_multiply_scalar(src, dest, tbl, nbytes, add); break;
+    }
+  } else {
+    if (r2 == NULL) {
+      r2 = region;
+      add = 0;
+    }
+    f->gf->multiply_region.w32(f->gf, region, r2, multby, nbytes, add);
+  }
+}
+
+/* Dot products: dest = coeffs[0]*srcs[0] + ... + coeffs[n-1]*srcs[n-1].
+
+   The native kernels walk dest once and keep the running sum of all of the
+   sources in vector registers, so dest is written exactly once.  For w=16
+   and w=32 the split tables are built on each call, GALOIS_DOTPROD_BATCH
+   sources at a time, and any later batch is added into dest.  Without
+   native kernels, the sum is built one GALOIS_DOTPROD_CHUNK of dest at a
+   time with GF-Complete, so that the chunk stays in cache across all of
+   the sources.
+
+   The w=16 and w=32 tables hold w/4 nibble positions times w/8 product
+   bytes, 16 entries each: entry x of table (pos*(w/8)+b) is byte b of
+   c*(x << 4*pos). */
+
+#define GALOIS_DOTPROD_BATCH 16
+#define GALOIS_DOTPROD_CHUNK 4096
+#define GALOIS_MULTI_DESTS 8
+#define GALOIS_MULTI_TABLE_BYTES 32768
+#define GALOIS_SPLIT_TABLE_BYTES(w) ((w)/4 * (w)/8 * 16)
+
+static void galois_region_dotprod_gf(gf_t *gf, char **srcs, int *coeffs, int n,
+                                     char *dest, int start, int end)
+{
+  int off, len, j, init;
+
+  for (off = start; off < end; off += GALOIS_DOTPROD_CHUNK) {
+    len = end - off;
+    if (len > GALOIS_DOTPROD_CHUNK) len = GALOIS_DOTPROD_CHUNK;
+    init = 0;
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      gf->multiply_region.w32(gf, srcs[j]+off, dest+off, coeffs[j], len, init);
+      init = 1;
+    }
+    if (!init) memset(dest+off, 0, len);
+  }
+}
+
+/* base[b] is c*2^b, looked up in the log tables if w has them.  The
+   products of each nibble are built by doubling:  prod[2^b + x] is
+   prod[x] + base[pos*4+b]. */
+
+static void galois_build_split_tables(galois_field_t *f, int w, int c, unsigned char *tbl)
+{
+  uint32_t base[32], prod[16];
+  gf_t *gf;
+  int pos, x, b;
+
+  gf = f->gf;
+  if (c != 0 && f->exp != NULL) {
+    base[0] = c;
+    for (b = 1; b < w; b++) base[b] = f->exp[f->log[base[b-1]] + f->log[2]];
+  } else {
+    for (b = 0; b < w; b++) base[b] = gf->multiply.w32(gf, c, ((uint32_t) 1) << b);
+  }
+  for (pos = 0; pos < w/4; pos++) {
+    prod[0] = 0;
+    for (b = 0; b < 4; b++) {
+      for (x = 0; x < (1 << b); x++) prod[(1 << b) + x] = prod[x] ^ base[pos*4+b];
+    }
+    for (b = 0; b < w/8; b++) {
+      for (x = 0; x < 16; x++) tbl[(pos*(w/8)+b)*16+x] = (prod[x] >> (8*b)) & 0xff;
+    }
+  }
+}
+
+static uint32_t galois_split_multiply(unsigned char *tbl, int w, uint32_t x)
+{
+  uint32_t p;
+  int pos, b, nib;
+
+  p = 0;
+  for (pos = 0; pos < w/4; pos++) {
+    nib = (x >> (4*pos)) & 0xf;
+    for (b = 0; b < w/8; b++) p ^= ((uint32_t) tbl[(pos*(w/8)+b)*16+nib]) << (8*b);
+  }
+  return p;
+}
+
+/* Scalar remainder of the native kernels, from byte offset start to nbytes. */
+
+static void galois_w08_region_dotprod_scalar(unsigned char **srcs, int *coeffs, int n,
+                                             unsigned char *dest, int start, int nbytes, int add)
+{
+  unsigned char *tbl, p, x;
+  int i, j;
+
+  for (i = start; i < nbytes; i++) {
+    p = (add) ? dest[i] : 0;
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      tbl = galois_w08_tables[coeffs[j] & 0xff];
+      x = srcs[j][i];
+      p ^= tbl[x & 0xf] ^ tbl[16 + (x >> 4)];
+    }
+    dest[i] = p;
+  }
+}
+
+/* Loads and stores a word of w = 16 or 32 bits, in the machine's byte
+   order, as the regions hold them. */
+
+static uint32_t galois_wxx_load(unsigned char *ptr, int w)
+{
+  uint16_t h;
+  uint32_t x;
+
+  if (w == 16) {
+    memcpy(&h, ptr, sizeof(h));
+    return h;
+  }
+  memcpy(&x, ptr, sizeof(x));
+  return x;
+}
+
+static void galois_wxx_store(unsigned char *ptr, int w, uint32_t x)
+{
+  uint16_t h;
+
+  if (w == 16) {
+    h = (uint16_t) x;
+    memcpy(ptr, &h, sizeof(h));
+  } else {
+    memcpy(ptr, &x, sizeof(x));
+  }
+}
+
+static void galois_wxx_region_dotprod_scalar(int w, unsigned char **srcs, int *coeffs,
+                                             unsigned char *tbls, int n,
+                                             unsigned char *dest, int start, int nbytes, int add)
+{
+  uint32_t p, x;
+  int i, j;
+
+  for (i = start; i + w/8 <= nbytes; i += w/8) {
+    p = (add) ? galois_wxx_load(dest+i, w) : 0;
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      x = galois_wxx_load(srcs[j]+i, w);
+      p ^= (coeffs[j] == 1) ? x : galois_split_multiply(tbls + j*GALOIS_SPLIT_TABLE_BYTES(w), w, x);
+    }
+    galois_wxx_store(dest+i, w, p);
+  }
+}
+
+#ifdef GALOIS_X86_KERNELS
+
+GALOIS_TARGET("ssse3")
+static void galois_w08_region_dotprod_ssse3(unsigned char **srcs, int *coeffs, int n,
+                                            unsigned char *dest, int nbytes, int add)
+{
+  __m128i mask, tlo, thi, v0, v1, a0, a1;
+  unsigned char *tbl;
+  int i, j;
+
+  mask = _mm_set1_epi8(0xf);
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    if (add) {
+      a0 = _mm_loadu_si128((__m128i *) (dest+i));
+      a1 = _mm_loadu_si128((__m128i *) (dest+i+16));
+    } else {
+      a0 = _mm_setzero_si128();
+      a1 = _mm_setzero_si128();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      v0 = _mm_loadu_si128((__m128i *) (srcs[j]+i));
+      v1 = _mm_loadu_si128((__m128i *) (srcs[j]+i+16));
+      if (coeffs[j] == 1) {
+        a0 = _mm_xor_si128(a0, v0);
+        a1 = _mm_xor_si128(a1, v1);
+        continue;
+      }
+      tbl = galois_w08_tables[coeffs[j] & 0xff];
+      tlo = _mm_loadu_si128((__m128i *) tbl);
+      thi = _mm_loadu_si128((__m128i *) (tbl+16));
+      a0 = _mm_xor_si128(a0, _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(v0, mask)),
+                         _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(v0, 4), mask))));
+      a1 = _mm_xor_si128(a1, _mm_xor_si128(_mm_shuffle_epi8(tlo, _mm_and_si128(v1, mask)),
+                         _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(v1, 4), mask))));
+    }
+    _mm_storeu_si128((__m128i *) (dest+i), a0);
+    _mm_storeu_si128((__m128i *) (dest+i+16), a1);
+  }
+  galois_w08_region_dotprod_scalar(srcs, coeffs, n, dest, i, nbytes, add);
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w08_region_dotprod_avx2(unsigned char **srcs, int *coeffs, int n,
+                                           unsigned char *dest, int nbytes, int add)
+{
+  __m256i mask, tlo, thi, v0, v1, a0, a1;
+  unsigned char *tbl;
+  int i, j;
+
+  mask = _mm256_set1_epi8(0xf);
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    if (add) {
+      a0 = _mm256_loadu_si256((__m256i *) (dest+i));
+      a1 = _mm256_loadu_si256((__m256i *) (dest+i+32));
+    } else {
+      a0 = _mm256_setzero_si256();
+      a1 = _mm256_setzero_si256();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      v0 = _mm256_loadu_si256((__m256i *) (srcs[j]+i));
+      v1 = _mm256_loadu_si256((__m256i *) (srcs[j]+i+32));
+      if (coeffs[j] == 1) {
+        a0 = _mm256_xor_si256(a0, v0);
+        a1 = _mm256_xor_si256(a1, v1);
+        continue;
+      }
+      tbl = galois_w08_tables[coeffs[j] & 0xff];
+      tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) tbl));
+      thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) (tbl+16)));
+      a0 = _mm256_xor_si256(a0, _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(v0, mask)),
+                            _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(v0, 4), mask))));
+      a1 = _mm256_xor_si256(a1, _mm256_xor_si256(_mm256_shuffle_epi8(tlo, _mm256_and_si256(v1, mask)),
+                            _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(v1, 4), mask))));
+    }
+    _mm256_storeu_si256((__m256i *) (dest+i), a0);
+    _mm256_storeu_si256((__m256i *) (dest+i+32), a1);
+  }
+  galois_w08_region_dotprod_scalar(srcs, coeffs, n, dest, i, nbytes, add);
+}
+
+GALOIS_TARGET("avx512f,avx512bw")
+static void galois_w08_region_dotprod_avx512(unsigned char **srcs, int *coeffs, int n,
+                                             unsigned char *dest, int nbytes, int add)
+{
+  __m512i mask, tlo, thi, v0, v1, a0, a1;
+  unsigned char *tbl;
+  int i, j;
+
+  mask = _mm512_set1_epi8(0xf);
+  for (i = 0; i + 128 <= nbytes; i += 128) {
+    if (add) {
+      a0 = _mm512_loadu_si512((void *) (dest+i));
+      a1 = _mm512_loadu_si512((void *) (dest+i+64));
+    } else {
+      a0 = _mm512_setzero_si512();
+      a1 = _mm512_setzero_si512();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      v0 = _mm512_loadu_si512((void *) (srcs[j]+i));
+      v1 = _mm512_loadu_si512((void *) (srcs[j]+i+64));
+      if (coeffs[j] == 1) {
+        a0 = _mm512_xor_si512(a0, v0);
+        a1 = _mm512_xor_si512(a1, v1);
+        continue;
+      }
+      tbl = galois_w08_tables[coeffs[j] & 0xff];
+      tlo = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) tbl));
+      thi = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) (tbl+16)));
+      a0 = _mm512_xor_si512(a0, _mm512_xor_si512(_mm512_shuffle_epi8(tlo, _mm512_and_si512(v0, mask)),
+                            _mm512_shuffle_epi8(thi, _mm512_and_si512(_mm512_srli_epi64(v0, 4), mask))));
+      a1 = _mm512_xor_si512(a1, _mm512_xor_si512(_mm512_shuffle_epi8(tlo, _mm512_and_si512(v1, mask)),
+                            _mm512_shuffle_epi8(thi, _mm512_and_si512(_mm512_srli_epi64(v1, 4), mask))));
+    }
+    _mm512_storeu_si512((void *) (dest+i), a0);
+    _mm512_storeu_si512((void *) (dest+i+64), a1);
+  }
+  galois_w08_region_dotprod_scalar(srcs, coeffs, n, dest, i, nbytes, add);
+}
+
+#define GALOIS_T128(tbl, t) _mm_loadu_si128((__m128i *) ((tbl) + (t)*16))
+#define GALOIS_T256(tbl, t) _mm256_broadcastsi128_si256(GALOIS_T128(tbl, t))
+
+/* Multi-destination w=8 kernels: each block of every source is loaded and
+   split into nibbles once, and then fed to up to GALOIS_MULTI_DESTS
+   accumulators, one per destination.  coeffs holds ndests rows of n. */
+
+GALOIS_TARGET("ssse3")
+static void galois_w08_region_dotprod_multi_ssse3(unsigned char **srcs, int *coeffs, int n,
+                                                  unsigned char **dests, int ndests, int nbytes)
+{
+  __m128i mask, v, lo, hi, acc[GALOIS_MULTI_DESTS];
+  unsigned char *tbl;
+  int i, j, d, c;
+
+  mask = _mm_set1_epi8(0xf);
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    for (d = 0; d < ndests; d++) acc[d] = _mm_setzero_si128();
+    for (j = 0; j < n; j++) {
+      v = _mm_loadu_si128((__m128i *) (srcs[j]+i));
+      lo = _mm_and_si128(v, mask);
+      hi = _mm_and_si128(_mm_srli_epi64(v, 4), mask);
+      for (d = 0; d < ndests; d++) {
+        c = coeffs[d*n+j];
+        if (c == 0) continue;
+        if (c == 1) {
+          acc[d] = _mm_xor_si128(acc[d], v);
+          continue;
+        }
+        tbl = galois_w08_tables[c & 0xff];
+        acc[d] = _mm_xor_si128(acc[d], _mm_xor_si128(
+                   _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) tbl), lo),
+                   _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (tbl+16)), hi)));
+      }
+    }
+    for (d = 0; d < ndests; d++) _mm_storeu_si128((__m128i *) (dests[d]+i), acc[d]);
+  }
+  for (d = 0; d < ndests; d++) {
+    galois_w08_region_dotprod_scalar(srcs, coeffs+d*n, n, dests[d], i, nbytes, 0);
+  }
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w08_region_dotprod_multi_avx2(unsigned char **srcs, int *coeffs, int n,
+                                                 unsigned char **dests, int ndests, int nbytes)
+{
+  __m256i mask, v, lo, hi, acc[GALOIS_MULTI_DESTS];
+  unsigned char *tbl;
+  int i, j, d, c;
+
+  mask = _mm256_set1_epi8(0xf);
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    for (d = 0; d < ndests; d++) acc[d] = _mm256_setzero_si256();
+    for (j = 0; j < n; j++) {
+      v = _mm256_loadu_si256((__m256i *) (srcs[j]+i));
+      lo = _mm256_and_si256(v, mask);
+      hi = _mm256_and_si256(_mm256_srli_epi64(v, 4), mask);
+      for (d = 0; d < ndests; d++) {
+        c = coeffs[d*n+j];
+        if (c == 0) continue;
+        if (c == 1) {
+          acc[d] = _mm256_xor_si256(acc[d], v);
+          continue;
+        }
+        tbl = galois_w08_tables[c & 0xff];
+        acc[d] = _mm256_xor_si256(acc[d], _mm256_xor_si256(
+                   _mm256_shuffle_epi8(GALOIS_T256(tbl, 0), lo),
+                   _mm256_shuffle_epi8(GALOIS_T256(tbl, 1), hi)));
+      }
+    }
+    for (d = 0; d < ndests; d++) _mm256_storeu_si256((__m256i *) (dests[d]+i), acc[d]);
+  }
+  for (d = 0; d < ndests; d++) {
+    galois_w08_region_dotprod_scalar(srcs, coeffs+d*n, n, dests[d], i, nbytes, 0);
+  }
+}
+
+GALOIS_TARGET("avx512f,avx512bw")
+static void galois_w08_region_dotprod_multi_avx512(unsigned char **srcs, int *coeffs, int n,
+                                                   unsigned char **dests, int ndests, int nbytes)
+{
+  __m512i mask, v, lo, hi, acc[GALOIS_MULTI_DESTS];
+  unsigned char *tbl;
+  int i, j, d, c;
+
+  mask = _mm512_set1_epi8(0xf);
+  for (i = 0; i + 64 <= nbytes; i += 64) {
+    for (d = 0; d < ndests; d++) acc[d] = _mm512_setzero_si512();
+    for (j = 0; j < n; j++) {
+      v = _mm512_loadu_si512((void *) (srcs[j]+i));
+      lo = _mm512_and_si512(v, mask);
+      hi = _mm512_and_si512(_mm512_srli_epi64(v, 4), mask);
+      for (d = 0; d < ndests; d++) {
+        c = coeffs[d*n+j];
+        if (c == 0) continue;
+        if (c == 1) {
+          acc[d] = _mm512_xor_si512(acc[d], v);
+          continue;
+        }
+        tbl = galois_w08_tables[c & 0xff];
+        acc[d] = _mm512_xor_si512(acc[d], _mm512_xor_si512(
+                   _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) tbl)), lo),
+                   _mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *) (tbl+16))), hi)));
+      }
+    }
+    for (d = 0; d < ndests; d++) _mm512_storeu_si512((void *) (dests[d]+i), acc[d]);
+  }
+  for (d = 0; d < ndests; d++) {
+    galois_w08_region_dotprod_scalar(srcs, coeffs+d*n, n, dests[d], i, nbytes, 0);
+  }
+}
+
+/* For w=16 and w=32, words are split into byte planes with pack/unpack, so
+   that each plane can go through the nibble shuffles.  The accumulators
+   stay split until the end of a block, when they are interleaved back into
+   little-endian words.  Pack and unpack both work within 128-bit lanes, so
+   the same code is correct for AVX2. */
+
+GALOIS_TARGET("ssse3")
+static void galois_w16_region_dotprod_ssse3(unsigned char **srcs, int *coeffs, unsigned char *tbls,
+                                            int n, unsigned char *dest, int start, int nbytes, int add)
+{
+  __m128i mask, lomask, v0, v1, lo, hi, n0, n1, n2, n3, alo, ahi;
+  unsigned char *tbl;
+  int i, j;
+
+  mask = _mm_set1_epi8(0xf);
+  lomask = _mm_set1_epi16(0xff);
+  for (i = start; i + 32 <= nbytes; i += 32) {
+    if (add) {
+      v0 = _mm_loadu_si128((__m128i *) (dest+i));
+      v1 = _mm_loadu_si128((__m128i *) (dest+i+16));
+      alo = _mm_packus_epi16(_mm_and_si128(v0, lomask), _mm_and_si128(v1, lomask));
+      ahi = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+    } else {
+      alo = _mm_setzero_si128();
+      ahi = _mm_setzero_si128();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      v0 = _mm_loadu_si128((__m128i *) (srcs[j]+i));
+      v1 = _mm_loadu_si128((__m128i *) (srcs[j]+i+16));
+      lo = _mm_packus_epi16(_mm_and_si128(v0, lomask), _mm_and_si128(v1, lomask));
+      hi = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+      if (coeffs[j] == 1) {
+        alo = _mm_xor_si128(alo, lo);
+        ahi = _mm_xor_si128(ahi, hi);
+        continue;
+      }
+      tbl = tbls + j*GALOIS_SPLIT_TABLE_BYTES(16);
+      n0 = _mm_and_si128(lo, mask);
+      n1 = _mm_and_si128(_mm_srli_epi16(lo, 4), mask);
+      n2 = _mm_and_si128(hi, mask);
+      n3 = _mm_and_si128(_mm_srli_epi16(hi, 4), mask);
+      alo = _mm_xor_si128(alo, _mm_xor_si128(
+              _mm_xor_si128(_mm_shuffle_epi8(GALOIS_T128(tbl, 0), n0), _mm_shuffle_epi8(GALOIS_T128(tbl, 2), n1)),
+              _mm_xor_si128(_mm_shuffle_epi8(GALOIS_T128(tbl, 4), n2), _mm_shuffle_epi8(GALOIS_T128(tbl, 6), n3))));
+      ahi = _mm_xor_si128(ahi, _mm_xor_si128(
+              _mm_xor_si128(_mm_shuffle_epi8(GALOIS_T128(tbl, 1), n0), _mm_shuffle_epi8(GALOIS_T128(tbl, 3), n1)),
+              _mm_xor_si128(_mm_shuffle_epi8(GALOIS_T128(tbl, 5), n2), _mm_shuffle_epi8(GALOIS_T128(tbl, 7), n3))));
+    }
+    _mm_storeu_si128((__m128i *) (dest+i), _mm_unpacklo_epi8(alo, ahi));
+    _mm_storeu_si128((__m128i *) (dest+i+16), _mm_unpackhi_epi8(alo, ahi));
+  }
+  galois_wxx_region_dotprod_scalar(16, srcs, coeffs, tbls, n, dest, i, nbytes, add);
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w16_region_dotprod_avx2(unsigned char **srcs, int *coeffs, unsigned char *tbls,
+                                           int n, unsigned char *dest, int start, int nbytes, int add)
+{
+  __m256i mask, lomask, v0, v1, lo, hi, n0, n1, n2, n3, alo, ahi;
+  unsigned char *tbl;
+  int i, j;
+
+  mask = _mm256_set1_epi8(0xf);
+  lomask = _mm256_set1_epi16(0xff);
+  for (i = start; i + 64 <= nbytes; i += 64) {
+    if (add) {
+      v0 = _mm256_loadu_si256((__m256i *) (dest+i));
+      v1 = _mm256_loadu_si256((__m256i *) (dest+i+32));
+      alo = _mm256_packus_epi16(_mm256_and_si256(v0, lomask), _mm256_and_si256(v1, lomask));
+      ahi = _mm256_packus_epi16(_mm256_srli_epi16(v0, 8), _mm256_srli_epi16(v1, 8));
+    } else {
+      alo = _mm256_setzero_si256();
+      ahi = _mm256_setzero_si256();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      v0 = _mm256_loadu_si256((__m256i *) (srcs[j]+i));
+      v1 = _mm256_loadu_si256((__m256i *) (srcs[j]+i+32));
+      lo = _mm256_packus_epi16(_mm256_and_si256(v0, lomask), _mm256_and_si256(v1, lomask));
+      hi = _mm256_packus_epi16(_mm256_srli_epi16(v0, 8), _mm256_srli_epi16(v1, 8));
+      if (coeffs[j] == 1) {
+        alo = _mm256_xor_si256(alo, lo);
+        ahi = _mm256_xor_si256(ahi, hi);
+        continue;
+      }
+      tbl = tbls + j*GALOIS_SPLIT_TABLE_BYTES(16);
+      n0 = _mm256_and_si256(lo, mask);
+      n1 = _mm256_and_si256(_mm256_srli_epi16(lo, 4), mask);
+      n2 = _mm256_and_si256(hi, mask);
+      n3 = _mm256_and_si256(_mm256_srli_epi16(hi, 4), mask);
+      alo = _mm256_xor_si256(alo, _mm256_xor_si256(
+              _mm256_xor_si256(_mm256_shuffle_epi8(GALOIS_T256(tbl, 0), n0), _mm256_shuffle_epi8(GALOIS_T256(tbl, 2), n1)),
+              _mm256_xor_si256(_mm256_shuffle_epi8(GALOIS_T256(tbl, 4), n2), _mm256_shuffle_epi8(GALOIS_T256(tbl, 6), n3))));
+      ahi = _mm256_xor_si256(ahi, _mm256_xor_si256(
+              _mm256_xor_si256(_mm256_shuffle_epi8(GALOIS_T256(tbl, 1), n0), _mm256_shuffle_epi8(GALOIS_T256(tbl, 3), n1)),
+              _mm256_xor_si256(_mm256_shuffle_epi8(GALOIS_T256(tbl, 5), n2), _mm256_shuffle_epi8(GALOIS_T256(tbl, 7), n3))));
+    }
+    _mm256_storeu_si256((__m256i *) (dest+i), _mm256_unpacklo_epi8(alo, ahi));
+    _mm256_storeu_si256((__m256i *) (dest+i+32), _mm256_unpackhi_epi8(alo, ahi));
+  }
+  galois_wxx_region_dotprod_scalar(16, srcs, coeffs, tbls, n, dest, i, nbytes, add);
+}
+
+/* w=32: four vectors are split into four byte planes p[0..3] (byte b of
+   every word goes to p[b]), and put back together in the reverse order. */
+
+GALOIS_TARGET("ssse3")
+static void galois_w32_split_ssse3(unsigned char *src, __m128i *p)
+{
+  __m128i lomask, v0, v1, v2, v3, t0, t1, t2, t3;
+
+  lomask = _mm_set1_epi16(0xff);
+  v0 = _mm_loadu_si128((__m128i *) src);
+  v1 = _mm_loadu_si128((__m128i *) (src+16));
+  v2 = _mm_loadu_si128((__m128i *) (src+32));
+  v3 = _mm_loadu_si128((__m128i *) (src+48));
+  t0 = _mm_packus_epi16(_mm_and_si128(v0, lomask), _mm_and_si128(v1, lomask));
+  t1 = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+  t2 = _mm_packus_epi16(_mm_and_si128(v2, lomask), _mm_and_si128(v3, lomask));
+  t3 = _mm_packus_epi16(_mm_srli_epi16(v2, 8), _mm_srli_epi16(v3, 8));
+  p[0] = _mm_packus_epi16(_mm_and_si128(t0, lomask), _mm_and_si128(t2, lomask));
+  p[2] = _mm_packus_epi16(_mm_srli_epi16(t0, 8), _mm_srli_epi16(t2, 8));
+  p[1] = _mm_packus_epi16(_mm_and_si128(t1, lomask), _mm_and_si128(t3, lomask));
+  p[3] = _mm_packus_epi16(_mm_srli_epi16(t1, 8), _mm_srli_epi16(t3, 8));
+}
+
+GALOIS_TARGET("ssse3")
+static void galois_w32_join_ssse3(__m128i *p, unsigned char *dest)
+{
+  __m128i t0, t1, t2, t3;
+
+  t0 = _mm_unpacklo_epi8(p[0], p[2]);
+  t2 = _mm_unpackhi_epi8(p[0], p[2]);
+  t1 = _mm_unpacklo_epi8(p[1], p[3]);
+  t3 = _mm_unpackhi_epi8(p[1], p[3]);
+  _mm_storeu_si128((__m128i *) dest, _mm_unpacklo_epi8(t0, t1));
+  _mm_storeu_si128((__m128i *) (dest+16), _mm_unpackhi_epi8(t0, t1));
+  _mm_storeu_si128((__m128i *) (dest+32), _mm_unpacklo_epi8(t2, t3));
+  _mm_storeu_si128((__m128i *) (dest+48), _mm_unpackhi_epi8(t2, t3));
+}
+
+GALOIS_TARGET("ssse3")
+static void galois_w32_region_dotprod_ssse3(unsigned char **srcs, int *coeffs, unsigned char *tbls,
+                                            int n, unsigned char *dest, int start, int nbytes, int add)
+{
+  __m128i mask, p[4], a[4], nib;
+  unsigned char *tbl;
+  int i, j, pos, b;
+
+  mask = _mm_set1_epi8(0xf);
+  for (i = start; i + 64 <= nbytes; i += 64) {
+    if (add) {
+      galois_w32_split_ssse3(dest+i, a);
+    } else {
+      for (b = 0; b < 4; b++) a[b] = _mm_setzero_si128();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      galois_w32_split_ssse3(srcs[j]+i, p);
+      if (coeffs[j] == 1) {
+        for (b = 0; b < 4; b++) a[b] = _mm_xor_si128(a[b], p[b]);
+        continue;
+      }
+      tbl = tbls + j*GALOIS_SPLIT_TABLE_BYTES(32);
+      for (pos = 0; pos < 8; pos++) {
+        nib = (pos & 1) ? _mm_srli_epi16(p[pos/2], 4) : p[pos/2];
+        nib = _mm_and_si128(nib, mask);
+        for (b = 0; b < 4; b++) {
+          a[b] = _mm_xor_si128(a[b], _mm_shuffle_epi8(GALOIS_T128(tbl, pos*4+b), nib));
+        }
+      }
+    }
+    galois_w32_join_ssse3(a, dest+i);
+  }
+  galois_wxx_region_dotprod_scalar(32, srcs, coeffs, tbls, n, dest, i, nbytes, add);
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w32_split_avx2(unsigned char *src, __m256i *p)
+{
+  __m256i lomask, v0, v1, v2, v3, t0, t1, t2, t3;
+
+  lomask = _mm256_set1_epi16(0xff);
+  v0 = _mm256_loadu_si256((__m256i *) src);
+  v1 = _mm256_loadu_si256((__m256i *) (src+32));
+  v2 = _mm256_loadu_si256((__m256i *) (src+64));
+  v3 = _mm256_loadu_si256((__m256i *) (src+96));
+  t0 = _mm256_packus_epi16(_mm256_and_si256(v0, lomask), _mm256_and_si256(v1, lomask));
+  t1 = _mm256_packus_epi16(_mm256_srli_epi16(v0, 8), _mm256_srli_epi16(v1, 8));
+  t2 = _mm256_packus_epi16(_mm256_and_si256(v2, lomask), _mm256_and_si256(v3, lomask));
+  t3 = _mm256_packus_epi16(_mm256_srli_epi16(v2, 8), _mm256_srli_epi16(v3, 8));
+  p[0] = _mm256_packus_epi16(_mm256_and_si256(t0, lomask), _mm256_and_si256(t2, lomask));
+  p[2] = _mm256_packus_epi16(_mm256_srli_epi16(t0, 8), _mm256_srli_epi16(t2, 8));
+  p[1] = _mm256_packus_epi16(_mm256_and_si256(t1, lomask), _mm256_and_si256(t3, lomask));
+  p[3] = _mm256_packus_epi16(_mm256_srli_epi16(t1, 8), _mm256_srli_epi16(t3, 8));
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w32_join_avx2(__m256i *p, unsigned char *dest)
+{
+  __m256i t0, t1, t2, t3;
+
+  t0 = _mm256_unpacklo_epi8(p[0], p[2]);
+  t2 = _mm256_unpackhi_epi8(p[0], p[2]);
+  t1 = _mm256_unpacklo_epi8(p[1], p[3]);
+  t3 = _mm256_unpackhi_epi8(p[1], p[3]);
+  _mm256_storeu_si256((__m256i *) dest, _mm256_unpacklo_epi8(t0, t1));
+  _mm256_storeu_si256((__m256i *) (dest+32), _mm256_unpackhi_epi8(t0, t1));
+  _mm256_storeu_si256((__m256i *) (dest+64), _mm256_unpacklo_epi8(t2, t3));
+  _mm256_storeu_si256((__m256i *) (dest+96), _mm256_unpackhi_epi8(t2, t3));
+}
+
+GALOIS_TARGET("avx2")
+static void galois_w32_region_dotprod_avx2(unsigned char **srcs, int *coeffs, unsigned char *tbls,
+                                           int n, unsigned char *dest, int start, int nbytes, int add)
+{
+  __m256i mask, p[4], a[4], nib;
+  unsigned char *tbl;
+  int i, j, pos, b;
+
+  mask = _mm256_set1_epi8(0xf);
+  for (i = start; i + 128 <= nbytes; i += 128) {
+    if (add) {
+      galois_w32_split_avx2(dest+i, a);
+    } else {
+      for (b = 0; b < 4; b++) a[b] = _mm256_setzero_si256();
+    }
+    for (j = 0; j < n; j++) {
+      if (coeffs[j] == 0) continue;
+      galois_w32_split_avx2(srcs[j]+i, p);
+      if (coeffs[j] == 1) {
+        for (b = 0; b < 4; b++) a[b] = _mm256_xor_si256(a[b], p[b]);
+        continue;
+      }
+      tbl = tbls + j*GALOIS_SPLIT_TABLE_BYTES(32);
+      for (pos = 0; pos < 8; pos++) {
+        nib = (pos & 1) ? _mm256_srli_epi16(p[pos/2], 4) : p[pos/2];
+        nib = _mm256_and_si256(nib, mask);
+        for (b = 0; b < 4; b++) {
+          a[b] = _mm256_xor_si256(a[b], _mm256_shuffle_epi8(GALOIS_T256(tbl, pos*4+b), nib));
+        }
+      }
+    }
+    galois_w32_join_avx2(a, dest+i);
+  }
+  galois_wxx_region_dotprod_scalar(32, srcs, coeffs, tbls, n, dest, i, nbytes, add);
+}
+
+#endif
+
+static void galois_wxx_region_dotprod_kernel(int w, unsigned char **srcs, int *coeffs,
+                                             unsigned char *tbls, int n, unsigned char *dest,
+                                             int start, int end, int add)
+{
+  switch (GALOIS_RELAXED_LOAD(galois_kernel)) {
+#ifdef GALOIS_X86_KERNELS
+    case GALOIS_KERNEL_AVX512:
+    case GALOIS_KERNEL_AVX2:
+      if (w == 16) {
+        galois_w16_region_dotprod_avx2(srcs, coeffs, tbls, n, dest, start, end, add);
+      } else {
+        galois_w32_region_dotprod_avx2(srcs, coeffs, tbls, n, dest, start, end, add);
+      }
+      break;
+    case GALOIS_KERNEL_SSSE3:
+      if (w == 16) {
+        galois_w16_region_dotprod_ssse3(srcs, coeffs, tbls, n, dest, start, end, add);
+      } else {
+        galois_w32_region_dotprod_ssse3(srcs, coeffs, tbls, n, dest, start, end, add);
+      }
+      break;
+#endif
+    default:
+      galois_wxx_region_dotprod_scalar(w, srcs, coeffs, tbls, n, dest, start, end, add);
+      break;
+  }
+}
+
+/* Runs the native w=16 or w=32 kernel over batches of sources, building
+   the split tables of each batch on the stack. */
+
+static void galois_wxx_region_dotprod_native(galois_field_t *f, int w, unsigned char **srcs,
+                                             int *coeffs, int n, unsigned char *dest, int nbytes)
+{
+  unsigned char tbls[GALOIS_DOTPROD_BATCH*GALOIS_SPLIT_TABLE_BYTES(32)];
+  int start, nb, j;
+
+  start = 0;
+  do {
+    nb = (n - start < GALOIS_DOTPROD_BATCH) ? n - start : GALOIS_DOTPROD_BATCH;
+    for (j = 0; j < nb; j++) {
+      if (coeffs[start+j] != 0 && coeffs[start+j] != 1) {
+        galois_build_split_tables(f, w, coeffs[start+j], tbls + j*GALOIS_SPLIT_TABLE_BYTES(w));
+      }
+    }
+    galois_wxx_region_dotprod_kernel(w, srcs+start, coeffs+start, tbls, nb, dest, 0, nbytes, start > 0);
+    start += nb;
+  } while (start < n);
+}
+
+/* With the default field, w=16 and w=32 regions are multiplied by the
+   native kernels too, as dot products of one source. */
+
+static void galois_wxx_field_multiply(galois_field_t *f, int w, char *region, int multby,
+                                      int nbytes, char *r2, int add)
+{
+  unsigned char tbls[GALOIS_SPLIT_TABLE_BYTES(32)];
+  unsigned char *src;
+
+  if (r2 == NULL) {
+    r2 = region;
+    add = 0;
+  }
+  if (!galois_native(f)) {
+    f->gf->multiply_region.w32(f->gf, region, r2, multby, nbytes, add);
+    return;
+  }
+  if (multby != 0 && multby != 1) galois_build_split_tables(f, w, multby, tbls);
+  src = (unsigned char *) region;
+  galois_wxx_region_dotprod_kernel(w, &src, &multby, tbls, 1, (unsigned char *) r2, 0, nbytes, add);
+}
+
+static void galois_check_region_w(const char *name, int w)
+{
+  if (w != 8 && w != 16 && w != 32) {
+    fprintf(stderr, "ERROR: %s() called and w is not 8, 16 or 32\n", name);
+    assert(0);
+  }
+}
+
+void galois_context_region_multiply(galois_context_t *ctx, int w, char *region, int multby,
+                                    int nbytes, char *r2, int add)
+{
+  galois_field_t *f;
+
+  galois_check_region_w("galois_context_region_multiply", w);
+  f = galois_enter_context(ctx, w);
+  if (w == 8) {
+    galois_w08_field_multiply(f, region, multby, nbytes, r2, add);
+  } else {
+    galois_wxx_field_multiply(f, w, region, multby, nbytes, r2, add);
+  }
+  galois_read_unlock();
+}
+
 void galois_w08_region_multiply(char *region,      /* Region to multiply */
                                   int multby,       /* Number to multiply by */
                                   int nbytes,        /* Number of bytes in region */
                                   char *r2,          /* If r2 != NULL, products go here */
                                   int add)
 {
-  if (gfp_array[8] == NULL) {
-    galois_init(8);
-  }
-  gfp_array[8]->multiply_region.w32(gfp_array[8], region, r2, multby, nbytes, add);
+  galois_context_region_multiply(NULL, 8, region, multby, nbytes, r2, add);
 }
 
 void galois_w16_region_multiply(char *region,      /* Region to multiply */
@@ -313,47 +1694,274 @@ void galois_w16_region_multiply(char *region,      /* Region to multiply */
                                   char *r2,          /* If r2 != NULL, products go here */
                                   int add)
 {
-  if (gfp_array[16] == NULL) {
-    galois_init(16);
-  }
-  gfp_array[16]->multiply_region.w32(gfp_array[16], region, r2, multby, nbytes, add);
+  galois_context_region_multiply(NULL, 16, region, multby, nbytes, r2, add);
 }
 
-
 void galois_w32_region_multiply(char *region,      /* Region to multiply */
                                   int multby,       /* Number to multiply by */
                                   int nbytes,        /* Number of bytes in region */
                                   char *r2,          /* If r2 != NULL, products go here */
                                   int add)
 {
-  if (gfp_array[32] == NULL) {
-    galois_init(32);
+  galois_context_region_multiply(NULL, 32, region, multby, nbytes, r2, add);
+}
+
+static void galois_w08_field_dotprod(galois_field_t *f, char **srcs, int *coeffs, int n,
+                                     char *dest, int size)
+{
+  unsigned char **s, *d;
+
+  if (!galois_native(f)) {
+    galois_region_dotprod_gf(f->gf, srcs, coeffs, n, dest, 0, size);
+    return;
+  }
+
+  s = (unsigned char **) srcs;
+  d = (unsigned char *) dest;
+  switch (GALOIS_RELAXED_LOAD(galois_kernel)) {
+#ifdef GALOIS_X86_KERNELS
+    case GALOIS_KERNEL_AVX512: galois_w08_region_dotprod_avx512(s, coeffs, n, d, size, 0); break;
+    case GALOIS_KERNEL_AVX2:   galois_w08_region_dotprod_avx2(s, coeffs, n, d, size, 0); break;
+    case GALOIS_KERNEL_SSSE3:  galois_w08_region_dotprod_ssse3(s, coeffs, n, d, size, 0); break;
+#endif
+    default: galois_w08_region_dotprod_scalar(s, coeffs, n, d, 0, size, 0); break;
   }
-  gfp_array[32]->multiply_region.w32(gfp_array[32], region, r2, multby, nbytes, add);
 }
 
-void galois_w8_region_xor(void *src, void *dest, int nbytes)
+void galois_context_region_dotprod(galois_context_t *ctx, int w, char **srcs, int *coeffs, int n,
+                                   char *dest, int size)
 {
-  if (gfp_array[8] == NULL) {
-    galois_init(8);
+  galois_field_t *f;
+
+  galois_check_region_w("galois_context_region_dotprod", w);
+  f = galois_enter_context(ctx, w);
+  if (w == 8) {
+    galois_w08_field_dotprod(f, srcs, coeffs, n, dest, size);
+  } else if (!galois_native(f)) {
+    galois_region_dotprod_gf(f->gf, srcs, coeffs, n, dest, 0, size);
+  } else {
+    galois_wxx_region_dotprod_native(f, w, (unsigned char **) srcs, coeffs, n, (unsigned char *) dest,
+                                     size);
   }
-  gfp_array[8]->multiply_region.w32(gfp_array[32], src, dest, 1, nbytes, 1);
+  galois_read_unlock();
 }
 
-void galois_w16_region_xor(void *src, void *dest, int nbytes)
+void galois_w08_region_dotprod(char **srcs, int *coeffs, int n, char *dest, int size)
 {
-  if (gfp_array[16] == NULL) {
-    galois_init(16);
+  galois_context_region_dotprod(NULL, 8, srcs, coeffs, n, dest, size);
+}
+
+void galois_w16_region_dotprod(char **srcs, int *coeffs, int n, char *dest, int size)
+{
+  galois_context_region_dotprod(NULL, 16, srcs, coeffs, n, dest, size);
+}
+
+void galois_w32_region_dotprod(char **srcs, int *coeffs, int n, char *dest, int size)
+{
+  galois_context_region_dotprod(NULL, 32, srcs, coeffs, n, dest, size);
+}
+
+/* Multi-destination dot products: dests[d] = sum of coeffs[d*n+j]*srcs[j].
+
+   The w=8 kernels load each block of the sources once for up to
+   GALOIS_MULTI_DESTS destinations.  For w=16 and w=32, all of the split
+   tables are built up front if they fit in GALOIS_MULTI_TABLE_BYTES, and
+   the region is then processed GALOIS_DOTPROD_CHUNK bytes at a time,
+   every destination in turn, so that only the first destination of each
+   chunk reads the sources from memory; the rest hit the cache.  The
+   GF-Complete path is chunked the same way. */
+
+static void galois_region_dotprod_multi_gf(gf_t *gf, char **srcs, int *coeffs, int n,
+                                           char **dests, int ndests, int size)
+{
+  int off, end, d;
+
+  for (off = 0; off < size; off += GALOIS_DOTPROD_CHUNK) {
+    end = (size - off < GALOIS_DOTPROD_CHUNK) ? size : off + GALOIS_DOTPROD_CHUNK;
+    for (d = 0; d < ndests; d++) {
+      galois_region_dotprod_gf(gf, srcs, coeffs+d*n, n, dests[d], off, end);
+    }
   }
-  gfp_array[16]->multiply_region.w32(gfp_array[16], src, dest, 1, nbytes, 1);
 }
 
-void galois_w32_region_xor(void *src, void *dest, int nbytes)
+static void galois_wxx_region_dotprod_multi_chunks(int w, unsigned char **srcs, int *coeffs,
+                                                   unsigned char *tbls, int n, unsigned char **dests,
+                                                   int ndests, int nbytes)
+{
+  int tb, off, end, d;
+
+  tb = GALOIS_SPLIT_TABLE_BYTES(w);
+  for (off = 0; off < nbytes; off += GALOIS_DOTPROD_CHUNK) {
+    end = (nbytes - off < GALOIS_DOTPROD_CHUNK) ? nbytes : off + GALOIS_DOTPROD_CHUNK;
+    for (d = 0; d < ndests; d++) {
+      galois_wxx_region_dotprod_kernel(w, srcs, coeffs+d*n, tbls + d*n*tb, n, dests[d], off, end, 0);
+    }
+  }
+}
+
+static void galois_wxx_region_dotprod_multi_native(galois_field_t *f, int w, unsigned char **srcs,
+                                                   int *coeffs, int n, unsigned char **dests,
+                                                   int ndests, int nbytes)
 {
-  if (gfp_array[32] == NULL) {
-    galois_init(32);
+  unsigned char tbls[GALOIS_MULTI_TABLE_BYTES];
+  int tb, d, j;
+
+  tb = GALOIS_SPLIT_TABLE_BYTES(w);
+  if (n > 0 && ndests > GALOIS_MULTI_TABLE_BYTES / (n * tb)) {
+    for (d = 0; d < ndests; d++) {
+      galois_wxx_region_dotprod_native(f, w, srcs, coeffs+d*n, n, dests[d], nbytes);
+    }
+    return;
   }
-  gfp_array[32]->multiply_region.w32(gfp_array[32], src, dest, 1, nbytes, 1);
+
+  for (j = 0; j < n * ndests; j++) {
+    if (coeffs[j] != 0 && coeffs[j] != 1) {
+      galois_build_split_tables(f, w, coeffs[j], tbls + j*tb);
+    }
+  }
+  galois_wxx_region_dotprod_multi_chunks(w, srcs, coeffs, tbls, n, dests, ndests, nbytes);
+}
+
+static void galois_w08_field_dotprod_multi(galois_field_t *f, char **srcs, int *coeffs, int n,
+                                           char **dests, int ndests, int size)
+{
+  unsigned char **s, **dp;
+  int d, nd, i;
+
+  if (!galois_native(f)) {
+    galois_region_dotprod_multi_gf(f->gf, srcs, coeffs, n, dests, ndests, size);
+    return;
+  }
+
+  s = (unsigned char **) srcs;
+  for (d = 0; d < ndests; d += GALOIS_MULTI_DESTS) {
+    nd = (ndests - d < GALOIS_MULTI_DESTS) ? ndests - d : GALOIS_MULTI_DESTS;
+    dp = (unsigned char **) dests + d;
+    switch (GALOIS_RELAXED_LOAD(galois_kernel)) {
+#ifdef GALOIS_X86_KERNELS
+      case GALOIS_KERNEL_AVX512: galois_w08_region_dotprod_multi_avx512(s, coeffs+d*n, n, dp, nd, size); break;
+      case GALOIS_KERNEL_AVX2:   galois_w08_region_dotprod_multi_avx2(s, coeffs+d*n, n, dp, nd, size); break;
+      case GALOIS_KERNEL_SSSE3:  galois_w08_region_dotprod_multi_ssse3(s, coeffs+d*n, n, dp, nd, size); break;
+#endif
+      default:
+        for (i = 0; i < nd; i++) galois_w08_region_dotprod_scalar(s, coeffs+(d+i)*n, n, dp[i], 0, size, 0);
+        break;
+    }
+  }
+}
+
+void galois_context_region_dotprod_multi(galois_context_t *ctx, int w, char **srcs, int *coeffs,
+                                         int n, char **dests, int ndests, int size)
+{
+  galois_field_t *f;
+
+  galois_check_region_w("galois_context_region_dotprod_multi", w);
+  f = galois_enter_context(ctx, w);
+  if (w == 8) {
+    galois_w08_field_dotprod_multi(f, srcs, coeffs, n, dests, ndests, size);
+  } else if (!galois_native(f)) {
+    galois_region_dotprod_multi_gf(f->gf, srcs, coeffs, n, dests, ndests, size);
+  } else {
+    galois_wxx_region_dotprod_multi_native(f, w, (unsigned char **) srcs, coeffs, n,
+                                           (unsigned char **) dests, ndests, size);
+  }
+  galois_read_unlock();
+}
+
+void galois_w08_region_dotprod_multi(char **srcs, int *coeffs, int n,
+                                     char **dests, int ndests, int size)
+{
+  galois_context_region_dotprod_multi(NULL, 8, srcs, coeffs, n, dests, ndests, size);
+}
+
+void galois_w16_region_dotprod_multi(char **srcs, int *coeffs, int n,
+                                     char **dests, int ndests, int size)
+{
+  galois_context_region_dotprod_multi(NULL, 16, srcs, coeffs, n, dests, ndests, size);
+}
+
+void galois_w32_region_dotprod_multi(char **srcs, int *coeffs, int n,
+                                     char **dests, int ndests, int size)
+{
+  galois_context_region_dotprod_multi(NULL, 32, srcs, coeffs, n, dests, ndests, size);
+}
+
+int galois_region_dotprod_table_bytes(int w, int n)
+{
+  return (w == 16 || w == 32) ? n * GALOIS_SPLIT_TABLE_BYTES(w) : 0;
+}
+
+void galois_region_dotprod_build_tables(int w, int *coeffs, int n, unsigned char *tables)
+{
+  galois_context_region_dotprod_build_tables(NULL, w, coeffs, n, tables);
+}
+
+void galois_context_region_dotprod_build_tables(galois_context_t *ctx, int w, int *coeffs, int n,
+                                                unsigned char *tables)
+{
+  galois_field_t *f;
+  int j;
+
+  if (w != 16 && w != 32) return;
+  f = galois_enter_context(ctx, w);
+  for (j = 0; j < n; j++) {
+    if (coeffs[j] != 0 && coeffs[j] != 1) {
+      galois_build_split_tables(f, w, coeffs[j], tables + j*GALOIS_SPLIT_TABLE_BYTES(w));
+    }
+  }
+  galois_read_unlock();
+}
+
+void galois_region_dotprod_multi_tables(int w, char **srcs, int *coeffs, unsigned char *tables,
+                                        int n, char **dests, int ndests, int size)
+{
+  galois_context_region_dotprod_multi_tables(NULL, w, srcs, coeffs, tables, n, dests, ndests, size);
+}
+
+void galois_context_region_dotprod_multi_tables(galois_context_t *ctx, int w, char **srcs,
+                                                int *coeffs, unsigned char *tables, int n,
+                                                char **dests, int ndests, int size)
+{
+  galois_field_t *f;
+
+  galois_check_region_w("galois_region_dotprod_multi_tables", w);
+  f = galois_enter_context(ctx, w);
+  if (w == 8) {
+    galois_w08_field_dotprod_multi(f, srcs, coeffs, n, dests, ndests, size);
+  } else if (!galois_native(f)) {
+    galois_region_dotprod_multi_gf(f->gf, srcs, coeffs, n, dests, ndests, size);
+  } else {
+    galois_wxx_region_dotprod_multi_chunks(w, (unsigned char **) srcs, coeffs, tables, n,
+                                           (unsigned char **) dests, ndests, size);
+  }
+  galois_read_unlock();
+}
+
+void galois_w8_region_xor(void *src, void *dest, int nbytes)
+{
+  galois_field_t *f;
+
+  f = galois_enter(8);
+  f->gf->multiply_region.w32(f->gf, src, dest, 1, nbytes, 1);
+  galois_read_unlock();
+}
+
+void galois_w16_region_xor(void *src, void *dest, int nbytes)
+{
+  galois_field_t *f;
+
+  f = galois_enter(16);
+  f->gf->multiply_region.w32(f->gf, src, dest, 1, nbytes, 1);
+  galois_read_unlock();
+}
+
+void galois_w32_region_xor(void *src, void *dest, int nbytes)
+{
+  galois_field_t *f;
+
+  f = galois_enter(32);
+  f->gf->multiply_region.w32(f->gf, src, dest, 1, nbytes, 1);
+  galois_read_unlock();
 }
 
 void galois_region_xor(char *src, char *dest, int nbytes)
@@ -370,6 +1978,190 @@ void galois_region_xor(char *src, char *dest, int nbytes)
   }
 }
 
+/* XOR of n regions:  dest = srcs[0] ^ ... ^ srcs[n-1].  The native kernels
+   keep the running XOR in registers and write each block of dest once.
+   Once dest is GALOIS_XOR_STREAM_BYTES or more, its head is done in scalar
+   code until dest is aligned, and the rest is written with non-temporal
+   stores, so that writing the parity does not evict the sources from the
+   cache.  SSE2 is part of every x86-64 CPU, so the SSSE3 level uses it. */
+
+#define GALOIS_XOR_STREAM_BYTES (1024*1024)
+
+#ifdef GALOIS_X86_KERNELS
+
+static void galois_region_xor_n_scalar(unsigned char **srcs, int n, unsigned char *dest,
+                                       int start, int nbytes)
+{
+  uint64_t p, x;
+  int i, j;
+
+  for (i = start; i + 8 <= nbytes; i += 8) {
+    memcpy(&p, srcs[0]+i, 8);
+    for (j = 1; j < n; j++) {
+      memcpy(&x, srcs[j]+i, 8);
+      p ^= x;
+    }
+    memcpy(dest+i, &p, 8);
+  }
+  for (; i < nbytes; i++) {
+    x = srcs[0][i];
+    for (j = 1; j < n; j++) x ^= srcs[j][i];
+    dest[i] = x;
+  }
+}
+
+/* Returns the number of bytes to do in scalar code before dest is aligned
+   to align bytes, or -1 if dest is too small for streaming stores. */
+
+static int galois_region_xor_n_head(unsigned char *dest, int nbytes, int align)
+{
+  if (nbytes < GALOIS_XOR_STREAM_BYTES) return -1;
+  return (align - (int) ((uintptr_t) dest & (align-1))) & (align-1);
+}
+
+GALOIS_TARGET("sse2")
+static void galois_region_xor_n_sse2(unsigned char **srcs, int n, unsigned char *dest, int nbytes)
+{
+  __m128i a0, a1, a2, a3;
+  int i, j, head;
+
+  head = galois_region_xor_n_head(dest, nbytes, 16);
+  i = (head < 0) ? 0 : head;
+  galois_region_xor_n_scalar(srcs, n, dest, 0, i);
+  for (; i + 64 <= nbytes; i += 64) {
+    a0 = _mm_loadu_si128((__m128i *) (srcs[0]+i));
+    a1 = _mm_loadu_si128((__m128i *) (srcs[0]+i+16));
+    a2 = _mm_loadu_si128((__m128i *) (srcs[0]+i+32));
+    a3 = _mm_loadu_si128((__m128i *) (srcs[0]+i+48));
+    for (j = 1; j < n; j++) {
+      a0 = _mm_xor_si128(a0, _mm_loadu_si128((__m128i *) (srcs[j]+i)));
+      a1 = _mm_xor_si128(a1, _mm_loadu_si128((__m128i *) (srcs[j]+i+16)));
+      a2 = _mm_xor_si128(a2, _mm_loadu_si128((__m128i *) (srcs[j]+i+32)));
+      a3 = _mm_xor_si128(a3, _mm_loadu_si128((__m128i *) (srcs[j]+i+48)));
+    }
+    if (head >= 0) {
+      _mm_stream_si128((__m128i *) (dest+i), a0);
+      _mm_stream_si128((__m128i *) (dest+i+16), a1);
+      _mm_stream_si128((__m128i *) (dest+i+32), a2);
+      _mm_stream_si128((__m128i *) (dest+i+48), a3);
+    } else {
+      _mm_storeu_si128((__m128i *) (dest+i), a0);
+      _mm_storeu_si128((__m128i *) (dest+i+16), a1);
+      _mm_storeu_si128((__m128i *) (dest+i+32), a2);
+      _mm_storeu_si128((__m128i *) (dest+i+48), a3);
+    }
+  }
+  if (head >= 0) _mm_sfence();
+  galois_region_xor_n_scalar(srcs, n, dest, i, nbytes);
+}
+
+GALOIS_TARGET("avx2")
+static void galois_region_xor_n_avx2(unsigned char **srcs, int n, unsigned char *dest, int nbytes)
+{
+  __m256i a0, a1, a2, a3;
+  int i, j, head;
+
+  head = galois_region_xor_n_head(dest, nbytes, 32);
+  i = (head < 0) ? 0 : head;
+  galois_region_xor_n_scalar(srcs, n, dest, 0, i);
+  for (; i + 128 <= nbytes; i += 128) {
+    a0 = _mm256_loadu_si256((__m256i *) (srcs[0]+i));
+    a1 = _mm256_loadu_si256((__m256i *) (srcs[0]+i+32));
+    a2 = _mm256_loadu_si256((__m256i *) (srcs[0]+i+64));
+    a3 = _mm256_loadu_si256((__m256i *) (srcs[0]+i+96));
+    for (j = 1; j < n; j++) {
+      a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((__m256i *) (srcs[j]+i)));
+      a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((__m256i *) (srcs[j]+i+32)));
+      a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((__m256i *) (srcs[j]+i+64)));
+      a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((__m256i *) (srcs[j]+i+96)));
+    }
+    if (head >= 0) {
+      _mm256_stream_si256((__m256i *) (dest+i), a0);
+      _mm256_stream_si256((__m256i *) (dest+i+32), a1);
+      _mm256_stream_si256((__m256i *) (dest+i+64), a2);
+      _mm256_stream_si256((__m256i *) (dest+i+96), a3);
+    } else {
+      _mm256_storeu_si256((__m256i *) (dest+i), a0);
+      _mm256_storeu_si256((__m256i *) (dest+i+32), a1);
+      _mm256_storeu_si256((__m256i *) (dest+i+64), a2);
+      _mm256_storeu_si256((__m256i *) (dest+i+96), a3);
+    }
+  }
+  if (head >= 0) _mm_sfence();
+  galois_region_xor_n_scalar(srcs, n, dest, i, nbytes);
+}
+
+GALOIS_TARGET("avx512f")
+static void galois_region_xor_n_avx512(unsigned char **srcs, int n, unsigned char *dest, int nbytes)
+{
+  __m512i a0, a1, a2, a3;
+  int i, j, head;
+
+  head = galois_region_xor_n_head(dest, nbytes, 64);
+  i = (head < 0) ? 0 : head;
+  galois_region_xor_n_scalar(srcs, n, dest, 0, i);
+  for (; i + 256 <= nbytes; i += 256) {
+    a0 = _mm512_loadu_si512((void *) (srcs[0]+i));
+    a1 = _mm512_loadu_si512((void *) (srcs[0]+i+64));
+    a2 = _mm512_loadu_si512((void *) (srcs[0]+i+128));
+    a3 = _mm512_loadu_si512((void *) (srcs[0]+i+192));
+    for (j = 1; j < n; j++) {
+      a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((void *) (srcs[j]+i)));
+      a1 = _mm512_xor_si512(a1, _mm512_loadu_si512((void *) (srcs[j]+i+64)));
+      a2 = _mm512_xor_si512(a2, _mm512_loadu_si512((void *) (srcs[j]+i+128)));
+      a3 = _mm512_xor_si512(a3, _mm512_loadu_si512((void *) (srcs[j]+i+192)));
+    }
+    if (head >= 0) {
+      _mm512_stream_si512((void *) (dest+i), a0);
+      _mm512_stream_si512((void *) (dest+i+64), a1);
+      _mm512_stream_si512((void *) (dest+i+128), a2);
+      _mm512_stream_si512((void *) (dest+i+192), a3);
+    } else {
+      _mm512_storeu_si512((void *) (dest+i), a0);
+      _mm512_storeu_si512((void *) (dest+i+64), a1);
+      _mm512_storeu_si512((void *) (dest+i+128), a2);
+      _mm512_storeu_si512((void *) (dest+i+192), a3);
+    }
+  }
+  if (head >= 0) _mm_sfence();
+  galois_region_xor_n_scalar(srcs, n, dest, i, nbytes);
+}
+
+#endif
+
+void galois_region_xor_n(char **srcs, int n, char *dest, int size)
+{
+  int off, len, j;
+
+  if (n <= 0) {
+    memset(dest, 0, size);
+    return;
+  }
+
+  switch (galois_get_region_kernel()) {
+#ifdef GALOIS_X86_KERNELS
+    case GALOIS_KERNEL_AVX512:
+      galois_region_xor_n_avx512((unsigned char **) srcs, n, (unsigned char *) dest, size);
+      return;
+    case GALOIS_KERNEL_AVX2:
+      galois_region_xor_n_avx2((unsigned char **) srcs, n, (unsigned char *) dest, size);
+      return;
+    case GALOIS_KERNEL_SSSE3:
+      galois_region_xor_n_sse2((unsigned char **) srcs, n, (unsigned char *) dest, size);
+      return;
+#endif
+  }
+
+  /* Without native kernels, XOR the sources in with GF-Complete, one
+     GALOIS_DOTPROD_CHUNK of dest at a time. */
+
+  for (off = 0; off < size; off += GALOIS_DOTPROD_CHUNK) {
+    len = (size - off < GALOIS_DOTPROD_CHUNK) ? size - off : GALOIS_DOTPROD_CHUNK;
+    if (dest != srcs[0]) memcpy(dest+off, srcs[0]+off, len);
+    for (j = 1; j < n; j++) galois_region_xor(srcs[j]+off, dest+off, len);
+  }
+}
+
 int galois_inverse(int y, int w)
 {
   if (y == 0) return -1;
@@ -47,16 +47,339 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef JERASURE_PTHREADS
+#include <pthread.h>
+#endif
 
 #include "galois.h"
 #include "jerasure.h"
 
 #define talloc(type, num) (type *) malloc(sizeof(type)*(num))
 
-static double jerasure_total_xor_bytes = 0;
-static double jerasure_total_gf_bytes = 0;
-static double jerasure_total_memcpy_bytes = 0;
+/* Dot products with up to this many sources keep their source pointers
+   on the stack. */
+
+#define JERASURE_DOTPROD_SRCS 256
+
+#ifdef JERASURE_PTHREADS
+#define JERASURE_LOCK(mutex) pthread_mutex_lock(mutex)
+#define JERASURE_UNLOCK(mutex) pthread_mutex_unlock(mutex)
+#else
+#define JERASURE_LOCK(mutex)
+#define JERASURE_UNLOCK(mutex)
+#endif
+
+/* Stats:  every thread counts into a jerasure_stats_block of its own, so
+   that the hot paths neither race with each other nor share a cache line.
+   Only the owner adds to its counts, with a relaxed load and store, and
+   jerasure_stats_collect() sums the blocks when the stats are read.  A
+   reset does not touch the counts:  it moves the block's base up to them,
+   and the stats are the counts above the base.  The counts of threads that
+   have exited are folded into jerasure_stats_retired, and their blocks
+   are reused.  Blocks are only registered and collected under
+   jerasure_stats_mutex.
+
+   Compiled with JERASURE_NO_STATS, JERASURE_COUNT() is empty, so that
+   the hot paths do no counting at all, and the stats are always 0. */
+
+#if defined(__GNUC__)
+#define JERASURE_RELAXED_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define JERASURE_RELAXED_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define JERASURE_THREAD_LOCAL __thread
+#else
+#define JERASURE_RELAXED_LOAD(x)     (x)
+#define JERASURE_RELAXED_STORE(x, v) ((x) = (v))
+#define JERASURE_THREAD_LOCAL
+#endif
+
+#ifdef JERASURE_NO_STATS
+#define JERASURE_COUNT(stat, v)
+#define JERASURE_COUNTING 0
+#else
+#define JERASURE_COUNT(stat, v) jerasure_stats_add((stat), (v))
+#define JERASURE_COUNTING 1
+
+/* The inversion time is counted in nanoseconds. */
+
+typedef struct jerasure_stats_block {
+  uint64_t count[JERASURE_NSTATS];
+  uint64_t base[JERASURE_NSTATS];
+  int in_use;
+  struct jerasure_stats_block *next;
+  char pad[64];
+} jerasure_stats_block;
+
+static jerasure_stats_block *jerasure_stats_blocks = NULL;
+static uint64_t jerasure_stats_retired[JERASURE_NSTATS];
+static JERASURE_THREAD_LOCAL jerasure_stats_block *jerasure_my_stats = NULL;
+
+#ifdef JERASURE_PTHREADS
+static pthread_mutex_t jerasure_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t jerasure_stats_key;
+static int jerasure_stats_key_made = 0;
+
+static void jerasure_stats_exit(void *arg)
+{
+  jerasure_stats_block *b;
+  int i;
+
+  b = (jerasure_stats_block *) arg;
+  JERASURE_LOCK(&jerasure_stats_mutex);
+  for (i = 0; i < JERASURE_NSTATS; i++) {
+    jerasure_stats_retired[i] += b->count[i] - b->base[i];
+    b->count[i] = 0;
+    b->base[i] = 0;
+  }
+  b->in_use = 0;
+  JERASURE_UNLOCK(&jerasure_stats_mutex);
+  jerasure_my_stats = NULL;
+}
+#endif
+
+static jerasure_stats_block *jerasure_stats_register(void)
+{
+  jerasure_stats_block *b;
+
+  JERASURE_LOCK(&jerasure_stats_mutex);
+#ifdef JERASURE_PTHREADS
+  if (!jerasure_stats_key_made) {
+    if (pthread_key_create(&jerasure_stats_key, jerasure_stats_exit) != 0) {
+      JERASURE_UNLOCK(&jerasure_stats_mutex);
+      return NULL;
+    }
+    jerasure_stats_key_made = 1;
+  }
+#endif
+  for (b = jerasure_stats_blocks; b != NULL && b->in_use; b = b->next) ;
+  if (b == NULL) {
+    b = (jerasure_stats_block *) calloc(1, sizeof(jerasure_stats_block));
+    if (b == NULL) {
+      JERASURE_UNLOCK(&jerasure_stats_mutex);
+      return NULL;
+    }
+    b->next = jerasure_stats_blocks;
+    jerasure_stats_blocks = b;
+  }
+  b->in_use = 1;
+  JERASURE_UNLOCK(&jerasure_stats_mutex);
+#ifdef JERASURE_PTHREADS
+  pthread_setspecific(jerasure_stats_key, b);
+#endif
+  jerasure_my_stats = b;
+  return b;
+}
+
+/* If no block can be had, the count is lost, rather than the call. */
+
+static void jerasure_stats_add(int stat, uint64_t v)
+{
+  jerasure_stats_block *b;
+
+  b = jerasure_my_stats;
+  if (b == NULL) b = jerasure_stats_register();
+  if (b == NULL) return;
+  JERASURE_RELAXED_STORE(b->count[stat], JERASURE_RELAXED_LOAD(b->count[stat]) + v);
+}
+
+static uint64_t jerasure_stats_nsec(void)
+{
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+/* Puts stats [first, first+n) into fill_in, and resets them. */
+
+static void jerasure_stats_collect(double *fill_in, int first, int n)
+{
+#ifndef JERASURE_NO_STATS
+  jerasure_stats_block *b;
+  uint64_t c, total;
+  int i;
+
+  JERASURE_LOCK(&jerasure_stats_mutex);
+  for (i = first; i < first+n; i++) {
+    total = jerasure_stats_retired[i];
+    jerasure_stats_retired[i] = 0;
+    for (b = jerasure_stats_blocks; b != NULL; b = b->next) {
+      c = JERASURE_RELAXED_LOAD(b->count[i]);
+      total += c - b->base[i];
+      b->base[i] = c;
+    }
+    fill_in[i-first] = (i == JERASURE_STAT_INVERT_SECONDS) ? total / 1e9 : (double) total;
+  }
+  JERASURE_UNLOCK(&jerasure_stats_mutex);
+#else
+  int i;
+
+  (void) first;
+  for (i = 0; i < n; i++) fill_in[i] = 0;
+#endif
+}
+
+/* Tiling: the encoders and decoders apply every row to one tile of the
+   devices before they move on to the next tile, so that the tile stays in
+   cache for all of the rows.  jerasure_tile_size is the number of bytes of
+   each device in a tile, or 0 to pick one from the size of the L2 cache. */
+
+#define JERASURE_TILE_UNIT 64
+#define JERASURE_DEFAULT_L2 (256*1024)
+
+static int jerasure_tile_size = 0;
+static int jerasure_l2_size = 0;
+
+void jerasure_set_tile_size(int bytes)
+{
+  JERASURE_RELAXED_STORE(jerasure_tile_size, (bytes > 0) ? bytes : 0);
+}
+
+int jerasure_get_tile_size()
+{
+  return JERASURE_RELAXED_LOAD(jerasure_tile_size);
+}
+
+static int jerasure_detect_l2_size()
+{
+  long l2;
+
+  l2 = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  return (l2 > 0 && l2 < (1 << 30)) ? (int) l2 : JERASURE_DEFAULT_L2;
+}
+
+/* Returns the tile for ndevs devices, as a multiple of unit bytes.  The
+   automatic tile lets all of the devices share half of the L2 cache. */
+
+static int jerasure_tile_bytes(int ndevs, int unit, int size)
+{
+  int t;
+
+  t = JERASURE_RELAXED_LOAD(jerasure_tile_size);
+  if (t <= 0) {
+    t = JERASURE_RELAXED_LOAD(jerasure_l2_size);
+    if (t == 0) {
+      t = jerasure_detect_l2_size();
+      JERASURE_RELAXED_STORE(jerasure_l2_size, t);
+    }
+    t = t / 2 / ((ndevs > 0) ? ndevs : 1);
+  }
+  t -= t % unit;
+  if (t < unit) t = unit;
+  return (t > size) ? size : t;
+}
+
+/* Accounts for one dot product row in the stats:  the first 1 of the row
+   is a copy, the other 1's are XORs, and the rest are multiplications by
+   a constant in GF(2^w). */
+
+static void jerasure_count_dotprod_bytes(int k, int w, int *matrix_row, int size)
+{
+#ifndef JERASURE_NO_STATS
+  int i, copies, xors, gfs;
+
+  copies = 0;
+  xors = 0;
+  gfs = 0;
+  for (i = 0; i < k; i++) {
+    if (matrix_row[i] == 1) {
+      if (copies) xors++; else copies = 1;
+    } else if (matrix_row[i] != 0) {
+      gfs++;
+    }
+  }
+  if (copies) {
+    JERASURE_COUNT(JERASURE_STAT_COPY_CALLS, 1);
+    JERASURE_COUNT(JERASURE_STAT_COPY_BYTES, size);
+  }
+  if (xors) {
+    JERASURE_COUNT(JERASURE_STAT_XOR_CALLS, xors);
+    JERASURE_COUNT(JERASURE_STAT_XOR_BYTES, (uint64_t) xors * size);
+  }
+  if (gfs) {
+    JERASURE_COUNT(JERASURE_STAT_GF_CALLS, gfs);
+    JERASURE_COUNT(JERASURE_STAT_GF_BYTES, (uint64_t) gfs * size);
+    switch (w) {
+      case 8:  JERASURE_COUNT(JERASURE_STAT_GF08_BYTES, (uint64_t) gfs * size); break;
+      case 16: JERASURE_COUNT(JERASURE_STAT_GF16_BYTES, (uint64_t) gfs * size); break;
+      case 32: JERASURE_COUNT(JERASURE_STAT_GF32_BYTES, (uint64_t) gfs * size); break;
+    }
+  }
+#else
+  (void) k;
+  (void) w;
+  (void) matrix_row;
+  (void) size;
+#endif
+}
+
+/* Accounts for the operations of a schedule, which are done packetsize
+   bytes at a time. */
+
+static void jerasure_count_schedule(long xors, long copies, int packetsize)
+{
+#ifdef JERASURE_NO_STATS
+  (void) xors;
+  (void) copies;
+  (void) packetsize;
+#endif
+  JERASURE_COUNT(JERASURE_STAT_XOR_CALLS, xors);
+  JERASURE_COUNT(JERASURE_STAT_XOR_BYTES, (uint64_t) xors * packetsize);
+  JERASURE_COUNT(JERASURE_STAT_COPY_CALLS, copies);
+  JERASURE_COUNT(JERASURE_STAT_COPY_BYTES, (uint64_t) copies * packetsize);
+}
+
+/* Computes bytes [off, off+len) of one matrix dot product.  The bytes are
+   not counted in the stats; the callers do that once for the whole row. */
+
+static void jerasure_matrix_dotprod_range(int k, int w, int *matrix_row,
+                          int *src_ids, int dest_id,
+                          char **data_ptrs, char **coding_ptrs, int off, int len)
+{
+  char *dptr;
+  char *srcs_buf[JERASURE_DOTPROD_SRCS], **srcs;
+  int i;
+
+  dptr = ((dest_id < k) ? data_ptrs[dest_id] : coding_ptrs[dest_id-k]) + off;
+
+  srcs = (k <= JERASURE_DOTPROD_SRCS) ? srcs_buf : talloc(char *, k);
+  if (srcs == NULL) {
+    fprintf(stderr, "ERROR: jerasure_matrix_dotprod() cannot allocate %d source pointers\n", k);
+    assert(0);
+  }
+
+  /* Gather the sources, and compute the whole row in one pass over dptr.
+     With w = 1, the elements are all 0 or 1, so any field will do. */
+
+  for (i = 0; i < k; i++) {
+    if (src_ids == NULL) {
+      srcs[i] = data_ptrs[i] + off;
+    } else if (src_ids[i] < k) {
+      srcs[i] = data_ptrs[src_ids[i]] + off;
+    } else {
+      srcs[i] = coding_ptrs[src_ids[i]-k] + off;
+    }
+  }
+
+  switch (w) {
+    case 1:
+    case 8:  galois_w08_region_dotprod(srcs, matrix_row, k, dptr, len); break;
+    case 16: galois_w16_region_dotprod(srcs, matrix_row, k, dptr, len); break;
+    case 32: galois_w32_region_dotprod(srcs, matrix_row, k, dptr, len); break;
+  }
+
+  if (srcs != srcs_buf) free(srcs);
+}
 
 void jerasure_print_matrix(int *m, int rows, int cols, int w)
 {
@@ -96,9 +419,35 @@ void jerasure_print_bitmatrix(int *m, int rows, int cols, int w)
   }
 }
 
-int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
+/* Inverts the k*k matrix (or k*w*k*w bitmatrix) of a decoding matrix, and
+   counts it, and the time that it took, in the stats. */
+
+static int jerasure_invert_decoding_matrix(galois_context_t *ctx, int is_bitmatrix, int *tmpmat,
+                                           int *decoding_matrix, int k, int w)
+{
+  int rc;
+#ifndef JERASURE_NO_STATS
+  uint64_t start;
+
+  start = jerasure_stats_nsec();
+#endif
+  if (is_bitmatrix) {
+    rc = jerasure_invert_bitmatrix(tmpmat, decoding_matrix, k*w);
+  } else {
+    rc = jerasure_context_invert_matrix(ctx, tmpmat, decoding_matrix, k, w);
+  }
+  JERASURE_COUNT(JERASURE_STAT_DECODING_MATRICES, 1);
+  JERASURE_COUNT(JERASURE_STAT_INVERT_SECONDS, jerasure_stats_nsec() - start);
+  return rc;
+}
+
+/* The decoding matrix routines build the matrix to invert in tmpmat, which
+   holds k*k (or k*k*w*w) integers.  The public ones allocate it. */
+
+static int jerasure_decoding_matrix_tmp(galois_context_t *ctx, int k, int w, int *matrix,
+                                        int *erased, int *decoding_matrix, int *dm_ids, int *tmpmat)
 {
-  int i, j, *tmpmat;
+  int i, j;
 
   j = 0;
   for (i = 0; j < k; i++) {
@@ -108,8 +457,6 @@ int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased,
     }
   }
 
-  tmpmat = talloc(int, k*k);
-  if (tmpmat == NULL) { return -1; }
   for (i = 0; i < k; i++) {
     if (dm_ids[i] < k) {
       for (j = 0; j < k; j++) tmpmat[i*k+j] = 0;
@@ -121,15 +468,13 @@ int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased,
     }
   }
 
-  i = jerasure_invert_matrix(tmpmat, decoding_matrix, k, w);
-  free(tmpmat);
-  return i;
+  return jerasure_invert_decoding_matrix(ctx, 0, tmpmat, decoding_matrix, k, w);
 }
 
-/* Internal Routine */
-int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
+static int jerasure_decoding_bitmatrix_tmp(int k, int w, int *matrix, int *erased,
+                                           int *decoding_matrix, int *dm_ids, int *tmpmat)
 {
-  int i, j, *tmpmat;
+  int i, j;
   int index, mindex;
 
   j = 0;
@@ -140,8 +485,6 @@ int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *eras
     }
   }
 
-  tmpmat = talloc(int, k*k*w*w);
-  if (tmpmat == NULL) { return -1; }
   for (i = 0; i < k; i++) {
     if (dm_ids[i] < k) {
       index = i*k*w*w;
@@ -160,122 +503,489 @@ int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *eras
     }
   }
 
-  i = jerasure_invert_bitmatrix(tmpmat, decoding_matrix, k*w);
-  free(tmpmat);
-  return i;
+  return jerasure_invert_decoding_matrix(NULL, 1, tmpmat, decoding_matrix, k, w);
 }
 
-int jerasure_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int *erasures,
-                          char **data_ptrs, char **coding_ptrs, int size)
+/* ------------------------------------------------------------ */
+/* The decoding matrix cache.
+
+   Decoded matrices are kept in a hash table, keyed by the coding matrix
+   and the erased vector, and evicted least recently used first once they
+   take more than jerasure_cache_lru.limit bytes.  Each distinct coding matrix
+   is stored once, in a jerasure_dm_code that is shared by its entries.
+   A lookup copies the decoding matrix out under the lock, so an entry may
+   be evicted as soon as the lock is released.  The inversion on a miss is
+   done without the lock. */
+
+#define JERASURE_CACHE_DEFAULT_BYTES (1024*1024)
+#define JERASURE_CACHE_BUCKETS 256
+
+#ifdef JERASURE_PTHREADS
+static pthread_mutex_t jerasure_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+#define JERASURE_CACHE_LOCK() JERASURE_LOCK(&jerasure_cache_mutex)
+#define JERASURE_CACHE_UNLOCK() JERASURE_UNLOCK(&jerasure_cache_mutex)
+
+/* A least recently used list of cache entries, which start with a
+   jerasure_lru_node.  It is shared by the decoding matrix cache and the
+   schedule caches.  bytes counts everything that the cache holds. */
+
+typedef struct jerasure_lru_node {
+  struct jerasure_lru_node *newer;
+  struct jerasure_lru_node *older;
+  long bytes;
+} jerasure_lru_node;
+
+typedef struct {
+  jerasure_lru_node *newest;
+  jerasure_lru_node *oldest;
+  long bytes;
+  long limit;
+  double hits;
+  double misses;
+} jerasure_lru;
+
+static void jerasure_lru_unlink(jerasure_lru *l, jerasure_lru_node *n)
 {
-  int i, edd, lastdrive;
-  int *tmpids;
-  int *erased, *decoding_matrix, *dm_ids;
+  if (n->newer != NULL) n->newer->older = n->older; else l->newest = n->older;
+  if (n->older != NULL) n->older->newer = n->newer; else l->oldest = n->newer;
+}
 
-  if (w != 8 && w != 16 && w != 32) return -1;
+static void jerasure_lru_push(jerasure_lru *l, jerasure_lru_node *n)
+{
+  n->newer = NULL;
+  n->older = l->newest;
+  if (l->newest != NULL) l->newest->newer = n;
+  l->newest = n;
+  if (l->oldest == NULL) l->oldest = n;
+}
 
-  erased = jerasure_erasures_to_erased(k, m, erasures);
-  if (erased == NULL) return -1;
+static void jerasure_lru_touch(jerasure_lru *l, jerasure_lru_node *n)
+{
+  jerasure_lru_unlink(l, n);
+  jerasure_lru_push(l, n);
+}
 
-  /* Find the number of data drives failed */
+typedef struct jerasure_dm_code {
+  struct jerasure_dm_code *next;
+  int is_bitmatrix, k, m, w;
+  unsigned long field;              /* galois_context_id() of the field of w */
+  int n;                            /* Number of ints in matrix */
+  int refs;                         /* Number of entries that use it */
+  unsigned int hash;
+  int *matrix;
+} jerasure_dm_code;
+
+typedef struct jerasure_dm_entry {
+  jerasure_lru_node lru;
+  struct jerasure_dm_entry *chain;  /* Hash chain */
+  jerasure_dm_code *code;
+  unsigned int hash;
+  int *erased;                      /* k+m */
+  int *dm_ids;                      /* k */
+  int *decoding_matrix;             /* k*k or kw*kw */
+} jerasure_dm_entry;
+
+static jerasure_lru jerasure_cache_lru = { NULL, NULL, 0, JERASURE_CACHE_DEFAULT_BYTES, 0, 0 };
+static jerasure_dm_code *jerasure_cache_codes = NULL;
+static jerasure_dm_entry *jerasure_cache_table[JERASURE_CACHE_BUCKETS];
+
+static unsigned int jerasure_hash_ints(unsigned int h, int *v, int n)
+{
+  int i;
 
-  lastdrive = k;
+  for (i = 0; i < n; i++) h = (h ^ (unsigned int) v[i]) * 16777619U;
+  return h;
+}
 
-  edd = 0;
-  for (i = 0; i < k; i++) {
-    if (erased[i]) {
-      edd++;
-      lastdrive = i;
+static jerasure_dm_code *jerasure_cache_find_code(int is_bitmatrix, int k, int m, int w,
+                                                  unsigned long field, int *matrix, int n,
+                                                  unsigned int hash)
+{
+  jerasure_dm_code *c;
+
+  for (c = jerasure_cache_codes; c != NULL; c = c->next) {
+    if (c->hash == hash && c->is_bitmatrix == is_bitmatrix && c->k == k && c->m == m &&
+        c->w == w && c->field == field && memcmp(c->matrix, matrix, sizeof(int)*n) == 0) return c;
+  }
+  return NULL;
+}
+
+static jerasure_dm_entry *jerasure_cache_find(jerasure_dm_code *code, int *erased, unsigned int hash)
+{
+  jerasure_dm_entry *e;
+
+  for (e = jerasure_cache_table[hash % JERASURE_CACHE_BUCKETS]; e != NULL; e = e->chain) {
+    if (e->hash == hash && e->code == code &&
+        memcmp(e->erased, erased, sizeof(int)*(code->k+code->m)) == 0) return e;
+  }
+  return NULL;
+}
+
+static void jerasure_cache_release_code(jerasure_dm_code *code)
+{
+  jerasure_dm_code **cp;
+
+  code->refs--;
+  if (code->refs > 0) return;
+  for (cp = &jerasure_cache_codes; *cp != code; cp = &(*cp)->next) ;
+  *cp = code->next;
+  jerasure_cache_lru.bytes -= sizeof(jerasure_dm_code) + sizeof(int)*code->n;
+  free(code);
+}
+
+static void jerasure_cache_remove(jerasure_dm_entry *e)
+{
+  jerasure_dm_entry **ep;
+
+  for (ep = &jerasure_cache_table[e->hash % JERASURE_CACHE_BUCKETS]; *ep != e; ep = &(*ep)->chain) ;
+  *ep = e->chain;
+  jerasure_lru_unlink(&jerasure_cache_lru, &e->lru);
+  jerasure_cache_lru.bytes -= e->lru.bytes;
+  jerasure_cache_release_code(e->code);
+  free(e);
+}
+
+/* Evicts the least recently used entries until the cache fits in limit. */
+
+static void jerasure_cache_shrink(long limit)
+{
+  while (jerasure_cache_lru.bytes > limit && jerasure_cache_lru.oldest != NULL) {
+    jerasure_cache_remove((jerasure_dm_entry *) jerasure_cache_lru.oldest);
+  }
+}
+
+/* Adds a decoding matrix to the cache.  Called with the lock held. */
+
+static void jerasure_cache_insert(int is_bitmatrix, int k, int m, int w, unsigned long field,
+                                  int *matrix, int n, unsigned int mhash, int *erased,
+                                  unsigned int hash, int *decoding_matrix, int *dm_ids, int dmsize)
+{
+  jerasure_dm_code *code;
+  jerasure_dm_entry *e;
+  long ebytes, cbytes;
+
+  code = jerasure_cache_find_code(is_bitmatrix, k, m, w, field, matrix, n, mhash);
+  if (code != NULL && jerasure_cache_find(code, erased, hash) != NULL) return;
+
+  ebytes = sizeof(jerasure_dm_entry) + sizeof(int)*(k+m+k+dmsize);
+  cbytes = (code == NULL) ? sizeof(jerasure_dm_code) + sizeof(int)*n : 0;
+  if (ebytes + cbytes > jerasure_cache_lru.limit) return;
+
+  if (code == NULL) {
+    code = (jerasure_dm_code *) malloc(cbytes);
+    if (code == NULL) return;
+    code->is_bitmatrix = is_bitmatrix;
+    code->k = k;
+    code->m = m;
+    code->w = w;
+    code->field = field;
+    code->n = n;
+    code->refs = 0;
+    code->hash = mhash;
+    code->matrix = (int *) (code + 1);
+    memcpy(code->matrix, matrix, sizeof(int)*n);
+    code->next = jerasure_cache_codes;
+    jerasure_cache_codes = code;
+    jerasure_cache_lru.bytes += cbytes;
+  }
+
+  /* The reference keeps the code alive while older entries are evicted. */
+
+  code->refs++;
+  jerasure_cache_shrink(jerasure_cache_lru.limit - ebytes);
+
+  e = (jerasure_dm_entry *) malloc(ebytes);
+  if (e == NULL) {
+    jerasure_cache_release_code(code);
+    return;
+  }
+  e->code = code;
+  e->hash = hash;
+  e->lru.bytes = ebytes;
+  e->erased = (int *) (e + 1);
+  e->dm_ids = e->erased + k+m;
+  e->decoding_matrix = e->dm_ids + k;
+  memcpy(e->erased, erased, sizeof(int)*(k+m));
+  memcpy(e->dm_ids, dm_ids, sizeof(int)*k);
+  memcpy(e->decoding_matrix, decoding_matrix, sizeof(int)*dmsize);
+  e->chain = jerasure_cache_table[hash % JERASURE_CACHE_BUCKETS];
+  jerasure_cache_table[hash % JERASURE_CACHE_BUCKETS] = e;
+  jerasure_lru_push(&jerasure_cache_lru, &e->lru);
+  jerasure_cache_lru.bytes += ebytes;
+}
+
+/* jerasure_make_decoding_matrix/bitmatrix through the cache.  tmpmat is the
+   scratch of the inversion, or NULL to allocate it on a miss.  Matrices
+   are inverted in the field of w of ctx (or of the process), so
+   galois_context_id() of that field is part of the key, and once the field
+   changes, what was cached in the old one is never found again.  A matrix
+   is not cached if the field changed while it was being inverted.
+   Bitmatrices are inverted in GF(2), whatever the field. */
+
+static int jerasure_cached_decoding_matrix(galois_context_t *ctx, int is_bitmatrix, int k, int m,
+                                           int w, int *matrix, int *erased, int *decoding_matrix,
+                                           int *dm_ids, int *tmpmat)
+{
+  jerasure_dm_code *code;
+  jerasure_dm_entry *e;
+  unsigned int mhash, hash;
+  unsigned long field;
+  int n, dmsize, enabled, rc, *tmp;
+
+  n = is_bitmatrix ? k*m*w*w : k*m;
+  dmsize = is_bitmatrix ? k*k*w*w : k*k;
+  field = is_bitmatrix ? 0 : galois_context_id(ctx, w);
+  mhash = 2166136261U ^ (unsigned int) (is_bitmatrix + 2*w + 128*field);
+  mhash = jerasure_hash_ints(mhash, matrix, n);
+  hash = jerasure_hash_ints(mhash, erased, k+m);
+
+  JERASURE_CACHE_LOCK();
+  enabled = (jerasure_cache_lru.limit > 0);
+  if (enabled) {
+    code = jerasure_cache_find_code(is_bitmatrix, k, m, w, field, matrix, n, mhash);
+    e = (code == NULL) ? NULL : jerasure_cache_find(code, erased, hash);
+    if (e != NULL) {
+      memcpy(decoding_matrix, e->decoding_matrix, sizeof(int)*dmsize);
+      memcpy(dm_ids, e->dm_ids, sizeof(int)*k);
+      jerasure_lru_touch(&jerasure_cache_lru, &e->lru);
+      jerasure_cache_lru.hits++;
+      JERASURE_CACHE_UNLOCK();
+      return 0;
     }
+    jerasure_cache_lru.misses++;
   }
-    
-  /* You only need to create the decoding matrix in the following cases:
+  JERASURE_CACHE_UNLOCK();
+
+  tmp = (tmpmat != NULL) ? tmpmat : talloc(int, dmsize);
+  if (tmp == NULL) return -1;
+  if (is_bitmatrix) {
+    rc = jerasure_decoding_bitmatrix_tmp(k, w, matrix, erased, decoding_matrix, dm_ids, tmp);
+  } else {
+    rc = jerasure_decoding_matrix_tmp(ctx, k, w, matrix, erased, decoding_matrix, dm_ids, tmp);
+  }
+  if (tmp != tmpmat) free(tmp);
+  if (rc < 0 || !enabled) return rc;
+
+  JERASURE_CACHE_LOCK();
+  if (jerasure_cache_lru.limit > 0 && (is_bitmatrix || galois_context_id(ctx, w) == field)) {
+    jerasure_cache_insert(is_bitmatrix, k, m, w, field, matrix, n, mhash, erased, hash,
+                          decoding_matrix, dm_ids, dmsize);
+  }
+  JERASURE_CACHE_UNLOCK();
+  return 0;
+}
+
+void jerasure_set_decoding_cache_size(long bytes)
+{
+  JERASURE_CACHE_LOCK();
+  jerasure_cache_lru.limit = (bytes > 0) ? bytes : 0;
+  jerasure_cache_shrink(jerasure_cache_lru.limit);
+  JERASURE_CACHE_UNLOCK();
+}
+
+long jerasure_get_decoding_cache_size()
+{
+  long bytes;
+
+  JERASURE_CACHE_LOCK();
+  bytes = jerasure_cache_lru.limit;
+  JERASURE_CACHE_UNLOCK();
+  return bytes;
+}
+
+void jerasure_clear_decoding_cache()
+{
+  JERASURE_CACHE_LOCK();
+  jerasure_cache_shrink(0);
+  JERASURE_CACHE_UNLOCK();
+}
+
+void jerasure_get_decoding_cache_stats(double *fill_in)
+{
+  JERASURE_CACHE_LOCK();
+  fill_in[0] = jerasure_cache_lru.hits;
+  fill_in[1] = jerasure_cache_lru.misses;
+  fill_in[2] = jerasure_cache_lru.bytes;
+  jerasure_cache_lru.hits = 0;
+  jerasure_cache_lru.misses = 0;
+  JERASURE_CACHE_UNLOCK();
+}
+
+int jerasure_make_decoding_matrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
+{
+  return jerasure_cached_decoding_matrix(NULL, 0, k, m, w, matrix, erased, decoding_matrix, dm_ids, NULL);
+}
+
+/* Internal Routine */
+int jerasure_make_decoding_bitmatrix(int k, int m, int w, int *matrix, int *erased, int *decoding_matrix, int *dm_ids)
+{
+  return jerasure_cached_decoding_matrix(NULL, 1, k, m, w, matrix, erased, decoding_matrix, dm_ids, NULL);
+}
+
+
+/* The state of a matrix or bitmatrix decoding, from
+   jerasure_decoding_setup():  the erased vector, and the decoding matrix
+   and tmpids, where they are needed.
+
+   You only need to create the decoding matrix in the following cases:
 
       1. edd > 0 and row_k_ones is false.
       2. edd > 0 and row_k_ones is true and coding device 0 has been erased.
       3. edd > 1
 
-      We're going to use lastdrive to denote when to stop decoding data.
-      At this point in the code, it is equal to the last erased data device.
-      However, if we can't use the parity row to decode it (i.e. row_k_ones=0
-         or erased[k] = 1, we're going to set it to k so that the decoding 
-         pass will decode all data.
-   */
+   We're going to use lastdrive to denote when to stop decoding data.
+   It starts as the last erased data device.  However, if we can't use the
+   parity row to decode it (i.e. row_k_ones=0 or erased[k] = 1, we're going
+   to set it to k so that the decoding pass will decode all data.  If
+   row_k_ones is true and coding device 0 is intact, then only edd-1 drives
+   are decoded with the decoding matrix, and lastdrive is decoded from
+   the parity row, with tmpids. */
 
-  if (!row_k_ones || erased[k]) lastdrive = k;
+typedef struct {
+  int *erased;
+  int *decoding_matrix;
+  int *dm_ids;
+  int *tmpids;
+  int lastdrive;
+} jerasure_decoding;
 
-  dm_ids = NULL;
-  decoding_matrix = NULL;
+static void jerasure_decoding_free(jerasure_decoding *d)
+{
+  if (d->tmpids != NULL) free(d->tmpids);
+  if (d->erased != NULL) free(d->erased);
+  if (d->dm_ids != NULL) free(d->dm_ids);
+  if (d->decoding_matrix != NULL) free(d->decoding_matrix);
+}
 
-  if (edd > 1 || (edd > 0 && (!row_k_ones || erased[k]))) {
-    dm_ids = talloc(int, k);
-    if (dm_ids == NULL) {
-      free(erased);
-      return -1;
-    }
+/* For a bitmatrix, row_k_ones must be exactly 1. */
 
-    decoding_matrix = talloc(int, k*k);
-    if (decoding_matrix == NULL) {
-      free(erased);
-      free(dm_ids);
-      return -1;
-    }
+static int jerasure_decoding_setup(int is_bitmatrix, int k, int m, int w, int *matrix, int row_k_ones,
+                                   int *erasures, jerasure_decoding *d)
+{
+  int i, edd, ones, dmsize, rc;
 
-    if (jerasure_make_decoding_matrix(k, m, w, matrix, erased, decoding_matrix, dm_ids) < 0) {
-      free(erased);
-      free(dm_ids);
-      free(decoding_matrix);
-      return -1;
+  d->decoding_matrix = NULL;
+  d->dm_ids = NULL;
+  d->tmpids = NULL;
+  d->erased = jerasure_erasures_to_erased(k, m, erasures);
+  if (d->erased == NULL) return -1;
+
+  /* Find the number of data drives failed */
+
+  d->lastdrive = k;
+  edd = 0;
+  for (i = 0; i < k; i++) {
+    if (d->erased[i]) {
+      edd++;
+      d->lastdrive = i;
     }
   }
 
-  /* Decode the data drives.  
-     If row_k_ones is true and coding device 0 is intact, then only decode edd-1 drives.
-     This is done by stopping at lastdrive.
-     We test whether edd > 0 so that we can exit the loop early if we're done.
-   */
+  ones = is_bitmatrix ? (row_k_ones == 1) : (row_k_ones != 0);
+  if (!ones || d->erased[k]) d->lastdrive = k;
 
-  for (i = 0; edd > 0 && i < lastdrive; i++) {
-    if (erased[i]) {
-      jerasure_matrix_dotprod(k, w, decoding_matrix+(i*k), dm_ids, i, data_ptrs, coding_ptrs, size);
-      edd--;
+  if (edd > 1 || (edd > 0 && (!ones || d->erased[k]))) {
+    dmsize = is_bitmatrix ? k*k*w*w : k*k;
+    d->dm_ids = talloc(int, k);
+    d->decoding_matrix = talloc(int, dmsize);
+    if (d->dm_ids == NULL || d->decoding_matrix == NULL) {
+      jerasure_decoding_free(d);
+      return -1;
+    }
+    if (is_bitmatrix) {
+      rc = jerasure_make_decoding_bitmatrix(k, m, w, matrix, d->erased, d->decoding_matrix, d->dm_ids);
+    } else {
+      rc = jerasure_make_decoding_matrix(k, m, w, matrix, d->erased, d->decoding_matrix, d->dm_ids);
+    }
+    if (rc < 0) {
+      jerasure_decoding_free(d);
+      return -1;
     }
   }
 
-  /* Then if necessary, decode drive lastdrive */
-
-  if (edd > 0) {
-    tmpids = talloc(int, k);
-    if (!tmpids) {
-      free(erased);
-      free(dm_ids);
-      free(decoding_matrix);
+  if (edd > 0 && d->lastdrive < k) {
+    d->tmpids = talloc(int, k);
+    if (d->tmpids == NULL) {
+      jerasure_decoding_free(d);
       return -1;
     }
     for (i = 0; i < k; i++) {
-      tmpids[i] = (i < lastdrive) ? i : i+1;
+      d->tmpids[i] = (i < d->lastdrive) ? i : i+1;
     }
-    jerasure_matrix_dotprod(k, w, matrix, tmpids, lastdrive, data_ptrs, coding_ptrs, size);
-    free(tmpids);
   }
-  
-  /* Finally, re-encode any erased coding devices */
+  return 0;
+}
+
+/* Counts the bytes of a matrix decoding of size bytes in the stats. */
+
+static void jerasure_matrix_decode_count(int k, int m, int w, int *matrix, jerasure_decoding *d, int size)
+{
+  int i;
 
+  for (i = 0; i < d->lastdrive; i++) {
+    if (d->erased[i]) jerasure_count_dotprod_bytes(k, w, d->decoding_matrix+(i*k), size);
+  }
+  if (d->tmpids != NULL) jerasure_count_dotprod_bytes(k, w, matrix, size);
   for (i = 0; i < m; i++) {
-    if (erased[k+i]) {
-      jerasure_matrix_dotprod(k, w, matrix+(i*k), NULL, i+k, data_ptrs, coding_ptrs, size);
+    if (d->erased[k+i]) jerasure_count_dotprod_bytes(k, w, matrix+(i*k), size);
+  }
+}
+
+/* The tile loop of jerasure_matrix_decode:  data devices before lastdrive
+   from the decoding matrix, lastdrive from the parity row if tmpids is
+   not NULL, and then the erased coding devices.
+
+   All of this is done one tile at a time.  Every byte only depends on
+   the bytes at the same offset in the other devices, so the result is
+   the same as doing each device over the whole size.  The bytes are not
+   counted here. */
+
+static void jerasure_matrix_decode_tiles(int k, int m, int w, int *matrix, jerasure_decoding *d,
+                                         char **data_ptrs, char **coding_ptrs, int size)
+{
+  int i, tile, off, len;
+
+  tile = jerasure_tile_bytes(k+m, JERASURE_TILE_UNIT, size);
+  for (off = 0; off < size; off += tile) {
+    len = (size - off < tile) ? size - off : tile;
+    for (i = 0; i < d->lastdrive; i++) {
+      if (d->erased[i]) {
+        jerasure_matrix_dotprod_range(k, w, d->decoding_matrix+(i*k), d->dm_ids, i, data_ptrs, coding_ptrs,
+                                      off, len);
+      }
+    }
+    if (d->tmpids != NULL) {
+      jerasure_matrix_dotprod_range(k, w, matrix, d->tmpids, d->lastdrive, data_ptrs, coding_ptrs, off, len);
+    }
+    for (i = 0; i < m; i++) {
+      if (d->erased[k+i]) {
+        jerasure_matrix_dotprod_range(k, w, matrix+(i*k), NULL, i+k, data_ptrs, coding_ptrs, off, len);
+      }
     }
   }
+}
 
-  free(erased);
-  if (dm_ids != NULL) free(dm_ids);
-  if (decoding_matrix != NULL) free(decoding_matrix);
+int jerasure_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int *erasures,
+                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  jerasure_decoding d;
 
+  if (w != 8 && w != 16 && w != 32) return -1;
+  if (jerasure_decoding_setup(0, k, m, w, matrix, row_k_ones, erasures, &d) < 0) return -1;
+  jerasure_matrix_decode_count(k, m, w, matrix, &d, size);
+  jerasure_matrix_decode_tiles(k, m, w, matrix, &d, data_ptrs, coding_ptrs, size);
+  jerasure_decoding_free(&d);
   return 0;
 }
 
 
 int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix) 
+{
+  return jerasure_context_matrix_to_bitmatrix(NULL, k, m, w, matrix);
+}
+
+int *jerasure_context_matrix_to_bitmatrix(galois_context_t *ctx, int k, int m, int w, int *matrix)
 {
   int *bitmatrix;
   int rowelts, rowindex, colindex, elt, i, j, l, x;
@@ -296,7 +1006,7 @@ int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix)
         for (l = 0; l < w; l++) {
           bitmatrix[colindex+x+l*rowelts] = ((elt & (1 << l)) ? 1 : 0);
         }
-        elt = galois_single_multiply(elt, 2, w);
+        elt = galois_context_single_multiply(ctx, elt, 2, w);
       }
       colindex += w;
     }
@@ -305,36 +1015,285 @@ int *jerasure_matrix_to_bitmatrix(int k, int m, int w, int *matrix)
   return bitmatrix;
 }
 
-void jerasure_matrix_encode(int k, int m, int w, int *matrix,
-                          char **data_ptrs, char **coding_ptrs, int size)
+/* ------------------------------------------------------------ */
+/* Packed bitmatrices.  Each row is a run of 64-bit words, so that rows
+   are XOR'd, compared and counted a word at a time. */
+
+jerasure_packed_bitmatrix_t *jerasure_new_packed_bitmatrix(int rows, int cols)
 {
+  jerasure_packed_bitmatrix_t *p;
+
+  if (rows < 0 || cols < 0) return NULL;
+  p = talloc(jerasure_packed_bitmatrix_t, 1);
+  if (p == NULL) return NULL;
+  p->rows = rows;
+  p->cols = cols;
+  p->words = (cols + 63) / 64;
+  p->bits = (uint64_t *) calloc((size_t) rows * p->words + 1, sizeof(uint64_t));
+  if (p->bits == NULL) {
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+void jerasure_free_packed_bitmatrix(jerasure_packed_bitmatrix_t *p)
+{
+  if (p == NULL) return;
+  free(p->bits);
+  free(p);
+}
+
+jerasure_packed_bitmatrix_t *jerasure_pack_bitmatrix(int *bitmatrix, int rows, int cols)
+{
+  jerasure_packed_bitmatrix_t *p;
+  uint64_t *row;
+  int i, j;
+
+  if (bitmatrix == NULL) return NULL;
+  p = jerasure_new_packed_bitmatrix(rows, cols);
+  if (p == NULL) return NULL;
+  for (i = 0; i < rows; i++) {
+    row = p->bits + (size_t) i * p->words;
+    for (j = 0; j < cols; j++) {
+      if (bitmatrix[(size_t) i*cols+j]) row[j >> 6] |= (uint64_t) 1 << (j & 63);
+    }
+  }
+  return p;
+}
+
+static void jerasure_unpack_bitmatrix_into(jerasure_packed_bitmatrix_t *p, int *bitmatrix)
+{
+  int i, j;
+
+  for (i = 0; i < p->rows; i++) {
+    for (j = 0; j < p->cols; j++) {
+      bitmatrix[(size_t) i*p->cols+j] = JERASURE_PACKED_BIT(p, i, j);
+    }
+  }
+}
+
+int *jerasure_unpack_bitmatrix(jerasure_packed_bitmatrix_t *p)
+{
+  int *bitmatrix;
+
+  bitmatrix = talloc(int, (size_t) p->rows * p->cols);
+  if (bitmatrix == NULL) return NULL;
+  jerasure_unpack_bitmatrix_into(p, bitmatrix);
+  return bitmatrix;
+}
+
+/* Column x of the w columns of element elt is elt*2^x, whose bit l is the
+   bit in row l, just as in jerasure_matrix_to_bitmatrix. */
+
+jerasure_packed_bitmatrix_t *jerasure_matrix_to_packed_bitmatrix(int k, int m, int w, int *matrix)
+{
+  jerasure_packed_bitmatrix_t *p;
+  uint64_t *row;
+  int elt, i, j, l, x, col;
+
+  if (matrix == NULL) return NULL;
+  p = jerasure_new_packed_bitmatrix(m*w, k*w);
+  if (p == NULL) return NULL;
+  for (i = 0; i < m; i++) {
+    for (j = 0; j < k; j++) {
+      elt = matrix[i*k+j];
+      for (x = 0; x < w; x++) {
+        col = j*w+x;
+        for (l = 0; l < w; l++) {
+          if (elt & (1 << l)) {
+            row = p->bits + (size_t) (i*w+l) * p->words;
+            row[col >> 6] |= (uint64_t) 1 << (col & 63);
+          }
+        }
+        elt = galois_single_multiply(elt, 2, w);
+      }
+    }
+  }
+  return p;
+}
+
+static int jerasure_popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static int jerasure_ctz64(uint64_t x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n;
+
+  for (n = 0; (x & 1) == 0; n++) x >>= 1;
+  return n;
+#endif
+}
+
+static void jerasure_packed_xor_row(uint64_t *dst, uint64_t *src, int from, int words)
+{
+  int i;
+
+  for (i = from; i < words; i++) dst[i] ^= src[i];
+}
+
+static void jerasure_packed_swap_rows(uint64_t *a, uint64_t *b, int words)
+{
+  uint64_t tmp;
   int i;
+
+  for (i = 0; i < words; i++) {
+    tmp = a[i]; a[i] = b[i]; b[i] = tmp;
+  }
+}
+
+/* Gaussian elimination, as in jerasure_invert_bitmatrix, but a word of
+   the row at a time.  When column i is reached, the rows below i are zero
+   in the columns before i, so only their words from i/64 on are XOR'd. */
+
+int jerasure_invert_packed_bitmatrix(jerasure_packed_bitmatrix_t *mat,
+                                     jerasure_packed_bitmatrix_t *inv)
+{
+  uint64_t *mi, *mj, bit;
+  int rows, words, i, j, wi;
+
+  rows = mat->rows;
+  if (mat->cols != rows || inv->rows != rows || inv->cols != rows) return -1;
+  words = mat->words;
+
+  memset(inv->bits, 0, sizeof(uint64_t) * (size_t) rows * words);
+  for (i = 0; i < rows; i++) inv->bits[(size_t) i*words + (i >> 6)] = (uint64_t) 1 << (i & 63);
+
+  /* First -- convert into upper triangular */
+
+  for (i = 0; i < rows; i++) {
+    wi = i >> 6;
+    bit = (uint64_t) 1 << (i & 63);
+    mi = mat->bits + (size_t) i*words;
+
+    /* Swap rows if we have a zero i,i element.  If we can't swap, then the
+       matrix was not invertible */
+
+    if ((mi[wi] & bit) == 0) {
+      for (j = i+1; j < rows && (mat->bits[(size_t) j*words+wi] & bit) == 0; j++) ;
+      if (j == rows) return -1;
+      jerasure_packed_swap_rows(mi, mat->bits + (size_t) j*words, words);
+      jerasure_packed_swap_rows(inv->bits + (size_t) i*words, inv->bits + (size_t) j*words, words);
+    }
+
+    for (j = i+1; j < rows; j++) {
+      mj = mat->bits + (size_t) j*words;
+      if (mj[wi] & bit) {
+        jerasure_packed_xor_row(mj, mi, wi, words);
+        jerasure_packed_xor_row(inv->bits + (size_t) j*words, inv->bits + (size_t) i*words, 0, words);
+      }
+    }
+  }
+
+  /* Now the matrix is upper triangular.  Start at the top and multiply down */
+
+  for (i = rows-1; i >= 0; i--) {
+    wi = i >> 6;
+    bit = (uint64_t) 1 << (i & 63);
+    mi = mat->bits + (size_t) i*words;
+    for (j = 0; j < i; j++) {
+      mj = mat->bits + (size_t) j*words;
+      if (mj[wi] & bit) {
+        jerasure_packed_xor_row(mj, mi, wi, words);
+        jerasure_packed_xor_row(inv->bits + (size_t) j*words, inv->bits + (size_t) i*words, 0, words);
+      }
+    }
+  }
+  return 0;
+}
+
+int jerasure_invertible_packed_bitmatrix(jerasure_packed_bitmatrix_t *mat)
+{
+  uint64_t *mi, *mj, bit;
+  int rows, words, i, j, wi;
+
+  rows = mat->rows;
+  if (mat->cols != rows) return 0;
+  words = mat->words;
+
+  for (i = 0; i < rows; i++) {
+    wi = i >> 6;
+    bit = (uint64_t) 1 << (i & 63);
+    mi = mat->bits + (size_t) i*words;
+    if ((mi[wi] & bit) == 0) {
+      for (j = i+1; j < rows && (mat->bits[(size_t) j*words+wi] & bit) == 0; j++) ;
+      if (j == rows) return 0;
+      jerasure_packed_swap_rows(mi, mat->bits + (size_t) j*words, words);
+    }
+    for (j = i+1; j < rows; j++) {
+      mj = mat->bits + (size_t) j*words;
+      if (mj[wi] & bit) jerasure_packed_xor_row(mj, mi, wi, words);
+    }
+  }
+  return 1;
+}
+
+/* All m coding devices are computed in the same pass over the data, so
+   that each data block is read from memory once rather than m times. */
+
+void jerasure_matrix_encode(int k, int m, int w, int *matrix,
+                          char **data_ptrs, char **coding_ptrs, int size)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS], **ptrs;
+  int i, tile, off, len;
   
   if (w != 8 && w != 16 && w != 32) {
     fprintf(stderr, "ERROR: jerasure_matrix_encode() and w is not 8, 16 or 32\n");
     assert(0);
   }
 
-  for (i = 0; i < m; i++) {
-    jerasure_matrix_dotprod(k, w, matrix+(i*k), NULL, k+i, data_ptrs, coding_ptrs, size);
+  for (i = 0; i < m; i++) jerasure_count_dotprod_bytes(k, w, matrix+(i*k), size);
+
+  if (k+m <= JERASURE_DOTPROD_SRCS) {
+    ptrs = ptrs_buf;
+  } else {
+    ptrs = talloc(char *, k+m);
+    if (ptrs == NULL) {
+      fprintf(stderr, "ERROR: jerasure_matrix_encode() cannot allocate %d pointers\n", k+m);
+      assert(0);
+    }
   }
+
+  tile = jerasure_tile_bytes(k+m, JERASURE_TILE_UNIT, size);
+  for (off = 0; off < size; off += tile) {
+    len = (size - off < tile) ? size - off : tile;
+    for (i = 0; i < k; i++) ptrs[i] = data_ptrs[i] + off;
+    for (i = 0; i < m; i++) ptrs[k+i] = coding_ptrs[i] + off;
+    switch (w) {
+      case 8:  galois_w08_region_dotprod_multi(ptrs, matrix, k, ptrs+k, m, len); break;
+      case 16: galois_w16_region_dotprod_multi(ptrs, matrix, k, ptrs+k, m, len); break;
+      case 32: galois_w32_region_dotprod_multi(ptrs, matrix, k, ptrs+k, m, len); break;
+    }
+  }
+
+  if (ptrs != ptrs_buf) free(ptrs);
 }
 
-void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
+/* Computes bytes [off, off+len) of one bitmatrix dot product.  off and len
+   are multiples of w*packetsize. */
+
+static void jerasure_bitmatrix_dotprod_range(int k, int w, int *bitmatrix_row,
                              int *src_ids, int dest_id,
-                             char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+                             char **data_ptrs, char **coding_ptrs, int off, int len, int packetsize)
 {
   int j, sindex, pstarted, index, x, y;
   char *dptr, *pptr, *bdptr, *bpptr;
 
-  if (size%(w*packetsize) != 0) {
-    fprintf(stderr, "jerasure_bitmatrix_dotprod - size%c(w*packetsize)) must = 0\n", '%');
-    assert(0);
-  }
-
   bpptr = (dest_id < k) ? data_ptrs[dest_id] : coding_ptrs[dest_id-k];
 
-  for (sindex = 0; sindex < size; sindex += (packetsize*w)) {
+  for (sindex = off; sindex < off+len; sindex += (packetsize*w)) {
     index = 0;
     for (j = 0; j < w; j++) {
       pstarted = 0;
@@ -352,11 +1311,13 @@ void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
             dptr = bdptr + sindex + y*packetsize;
             if (!pstarted) {
               memcpy(pptr, dptr, packetsize);
-              jerasure_total_memcpy_bytes += packetsize;
+              JERASURE_COUNT(JERASURE_STAT_COPY_CALLS, 1);
+              JERASURE_COUNT(JERASURE_STAT_COPY_BYTES, packetsize);
               pstarted = 1;
             } else {
               galois_region_xor(dptr, pptr, packetsize);
-              jerasure_total_xor_bytes += packetsize;
+              JERASURE_COUNT(JERASURE_STAT_XOR_CALLS, 1);
+              JERASURE_COUNT(JERASURE_STAT_XOR_BYTES, packetsize);
             }
           }
           index++;
@@ -366,26 +1327,263 @@ void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
   }
 }
 
+void jerasure_bitmatrix_dotprod(int k, int w, int *bitmatrix_row,
+                             int *src_ids, int dest_id,
+                             char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  if (size%(w*packetsize) != 0) {
+    fprintf(stderr, "jerasure_bitmatrix_dotprod - size%c(w*packetsize)) must = 0\n", '%');
+    assert(0);
+  }
+
+  jerasure_bitmatrix_dotprod_range(k, w, bitmatrix_row, src_ids, dest_id, data_ptrs, coding_ptrs,
+                                   0, size, packetsize);
+}
+
 void jerasure_do_parity(int k, char **data_ptrs, char *parity_ptr, int size) 
 {
-  int i;
+  galois_region_xor_n(data_ptrs, k, parity_ptr, size);
+  JERASURE_COUNT(JERASURE_STAT_COPY_CALLS, 1);
+  JERASURE_COUNT(JERASURE_STAT_COPY_BYTES, size);
+  JERASURE_COUNT(JERASURE_STAT_XOR_CALLS, k-1);
+  JERASURE_COUNT(JERASURE_STAT_XOR_BYTES, (uint64_t) size * (k-1));
+}
 
-  memcpy(parity_ptr, data_ptrs[0], size);
-  jerasure_total_memcpy_bytes += size;
-  
-  for (i = 1; i < k; i++) {
-    galois_region_xor(data_ptrs[i], parity_ptr, size);
-    jerasure_total_xor_bytes += size;
+/* Fast matrix inversion, for w <= 16.  Products are looked up in the log
+   tables of the field (galois_log_tables()), instead of going through
+   galois_single_multiply() and galois_single_divide().  For w = 8 and 16,
+   once the rows are long enough to pay for the call (and for w = 16, for
+   building the split tables of every multiplier), a multiple of one row
+   is added to another with the region multiply kernels instead:  mat and
+   inv are copied into an array of bytes or 16-bit words, with row i of
+   mat followed by row i of inv, each padded to a multiple of
+   JERASURE_INVERT_ALIGN bytes, so that every row has the same alignment.
+   jerasure_set_fast_invert(0) goes back to the generic code, for testing
+   and benchmarking.  All of them do the same elimination, so they compute
+   the same inverse. */
+
+#define JERASURE_INVERT_REGION_ROWS_W08 64
+#define JERASURE_INVERT_REGION_ROWS_W16 256
+#define JERASURE_INVERT_ALIGN 32
+
+static int jerasure_fast_invert_enabled = 1;
+
+void jerasure_set_fast_invert(int enable)
+{
+  jerasure_fast_invert_enabled = (enable != 0);
+}
+
+int jerasure_get_fast_invert()
+{
+  return jerasure_fast_invert_enabled;
+}
+
+static void jerasure_swap_ints(int *a, int *b, int n)
+{
+  int i, tmp;
+
+  for (i = 0; i < n; i++) {
+    tmp = a[i]; a[i] = b[i]; b[i] = tmp;
   }
 }
 
-int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
+/* Multiplies the n elements of src by c (whose log is lc), and adds the
+   products to dest, or stores them if dest is src. */
+
+static void jerasure_log_row_multiply(int *src, int *dest, int n, int lc, uint16_t *lg, uint16_t *ex)
+{
+  int x;
+
+  if (dest == src) {
+    for (x = 0; x < n; x++) if (src[x] != 0) dest[x] = ex[lg[src[x]]+lc];
+  } else {
+    for (x = 0; x < n; x++) if (src[x] != 0) dest[x] ^= ex[lg[src[x]]+lc];
+  }
+}
+
+/* The elimination of jerasure_invert_matrix, with log tables.  If inv is
+   NULL, it stops once mat is upper triangular, as
+   jerasure_invertible_matrix does. */
+
+static int jerasure_invert_matrix_logs(int *mat, int *inv, int rows, int w, uint16_t *lg, uint16_t *ex)
+{
+  int cols, i, j, q, row_start, rs2, tmp;
+
+  cols = rows;
+  q = (1 << w) - 1;
+  if (inv != NULL) {
+    for (i = 0; i < rows*cols; i++) inv[i] = 0;
+    for (i = 0; i < rows; i++) inv[i*cols+i] = 1;
+  }
+
+  for (i = 0; i < cols; i++) {
+    row_start = cols*i;
+    if (mat[row_start+i] == 0) {
+      for (j = i+1; j < rows && mat[cols*j+i] == 0; j++) ;
+      if (j == rows) return -1;
+      jerasure_swap_ints(mat+row_start, mat+j*cols, cols);
+      if (inv != NULL) jerasure_swap_ints(inv+row_start, inv+j*cols, cols);
+    }
+
+    /* Multiply the row by 1/element i,i.  The elements before i are zero. */
+    tmp = mat[row_start+i];
+    if (tmp != 1) {
+      jerasure_log_row_multiply(mat+row_start+i, mat+row_start+i, cols-i, q-lg[tmp], lg, ex);
+      if (inv != NULL) jerasure_log_row_multiply(inv+row_start, inv+row_start, cols, q-lg[tmp], lg, ex);
+    }
+
+    /* Now for each j>i, add A_ji*Ai to Aj */
+    for (j = i+1; j != cols; j++) {
+      rs2 = cols*j;
+      tmp = mat[rs2+i];
+      if (tmp != 0) {
+        jerasure_log_row_multiply(mat+row_start+i, mat+rs2+i, cols-i, lg[tmp], lg, ex);
+        if (inv != NULL) jerasure_log_row_multiply(inv+row_start, inv+rs2, cols, lg[tmp], lg, ex);
+      }
+    }
+  }
+  if (inv == NULL) return 0;
+
+  /* Now the matrix is upper triangular.  Start at the top and multiply down */
+
+  for (i = rows-1; i >= 0; i--) {
+    row_start = i*cols;
+    for (j = 0; j < i; j++) {
+      rs2 = j*cols;
+      tmp = mat[rs2+i];
+      if (tmp != 0) {
+        mat[rs2+i] = 0;
+        jerasure_log_row_multiply(inv+row_start, inv+rs2, cols, lg[tmp], lg, ex);
+      }
+    }
+  }
+  return 0;
+}
+
+static int jerasure_region_get(unsigned char *p, int w)
+{
+  return (w == 8) ? *p : *((uint16_t *) p);
+}
+
+static void jerasure_region_set(unsigned char *p, int w, int x)
+{
+  if (w == 8) *p = x; else *((uint16_t *) p) = x;
+}
+
+/* Adds c times the n bytes of src to dest, or multiplies src by c if dest
+   is NULL. */
+
+static void jerasure_region_row_multiply(galois_context_t *ctx, unsigned char *src, unsigned char *dest,
+                                         int c, int n, int w)
+{
+  galois_context_region_multiply(ctx, w, (char *) src, c, n, (char *) dest, dest != NULL);
+}
+
+/* The same elimination, on rows of bytes (w = 8) or 16-bit words (w = 16)
+   with the region kernels.  It returns -2 if it cannot allocate them. */
+
+static int jerasure_invert_matrix_regions(galois_context_t *ctx, int *mat, int *inv, int rows, int w, uint16_t *lg, uint16_t *ex)
+{
+  unsigned char *aug, *ri, *rj, *tmprow;
+  int b, width, stride, i, j, x, q, c, rv;
+
+  b = w/8;
+  q = (1 << w) - 1;
+  width = (inv == NULL) ? rows : 2*rows;
+  stride = (width*b + JERASURE_INVERT_ALIGN - 1) / JERASURE_INVERT_ALIGN * JERASURE_INVERT_ALIGN;
+  aug = (unsigned char *) calloc((size_t) rows + 1, stride);
+  if (aug == NULL) return -2;
+  tmprow = aug + (size_t) rows*stride;
+
+  for (i = 0; i < rows; i++) {
+    ri = aug + (size_t) i*stride;
+    for (x = 0; x < rows; x++) jerasure_region_set(ri + x*b, w, mat[i*rows+x]);
+    if (inv != NULL) jerasure_region_set(ri + (rows+i)*b, w, 1);
+  }
+
+  rv = 0;
+  for (i = 0; i < rows && rv == 0; i++) {
+    ri = aug + (size_t) i*stride;
+    if (jerasure_region_get(ri + i*b, w) == 0) {
+      for (j = i+1; j < rows && jerasure_region_get(aug + (size_t) j*stride + i*b, w) == 0; j++) ;
+      if (j == rows) {
+        rv = -1;
+        break;
+      }
+      rj = aug + (size_t) j*stride;
+      memcpy(tmprow, ri, stride);
+      memcpy(ri, rj, stride);
+      memcpy(rj, tmprow, stride);
+    }
+
+    c = jerasure_region_get(ri + i*b, w);
+    if (c != 1) jerasure_region_row_multiply(ctx, ri + i*b, NULL, ex[q-lg[c]], (width-i)*b, w);
+
+    for (j = i+1; j < rows; j++) {
+      rj = aug + (size_t) j*stride;
+      c = jerasure_region_get(rj + i*b, w);
+      if (c != 0) jerasure_region_row_multiply(ctx, ri + i*b, rj + i*b, c, (width-i)*b, w);
+    }
+  }
+
+  if (rv == 0 && inv != NULL) {
+    for (i = rows-1; i >= 0; i--) {
+      ri = aug + (size_t) i*stride;
+      for (j = 0; j < i; j++) {
+        rj = aug + (size_t) j*stride;
+        c = jerasure_region_get(rj + i*b, w);
+        if (c != 0) {
+          jerasure_region_set(rj + i*b, w, 0);
+          jerasure_region_row_multiply(ctx, ri + rows*b, rj + rows*b, c, rows*b, w);
+        }
+      }
+    }
+  }
+
+  for (i = 0; i < rows; i++) {
+    ri = aug + (size_t) i*stride;
+    for (x = 0; x < rows; x++) {
+      mat[i*rows+x] = jerasure_region_get(ri + x*b, w);
+      if (inv != NULL && rv == 0) inv[i*rows+x] = jerasure_region_get(ri + (rows+x)*b, w);
+    }
+  }
+  free(aug);
+  return rv;
+}
+
+/* Returns the result of the fast inversion, or -2 if it cannot be used.
+   The read section keeps the log tables from being freed by another
+   thread's galois_change_technique(). */
+
+static int jerasure_fast_invert_matrix(galois_context_t *ctx, int *mat, int *inv, int rows, int w)
+{
+  uint16_t *lg, *ex;
+  int rv;
+
+  if (!jerasure_fast_invert_enabled) return -2;
+  galois_read_lock();
+  rv = -2;
+  if (galois_context_log_tables(ctx, w, &lg, &ex) == 0) {
+    if ((w == 8 && rows >= JERASURE_INVERT_REGION_ROWS_W08) ||
+        (w == 16 && rows >= JERASURE_INVERT_REGION_ROWS_W16)) {
+      rv = jerasure_invert_matrix_regions(ctx, mat, inv, rows, w, lg, ex);
+    }
+    if (rv == -2) rv = jerasure_invert_matrix_logs(mat, inv, rows, w, lg, ex);
+  }
+  galois_read_unlock();
+  return rv;
+}
+
+int jerasure_context_invert_matrix(galois_context_t *ctx, int *mat, int *inv, int rows, int w)
 {
   int cols, i, j, k, x, rs2;
   int row_start, tmp, inverse;
  
   cols = rows;
 
+  x = jerasure_fast_invert_matrix(ctx, mat, inv, rows, w);
+  if (x != -2) return x;
+
   k = 0;
   for (i = 0; i < rows; i++) {
     for (j = 0; j < cols; j++) {
@@ -418,10 +1616,10 @@ int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
     /* Multiply the row by 1/element i,i  */
     tmp = mat[row_start+i];
     if (tmp != 1) {
-      inverse = galois_single_divide(1, tmp, w);
+      inverse = galois_context_single_divide(ctx, 1, tmp, w);
       for (j = 0; j < cols; j++) { 
-        mat[row_start+j] = galois_single_multiply(mat[row_start+j], inverse, w);
-        inv[row_start+j] = galois_single_multiply(inv[row_start+j], inverse, w);
+        mat[row_start+j] = galois_context_single_multiply(ctx, mat[row_start+j], inverse, w);
+        inv[row_start+j] = galois_context_single_multiply(ctx, inv[row_start+j], inverse, w);
       }
     }
 
@@ -440,8 +1638,8 @@ int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
           tmp = mat[k];
           rs2 = cols*j;
           for (x = 0; x < cols; x++) {
-            mat[rs2+x] ^= galois_single_multiply(tmp, mat[row_start+x], w);
-            inv[rs2+x] ^= galois_single_multiply(tmp, inv[row_start+x], w);
+            mat[rs2+x] ^= galois_context_single_multiply(ctx, tmp, mat[row_start+x], w);
+            inv[rs2+x] ^= galois_context_single_multiply(ctx, tmp, inv[row_start+x], w);
           }
         }
       }
@@ -458,7 +1656,7 @@ int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
         tmp = mat[rs2+i];
         mat[rs2+i] = 0; 
         for (k = 0; k < cols; k++) {
-          inv[rs2+k] ^= galois_single_multiply(tmp, inv[row_start+k], w);
+          inv[rs2+k] ^= galois_context_single_multiply(ctx, tmp, inv[row_start+k], w);
         }
       }
     }
@@ -466,6 +1664,11 @@ int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
   return 0;
 }
 
+int jerasure_invert_matrix(int *mat, int *inv, int rows, int w)
+{
+  return jerasure_context_invert_matrix(NULL, mat, inv, rows, w);
+}
+
 int jerasure_invertible_matrix(int *mat, int rows, int w)
 {
   int cols, i, j, k, x, rs2;
@@ -473,6 +1676,9 @@ int jerasure_invertible_matrix(int *mat, int rows, int w)
  
   cols = rows;
 
+  x = jerasure_fast_invert_matrix(NULL, mat, NULL, rows, w);
+  if (x != -2) return (x == 0);
+
   /* First -- convert into upper triangular  */
   for (i = 0; i < cols; i++) {
     row_start = cols*i;
@@ -526,16 +1732,13 @@ int jerasure_invertible_matrix(int *mat, int rows, int w)
 /* Converts a list-style version of the erasures into an array of k+m elements
    where the element = 1 if the index has been erased, and zero otherwise */
 
-int *jerasure_erasures_to_erased(int k, int m, int *erasures)
+static int jerasure_fill_erased(int k, int m, int *erasures, int *erased)
 {
   int td;
   int t_non_erased;
-  int *erased;
   int i;
 
   td = k+m;
-  erased = talloc(int, td);
-  if (erased == NULL) return NULL;
   t_non_erased = td;
 
   for (i = 0; i < td; i++) erased[i] = 0;
@@ -544,12 +1747,22 @@ int *jerasure_erasures_to_erased(int k, int m, int *erasures)
     if (erased[erasures[i]] == 0) {
       erased[erasures[i]] = 1;
       t_non_erased--;
-      if (t_non_erased < k) {
-        free(erased);
-        return NULL;
-      }
+      if (t_non_erased < k) return -1;
     }
   }
+  return 0;
+}
+
+int *jerasure_erasures_to_erased(int k, int m, int *erasures)
+{
+  int *erased;
+
+  erased = talloc(int, k+m);
+  if (erased == NULL) return NULL;
+  if (jerasure_fill_erased(k, m, erasures, erased) < 0) {
+    free(erased);
+    return NULL;
+  }
   return erased;
 }
   
@@ -584,168 +1797,68 @@ void jerasure_matrix_dotprod(int k, int w, int *matrix_row,
                           int *src_ids, int dest_id,
                           char **data_ptrs, char **coding_ptrs, int size)
 {
-  int init;
-  char *dptr, *sptr;
-  int i;
-
   if (w != 1 && w != 8 && w != 16 && w != 32) {
     fprintf(stderr, "ERROR: jerasure_matrix_dotprod() called and w is not 1, 8, 16 or 32\n");
     assert(0);
   }
 
-  init = 0;
+  jerasure_count_dotprod_bytes(k, w, matrix_row, size);
+  jerasure_matrix_dotprod_range(k, w, matrix_row, src_ids, dest_id, data_ptrs, coding_ptrs, 0, size);
+}
 
-  dptr = (dest_id < k) ? data_ptrs[dest_id] : coding_ptrs[dest_id-k];
 
-  /* First copy or xor any data that does not need to be multiplied by a factor */
+/* The tile loop of jerasure_bitmatrix_decode, like that of
+   jerasure_matrix_decode. */
 
-  for (i = 0; i < k; i++) {
-    if (matrix_row[i] == 1) {
-      if (src_ids == NULL) {
-        sptr = data_ptrs[i];
-      } else if (src_ids[i] < k) {
-        sptr = data_ptrs[src_ids[i]];
-      } else {
-        sptr = coding_ptrs[src_ids[i]-k];
-      }
-      if (init == 0) {
-        memcpy(dptr, sptr, size);
-        jerasure_total_memcpy_bytes += size;
-        init = 1;
-      } else {
-        galois_region_xor(sptr, dptr, size);
-        jerasure_total_xor_bytes += size;
+static void jerasure_bitmatrix_decode_tiles(int k, int m, int w, int *bitmatrix, jerasure_decoding *d,
+                                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  int i, tile, off, len;
+
+  tile = jerasure_tile_bytes(k+m, packetsize*w, size);
+  for (off = 0; off < size; off += tile) {
+    len = (size - off < tile) ? size - off : tile;
+    for (i = 0; i < d->lastdrive; i++) {
+      if (d->erased[i]) {
+        jerasure_bitmatrix_dotprod_range(k, w, d->decoding_matrix+i*k*w*w, d->dm_ids, i, data_ptrs,
+                                         coding_ptrs, off, len, packetsize);
       }
     }
-  }
-
-  /* Now do the data that needs to be multiplied by a factor */
-
-  for (i = 0; i < k; i++) {
-    if (matrix_row[i] != 0 && matrix_row[i] != 1) {
-      if (src_ids == NULL) {
-        sptr = data_ptrs[i];
-      } else if (src_ids[i] < k) {
-        sptr = data_ptrs[src_ids[i]];
-      } else {
-        sptr = coding_ptrs[src_ids[i]-k];
-      }
-      switch (w) {
-        case 8:  galois_w08_region_multiply(sptr, matrix_row[i], size, dptr, init); break;
-        case 16: galois_w16_region_multiply(sptr, matrix_row[i], size, dptr, init); break;
-        case 32: galois_w32_region_multiply(sptr, matrix_row[i], size, dptr, init); break;
+    if (d->tmpids != NULL) {
+      jerasure_bitmatrix_dotprod_range(k, w, bitmatrix, d->tmpids, d->lastdrive, data_ptrs, coding_ptrs,
+                                       off, len, packetsize);
+    }
+    for (i = 0; i < m; i++) {
+      if (d->erased[k+i]) {
+        jerasure_bitmatrix_dotprod_range(k, w, bitmatrix+i*k*w*w, NULL, k+i, data_ptrs, coding_ptrs,
+                                         off, len, packetsize);
       }
-      jerasure_total_gf_bytes += size;
-      init = 1;
     }
   }
 }
 
-
 int jerasure_bitmatrix_decode(int k, int m, int w, int *bitmatrix, int row_k_ones, int *erasures,
                             char **data_ptrs, char **coding_ptrs, int size, int packetsize)
 {
-  int i;
-  int *erased;
-  int *decoding_matrix;
-  int *dm_ids;
-  int edd, *tmpids, lastdrive;
-  
-  erased = jerasure_erasures_to_erased(k, m, erasures);
-  if (erased == NULL) return -1;
-
-  /* See jerasure_matrix_decode for the logic of this routine.  This one works just like
-     it, but calls the bitmatrix ops instead */
-
-  lastdrive = k;
-    
-  edd = 0;
-  for (i = 0; i < k; i++) {
-    if (erased[i]) {
-      edd++;
-      lastdrive = i;
-    } 
-  }
-
-  if (row_k_ones != 1 || erased[k]) lastdrive = k;
-  
-  dm_ids = NULL;
-  decoding_matrix = NULL;
-  
-  if (edd > 1 || (edd > 0 && (row_k_ones != 1 || erased[k]))) {
-
-    dm_ids = talloc(int, k);
-    if (dm_ids == NULL) {
-      free(erased);
-      return -1;
-    }
-  
-    decoding_matrix = talloc(int, k*k*w*w);
-    if (decoding_matrix == NULL) {
-      free(erased);
-      free(dm_ids);
-      return -1;
-    }
-  
-    if (jerasure_make_decoding_bitmatrix(k, m, w, bitmatrix, erased, decoding_matrix, dm_ids) < 0) {
-      free(erased);
-      free(dm_ids);
-      free(decoding_matrix);
-      return -1;
-    }
-  }
-
-  for (i = 0; edd > 0 && i < lastdrive; i++) {
-    if (erased[i]) {
-      jerasure_bitmatrix_dotprod(k, w, decoding_matrix+i*k*w*w, dm_ids, i, data_ptrs, coding_ptrs, size, packetsize);
-      edd--;
-    }
-  }
+  jerasure_decoding d;
 
-  if (edd > 0) {
-    tmpids = talloc(int, k);
-    if (!tmpids) {
-      free(erased);
-      free(dm_ids);
-      free(decoding_matrix);
-      return -1;
-    }
-    for (i = 0; i < k; i++) {
-      tmpids[i] = (i < lastdrive) ? i : i+1;
-    }
-    jerasure_bitmatrix_dotprod(k, w, bitmatrix, tmpids, lastdrive, data_ptrs, coding_ptrs, size, packetsize);
-    free(tmpids);
-  }
+  if (jerasure_decoding_setup(1, k, m, w, bitmatrix, row_k_ones, erasures, &d) < 0) return -1;
 
-  for (i = 0; i < m; i++) {
-    if (erased[k+i]) {
-      jerasure_bitmatrix_dotprod(k, w, bitmatrix+i*k*w*w, NULL, k+i, data_ptrs, coding_ptrs, size, packetsize);
-    }
+  if (size%(w*packetsize) != 0) {
+    fprintf(stderr, "jerasure_bitmatrix_dotprod - size%c(w*packetsize)) must = 0\n", '%');
+    assert(0);
   }
 
-  free(erased);
-  if (dm_ids != NULL) free(dm_ids);
-  if (decoding_matrix != NULL) free(decoding_matrix);
-
+  jerasure_bitmatrix_decode_tiles(k, m, w, bitmatrix, &d, data_ptrs, coding_ptrs, size, packetsize);
+  jerasure_decoding_free(&d);
   return 0;
 }
 
-static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, char **data_ptrs, char **coding_ptrs)
+static void fill_ptrs_for_scheduled_decoding(int k, int m, int *erased, char **data_ptrs,
+                                             char **coding_ptrs, char **ptrs)
 {
-  int ddf, cdf;
-  int *erased;
-  char **ptrs;
   int i, j, x;
 
-  ddf = 0;
-  cdf = 0;
-  for (i = 0; erasures[i] != -1; i++) {
-    if (erasures[i] < k) ddf++; else cdf++;
-  }
-  
-  erased = jerasure_erasures_to_erased(k, m, erasures);
-  if (erased == NULL) return NULL;
-
   /* Set up ptrs.  It will be as follows:
 
        - If data drive i has not failed, then ptrs[i] = data_ptrs[i].
@@ -760,12 +1873,6 @@ static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, ch
        However, we're going to set row_ids and ind_to_row in a different procedure.
    */
          
-  ptrs = talloc(char *, k+m);
-  if (!ptrs) {
-    free(erased);
-    return NULL;
-  }
-
   j = k;
   x = k;
   for (i = 0; i < k; i++) {
@@ -785,6 +1892,18 @@ static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, ch
       x++;
     }
   }
+}
+
+static char **set_up_ptrs_for_scheduled_decoding(int k, int m, int *erasures, char **data_ptrs, char **coding_ptrs)
+{
+  int *erased;
+  char **ptrs;
+
+  erased = jerasure_erasures_to_erased(k, m, erasures);
+  if (erased == NULL) return NULL;
+
+  ptrs = talloc(char *, k+m);
+  if (ptrs != NULL) fill_ptrs_for_scheduled_decoding(k, m, erased, data_ptrs, coding_ptrs, ptrs);
   free(erased);
   return ptrs;
 }
@@ -833,235 +1952,941 @@ static int set_up_ids_for_scheduled_decoding(int k, int m, int *erasures, int *r
   return 0;
 }
 
-static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitmatrix, int *erasures, int smart)
+/* Flat schedules.  A schedule is one block:  the jerasure_flat_schedule_t,
+   followed by its operations.  The generators allocate room for the most
+   operations that a bitmatrix can need, k*m*w*w, and give back the rest
+   when they are done. */
+
+static jerasure_flat_schedule_t *jerasure_new_flat_schedule(int maxops)
 {
-  int i, j, x, drive, y, index, z;
-  int *decoding_matrix, *inverse, *real_decoding_matrix;
-  int *ptr;
-  int *row_ids;
-  int *ind_to_row;
-  int ddf, cdf;
-  int **schedule;
-  int *b1, *b2;
- 
- /* First, figure out the number of data drives that have failed, and the
-    number of coding drives that have failed: ddf and cdf */
+  jerasure_flat_schedule_t *s;
+
+  s = (jerasure_flat_schedule_t *) malloc(sizeof(jerasure_flat_schedule_t) +
+                                          sizeof(jerasure_schedule_op_t)*maxops);
+  if (s == NULL) return NULL;
+  s->nops = 0;
+  s->tdev = 0;
+  s->ntdevs = 0;
+  s->ops = (jerasure_schedule_op_t *) (s + 1);
+  return s;
+}
 
-  ddf = 0;
-  cdf = 0;
-  for (i = 0; erasures[i] != -1; i++) {
-    if (erasures[i] < k) ddf++; else cdf++;
-  }
-  
-  row_ids = talloc(int, k+m);
-  if (!row_ids) return NULL;
-  ind_to_row = talloc(int, k+m);
-  if (!ind_to_row) {
-    free(row_ids);
-    return NULL;
-  }
+static jerasure_flat_schedule_t *jerasure_trim_flat_schedule(jerasure_flat_schedule_t *s)
+{
+  jerasure_flat_schedule_t *t;
 
-  if (set_up_ids_for_scheduled_decoding(k, m, erasures, row_ids, ind_to_row) < 0) {
-    free(row_ids);
-    free(ind_to_row);
-    return NULL;
-  }
+  t = (jerasure_flat_schedule_t *) realloc(s, sizeof(jerasure_flat_schedule_t) +
+                                              sizeof(jerasure_schedule_op_t)*s->nops);
+  if (t == NULL) return s;
+  t->ops = (jerasure_schedule_op_t *) (t + 1);
+  return t;
+}
 
-  /* Now, we're going to create one decoding matrix which is going to 
-     decode everything with one call.  The hope is that the scheduler
-     will do a good job.    This matrix has w*e rows, where e is the
-     number of erasures (ddf+cdf) */
+static void jerasure_add_flat_op(jerasure_flat_schedule_t *s, int op, int from_dev, int from_pkt,
+                                 int to_dev, int to_pkt)
+{
+  jerasure_schedule_op_t *o;
+
+  o = s->ops + s->nops;
+  o->from_dev = from_dev;
+  o->to_dev = to_dev;
+  o->from_pkt = from_pkt;
+  o->to_pkt = to_pkt;
+  o->op = op;
+  o->pad = 0;
+  s->nops++;
+}
 
-  real_decoding_matrix = talloc(int, k*w*(cdf+ddf)*w);
-  if (!real_decoding_matrix) {
-    free(row_ids);
-    free(ind_to_row);
-    return NULL;
-  }
+static int jerasure_flat_schedule_fits(int k, int m, int w)
+{
+  return (k+m <= JERASURE_FLAT_MAX_DEVICES && w <= JERASURE_FLAT_MAX_PACKETS);
+}
 
-  /* First, if any data drives have failed, then initialize the first
-     ddf*w rows of the decoding matrix from the standard decoding
-     matrix inversion */
+/* Schedule compiler.  On x86-64 with AVX2, a flat schedule is compiled for
+   one packetsize into a function f(ptrs, packetsize), in an mmap'd buffer
+   that is made executable once it is written.  Each chain of operations
+   on one destination packet becomes a loop over the packet, which keeps
+   JERASURE_JIT_BLOCK bytes of it (or less, if packetsize is not a multiple
+   of that) in ymm0-ymm7, loads or XORs each source into them, and stores
+   them once.  The device pointers of the destination and of the first
+   four other source devices are loaded into rdx and r8-r11 before the
+   loop; the others are loaded into rax where they are used.  The
+   displacements are packet*packetsize, so packetsize is at most
+   JERASURE_JIT_MAX_PACKETSIZE.
+
+   The code is emitted twice:  once with code == NULL, to size it, and
+   once into the buffer. */
+
+#if !defined(JERASURE_NO_SIMD) && defined(__GNUC__) && defined(__x86_64__) && \
+    !defined(_WIN32) && defined(MAP_ANONYMOUS)
+#define JERASURE_JIT
+#endif
+
+#define JERASURE_JIT_BLOCK 256
+#define JERASURE_JIT_MAX_PACKETSIZE (1 << 22)
+#define JERASURE_JIT_MAX_BYTES (64*1024*1024)
+
+typedef void (*jerasure_jit_function)(char **ptrs, long packetsize);
+
+struct jerasure_jit_schedule {
+  int packetsize;
+  long xors, copies;                  /* Operations, for the stats */
+  jerasure_jit_function function;     /* NULL if not compiled */
+  void *code;
+  size_t code_bytes;                  /* Of the mapping */
+  jerasure_flat_schedule_t *schedule; /* Copy, for the interpreter */
+};
+
+static int jerasure_jit_enabled = 1;
+
+void jerasure_set_jit(int enable)
+{
+  jerasure_jit_enabled = (enable != 0);
+}
 
-  if (ddf > 0) {
-    
-    decoding_matrix = talloc(int, k*k*w*w);
-    if (!decoding_matrix) {
-      free(row_ids);
-      free(ind_to_row);
-      return NULL;
-    }
-    ptr = decoding_matrix;
-    for (i = 0; i < k; i++) {
-      if (row_ids[i] == i) {
-        bzero(ptr, k*w*w*sizeof(int));
-        for (x = 0; x < w; x++) {
-          ptr[x+i*w+x*k*w] = 1;
-        } 
-      } else {
-        memcpy(ptr, bitmatrix+k*w*w*(row_ids[i]-k), k*w*w*sizeof(int));
-      }
-      ptr += (k*w*w);
-    }
-    inverse = talloc(int, k*k*w*w);
-    if (!inverse) {
-      free(row_ids);
-      free(ind_to_row);
-      free(decoding_matrix);
-      return NULL;
-    }
-    jerasure_invert_bitmatrix(decoding_matrix, inverse, k*w);
+int jerasure_get_jit()
+{
+  return jerasure_jit_enabled;
+}
 
-/*    printf("\nMatrix to invert\n");
-    jerasure_print_bitmatrix(decoding_matrix, k*w, k*w, w);
-    printf("\n");
-    printf("\nInverse\n");
-    jerasure_print_bitmatrix(inverse, k*w, k*w, w);
-    printf("\n"); */
+#ifdef JERASURE_JIT
 
-    free(decoding_matrix);
-    ptr = real_decoding_matrix;
-    for (i = 0; i < ddf; i++) {
-      memcpy(ptr, inverse+k*w*w*row_ids[k+i], sizeof(int)*k*w*w);
-      ptr += (k*w*w);
-    }
-    free(inverse);
-  } 
+typedef struct {
+  unsigned char *code;
+  size_t n;
+} jerasure_jit_buffer;
 
-  /* Next, here comes the hard part.  For each coding node that needs
-     to be decoded, you start by putting its rows of the distribution
-     matrix into the decoding matrix.  If there were no failed data
-     nodes, then you're done.  However, if there have been failed
-     data nodes, then you need to modify the columns that correspond
-     to the data nodes.  You do that by first zeroing them.  Then
-     whereever there is a one in the distribution matrix, you XOR
-     in the corresponding row from the failed data node's entry in
-     the decoding matrix.  The whole process kind of makes my head
-     spin, but it works.
-   */
+static void jerasure_jit_byte(jerasure_jit_buffer *b, int x)
+{
+  if (b->code != NULL) b->code[b->n] = x;
+  b->n++;
+}
 
-  for (x = 0; x < cdf; x++) {
-    drive = row_ids[x+ddf+k]-k;
-    ptr = real_decoding_matrix + k*w*w*(ddf+x);
-    memcpy(ptr, bitmatrix+drive*k*w*w, sizeof(int)*k*w*w);
+static void jerasure_jit_int32(jerasure_jit_buffer *b, long x)
+{
+  int i;
 
-    for (i = 0; i < k; i++) {
-      if (row_ids[i] != i) {
-        for (j = 0; j < w; j++) {
-          bzero(ptr+j*k*w+i*w, sizeof(int)*w);
-        }
-      }  
+  for (i = 0; i < 4; i++) jerasure_jit_byte(b, (x >> (8*i)) & 0xff);
+}
+
+/* mov reg, [rdi + 8*dev] */
+
+static void jerasure_jit_load_pointer(jerasure_jit_buffer *b, int reg, int dev)
+{
+  jerasure_jit_byte(b, 0x48 | ((reg >> 3) << 2));
+  jerasure_jit_byte(b, 0x8b);
+  jerasure_jit_byte(b, 0x80 | ((reg & 7) << 3) | 7);
+  jerasure_jit_int32(b, 8L*dev);
+}
+
+/* One AVX2 instruction on ymm and [base + rcx + disp]:  vmovdqu load
+   (0x6f) or store (0x7f) with pp = F3, or vpxor ymm, ymm, mem (0xef) with
+   pp = 66.  It has a three byte VEX prefix, for bases r8-r11. */
+
+#define JERASURE_JIT_LOAD 0x6f
+#define JERASURE_JIT_STORE 0x7f
+#define JERASURE_JIT_XOR 0xef
+
+static void jerasure_jit_vector(jerasure_jit_buffer *b, int opcode, int ymm, int base, long disp)
+{
+  int vvvv, pp;
+
+  vvvv = (opcode == JERASURE_JIT_XOR) ? ymm : 0;
+  pp = (opcode == JERASURE_JIT_XOR) ? 1 : 2;
+  jerasure_jit_byte(b, 0xc4);
+  jerasure_jit_byte(b, 0xc1 | ((base < 8) ? 0x20 : 0));
+  jerasure_jit_byte(b, ((~vvvv & 15) << 3) | 4 | pp);
+  jerasure_jit_byte(b, opcode);
+  jerasure_jit_byte(b, 0x84 | (ymm << 3));
+  jerasure_jit_byte(b, 0x08 | (base & 7));
+  jerasure_jit_int32(b, disp);
+}
+
+/* Emits one chain, ops[0] to ops[n-1], with nacc accumulators. */
+
+static void jerasure_jit_chain(jerasure_jit_buffer *b, jerasure_schedule_op_t *ops, int n,
+                               int packetsize, int nacc)
+{
+  static const int regs[4] = { 8, 9, 10, 11 };
+  int devs[4], ndevs, i, j, reg, rax_dev, loaded;
+  size_t top;
+  long disp;
+
+  jerasure_jit_load_pointer(b, 2, ops[0].to_dev);
+  ndevs = 0;
+  for (i = 0; i < n && ndevs < 4; i++) {
+    if (ops[i].from_dev == ops[0].to_dev) continue;
+    for (j = 0; j < ndevs && devs[j] != ops[i].from_dev; j++) ;
+    if (j == ndevs) {
+      devs[ndevs] = ops[i].from_dev;
+      jerasure_jit_load_pointer(b, regs[ndevs], devs[ndevs]);
+      ndevs++;
     }
+  }
 
-    /* There's the yucky part */
+  /* xor ecx, ecx */
+
+  jerasure_jit_byte(b, 0x31);
+  jerasure_jit_byte(b, 0xc9);
+  top = b->n;
+  rax_dev = -1;
+  loaded = 0;
+  for (i = 0; i < n; i++) {
+    if (ops[i].from_dev == ops[i].to_dev && ops[i].from_pkt == ops[i].to_pkt) {
+      if (!loaded) {
+        for (j = 0; j < nacc; j++) {
+          jerasure_jit_vector(b, JERASURE_JIT_LOAD, j, 2, (long) ops[i].to_pkt*packetsize + 32*j);
+        }
+        loaded = 1;
+      }
+      if (ops[i].op) {
 
-    index = drive*k*w*w;
-    for (i = 0; i < k; i++) {
-      if (row_ids[i] != i) {
-        b1 = real_decoding_matrix+(ind_to_row[i]-k)*k*w*w;
-        for (j = 0; j < w; j++) {
-          b2 = ptr + j*k*w;
-          for (y = 0; y < w; y++) {
-            if (bitmatrix[index+j*k*w+i*w+y]) {
-              for (z = 0; z < k*w; z++) {
-                b2[z] = b2[z] ^ b1[z+y*k*w];
-              }
-            }
-          }
+        /* vpxor ymmj, ymmj, ymmj */
+
+        for (j = 0; j < nacc; j++) {
+          jerasure_jit_byte(b, 0xc5);
+          jerasure_jit_byte(b, 0x80 | ((~j & 15) << 3) | 4 | 1);
+          jerasure_jit_byte(b, 0xef);
+          jerasure_jit_byte(b, 0xc0 | (j << 3) | j);
         }
-      }  
+      }
+      continue;
+    }
+    if (ops[i].op && !loaded) {
+      for (j = 0; j < nacc; j++) {
+        jerasure_jit_vector(b, JERASURE_JIT_LOAD, j, 2, (long) ops[i].to_pkt*packetsize + 32*j);
+      }
+    }
+    loaded = 1;
+    if (ops[i].from_dev == ops[i].to_dev) {
+      reg = 2;
+    } else {
+      for (j = 0; j < ndevs && devs[j] != ops[i].from_dev; j++) ;
+      if (j < ndevs) {
+        reg = regs[j];
+      } else {
+        if (rax_dev != ops[i].from_dev) jerasure_jit_load_pointer(b, 0, ops[i].from_dev);
+        rax_dev = ops[i].from_dev;
+        reg = 0;
+      }
+    }
+    disp = (long) ops[i].from_pkt*packetsize;
+    for (j = 0; j < nacc; j++) {
+      jerasure_jit_vector(b, ops[i].op ? JERASURE_JIT_XOR : JERASURE_JIT_LOAD, j, reg, disp + 32*j);
     }
   }
-
-/*
-  printf("\n\nReal Decoding Matrix\n\n");
-  jerasure_print_bitmatrix(real_decoding_matrix, (ddf+cdf)*w, k*w, w);
-  printf("\n"); */
-  if (smart) {
-    schedule = jerasure_smart_bitmatrix_to_schedule(k, ddf+cdf, w, real_decoding_matrix);
-  } else {
-    schedule = jerasure_dumb_bitmatrix_to_schedule(k, ddf+cdf, w, real_decoding_matrix);
+  for (j = 0; j < nacc; j++) {
+    jerasure_jit_vector(b, JERASURE_JIT_STORE, j, 2, (long) ops[0].to_pkt*packetsize + 32*j);
   }
-  free(row_ids);
-  free(ind_to_row);
-  free(real_decoding_matrix);
-  return schedule;
+
+  /* add rcx, 32*nacc; cmp rcx, rsi; jb top */
+
+  jerasure_jit_byte(b, 0x48);
+  jerasure_jit_byte(b, 0x81);
+  jerasure_jit_byte(b, 0xc1);
+  jerasure_jit_int32(b, 32*nacc);
+  jerasure_jit_byte(b, 0x48);
+  jerasure_jit_byte(b, 0x39);
+  jerasure_jit_byte(b, 0xf1);
+  jerasure_jit_byte(b, 0x0f);
+  jerasure_jit_byte(b, 0x82);
+  jerasure_jit_int32(b, (long) top - (long) (b->n + 4));
 }
 
-int jerasure_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *erasures,
-                            char **data_ptrs, char **coding_ptrs, int size, int packetsize, 
-                            int smart)
+static void jerasure_jit_emit(jerasure_jit_buffer *b, jerasure_flat_schedule_t *s, int packetsize)
 {
-  int i, tdone;
-  char **ptrs;
-  int **schedule;
- 
-  ptrs = set_up_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs);
-  if (ptrs == NULL) return -1;
-
-  schedule = jerasure_generate_decoding_schedule(k, m, w, bitmatrix, erasures, smart);
-  if (schedule == NULL) {
-    free(ptrs);
-    return -1;
-  }
-
-  for (tdone = 0; tdone < size; tdone += packetsize*w) {
-  jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
-    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
+  jerasure_schedule_op_t *o, *end;
+  int nacc, n;
+
+  nacc = JERASURE_JIT_BLOCK/32;
+  while (packetsize % (32*nacc) != 0) nacc /= 2;
+  end = s->ops + s->nops;
+  for (o = s->ops; o < end; o += n) {
+    for (n = 1; o+n < end && o[n].to_dev == o->to_dev && o[n].to_pkt == o->to_pkt; n++) ;
+    jerasure_jit_chain(b, o, n, packetsize, nacc);
   }
 
-  jerasure_free_schedule(schedule);
-  free(ptrs);
+  /* vzeroupper; ret */
 
-  return 0;
+  jerasure_jit_byte(b, 0xc5);
+  jerasure_jit_byte(b, 0xf8);
+  jerasure_jit_byte(b, 0x77);
+  jerasure_jit_byte(b, 0xc3);
 }
 
-int jerasure_schedule_decode_cache(int k, int m, int w, int ***scache, int *erasures,
-                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+/* Compiles j->schedule, or leaves j->function NULL if it cannot. */
+
+static void jerasure_jit_compile(jerasure_jit_schedule_t *j)
 {
-  int i, tdone;
-  char **ptrs;
-  int **schedule;
-  int index;
- 
-  if (erasures[1] == -1) {
-    index = erasures[0]*(k+m) + erasures[0];
-  } else if (erasures[2] == -1) {
-    index = erasures[0]*(k+m) + erasures[1];
-  } else {
-    return -1;
+  jerasure_jit_buffer b;
+  long page;
+  void *code;
+
+  if (!jerasure_jit_enabled || galois_get_region_kernel() < GALOIS_KERNEL_AVX2) return;
+  if (j->packetsize % 32 != 0 || j->packetsize > JERASURE_JIT_MAX_PACKETSIZE) return;
+
+  b.code = NULL;
+  b.n = 0;
+  jerasure_jit_emit(&b, j->schedule, j->packetsize);
+  if (b.n > JERASURE_JIT_MAX_BYTES) return;
+  page = sysconf(_SC_PAGESIZE);
+  if (page <= 0) page = 4096;
+  j->code_bytes = (b.n + page - 1) / page * page;
+  code = mmap(NULL, j->code_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) return;
+  b.code = (unsigned char *) code;
+  b.n = 0;
+  jerasure_jit_emit(&b, j->schedule, j->packetsize);
+  if (mprotect(code, j->code_bytes, PROT_READ | PROT_EXEC) != 0) {
+    munmap(code, j->code_bytes);
+    return;
   }
+  j->code = code;
+  memcpy(&j->function, &code, sizeof(void *));
+}
 
-  schedule = scache[index];
-
-  ptrs = set_up_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs);
-  if (ptrs == NULL) return -1;
+#endif
 
+jerasure_jit_schedule_t *jerasure_jit_compile_flat_schedule(jerasure_flat_schedule_t *schedule,
+                                                            int packetsize)
+{
+  jerasure_jit_schedule_t *j;
+  int i;
 
-  for (tdone = 0; tdone < size; tdone += packetsize*w) {
-  jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
-    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
+  if (packetsize <= 0) return NULL;
+  j = talloc(jerasure_jit_schedule_t, 1);
+  if (j == NULL) return NULL;
+  memset(j, 0, sizeof(jerasure_jit_schedule_t));
+  j->packetsize = packetsize;
+  j->schedule = jerasure_new_flat_schedule(schedule->nops);
+  if (j->schedule == NULL) {
+    free(j);
+    return NULL;
   }
+  memcpy(j->schedule->ops, schedule->ops, sizeof(jerasure_schedule_op_t)*schedule->nops);
+  j->schedule->nops = schedule->nops;
+  j->schedule->tdev = schedule->tdev;
+  j->schedule->ntdevs = schedule->ntdevs;
+  for (i = 0; i < schedule->nops; i++) {
+    if (schedule->ops[i].op) j->xors++; else j->copies++;
+  }
+#ifdef JERASURE_JIT
+  jerasure_jit_compile(j);
+#endif
+  return j;
+}
 
-  free(ptrs);
-
-  return 0;
+int jerasure_jit_schedule_is_native(jerasure_jit_schedule_t *jit)
+{
+  return (jit->function != NULL);
 }
 
-/* This only works when m = 2 */
+/* Bytes that jit takes, for the caches. */
 
-int ***jerasure_generate_schedule_cache(int k, int m, int w, int *bitmatrix, int smart)
+static long jerasure_jit_schedule_bytes(jerasure_jit_schedule_t *jit)
 {
-  int ***scache;
-  int erasures[3];
-  int e1, e2;
- 
-  /* Ok -- this is yucky, but it's how I'm doing it.  You will make an index out
-     of erasures, which will be  e1*(k+m)+(e2).  If there is no e2, then e2 = e1.
-     Isn't that clever and confusing.  Sorry.
+  return sizeof(jerasure_jit_schedule_t) + sizeof(jerasure_flat_schedule_t) +
+         sizeof(jerasure_schedule_op_t)*jit->schedule->nops + jit->code_bytes;
+}
 
-     We're not going to worry about ordering -- in other words, the schedule for
-     e1,e2 will be the same as e2,e1.  They will have the same pointer -- the 
+void jerasure_free_jit_schedule(jerasure_jit_schedule_t *jit)
+{
+  if (jit == NULL) return;
+  if (jit->code != NULL) munmap(jit->code, jit->code_bytes);
+  jerasure_free_flat_schedule(jit->schedule);
+  free(jit);
+}
+
+void jerasure_do_jit_scheduled_operations(char **ptrs, jerasure_jit_schedule_t *jit)
+{
+  if (jit->function == NULL) {
+    jerasure_do_flat_scheduled_operations(ptrs, jit->schedule, jit->packetsize);
+    return;
+  }
+  jit->function(ptrs, jit->packetsize);
+  jerasure_count_schedule(jit->xors, jit->copies, jit->packetsize);
+}
+
+/* Runs schedule over size bytes of the ndevs devices in ptrs, w*packetsize
+   bytes at a time.  The schedule's temporary devices, which follow the
+   real ones, use scratch, which holds w*packetsize bytes for each of them.
+   If scratch is NULL and the schedule has temporaries, it is allocated
+   here.  If jit is not NULL, and compiled for packetsize, it is run
+   instead of schedule.  Returns 0, or -1 if memory runs out. */
+
+static int jerasure_run_flat_schedule(char **ptrs, int ndevs, int w, jerasure_flat_schedule_t *schedule,
+                                      jerasure_jit_schedule_t *jit, char *scratch, int size,
+                                      int packetsize)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS], **p;
+  char *tmp;
+  int i, n, tdone;
+
+  n = ndevs;
+  if (schedule->ntdevs > 0 && schedule->tdev + schedule->ntdevs > n) n = schedule->tdev + schedule->ntdevs;
+  p = (n <= JERASURE_DOTPROD_SRCS) ? ptrs_buf : talloc(char *, n);
+  if (p == NULL) return -1;
+  tmp = NULL;
+  if (schedule->ntdevs > 0 && scratch == NULL) {
+    tmp = scratch = talloc(char, schedule->ntdevs*w*packetsize);
+    if (tmp == NULL) {
+      if (p != ptrs_buf) free(p);
+      return -1;
+    }
+  }
+
+  memcpy(p, ptrs, sizeof(char *)*ndevs);
+  for (i = 0; i < schedule->ntdevs; i++) p[schedule->tdev+i] = scratch + i*w*packetsize;
+  for (tdone = 0; tdone < size; tdone += packetsize*w) {
+    if (jit != NULL && jit->packetsize == packetsize) {
+      jerasure_do_jit_scheduled_operations(p, jit);
+    } else {
+      jerasure_do_flat_scheduled_operations(p, schedule, packetsize);
+    }
+    for (i = 0; i < ndevs; i++) p[i] += (packetsize*w);
+  }
+
+  if (tmp != NULL) free(tmp);
+  if (p != ptrs_buf) free(p);
+  return 0;
+}
+
+/* Scheduling with common subexpressions.  Each row of the bitmatrix starts
+   as the sorted list of the source packets (symbols) that it XORs.  While
+   some pair of symbols is in three or more rows, the pair that is in the
+   most rows (the first one found, on a tie) becomes a new symbol, a
+   temporary packet that is computed once, and replaces the pair in those
+   rows.  A temporary costs a copy and an XOR, so a pair that is only in
+   two rows saves nothing.  A new symbol is bigger than the others, so the rows stay sorted.
+   Then the temporaries are computed in order, and each row is the XOR of
+   what is left of it.
+
+   Temporary t is packet t%w of device tdev + t/w.  The pair counts take
+   2 bytes for every pair of symbols, so the number of temporaries is
+   bounded by JERASURE_CSE_MAX_SYMBOLS. */
+
+#define JERASURE_CSE_MAX_SYMBOLS 2048
+
+static jerasure_flat_schedule_t *jerasure_cse_flat_schedule(int k, int m, int w, int *bitmatrix, int tdev)
+{
+  jerasure_flat_schedule_t *s;
+  unsigned short *count;
+  int *sym, *len, *pair;
+  int rows, cols, ones, maxsym, nsym, ntemps;
+  int r, i, j, a, c, best, besta, bestb, nops;
+
+  rows = m*w;
+  cols = k*w;
+  ones = 0;
+  for (i = 0; i < rows*cols; i++) ones += (bitmatrix[i] != 0);
+  maxsym = cols + ones/2 + 1;
+  if (maxsym > JERASURE_CSE_MAX_SYMBOLS) maxsym = JERASURE_CSE_MAX_SYMBOLS;
+  if (maxsym <= cols) return NULL;
+
+  sym = talloc(int, rows*cols);
+  len = talloc(int, rows);
+  pair = talloc(int, 2*(maxsym-cols));
+  count = (unsigned short *) calloc((size_t) maxsym*maxsym, sizeof(unsigned short));
+  s = NULL;
+  if (sym == NULL || len == NULL || pair == NULL || count == NULL) goto done;
+
+  for (r = 0; r < rows; r++) {
+    len[r] = 0;
+    for (j = 0; j < cols; j++) {
+      if (bitmatrix[r*cols+j]) sym[r*cols+len[r]++] = j;
+    }
+  }
+
+  nsym = cols;
+  while (nsym < maxsym) {
+    best = 2;
+    besta = 0;
+    bestb = 0;
+    for (r = 0; r < rows; r++) {
+      for (i = 0; i < len[r]; i++) {
+        a = sym[r*cols+i]*maxsym;
+        for (j = i+1; j < len[r]; j++) {
+          c = ++count[a+sym[r*cols+j]];
+          if (c > best) {
+            best = c;
+            besta = sym[r*cols+i];
+            bestb = sym[r*cols+j];
+          }
+        }
+      }
+    }
+    for (r = 0; r < rows; r++) {
+      for (i = 0; i < len[r]; i++) {
+        a = sym[r*cols+i]*maxsym;
+        for (j = i+1; j < len[r]; j++) count[a+sym[r*cols+j]] = 0;
+      }
+    }
+    if (best < 3) break;
+
+    pair[2*(nsym-cols)] = besta;
+    pair[2*(nsym-cols)+1] = bestb;
+    for (r = 0; r < rows; r++) {
+      for (i = 0; i < len[r] && sym[r*cols+i] != besta; i++) ;
+      for (j = i; j < len[r] && sym[r*cols+j] != bestb; j++) ;
+      if (j == len[r]) continue;
+      for (c = 0, a = 0; a < len[r]; a++) {
+        if (a != i && a != j) sym[r*cols+c++] = sym[r*cols+a];
+      }
+      sym[r*cols+c++] = nsym;
+      len[r] = c;
+    }
+    nsym++;
+  }
+
+  ntemps = nsym - cols;
+  nops = 2*ntemps;
+  for (r = 0; r < rows; r++) nops += len[r];
+  if (!jerasure_flat_schedule_fits(tdev + (ntemps+w-1)/w, 0, w)) goto done;
+  s = jerasure_new_flat_schedule(nops);
+  if (s == NULL) goto done;
+  if (ntemps > 0) {
+    s->tdev = tdev;
+    s->ntdevs = (ntemps+w-1)/w;
+  }
+
+  /* Symbol a is packet a%w of device a/w if it is a source packet, and of
+     device tdev + (a-cols)/w if it is a temporary. */
+
+  for (i = 0; i < ntemps; i++) {
+    for (j = 0; j < 2; j++) {
+      a = pair[2*i+j];
+      jerasure_add_flat_op(s, j, (a < cols) ? a/w : tdev+(a-cols)/w, a%w, tdev+i/w, i%w);
+    }
+  }
+  for (r = 0; r < rows; r++) {
+    for (i = 0; i < len[r]; i++) {
+      a = sym[r*cols+i];
+      jerasure_add_flat_op(s, (i > 0), (a < cols) ? a/w : tdev+(a-cols)/w, a%w, k+r/w, r%w);
+    }
+  }
+
+done:
+  free(sym);
+  free(len);
+  free(pair);
+  free(count);
+  return s;
+}
+
+/* Reordering.  A schedule is a list of chains:  runs of operations with
+   the same destination packet.  The chains are scheduled again, as a
+   topological sort of their dependences (a chain that reads or writes a
+   packet stays after the chains before it that write it, and a chain that
+   writes a packet stays after the chains before it that read it).  Of the
+   chains that are ready, the next is the one that reads the most packets
+   that the last two chains used, so that they are read again while they
+   are still in cache (the first one, on a tie).  Within a chain whose
+   only copy is its first operation, and that does not read its own
+   destination, the sources are XOR'd most recently used first; other
+   chains keep their order.  XOR is commutative, so none of this changes
+   the result.
+
+   Packet p of device d is key d*JERASURE_FLAT_MAX_PACKETS + p. */
+
+int jerasure_reorder_flat_schedule(jerasure_flat_schedule_t *schedule)
+{
+  jerasure_schedule_op_t *ops, *o, t;
+  int *cstart, *head, *next, *to, *indeg, *lastw, *rhead, *rnext, *rchain, *lastuse, *ready;
+  int nops, nchains, nkeys, nedges, nreads, nready, c, d, i, j, key, best, score, bestscore, step, n;
+  int rc;
+
+  nops = schedule->nops;
+  if (nops < 2) return 0;
+
+  nkeys = 0;
+  nchains = 0;
+  for (i = 0; i < nops; i++) {
+    o = schedule->ops + i;
+    if (o->from_dev >= nkeys) nkeys = o->from_dev+1;
+    if (o->to_dev >= nkeys) nkeys = o->to_dev+1;
+    if (i == 0 || o->to_dev != o[-1].to_dev || o->to_pkt != o[-1].to_pkt) nchains++;
+  }
+  nkeys *= JERASURE_FLAT_MAX_PACKETS;
+
+  ops = talloc(jerasure_schedule_op_t, nops);
+  cstart = talloc(int, nchains+1);
+  head = talloc(int, nchains);
+  indeg = talloc(int, nchains);
+  ready = talloc(int, nchains);
+  next = talloc(int, 2*nops+nchains);
+  to = talloc(int, 2*nops+nchains);
+  rnext = talloc(int, nops);
+  rchain = talloc(int, nops);
+  lastw = talloc(int, nkeys);
+  rhead = talloc(int, nkeys);
+  lastuse = talloc(int, nkeys);
+  rc = -1;
+  if (ops == NULL || cstart == NULL || head == NULL || indeg == NULL || ready == NULL ||
+      next == NULL || to == NULL || rnext == NULL || rchain == NULL || lastw == NULL ||
+      rhead == NULL || lastuse == NULL) goto done;
+
+  nchains = 0;
+  for (i = 0; i < nops; i++) {
+    o = schedule->ops + i;
+    if (i == 0 || o->to_dev != o[-1].to_dev || o->to_pkt != o[-1].to_pkt) cstart[nchains++] = i;
+  }
+  cstart[nchains] = nops;
+  for (i = 0; i < nkeys; i++) {
+    lastw[i] = -1;
+    rhead[i] = -1;
+    lastuse[i] = -1;
+  }
+
+  /* The dependences, as edges from chain to chain */
+
+  nedges = 0;
+  nreads = 0;
+  for (c = 0; c < nchains; c++) {
+    head[c] = -1;
+    indeg[c] = 0;
+  }
+  for (c = 0; c < nchains; c++) {
+    for (i = cstart[c]; i < cstart[c+1]; i++) {
+      o = schedule->ops + i;
+      key = o->from_dev*JERASURE_FLAT_MAX_PACKETS + o->from_pkt;
+      if (lastw[key] >= 0 && lastw[key] != c) {
+        to[nedges] = c;
+        next[nedges] = head[lastw[key]];
+        head[lastw[key]] = nedges++;
+        indeg[c]++;
+      }
+      rchain[nreads] = c;
+      rnext[nreads] = rhead[key];
+      rhead[key] = nreads++;
+    }
+    o = schedule->ops + cstart[c];
+    key = o->to_dev*JERASURE_FLAT_MAX_PACKETS + o->to_pkt;
+    for (j = rhead[key]; j >= 0; j = rnext[j]) {
+      if (rchain[j] != c) {
+        to[nedges] = c;
+        next[nedges] = head[rchain[j]];
+        head[rchain[j]] = nedges++;
+        indeg[c]++;
+      }
+    }
+    rhead[key] = -1;
+    if (lastw[key] >= 0) {
+      to[nedges] = c;
+      next[nedges] = head[lastw[key]];
+      head[lastw[key]] = nedges++;
+      indeg[c]++;
+    }
+    lastw[key] = c;
+  }
+
+  /* The chains, in their new order */
+
+  nready = 0;
+  for (c = 0; c < nchains; c++) if (indeg[c] == 0) ready[nready++] = c;
+  n = 0;
+  for (step = 0; step < nchains; step++) {
+    best = 0;
+    bestscore = -1;
+    for (j = 0; j < nready; j++) {
+      c = ready[j];
+      score = 0;
+      for (i = cstart[c]; i < cstart[c+1]; i++) {
+        o = schedule->ops + i;
+        if (lastuse[o->from_dev*JERASURE_FLAT_MAX_PACKETS + o->from_pkt] >= step-2) score++;
+      }
+      if (score > bestscore || (score == bestscore && c < ready[best])) {
+        best = j;
+        bestscore = score;
+      }
+    }
+    c = ready[best];
+    ready[best] = ready[--nready];
+
+    d = n;
+    for (i = cstart[c]; i < cstart[c+1]; i++) ops[n++] = schedule->ops[i];
+    o = ops + d;
+    key = o->to_dev*JERASURE_FLAT_MAX_PACKETS + o->to_pkt;
+    if (o->op == 0) {
+      for (i = d; i < n && (i == d || ops[i].op == 1) &&
+                  (ops[i].from_dev != o->to_dev || ops[i].from_pkt != o->to_pkt); i++) ;
+      if (i == n) {
+        for (i = d+1; i < n; i++) {
+          t = ops[i];
+          score = lastuse[t.from_dev*JERASURE_FLAT_MAX_PACKETS + t.from_pkt];
+          for (j = i; j > d && lastuse[ops[j-1].from_dev*JERASURE_FLAT_MAX_PACKETS + ops[j-1].from_pkt] < score; j--) {
+            ops[j] = ops[j-1];
+          }
+          ops[j] = t;
+        }
+        for (i = d; i < n; i++) ops[i].op = (i > d);
+      }
+    }
+    for (i = d; i < n; i++) lastuse[ops[i].from_dev*JERASURE_FLAT_MAX_PACKETS + ops[i].from_pkt] = step;
+    lastuse[key] = step;
+
+    for (j = head[c]; j >= 0; j = next[j]) {
+      if (--indeg[to[j]] == 0) ready[nready++] = to[j];
+    }
+  }
+  memcpy(schedule->ops, ops, sizeof(jerasure_schedule_op_t)*nops);
+  rc = 0;
+
+done:
+  free(ops);
+  free(cstart);
+  free(head);
+  free(indeg);
+  free(ready);
+  free(next);
+  free(to);
+  free(rnext);
+  free(rchain);
+  free(lastw);
+  free(rhead);
+  free(lastuse);
+  return rc;
+}
+
+/* Returns whichever of the common subexpression and smart schedules does
+   fewer operations, reordered. */
+
+static jerasure_flat_schedule_t *jerasure_best_flat_schedule(int k, int m, int w, int *bitmatrix, int tdev)
+{
+  jerasure_flat_schedule_t *cse, *smart;
+
+  smart = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
+  if (smart == NULL) return NULL;
+  cse = jerasure_cse_flat_schedule(k, m, w, bitmatrix, tdev);
+  if (cse == NULL || cse->nops >= smart->nops) {
+    if (cse != NULL) jerasure_free_flat_schedule(cse);
+    cse = smart;
+  } else {
+    jerasure_free_flat_schedule(smart);
+  }
+  jerasure_reorder_flat_schedule(cse);
+  return cse;
+}
+
+jerasure_flat_schedule_t *jerasure_cse_bitmatrix_to_flat_schedule(int k, int m, int w, int *bitmatrix)
+{
+  if (!jerasure_flat_schedule_fits(k, m, w)) return NULL;
+  return jerasure_best_flat_schedule(k, m, w, bitmatrix, k+m);
+}
+
+jerasure_flat_schedule_t *jerasure_generate_flat_decoding_schedule(int k, int m, int w, int *bitmatrix,
+                                                                   int *erasures, int smart)
+{
+  int i, j, x, drive, y, words;
+  jerasure_packed_bitmatrix_t *coding, *decoding_matrix, *inverse, *real_decoding_matrix;
+  uint64_t *keep, *b1, *b2, *row;
+  int *row_ids;
+  int *ind_to_row;
+  int *unpacked;
+  int ddf, cdf;
+  jerasure_flat_schedule_t *schedule;
+ 
+ /* First, figure out the number of data drives that have failed, and the
+    number of coding drives that have failed: ddf and cdf */
+
+  ddf = 0;
+  cdf = 0;
+  for (i = 0; erasures[i] != -1; i++) {
+    if (erasures[i] < k) ddf++; else cdf++;
+  }
+  
+  row_ids = talloc(int, k+m);
+  ind_to_row = talloc(int, k+m);
+  coding = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  real_decoding_matrix = jerasure_new_packed_bitmatrix((ddf+cdf)*w, k*w);
+  keep = NULL;
+  decoding_matrix = NULL;
+  inverse = NULL;
+  schedule = NULL;
+  if (row_ids == NULL || ind_to_row == NULL || coding == NULL || real_decoding_matrix == NULL) {
+    goto done;
+  }
+  if (set_up_ids_for_scheduled_decoding(k, m, erasures, row_ids, ind_to_row) < 0) goto done;
+  words = coding->words;
+
+  /* Now, we're going to create one decoding matrix which is going to 
+     decode everything with one call.  The hope is that the scheduler
+     will do a good job.    This matrix has w*e rows, where e is the
+     number of erasures (ddf+cdf).  Its rows are packed, so that they
+     are built, inverted and scheduled a word at a time. */
+
+  /* First, if any data drives have failed, then initialize the first
+     ddf*w rows of the decoding matrix from the standard decoding
+     matrix inversion */
+
+  if (ddf > 0) {
+    decoding_matrix = jerasure_new_packed_bitmatrix(k*w, k*w);
+    inverse = jerasure_new_packed_bitmatrix(k*w, k*w);
+    if (decoding_matrix == NULL || inverse == NULL) goto done;
+    for (i = 0; i < k; i++) {
+      for (x = 0; x < w; x++) {
+        row = decoding_matrix->bits + (size_t) (i*w+x)*words;
+        if (row_ids[i] == i) {
+          row[(i*w+x) >> 6] = (uint64_t) 1 << ((i*w+x) & 63);
+        } else {
+          memcpy(row, coding->bits + (size_t) ((row_ids[i]-k)*w+x)*words, sizeof(uint64_t)*words);
+        }
+      }
+    }
+    jerasure_invert_packed_bitmatrix(decoding_matrix, inverse);
+    for (i = 0; i < ddf; i++) {
+      memcpy(real_decoding_matrix->bits + (size_t) i*w*words,
+             inverse->bits + (size_t) row_ids[k+i]*w*words, sizeof(uint64_t)*w*words);
+    }
+  } 
+
+  /* Next, here comes the hard part.  For each coding node that needs
+     to be decoded, you start by putting its rows of the distribution
+     matrix into the decoding matrix.  If there were no failed data
+     nodes, then you're done.  However, if there have been failed
+     data nodes, then you need to modify the columns that correspond
+     to the data nodes.  You do that by first zeroing them (with the
+     mask keep).  Then whereever there is a one in the distribution
+     matrix, you XOR in the corresponding row from the failed data
+     node's entry in the decoding matrix.  The whole process kind of
+     makes my head spin, but it works.
+   */
+
+  keep = (uint64_t *) malloc(sizeof(uint64_t)*(words+1));
+  if (keep == NULL) goto done;
+  memset(keep, 0xff, sizeof(uint64_t)*words);
+  for (i = 0; i < k; i++) {
+    if (row_ids[i] != i) {
+      for (y = i*w; y < (i+1)*w; y++) keep[y >> 6] &= ~((uint64_t) 1 << (y & 63));
+    }
+  }
+
+  for (x = 0; x < cdf; x++) {
+    drive = row_ids[x+ddf+k]-k;
+    for (j = 0; j < w; j++) {
+      b2 = real_decoding_matrix->bits + (size_t) ((ddf+x)*w+j)*words;
+      row = coding->bits + (size_t) (drive*w+j)*words;
+      for (y = 0; y < words; y++) b2[y] = row[y] & keep[y];
+
+      /* There's the yucky part */
+
+      for (i = 0; i < k; i++) {
+        if (row_ids[i] != i) {
+          b1 = real_decoding_matrix->bits + (size_t) (ind_to_row[i]-k)*w*words;
+          for (y = 0; y < w; y++) {
+            if (JERASURE_PACKED_BIT(coding, drive*w+j, i*w+y)) {
+              jerasure_packed_xor_row(b2, b1 + (size_t) y*words, 0, words);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (smart == JERASURE_SCHEDULE_CSE) {
+    unpacked = jerasure_unpack_bitmatrix(real_decoding_matrix);
+    if (unpacked != NULL) {
+      schedule = jerasure_best_flat_schedule(k, ddf+cdf, w, unpacked, k+m);
+      free(unpacked);
+    }
+  } else if (smart) {
+    schedule = jerasure_smart_packed_bitmatrix_to_flat_schedule(k, ddf+cdf, w, real_decoding_matrix);
+  } else {
+    schedule = jerasure_dumb_packed_bitmatrix_to_flat_schedule(k, ddf+cdf, w, real_decoding_matrix);
+  }
+
+done:
+  free(row_ids);
+  free(ind_to_row);
+  free(keep);
+  jerasure_free_packed_bitmatrix(coding);
+  jerasure_free_packed_bitmatrix(decoding_matrix);
+  jerasure_free_packed_bitmatrix(inverse);
+  jerasure_free_packed_bitmatrix(real_decoding_matrix);
+  return schedule;
+}
+
+static int **jerasure_generate_decoding_schedule(int k, int m, int w, int *bitmatrix, int *erasures, int smart)
+{
+  jerasure_flat_schedule_t *flat;
+  int **schedule;
+
+  flat = jerasure_generate_flat_decoding_schedule(k, m, w, bitmatrix, erasures, (smart != 0));
+  if (flat == NULL) return NULL;
+  schedule = jerasure_flat_schedule_to_schedule(flat);
+  jerasure_free_flat_schedule(flat);
+  return schedule;
+}
+
+int jerasure_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize, 
+                            int smart)
+{
+  int i;
+  char **ptrs;
+  jerasure_flat_schedule_t *schedule;
+ 
+  ptrs = set_up_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs);
+  if (ptrs == NULL) return -1;
+
+  schedule = jerasure_generate_flat_decoding_schedule(k, m, w, bitmatrix, erasures, smart);
+  if (schedule == NULL) {
+    free(ptrs);
+    return -1;
+  }
+
+  i = jerasure_run_flat_schedule(ptrs, k+m, w, schedule, NULL, NULL, size, packetsize);
+  jerasure_free_flat_schedule(schedule);
+  free(ptrs);
+
+  return i;
+}
+
+int jerasure_schedule_decode_cache(int k, int m, int w, int ***scache, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  int i, tdone;
+  char **ptrs;
+  int **schedule;
+  int index;
+ 
+  if (erasures[1] == -1) {
+    index = erasures[0]*(k+m) + erasures[0];
+  } else if (erasures[2] == -1) {
+    index = erasures[0]*(k+m) + erasures[1];
+  } else {
+    return -1;
+  }
+
+  schedule = scache[index];
+
+  ptrs = set_up_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs);
+  if (ptrs == NULL) return -1;
+
+
+  for (tdone = 0; tdone < size; tdone += packetsize*w) {
+  jerasure_do_scheduled_operations(ptrs, schedule, packetsize);
+    for (i = 0; i < k+m; i++) ptrs[i] += (packetsize*w);
+  }
+
+  free(ptrs);
+
+  return 0;
+}
+
+/* This only works when m = 2 */
+
+int ***jerasure_generate_schedule_cache(int k, int m, int w, int *bitmatrix, int smart)
+{
+  int ***scache;
+  int erasures[3];
+  int e1, e2;
+ 
+  /* Ok -- this is yucky, but it's how I'm doing it.  You will make an index out
+     of erasures, which will be  e1*(k+m)+(e2).  If there is no e2, then e2 = e1.
+     Isn't that clever and confusing.  Sorry.
+
+     We're not going to worry about ordering -- in other words, the schedule for
+     e1,e2 will be the same as e2,e1.  They will have the same pointer -- the 
      schedule will not be duplicated. */
 
   if (m != 2) return NULL;
@@ -1084,390 +2909,2405 @@ int ***jerasure_generate_schedule_cache(int k, int m, int w, int *bitmatrix, int
 
 }
 
-int jerasure_invert_bitmatrix(int *mat, int *inv, int rows)
+/* Lazy schedule caches.  Unlike jerasure_generate_schedule_cache, these
+   work for any m, and only build the decoding schedule of an erasure
+   pattern when it is first decoded.  The key is the erased vector, so the
+   order of the erasures does not matter.  Schedules are evicted least
+   recently used first, once they take more than the cache's budget.  A
+   schedule is run without the lock, so an entry that is evicted while
+   decodes are running it is freed by the last of them.  A schedule is
+   compiled for the packetsize of the decode that builds it, and is then
+   interpreted for other packetsizes. */
+
+#define JERASURE_SCHEDULE_BUCKETS 64
+
+typedef struct jerasure_schedule_entry {
+  jerasure_lru_node lru;
+  struct jerasure_schedule_entry *chain;   /* Hash chain */
+  unsigned int hash;
+  int users;                               /* Decodes running schedule */
+  int evicted;                             /* No longer in the cache */
+  jerasure_flat_schedule_t *schedule;      /* Owned by jit, if there is one */
+  jerasure_jit_schedule_t *jit;            /* NULL if not compiled */
+  int *erased;                             /* k+m */
+} jerasure_schedule_entry;
+
+struct jerasure_schedule_cache {
+  int k, m, w, smart;
+  int *bitmatrix;
+  jerasure_lru lru;
+  jerasure_schedule_entry *table[JERASURE_SCHEDULE_BUCKETS];
+#ifdef JERASURE_PTHREADS
+  pthread_mutex_t mutex;
+#endif
+};
+
+jerasure_schedule_cache_t *jerasure_create_lazy_schedule_cache(int k, int m, int w, int *bitmatrix,
+                                                               int smart, long max_bytes)
 {
-  int cols, i, j, k;
-  int tmp;
- 
-  cols = rows;
+  jerasure_schedule_cache_t *c;
+
+  c = talloc(jerasure_schedule_cache_t, 1);
+  if (c == NULL) return NULL;
+  memset(c, 0, sizeof(jerasure_schedule_cache_t));
+  c->bitmatrix = talloc(int, k*m*w*w);
+  if (c->bitmatrix == NULL) {
+    free(c);
+    return NULL;
+  }
+  memcpy(c->bitmatrix, bitmatrix, sizeof(int)*k*m*w*w);
+  c->k = k;
+  c->m = m;
+  c->w = w;
+  c->smart = smart;
+  c->lru.limit = (max_bytes > 0) ? max_bytes : 0;
+#ifdef JERASURE_PTHREADS
+  pthread_mutex_init(&c->mutex, NULL);
+#endif
+  return c;
+}
 
-  k = 0;
-  for (i = 0; i < rows; i++) {
-    for (j = 0; j < cols; j++) {
-      inv[k] = (i == j) ? 1 : 0;
-      k++;
-    }
+static void jerasure_free_schedule_entry(jerasure_schedule_entry *e)
+{
+  if (e->jit != NULL) {
+    jerasure_free_jit_schedule(e->jit);
+  } else {
+    jerasure_free_flat_schedule(e->schedule);
+  }
+  free(e);
+}
+
+/* Takes e out of the cache, and frees it unless a decode is running it. */
+
+static void jerasure_evict_schedule_entry(jerasure_schedule_cache_t *c, jerasure_schedule_entry *e)
+{
+  jerasure_schedule_entry **ep;
+
+  for (ep = &c->table[e->hash % JERASURE_SCHEDULE_BUCKETS]; *ep != e; ep = &(*ep)->chain) ;
+  *ep = e->chain;
+  jerasure_lru_unlink(&c->lru, &e->lru);
+  c->lru.bytes -= e->lru.bytes;
+  e->evicted = 1;
+  if (e->users == 0) jerasure_free_schedule_entry(e);
+}
+
+static void jerasure_shrink_schedule_cache(jerasure_schedule_cache_t *c, long limit)
+{
+  while (c->lru.bytes > limit && c->lru.oldest != NULL) {
+    jerasure_evict_schedule_entry(c, (jerasure_schedule_entry *) c->lru.oldest);
+  }
+}
+
+static jerasure_schedule_entry *jerasure_find_schedule_entry(jerasure_schedule_cache_t *c,
+                                                             int *erased, unsigned int hash)
+{
+  jerasure_schedule_entry *e;
+
+  for (e = c->table[hash % JERASURE_SCHEDULE_BUCKETS]; e != NULL; e = e->chain) {
+    if (e->hash == hash && memcmp(e->erased, erased, sizeof(int)*(c->k+c->m)) == 0) return e;
+  }
+  return NULL;
+}
+
+/* Builds the schedule of erased, compiled for packetsize, and adds it to
+   the cache if it fits.  Returns the entry with a user count of one, or
+   NULL. */
+
+static jerasure_schedule_entry *jerasure_new_schedule_entry(jerasure_schedule_cache_t *c,
+                                                            int *erased, unsigned int hash,
+                                                            int packetsize)
+{
+  int list_buf[JERASURE_DOTPROD_SRCS+1], *list;
+  jerasure_schedule_entry *e, *other;
+  jerasure_flat_schedule_t *schedule;
+  jerasure_jit_schedule_t *jit;
+  int i, n, nops;
+
+  n = c->k + c->m;
+  list = (n < JERASURE_DOTPROD_SRCS) ? list_buf : talloc(int, n+1);
+  if (list == NULL) return NULL;
+  for (i = 0, nops = 0; i < n; i++) if (erased[i]) list[nops++] = i;
+  list[nops] = -1;
+  schedule = jerasure_generate_flat_decoding_schedule(c->k, c->m, c->w, c->bitmatrix, list, c->smart);
+  if (list != list_buf) free(list);
+  if (schedule == NULL) return NULL;
+
+  e = (jerasure_schedule_entry *) malloc(sizeof(jerasure_schedule_entry) + sizeof(int)*n);
+  if (e == NULL) {
+    jerasure_free_flat_schedule(schedule);
+    return NULL;
+  }
+  jit = jerasure_jit_compile_flat_schedule(schedule, packetsize);
+  if (jit != NULL && !jerasure_jit_schedule_is_native(jit)) {
+    jerasure_free_jit_schedule(jit);
+    jit = NULL;
+  }
+  if (jit != NULL) {
+    jerasure_free_flat_schedule(schedule);
+    schedule = jit->schedule;
+    e->lru.bytes = sizeof(jerasure_schedule_entry) + sizeof(int)*n + jerasure_jit_schedule_bytes(jit);
+  } else {
+    e->lru.bytes = sizeof(jerasure_schedule_entry) + sizeof(int)*n +
+                   sizeof(jerasure_flat_schedule_t) + sizeof(jerasure_schedule_op_t)*schedule->nops;
+  }
+  e->hash = hash;
+  e->users = 1;
+  e->evicted = 1;
+  e->schedule = schedule;
+  e->jit = jit;
+  e->erased = (int *) (e + 1);
+  memcpy(e->erased, erased, sizeof(int)*n);
+
+  /* Another decode may have built the same schedule in the meantime. */
+
+  JERASURE_LOCK(&c->mutex);
+  other = jerasure_find_schedule_entry(c, erased, hash);
+  if (other != NULL) {
+    other->users++;
+    JERASURE_UNLOCK(&c->mutex);
+    jerasure_free_schedule_entry(e);
+    return other;
+  }
+  if (e->lru.bytes <= c->lru.limit) {
+    jerasure_shrink_schedule_cache(c, c->lru.limit - e->lru.bytes);
+    e->evicted = 0;
+    e->chain = c->table[hash % JERASURE_SCHEDULE_BUCKETS];
+    c->table[hash % JERASURE_SCHEDULE_BUCKETS] = e;
+    jerasure_lru_push(&c->lru, &e->lru);
+    c->lru.bytes += e->lru.bytes;
+  }
+  JERASURE_UNLOCK(&c->mutex);
+  return e;
+}
+
+int jerasure_schedule_decode_lazy_cache(jerasure_schedule_cache_t *c, int *erasures,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  int erased_buf[JERASURE_DOTPROD_SRCS], *erased;
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS], **ptrs;
+  jerasure_schedule_entry *e;
+  unsigned int hash;
+  int k, m, rc;
+
+  k = c->k;
+  m = c->m;
+  if (erasures[0] == -1) return 0;
+  if (k+m <= JERASURE_DOTPROD_SRCS) {
+    erased = erased_buf;
+    ptrs = ptrs_buf;
+  } else {
+    erased = talloc(int, k+m);
+    ptrs = talloc(char *, k+m);
+    if (erased == NULL || ptrs == NULL) {
+      free(erased);
+      free(ptrs);
+      return -1;
+    }
+  }
+
+  rc = -1;
+  if (jerasure_fill_erased(k, m, erasures, erased) < 0) goto done;
+  hash = jerasure_hash_ints(2166136261U, erased, k+m);
+
+  JERASURE_LOCK(&c->mutex);
+  e = jerasure_find_schedule_entry(c, erased, hash);
+  if (e != NULL) {
+    e->users++;
+    jerasure_lru_touch(&c->lru, &e->lru);
+    c->lru.hits++;
+  } else {
+    c->lru.misses++;
+  }
+  JERASURE_UNLOCK(&c->mutex);
+  if (e == NULL) e = jerasure_new_schedule_entry(c, erased, hash, packetsize);
+  if (e == NULL) goto done;
+
+  fill_ptrs_for_scheduled_decoding(k, m, erased, data_ptrs, coding_ptrs, ptrs);
+  rc = jerasure_run_flat_schedule(ptrs, k+m, c->w, e->schedule, e->jit, NULL, size, packetsize);
+
+  JERASURE_LOCK(&c->mutex);
+  e->users--;
+  if (e->evicted && e->users == 0) jerasure_free_schedule_entry(e);
+  JERASURE_UNLOCK(&c->mutex);
+
+done:
+  if (erased != erased_buf) {
+    free(erased);
+    free(ptrs);
+  }
+  return rc;
+}
+
+void jerasure_get_lazy_schedule_cache_stats(jerasure_schedule_cache_t *c, double *fill_in)
+{
+  JERASURE_LOCK(&c->mutex);
+  fill_in[0] = c->lru.hits;
+  fill_in[1] = c->lru.misses;
+  fill_in[2] = c->lru.bytes;
+  c->lru.hits = 0;
+  c->lru.misses = 0;
+  JERASURE_UNLOCK(&c->mutex);
+}
+
+void jerasure_free_lazy_schedule_cache(jerasure_schedule_cache_t *c)
+{
+  if (c == NULL) return;
+  jerasure_shrink_schedule_cache(c, 0);
+#ifdef JERASURE_PTHREADS
+  pthread_mutex_destroy(&c->mutex);
+#endif
+  free(c->bitmatrix);
+  free(c);
+}
+
+/* The int bitmatrices are packed, and inverted a word at a time. */
+
+int jerasure_invert_bitmatrix(int *mat, int *inv, int rows)
+{
+  jerasure_packed_bitmatrix_t *pmat, *pinv;
+  int rv;
+
+  pmat = jerasure_pack_bitmatrix(mat, rows, rows);
+  pinv = jerasure_new_packed_bitmatrix(rows, rows);
+  rv = -1;
+  if (pmat != NULL && pinv != NULL) {
+    rv = jerasure_invert_packed_bitmatrix(pmat, pinv);
+    if (rv == 0) {
+      jerasure_unpack_bitmatrix_into(pmat, mat);
+      jerasure_unpack_bitmatrix_into(pinv, inv);
+    }
+  }
+  jerasure_free_packed_bitmatrix(pmat);
+  jerasure_free_packed_bitmatrix(pinv);
+  return rv;
+}
+
+int jerasure_invertible_bitmatrix(int *mat, int rows)
+{
+  jerasure_packed_bitmatrix_t *pmat;
+  int rv;
+
+  pmat = jerasure_pack_bitmatrix(mat, rows, rows);
+  if (pmat == NULL) return 0;
+  rv = jerasure_invertible_packed_bitmatrix(pmat);
+  jerasure_unpack_bitmatrix_into(pmat, mat);
+  jerasure_free_packed_bitmatrix(pmat);
+  return rv;
+}
+
+  
+int *jerasure_matrix_multiply(int *m1, int *m2, int r1, int c1, int r2, int c2, int w)
+{
+  int *product, i, j, k;
+
+  product = (int *) malloc(sizeof(int)*r1*c2);
+  for (i = 0; i < r1*c2; i++) product[i] = 0;
+
+  for (i = 0; i < r1; i++) {
+    for (j = 0; j < c2; j++) {
+      for (k = 0; k < r2; k++) {
+        product[i*c2+j] ^= galois_single_multiply(m1[i*c1+k], m2[k*c2+j], w);
+      }
+    }
+  }
+  return product;
+}
+
+void jerasure_get_stats(double *fill_in)
+{
+  jerasure_stats_collect(fill_in, JERASURE_STAT_XOR_BYTES, 3);
+}
+
+void jerasure_get_detailed_stats(double *fill_in)
+{
+  jerasure_stats_collect(fill_in, 0, JERASURE_NSTATS);
+}
+
+int jerasure_get_stats_enabled()
+{
+  return JERASURE_COUNTING;
+}
+
+void jerasure_free_flat_schedule(jerasure_flat_schedule_t *schedule)
+{
+  free(schedule);
+}
+
+int **jerasure_flat_schedule_to_schedule(jerasure_flat_schedule_t *schedule)
+{
+  int **operations;
+  jerasure_schedule_op_t *o;
+  int i;
+
+  if (schedule->ntdevs > 0) return NULL;
+  operations = talloc(int *, schedule->nops+1);
+  if (!operations) return NULL;
+  for (i = 0; i <= schedule->nops; i++) {
+    operations[i] = talloc(int, 5);
+    if (!operations[i]) {
+      while (--i >= 0) free(operations[i]);
+      free(operations);
+      return NULL;
+    }
+    if (i == schedule->nops) {
+      operations[i][0] = -1;
+    } else {
+      o = schedule->ops + i;
+      operations[i][0] = o->from_dev;
+      operations[i][1] = o->from_pkt;
+      operations[i][2] = o->to_dev;
+      operations[i][3] = o->to_pkt;
+      operations[i][4] = o->op;
+    }
+  }
+  return operations;
+}
+
+jerasure_flat_schedule_t *jerasure_schedule_to_flat_schedule(int **schedule)
+{
+  jerasure_flat_schedule_t *s;
+  int *o;
+  int i, nops;
+
+  for (nops = 0; schedule[nops][0] >= 0; nops++) ;
+  s = jerasure_new_flat_schedule(nops);
+  if (s == NULL) return NULL;
+  for (i = 0; i < nops; i++) {
+    o = schedule[i];
+    if (o[0] >= JERASURE_FLAT_MAX_DEVICES || o[2] >= JERASURE_FLAT_MAX_DEVICES ||
+        o[1] >= JERASURE_FLAT_MAX_PACKETS || o[3] >= JERASURE_FLAT_MAX_PACKETS) {
+      free(s);
+      return NULL;
+    }
+    jerasure_add_flat_op(s, o[4] != 0, o[0], o[1], o[2], o[3]);
+  }
+  return s;
+}
+
+/* Fused execution.  The executors gather the operations on one
+   destination packet (a chain) into a list of sources, and do them with
+   one galois_region_xor_n(), which reads each source once and writes the
+   destination once, instead of reading and writing the destination once
+   per operation.  A copy starts the list over; if the chain starts with an
+   XOR, the destination is the first source.  When the list is full, or an
+   operation reads the destination itself, the list is done so far, and
+   continues from the destination.  The stats still count every
+   operation. */
+
+static void jerasure_do_chain(char **srcs, int n, char *dptr, int packetsize)
+{
+  if (n == 1) {
+    if (srcs[0] != dptr) memcpy(dptr, srcs[0], packetsize);
+  } else if (n == 2 && srcs[0] == dptr) {
+    galois_region_xor(srcs[1], dptr, packetsize);
+  } else if (n > 1) {
+    galois_region_xor_n(srcs, n, dptr, packetsize);
+  }
+}
+
+/* Adds an operation from sptr to the chain of dptr, or does it if it reads
+   dptr.  Returns the new length of the list. */
+
+static int jerasure_add_to_chain(char **srcs, int n, char *sptr, char *dptr, int op, int packetsize)
+{
+  if (sptr == dptr) {
+    jerasure_do_chain(srcs, n, dptr, packetsize);
+    if (op) memset(dptr, 0, packetsize);
+    srcs[0] = dptr;
+    return 1;
+  }
+  if (!op) n = 0;
+  if (n == JERASURE_DOTPROD_SRCS) {
+    jerasure_do_chain(srcs, n, dptr, packetsize);
+    srcs[0] = dptr;
+    n = 1;
+  }
+  srcs[n++] = sptr;
+  return n;
+}
+
+void jerasure_do_scheduled_operations(char **ptrs, int **operations, int packetsize)
+{
+  char *srcs[JERASURE_DOTPROD_SRCS];
+  char *dptr;
+  int op, n;
+  long xors, copies;
+
+  xors = 0;
+  copies = 0;
+  op = 0;
+  while (operations[op][0] >= 0) {
+    dptr = ptrs[operations[op][2]] + operations[op][3]*packetsize;
+    n = 0;
+    if (operations[op][4]) srcs[n++] = dptr;
+    for (; operations[op][0] >= 0 && ptrs[operations[op][2]] + operations[op][3]*packetsize == dptr; op++) {
+      n = jerasure_add_to_chain(srcs, n, ptrs[operations[op][0]] + operations[op][1]*packetsize,
+                                dptr, operations[op][4], packetsize);
+      if (operations[op][4]) xors++; else copies++;
+    }
+    jerasure_do_chain(srcs, n, dptr, packetsize);
+  }
+  jerasure_count_schedule(xors, copies, packetsize);
+}
+
+void jerasure_schedule_encode(int k, int m, int w, int **schedule,
+                                   char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char **ptr_copy;
+  int i, tdone;
+
+  ptr_copy = talloc(char *, (k+m));
+  for (i = 0; i < k; i++) ptr_copy[i] = data_ptrs[i];
+  for (i = 0; i < m; i++) ptr_copy[i+k] = coding_ptrs[i];
+  for (tdone = 0; tdone < size; tdone += packetsize*w) {
+    jerasure_do_scheduled_operations(ptr_copy, schedule, packetsize);
+    for (i = 0; i < k+m; i++) ptr_copy[i] += (packetsize*w);
+  }
+  free(ptr_copy);
+}
+    
+void jerasure_do_flat_scheduled_operations(char **ptrs, jerasure_flat_schedule_t *schedule,
+                                           int packetsize)
+{
+  jerasure_schedule_op_t *o, *end;
+  char *srcs[JERASURE_DOTPROD_SRCS];
+  char *dptr;
+  int dev, pkt, n;
+  long xors, copies;
+
+  xors = 0;
+  copies = 0;
+  end = schedule->ops + schedule->nops;
+  o = schedule->ops;
+  while (o < end) {
+    dev = o->to_dev;
+    pkt = o->to_pkt;
+    dptr = ptrs[dev] + pkt*packetsize;
+    n = 0;
+    if (o->op) srcs[n++] = dptr;
+    for (; o < end && o->to_dev == dev && o->to_pkt == pkt; o++) {
+      n = jerasure_add_to_chain(srcs, n, ptrs[o->from_dev] + o->from_pkt*packetsize, dptr, o->op, packetsize);
+      if (o->op) xors++; else copies++;
+    }
+    jerasure_do_chain(srcs, n, dptr, packetsize);
+  }
+  jerasure_count_schedule(xors, copies, packetsize);
+}
+
+static void jerasure_encode_flat(const char *caller, int k, int m, int w,
+                                 jerasure_flat_schedule_t *schedule, jerasure_jit_schedule_t *jit,
+                                 char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS], **ptrs;
+  int i;
+
+  ptrs = (k+m <= JERASURE_DOTPROD_SRCS) ? ptrs_buf : talloc(char *, k+m);
+  if (ptrs != NULL) {
+    for (i = 0; i < k; i++) ptrs[i] = data_ptrs[i];
+    for (i = 0; i < m; i++) ptrs[i+k] = coding_ptrs[i];
+  }
+  if (ptrs == NULL || jerasure_run_flat_schedule(ptrs, k+m, w, schedule, jit, NULL, size, packetsize) < 0) {
+    fprintf(stderr, "%s(): out of memory\n", caller);
+    assert(0);
+  }
+  if (ptrs != ptrs_buf) free(ptrs);
+}
+
+void jerasure_flat_schedule_encode(int k, int m, int w, jerasure_flat_schedule_t *schedule,
+                                   char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  jerasure_encode_flat("jerasure_flat_schedule_encode", k, m, w, schedule, NULL,
+                       data_ptrs, coding_ptrs, size, packetsize);
+}
+
+void jerasure_jit_schedule_encode(int k, int m, int w, jerasure_jit_schedule_t *jit,
+                                  char **data_ptrs, char **coding_ptrs, int size)
+{
+  jerasure_encode_flat("jerasure_jit_schedule_encode", k, m, w, jit->schedule, jit,
+                       data_ptrs, coding_ptrs, size, jit->packetsize);
+}
+
+jerasure_flat_schedule_t *jerasure_dumb_packed_bitmatrix_to_flat_schedule(int k, int m, int w,
+                                                                    jerasure_packed_bitmatrix_t *bitmatrix)
+{
+  jerasure_flat_schedule_t *s;
+  uint64_t *row, x;
+  int optodo, i, j, wd;
+
+  if (!jerasure_flat_schedule_fits(k, m, w)) return NULL;
+  if (bitmatrix->rows != m*w || bitmatrix->cols != k*w) return NULL;
+  s = jerasure_new_flat_schedule(k*m*w*w);
+  if (s == NULL) return NULL;
+
+  for (i = 0; i < m*w; i++) {
+    optodo = 0;
+    row = bitmatrix->bits + (size_t) i*bitmatrix->words;
+    for (wd = 0; wd < bitmatrix->words; wd++) {
+      for (x = row[wd]; x != 0; x &= x-1) {
+        j = wd*64 + jerasure_ctz64(x);
+        jerasure_add_flat_op(s, optodo, j/w, j%w, k+i/w, i%w);
+        optodo = 1;
+      }
+    }
+  }
+  return jerasure_trim_flat_schedule(s);
+}
+
+jerasure_flat_schedule_t *jerasure_dumb_bitmatrix_to_flat_schedule(int k, int m, int w, int *bitmatrix)
+{
+  jerasure_packed_bitmatrix_t *p;
+  jerasure_flat_schedule_t *s;
+
+  p = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  if (p == NULL) return NULL;
+  s = jerasure_dumb_packed_bitmatrix_to_flat_schedule(k, m, w, p);
+  jerasure_free_packed_bitmatrix(p);
+  return s;
+}
+
+int **jerasure_dumb_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+{
+  jerasure_flat_schedule_t *flat;
+  int **schedule;
+
+  flat = jerasure_dumb_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
+  if (flat == NULL) return NULL;
+  schedule = jerasure_flat_schedule_to_schedule(flat);
+  jerasure_free_flat_schedule(flat);
+  return schedule;
+}
+
+/* Each row is done either from the data, or from a coding row that is
+   already done, whichever takes fewer XORs; the difference between two
+   rows is the popcount of their XOR. */
+
+jerasure_flat_schedule_t *jerasure_smart_packed_bitmatrix_to_flat_schedule(int k, int m, int w,
+                                                                     jerasure_packed_bitmatrix_t *bitmatrix)
+{
+  jerasure_flat_schedule_t *operations;
+  int i, j, wd, words;
+  int *diff, *from, *flink, *blink;
+  uint64_t *ptr, *b1, x;
+  int no, row;
+  int bestrow = 0, bestdiff, top;
+
+  if (!jerasure_flat_schedule_fits(k, m, w)) return NULL;
+  if (bitmatrix->rows != m*w || bitmatrix->cols != k*w) return NULL;
+  words = bitmatrix->words;
+  operations = jerasure_new_flat_schedule(k*m*w*w);
+  if (!operations) return NULL;
+
+  diff = talloc(int, m*w);
+  from = talloc(int, m*w);
+  flink = talloc(int, m*w);
+  blink = talloc(int, m*w);
+  if (diff == NULL || from == NULL || flink == NULL || blink == NULL) {
+    free(operations);
+    free(diff);
+    free(from);
+    free(flink);
+    free(blink);
+    return NULL;
+  }
+
+  bestdiff = k*w+1;
+  top = 0;
+  for (i = 0; i < m*w; i++) {
+    ptr = bitmatrix->bits + (size_t) i*words;
+    no = 0;
+    for (wd = 0; wd < words; wd++) no += jerasure_popcount64(ptr[wd]);
+    diff[i] = no;
+    from[i] = -1;
+    flink[i] = i+1;
+    blink[i] = i-1;
+    if (no < bestdiff) {
+      bestdiff = no;
+      bestrow = i;
+    }
+  }
+
+  flink[m*w-1] = -1;
+  
+  while (top != -1) {
+    row = bestrow;
+
+    if (blink[row] == -1) {
+      top = flink[row];
+      if (top != -1) blink[top] = -1;
+    } else {
+      flink[blink[row]] = flink[row];
+      if (flink[row] != -1) {
+        blink[flink[row]] = blink[row];
+      }
+    }
+
+    ptr = bitmatrix->bits + (size_t) row*words;
+    if (from[row] == -1) {
+      no = 0;
+      for (wd = 0; wd < words; wd++) {
+        for (x = ptr[wd]; x != 0; x &= x-1) {
+          j = wd*64 + jerasure_ctz64(x);
+          jerasure_add_flat_op(operations, no, j/w, j%w, k+row/w, row%w);
+          no = 1;
+        }
+      }
+    } else {
+      jerasure_add_flat_op(operations, 0, k+from[row]/w, from[row]%w, k+row/w, row%w);
+      b1 = bitmatrix->bits + (size_t) from[row]*words;
+      for (wd = 0; wd < words; wd++) {
+        for (x = ptr[wd] ^ b1[wd]; x != 0; x &= x-1) {
+          j = wd*64 + jerasure_ctz64(x);
+          jerasure_add_flat_op(operations, 1, j/w, j%w, k+row/w, row%w);
+        }
+      }
+    }
+    bestdiff = k*w+1;
+    for (i = top; i != -1; i = flink[i]) {
+      no = 1;
+      b1 = bitmatrix->bits + (size_t) i*words;
+      for (wd = 0; wd < words; wd++) no += jerasure_popcount64(ptr[wd] ^ b1[wd]);
+      if (no < diff[i]) {
+        from[i] = row;
+        diff[i] = no;
+      }
+      if (diff[i] < bestdiff) {
+        bestdiff = diff[i];
+        bestrow = i;
+      }
+    }
+  }
+  
+  free(from);
+  free(diff);
+  free(blink);
+  free(flink);
+
+  return jerasure_trim_flat_schedule(operations);
+}
+
+jerasure_flat_schedule_t *jerasure_smart_bitmatrix_to_flat_schedule(int k, int m, int w, int *bitmatrix)
+{
+  jerasure_packed_bitmatrix_t *p;
+  jerasure_flat_schedule_t *s;
+
+  p = jerasure_pack_bitmatrix(bitmatrix, m*w, k*w);
+  if (p == NULL) return NULL;
+  s = jerasure_smart_packed_bitmatrix_to_flat_schedule(k, m, w, p);
+  jerasure_free_packed_bitmatrix(p);
+  return s;
+}
+
+int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+{
+  jerasure_flat_schedule_t *flat;
+  int **schedule;
+
+  flat = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
+  if (flat == NULL) return NULL;
+  schedule = jerasure_flat_schedule_to_schedule(flat);
+  jerasure_free_flat_schedule(flat);
+  return schedule;
+}
+
+void jerasure_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
+                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  int i, tile, off, len;
+
+  if (packetsize%sizeof(long) != 0) {
+    fprintf(stderr, "jerasure_bitmatrix_encode - packetsize(%d) %c sizeof(long) != 0\n", packetsize, '%');
+    assert(0);
+  }
+  if (size%(packetsize*w) != 0) {
+    fprintf(stderr, "jerasure_bitmatrix_encode - size(%d) %c (packetsize(%d)*w(%d))) != 0\n", 
+         size, '%', packetsize, w);
+    assert(0);
+  }
+
+  tile = jerasure_tile_bytes(k+m, packetsize*w, size);
+  for (off = 0; off < size; off += tile) {
+    len = (size - off < tile) ? size - off : tile;
+    for (i = 0; i < m; i++) {
+      jerasure_bitmatrix_dotprod_range(k, w, bitmatrix+i*k*w*w, NULL, k+i, data_ptrs, coding_ptrs,
+                                       off, len, packetsize);
+    }
+  }
+}
+
+/* ------------------------------------------------------------ */
+/* Parallel encoding and decoding.
+
+   The jerasure_parallel_* routines split size into slices, and run the
+   slices on a pool of worker threads and on the calling thread.  Every
+   byte only depends on the bytes at the same offset in the other devices,
+   so the slices are independent.  What only needs to be done once for a
+   call, like the decoding matrix or the decoding schedule, is done by the
+   caller before the slices are started.
+
+   A call is on the list jerasure_pool_calls until all of its slices have
+   been claimed.  The caller claims slices of its own call too, so a call
+   finishes even if every worker is busy, and then waits for the slices
+   that the workers claimed.  The workers are started by the first call
+   that needs them, and stopped by jerasure_set_threads().  Slices are
+   claimed under jerasure_pool_mutex, so they are at least
+   JERASURE_PARALLEL_MIN_SLICE bytes. */
+
+#define JERASURE_PARALLEL_MIN_SLICE (64*1024)
+
+typedef struct jerasure_parallel_call {
+  int (*part)(struct jerasure_parallel_call *c, int i);      /* Runs part i */
+  int (*run)(struct jerasure_parallel_call *c, char **ptrs, int len);
+  void *arg;
+  int k, m, w, packetsize;
+  int *matrix;
+  int **schedule;
+  jerasure_flat_schedule_t *flat;
+  jerasure_decoding *d;
+  char **ptrs;                /* k+m devices: data, then coding, for all but schedule decoding */
+  int size, slice, nslices;
+  int claimed, finished, rc;
+  struct jerasure_parallel_call *next;
+} jerasure_parallel_call;
+
+static int jerasure_threads = 0;    /* 0: one for each online processor */
+
+#ifdef JERASURE_PTHREADS
+static pthread_mutex_t jerasure_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t jerasure_pool_config_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jerasure_pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jerasure_pool_done = PTHREAD_COND_INITIALIZER;
+static pthread_t *jerasure_pool_workers = NULL;
+static int jerasure_pool_nworkers = 0;
+static int jerasure_pool_capacity = 0;      /* Of jerasure_pool_workers */
+static int jerasure_pool_quit = 0;
+static jerasure_parallel_call *jerasure_pool_calls = NULL;
+#endif
+
+/* Runs slice i of c on offset copies of its device pointers. */
+
+static int jerasure_parallel_slice(jerasure_parallel_call *c, int i)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS], **p;
+  int j, n, off, len, rc;
+
+  n = c->k + c->m;
+  p = (n <= JERASURE_DOTPROD_SRCS) ? ptrs_buf : talloc(char *, n);
+  if (p == NULL) return -1;
+  off = i * c->slice;
+  len = (c->size - off < c->slice) ? c->size - off : c->slice;
+  for (j = 0; j < n; j++) p[j] = c->ptrs[j] + off;
+  rc = c->run(c, p, len);
+  if (p != ptrs_buf) free(p);
+  return rc;
+}
+
+#ifdef JERASURE_PTHREADS
+
+/* These two are called with jerasure_pool_mutex held. */
+
+static int jerasure_pool_claim(jerasure_parallel_call *c)
+{
+  jerasure_parallel_call **l;
+
+  if (++c->claimed == c->nslices) {
+    for (l = &jerasure_pool_calls; *l != c; l = &(*l)->next) ;
+    *l = c->next;
+  }
+  return c->claimed - 1;
+}
+
+static void jerasure_pool_finish(jerasure_parallel_call *c, int rc)
+{
+  if (rc < 0) c->rc = -1;
+  if (++c->finished == c->nslices) pthread_cond_broadcast(&jerasure_pool_done);
+}
+
+static void *jerasure_pool_worker(void *arg)
+{
+  jerasure_parallel_call *c;
+  int i, rc;
+
+  (void) arg;
+  JERASURE_LOCK(&jerasure_pool_mutex);
+  while (1) {
+    while (!jerasure_pool_quit && jerasure_pool_calls == NULL) {
+      pthread_cond_wait(&jerasure_pool_work, &jerasure_pool_mutex);
+    }
+    if (jerasure_pool_quit) break;
+    c = jerasure_pool_calls;
+    i = jerasure_pool_claim(c);
+    JERASURE_UNLOCK(&jerasure_pool_mutex);
+    rc = c->part(c, i);
+    JERASURE_LOCK(&jerasure_pool_mutex);
+    jerasure_pool_finish(c, rc);
+  }
+  JERASURE_UNLOCK(&jerasure_pool_mutex);
+  return NULL;
+}
+#endif
+
+#ifdef JERASURE_PTHREADS
+static int jerasure_default_threads()
+{
+  long n;
+
+  n = -1;
+#ifdef _SC_NPROCESSORS_ONLN
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return (n > 0 && n < 4096) ? (int) n : 1;
+}
+#endif
+
+void jerasure_set_threads(int threads)
+{
+#ifdef JERASURE_PTHREADS
+  pthread_t *workers;
+  int i, n;
+
+  JERASURE_LOCK(&jerasure_pool_config_mutex);
+  JERASURE_LOCK(&jerasure_pool_mutex);
+  jerasure_threads = (threads > 0) ? threads : 0;
+  workers = jerasure_pool_workers;
+  n = jerasure_pool_nworkers;
+  jerasure_pool_quit = 1;
+  pthread_cond_broadcast(&jerasure_pool_work);
+  JERASURE_UNLOCK(&jerasure_pool_mutex);
+
+  for (i = 0; i < n; i++) pthread_join(workers[i], NULL);
+
+  JERASURE_LOCK(&jerasure_pool_mutex);
+  jerasure_pool_workers = NULL;
+  jerasure_pool_nworkers = 0;
+  jerasure_pool_capacity = 0;
+  jerasure_pool_quit = 0;
+  JERASURE_UNLOCK(&jerasure_pool_mutex);
+  JERASURE_UNLOCK(&jerasure_pool_config_mutex);
+  if (workers != NULL) free(workers);
+#else
+  jerasure_threads = (threads > 0) ? threads : 0;
+#endif
+}
+
+int jerasure_get_threads()
+{
+#ifdef JERASURE_PTHREADS
+  int n;
+
+  JERASURE_LOCK(&jerasure_pool_mutex);
+  n = jerasure_threads;
+  JERASURE_UNLOCK(&jerasure_pool_mutex);
+  return (n > 0) ? n : jerasure_default_threads();
+#else
+  return 1;
+#endif
+}
+
+/* Runs the c->nslices parts of c, with c->part, and returns once all of
+   them are done:  0, or -1 if any of them failed. */
+
+static int jerasure_pool_run(jerasure_parallel_call *c)
+{
+  int i, n, rc;
+
+  c->claimed = 0;
+  c->finished = 0;
+  c->rc = 0;
+  c->next = NULL;
+  if (c->nslices == 1) return c->part(c, 0);
+
+#ifdef JERASURE_PTHREADS
+  {
+    jerasure_parallel_call **l;
+    pthread_t *workers;
+
+    /* The default number of threads may grow as processors come online,
+       so the array of workers grows with it. */
+
+    JERASURE_LOCK(&jerasure_pool_mutex);
+    n = ((jerasure_threads > 0) ? jerasure_threads : jerasure_default_threads()) - 1;
+    if (!jerasure_pool_quit && jerasure_pool_nworkers < n) {
+      if (jerasure_pool_capacity < n) {
+        workers = (pthread_t *) realloc(jerasure_pool_workers, sizeof(pthread_t)*n);
+        if (workers != NULL) {
+          jerasure_pool_workers = workers;
+          jerasure_pool_capacity = n;
+        }
+      }
+      while (jerasure_pool_nworkers < jerasure_pool_capacity && jerasure_pool_nworkers < n &&
+             pthread_create(jerasure_pool_workers+jerasure_pool_nworkers, NULL,
+                            jerasure_pool_worker, NULL) == 0) {
+        jerasure_pool_nworkers++;
+      }
+    }
+    for (l = &jerasure_pool_calls; *l != NULL; l = &(*l)->next) ;
+    *l = c;
+    pthread_cond_broadcast(&jerasure_pool_work);
+    while (c->claimed < c->nslices) {
+      i = jerasure_pool_claim(c);
+      JERASURE_UNLOCK(&jerasure_pool_mutex);
+      rc = c->part(c, i);
+      JERASURE_LOCK(&jerasure_pool_mutex);
+      jerasure_pool_finish(c, rc);
+    }
+    while (c->finished < c->nslices) pthread_cond_wait(&jerasure_pool_done, &jerasure_pool_mutex);
+    JERASURE_UNLOCK(&jerasure_pool_mutex);
+  }
+#else
+  n = c->nslices;
+  for (i = 0; i < n; i++) {
+    rc = c->part(c, i);
+    if (rc < 0) c->rc = -1;
+  }
+#endif
+  return c->rc;
+}
+
+/* Splits c->size into slices that are multiples of unit bytes, and runs
+   them with jerasure_pool_run(). */
+
+static int jerasure_parallel_run(jerasure_parallel_call *c, int unit)
+{
+  int n, threads;
+
+  n = c->size / JERASURE_PARALLEL_MIN_SLICE;
+  threads = jerasure_get_threads();
+  if (n > threads) n = threads;
+  if (n < 1) n = 1;
+  c->slice = (c->size + n - 1) / n;
+  c->slice += (unit - c->slice % unit) % unit;
+  if (c->slice < unit) c->slice = unit;
+  c->nslices = (c->size + c->slice - 1) / c->slice;
+  if (c->nslices < 1) c->nslices = 1;
+  c->part = jerasure_parallel_slice;
+  return jerasure_pool_run(c);
+}
+
+/* Sets up c for k+m devices, with its pointers in ptrs_buf if they fit. */
+
+static int jerasure_parallel_init(jerasure_parallel_call *c, int k, int m, int w, int packetsize,
+                                  char **data_ptrs, char **coding_ptrs, char **ptrs_buf, int size)
+{
+  int i;
+
+  memset(c, 0, sizeof(jerasure_parallel_call));
+  c->k = k;
+  c->m = m;
+  c->w = w;
+  c->packetsize = packetsize;
+  c->size = size;
+  c->ptrs = (k+m <= JERASURE_DOTPROD_SRCS) ? ptrs_buf : talloc(char *, k+m);
+  if (c->ptrs == NULL) return -1;
+  if (data_ptrs != NULL) {
+    for (i = 0; i < k; i++) c->ptrs[i] = data_ptrs[i];
+    for (i = 0; i < m; i++) c->ptrs[k+i] = coding_ptrs[i];
+  }
+  return 0;
+}
+
+static void jerasure_parallel_done(jerasure_parallel_call *c, char **ptrs_buf)
+{
+  if (c->ptrs != NULL && c->ptrs != ptrs_buf) free(c->ptrs);
+}
+
+static int jerasure_parallel_matrix_encode_slice(jerasure_parallel_call *c, char **ptrs, int len)
+{
+  jerasure_matrix_encode(c->k, c->m, c->w, c->matrix, ptrs, ptrs+c->k, len);
+  return 0;
+}
+
+static int jerasure_parallel_bitmatrix_encode_slice(jerasure_parallel_call *c, char **ptrs, int len)
+{
+  jerasure_bitmatrix_encode(c->k, c->m, c->w, c->matrix, ptrs, ptrs+c->k, len, c->packetsize);
+  return 0;
+}
+
+static int jerasure_parallel_schedule_encode_slice(jerasure_parallel_call *c, char **ptrs, int len)
+{
+  jerasure_schedule_encode(c->k, c->m, c->w, c->schedule, ptrs, ptrs+c->k, len, c->packetsize);
+  return 0;
+}
+
+static int jerasure_parallel_matrix_decode_slice(jerasure_parallel_call *c, char **ptrs, int len)
+{
+  jerasure_matrix_decode_tiles(c->k, c->m, c->w, c->matrix, c->d, ptrs, ptrs+c->k, len);
+  return 0;
+}
+
+static int jerasure_parallel_bitmatrix_decode_slice(jerasure_parallel_call *c, char **ptrs, int len)
+{
+  jerasure_bitmatrix_decode_tiles(c->k, c->m, c->w, c->matrix, c->d, ptrs, ptrs+c->k, len, c->packetsize);
+  return 0;
+}
+
+static int jerasure_parallel_schedule_decode_slice(jerasure_parallel_call *c, char **ptrs, int len)
+{
+  return jerasure_run_flat_schedule(ptrs, c->k+c->m, c->w, c->flat, NULL, NULL, len, c->packetsize);
+}
+
+/* The encoders have no way to report an error, so running out of memory
+   is fatal, as in jerasure_encode_flat(). */
+
+static void jerasure_parallel_encode(const char *caller, jerasure_parallel_call *c, char **ptrs_buf,
+                                     int unit)
+{
+  if (c->ptrs == NULL || jerasure_parallel_run(c, unit) < 0) {
+    fprintf(stderr, "%s(): out of memory\n", caller);
+    assert(0);
+  }
+  jerasure_parallel_done(c, ptrs_buf);
+}
+
+void jerasure_parallel_matrix_encode(int k, int m, int w, int *matrix,
+                                     char **data_ptrs, char **coding_ptrs, int size)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS];
+  jerasure_parallel_call c;
+
+  jerasure_parallel_init(&c, k, m, w, 0, data_ptrs, coding_ptrs, ptrs_buf, size);
+  c.matrix = matrix;
+  c.run = jerasure_parallel_matrix_encode_slice;
+  jerasure_parallel_encode("jerasure_parallel_matrix_encode", &c, ptrs_buf, JERASURE_TILE_UNIT);
+}
+
+void jerasure_parallel_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
+                                        char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS];
+  jerasure_parallel_call c;
+
+  jerasure_parallel_init(&c, k, m, w, packetsize, data_ptrs, coding_ptrs, ptrs_buf, size);
+  c.matrix = bitmatrix;
+  c.run = jerasure_parallel_bitmatrix_encode_slice;
+  jerasure_parallel_encode("jerasure_parallel_bitmatrix_encode", &c, ptrs_buf, w*packetsize);
+}
+
+void jerasure_parallel_schedule_encode(int k, int m, int w, int **schedule,
+                                       char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS];
+  jerasure_parallel_call c;
+
+  jerasure_parallel_init(&c, k, m, w, packetsize, data_ptrs, coding_ptrs, ptrs_buf, size);
+  c.schedule = schedule;
+  c.run = jerasure_parallel_schedule_encode_slice;
+  jerasure_parallel_encode("jerasure_parallel_schedule_encode", &c, ptrs_buf, w*packetsize);
+}
+
+int jerasure_parallel_matrix_decode(int k, int m, int w, int *matrix, int row_k_ones, int *erasures,
+                                    char **data_ptrs, char **coding_ptrs, int size)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS];
+  jerasure_parallel_call c;
+  jerasure_decoding d;
+  int rc;
+
+  if (w != 8 && w != 16 && w != 32) return -1;
+  if (jerasure_decoding_setup(0, k, m, w, matrix, row_k_ones, erasures, &d) < 0) return -1;
+  jerasure_matrix_decode_count(k, m, w, matrix, &d, size);
+  rc = jerasure_parallel_init(&c, k, m, w, 0, data_ptrs, coding_ptrs, ptrs_buf, size);
+  if (rc == 0) {
+    c.matrix = matrix;
+    c.d = &d;
+    c.run = jerasure_parallel_matrix_decode_slice;
+    rc = jerasure_parallel_run(&c, JERASURE_TILE_UNIT);
+  }
+  jerasure_parallel_done(&c, ptrs_buf);
+  jerasure_decoding_free(&d);
+  return rc;
+}
+
+int jerasure_parallel_bitmatrix_decode(int k, int m, int w, int *bitmatrix, int row_k_ones, int *erasures,
+                                       char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS];
+  jerasure_parallel_call c;
+  jerasure_decoding d;
+  int rc;
+
+  if (size%(w*packetsize) != 0) {
+    fprintf(stderr, "jerasure_parallel_bitmatrix_decode - size%c(w*packetsize)) must = 0\n", '%');
+    assert(0);
+  }
+  if (jerasure_decoding_setup(1, k, m, w, bitmatrix, row_k_ones, erasures, &d) < 0) return -1;
+  rc = jerasure_parallel_init(&c, k, m, w, packetsize, data_ptrs, coding_ptrs, ptrs_buf, size);
+  if (rc == 0) {
+    c.matrix = bitmatrix;
+    c.d = &d;
+    c.run = jerasure_parallel_bitmatrix_decode_slice;
+    rc = jerasure_parallel_run(&c, w*packetsize);
+  }
+  jerasure_parallel_done(&c, ptrs_buf);
+  jerasure_decoding_free(&d);
+  return rc;
+}
+
+int jerasure_parallel_schedule_decode_lazy(int k, int m, int w, int *bitmatrix, int *erasures,
+                                           char **data_ptrs, char **coding_ptrs, int size, int packetsize,
+                                           int smart)
+{
+  jerasure_parallel_call c;
+  char **ptrs;
+  int rc;
+
+  ptrs = set_up_ptrs_for_scheduled_decoding(k, m, erasures, data_ptrs, coding_ptrs);
+  if (ptrs == NULL) return -1;
+  memset(&c, 0, sizeof(jerasure_parallel_call));
+  c.k = k;
+  c.m = m;
+  c.w = w;
+  c.packetsize = packetsize;
+  c.size = size;
+  c.ptrs = ptrs;
+  c.flat = jerasure_generate_flat_decoding_schedule(k, m, w, bitmatrix, erasures, smart);
+  c.run = jerasure_parallel_schedule_decode_slice;
+  rc = (c.flat == NULL) ? -1 : jerasure_parallel_run(&c, w*packetsize);
+  if (c.flat != NULL) jerasure_free_flat_schedule(c.flat);
+  free(ptrs);
+  return rc;
+}
+
+/* ------------------------------------------------------------ */
+/* Codec plans.
+
+   A plan owns copies of the coding matrix or bitmatrix, everything that
+   is derived from them, and all of the scratch that encoding and decoding
+   need.  The decoding state of the last erasure pattern is kept, so that
+   decoding a run of stripes with the same erasures inverts the matrix once.
+   The matrix technique decodes every erased data device from the decoding
+   matrix in one multi-destination pass, and then re-encodes the erased
+   coding devices in a second pass over the same tile.  The schedule
+   technique encodes with its schedule compiled for the plan's packetsize,
+   and keeps its decoding schedules in a lazy schedule cache of
+   JERASURE_PLAN_SCHEDULE_BYTES, which compiles them too. */
+
+#define JERASURE_PLAN_SCHEDULE_BYTES (4*1024*1024)
+
+struct jerasure_plan {
+  int k, m, w, technique, packetsize, row_k_ones;
+  galois_context_t *ctx;    /* Fields of the arithmetic, or NULL */
+  int *matrix;              /* m*k coding matrix (matrix technique) */
+  int *bitmatrix;           /* mw*kw coding bitmatrix (other techniques) */
+  jerasure_flat_schedule_t *schedule;  /* Encoding schedule (schedule technique) */
+  jerasure_jit_schedule_t *jit;        /* It compiled, or NULL */
+  jerasure_schedule_cache_t *scache;  /* Decoding schedules (schedule technique) */
+  unsigned char *tables;    /* Split tables of matrix */
+  int *coding_ids;          /* m: ids of the coding devices */
+  char **ptrs;              /* 2*(k+m) pointers of scratch */
+  char *scratch;            /* Temporaries of schedule */
+  int *erased;              /* k+m */
+  int *tmpmat;              /* Scratch of the matrix inversion */
+
+  /* Decoding state of the last erasure pattern.  last_erased[0] is -1
+     until there is one. */
+
+  int *last_erased;         /* k+m */
+  int *dm_ids;              /* k */
+  int *tmpids;              /* k: sources of the erased data devices */
+  int *decoding_matrix;     /* k*k or kw*kw */
+  int lastdrive;            /* See jerasure_matrix_decode */
+  int use_tmpids;           /* Bitmatrix technique: decode lastdrive from the parity row */
+  int ndata, ncoding;       /* Matrix technique: erased data and coding devices */
+  int *dest_ids;            /* m: their ids, data devices first */
+  int *rows;                /* m*k: their rows, in the same order */
+  unsigned char *rtables;   /* Split tables of rows */
+};
+
+static int jerasure_plan_row_k_ones(int k, int w, int technique, int *matrix, int *bitmatrix)
+{
+  int i, j;
+
+  if (technique == JERASURE_PLAN_MATRIX) {
+    for (j = 0; j < k; j++) if (matrix[j] != 1) return 0;
+    return 1;
+  }
+  for (i = 0; i < w; i++) {
+    for (j = 0; j < k*w; j++) {
+      if (bitmatrix[i*k*w+j] != ((j % w) == i)) return 0;
+    }
+  }
+  return 1;
+}
+
+jerasure_plan_t *jerasure_plan_create(int k, int m, int w, int technique,
+                                      int *matrix, int *bitmatrix, int packetsize)
+{
+  return jerasure_plan_create_with_context(NULL, k, m, w, technique, matrix, bitmatrix, packetsize);
+}
+
+jerasure_plan_t *jerasure_plan_create_with_context(galois_context_t *ctx, int k, int m, int w,
+                                                   int technique, int *matrix, int *bitmatrix,
+                                                   int packetsize)
+{
+  jerasure_plan_t *p;
+  int i, tb, kw;
+
+  if (k <= 0 || m <= 0) return NULL;
+  if (technique == JERASURE_PLAN_MATRIX) {
+    if (matrix == NULL || (w != 8 && w != 16 && w != 32)) return NULL;
+  } else if (technique == JERASURE_PLAN_BITMATRIX || technique == JERASURE_PLAN_SCHEDULE) {
+    if (w < 1 || w > 32 || packetsize <= 0 || packetsize%sizeof(long) != 0) return NULL;
+    if (matrix == NULL && bitmatrix == NULL) return NULL;
+  } else {
+    return NULL;
+  }
+
+  p = talloc(jerasure_plan_t, 1);
+  if (p == NULL) return NULL;
+  memset(p, 0, sizeof(jerasure_plan_t));
+  p->k = k;
+  p->m = m;
+  p->w = w;
+  p->technique = technique;
+  p->packetsize = packetsize;
+  p->ctx = ctx;
+
+  kw = (technique == JERASURE_PLAN_MATRIX) ? k : k*w;
+  p->ptrs = talloc(char *, 2*(k+m));
+  p->erased = talloc(int, k+m);
+  p->last_erased = talloc(int, k+m);
+  p->dm_ids = talloc(int, k);
+  p->tmpids = talloc(int, k);
+  p->tmpmat = talloc(int, kw*kw);
+  p->decoding_matrix = talloc(int, kw*kw);
+  if (p->ptrs == NULL || p->erased == NULL || p->last_erased == NULL || p->dm_ids == NULL ||
+      p->tmpids == NULL || p->tmpmat == NULL || p->decoding_matrix == NULL) {
+    jerasure_plan_free(p);
+    return NULL;
+  }
+  p->last_erased[0] = -1;
+
+  if (technique == JERASURE_PLAN_MATRIX) {
+    p->matrix = talloc(int, k*m);
+    p->coding_ids = talloc(int, m);
+    p->dest_ids = talloc(int, m);
+    p->rows = talloc(int, k*m);
+    if (p->matrix == NULL || p->coding_ids == NULL || p->dest_ids == NULL || p->rows == NULL) {
+      jerasure_plan_free(p);
+      return NULL;
+    }
+    memcpy(p->matrix, matrix, sizeof(int)*k*m);
+    for (i = 0; i < m; i++) p->coding_ids[i] = k+i;
+    tb = galois_region_dotprod_table_bytes(w, k*m);
+    if (tb > 0) {
+      p->tables = talloc(unsigned char, tb);
+      p->rtables = talloc(unsigned char, tb);
+      if (p->tables == NULL || p->rtables == NULL) {
+        jerasure_plan_free(p);
+        return NULL;
+      }
+      galois_context_region_dotprod_build_tables(ctx, w, p->matrix, k*m, p->tables);
+    }
+  } else {
+    if (bitmatrix != NULL) {
+      p->bitmatrix = talloc(int, k*m*w*w);
+      if (p->bitmatrix != NULL) memcpy(p->bitmatrix, bitmatrix, sizeof(int)*k*m*w*w);
+    } else {
+      p->bitmatrix = jerasure_context_matrix_to_bitmatrix(ctx, k, m, w, matrix);
+    }
+    if (p->bitmatrix == NULL) {
+      jerasure_plan_free(p);
+      return NULL;
+    }
+    if (technique == JERASURE_PLAN_SCHEDULE) {
+      p->schedule = jerasure_cse_bitmatrix_to_flat_schedule(k, m, w, p->bitmatrix);
+      if (p->schedule == NULL) {
+        jerasure_plan_free(p);
+        return NULL;
+      }
+      p->jit = jerasure_jit_compile_flat_schedule(p->schedule, packetsize);
+      if (p->jit == NULL) {
+        jerasure_plan_free(p);
+        return NULL;
+      }
+      if (p->schedule->ntdevs > 0) {
+        p->scratch = talloc(char, p->schedule->ntdevs*w*packetsize);
+        if (p->scratch == NULL) {
+          jerasure_plan_free(p);
+          return NULL;
+        }
+      }
+      p->scache = jerasure_create_lazy_schedule_cache(k, m, w, p->bitmatrix, 1, JERASURE_PLAN_SCHEDULE_BYTES);
+      if (p->scache == NULL) {
+        jerasure_plan_free(p);
+        return NULL;
+      }
+    }
+  }
+
+  p->row_k_ones = jerasure_plan_row_k_ones(k, w, technique, p->matrix, p->bitmatrix);
+  return p;
+}
+
+void jerasure_plan_free(jerasure_plan_t *p)
+{
+  if (p == NULL) return;
+  if (p->matrix != NULL) free(p->matrix);
+  if (p->bitmatrix != NULL) free(p->bitmatrix);
+  if (p->schedule != NULL) jerasure_free_flat_schedule(p->schedule);
+  if (p->jit != NULL) jerasure_free_jit_schedule(p->jit);
+  if (p->scache != NULL) jerasure_free_lazy_schedule_cache(p->scache);
+  if (p->tables != NULL) free(p->tables);
+  if (p->rtables != NULL) free(p->rtables);
+  if (p->coding_ids != NULL) free(p->coding_ids);
+  if (p->ptrs != NULL) free(p->ptrs);
+  if (p->scratch != NULL) free(p->scratch);
+  if (p->erased != NULL) free(p->erased);
+  if (p->tmpmat != NULL) free(p->tmpmat);
+  if (p->last_erased != NULL) free(p->last_erased);
+  if (p->dm_ids != NULL) free(p->dm_ids);
+  if (p->tmpids != NULL) free(p->tmpids);
+  if (p->decoding_matrix != NULL) free(p->decoding_matrix);
+  if (p->dest_ids != NULL) free(p->dest_ids);
+  if (p->rows != NULL) free(p->rows);
+  free(p);
+}
+
+static int jerasure_plan_check_size(jerasure_plan_t *p, int size)
+{
+  if (size < 0) return -1;
+  if (p->technique == JERASURE_PLAN_MATRIX) return (size % (p->w/8) == 0) ? 0 : -1;
+  return (size % (p->w*p->packetsize) == 0) ? 0 : -1;
+}
+
+/* One tile of ndests matrix dot products, with the split tables in tables.
+   src_ids are the ids of the k sources, or NULL for the data devices.
+   ptrs is scratch for k+ndests pointers. */
+
+static void jerasure_plan_matrix_tile(jerasure_plan_t *p, char **ptrs, int *coeffs, unsigned char *tables,
+                                      int *src_ids, int *dest_ids, int ndests,
+                                      char **data_ptrs, char **coding_ptrs, int off, int len)
+{
+  char **srcs, **dests;
+  int k, i, id;
+
+  k = p->k;
+  srcs = ptrs;
+  dests = ptrs + k;
+  for (i = 0; i < k; i++) {
+    id = (src_ids == NULL) ? i : src_ids[i];
+    srcs[i] = ((id < k) ? data_ptrs[id] : coding_ptrs[id-k]) + off;
+  }
+  for (i = 0; i < ndests; i++) {
+    id = dest_ids[i];
+    dests[i] = ((id < k) ? data_ptrs[id] : coding_ptrs[id-k]) + off;
+  }
+  galois_context_region_dotprod_multi_tables(p->ctx, p->w, srcs, coeffs, tables, k, dests, ndests, len);
+}
+
+/* jerasure_plan_encode() with the scratch in ptrs, which holds 2*(k+m)
+   pointers, and scratch, which holds the temporaries of the schedule, so
+   that threads with scratch of their own may encode with one plan. */
+
+static int jerasure_plan_encode_scratch(jerasure_plan_t *p, char **ptrs, char *scratch,
+                                        char **data_ptrs, char **coding_ptrs, int size)
+{
+  int i, k, m, tile, off, len;
+
+  if (jerasure_plan_check_size(p, size) < 0) return -1;
+  k = p->k;
+  m = p->m;
+
+  switch (p->technique) {
+    case JERASURE_PLAN_MATRIX:
+      for (i = 0; i < m; i++) jerasure_count_dotprod_bytes(k, p->w, p->matrix+i*k, size);
+      tile = jerasure_tile_bytes(k+m, JERASURE_TILE_UNIT, size);
+      for (off = 0; off < size; off += tile) {
+        len = (size - off < tile) ? size - off : tile;
+        jerasure_plan_matrix_tile(p, ptrs, p->matrix, p->tables, NULL, p->coding_ids, m,
+                                  data_ptrs, coding_ptrs, off, len);
+      }
+      break;
+    case JERASURE_PLAN_BITMATRIX:
+      jerasure_bitmatrix_encode(k, m, p->w, p->bitmatrix, data_ptrs, coding_ptrs, size, p->packetsize);
+      break;
+    case JERASURE_PLAN_SCHEDULE:
+      for (i = 0; i < k; i++) ptrs[i] = data_ptrs[i];
+      for (i = 0; i < m; i++) ptrs[k+i] = coding_ptrs[i];
+      return jerasure_run_flat_schedule(ptrs, k+m, p->w, p->schedule, p->jit, scratch, size,
+                                        p->packetsize);
+  }
+  return 0;
+}
+
+int jerasure_plan_encode(jerasure_plan_t *p, char **data_ptrs, char **coding_ptrs, int size)
+{
+  return jerasure_plan_encode_scratch(p, p->ptrs, p->scratch, data_ptrs, coding_ptrs, size);
+}
+
+/* Sets up the decoding state of p->erased, unless it is that of the
+   last pattern already. */
+
+static int jerasure_plan_setup_decoding(jerasure_plan_t *p)
+{
+  int k, m, w, i, j, edd, tb;
+
+  k = p->k;
+  m = p->m;
+  w = p->w;
+  if (p->last_erased[0] != -1 && memcmp(p->last_erased, p->erased, sizeof(int)*(k+m)) == 0) return 0;
+  p->last_erased[0] = -1;
+
+  edd = 0;
+  p->lastdrive = k;
+  for (i = 0; i < k; i++) {
+    if (p->erased[i]) {
+      edd++;
+      p->lastdrive = i;
+    }
+  }
+
+  switch (p->technique) {
+    case JERASURE_PLAN_MATRIX:
+
+      /* With one erased data device and an intact parity device, the data
+         device is the parity device minus the others; otherwise all of the
+         erased data devices come from the decoding matrix. */
+
+      p->ndata = 0;
+      if (edd == 1 && p->row_k_ones && !p->erased[k]) {
+        for (i = 0; i < k; i++) p->tmpids[i] = (i < p->lastdrive) ? i : i+1;
+        p->dest_ids[0] = p->lastdrive;
+        memcpy(p->rows, p->matrix, sizeof(int)*k);
+        p->ndata = 1;
+      } else if (edd > 0) {
+        if (jerasure_cached_decoding_matrix(p->ctx, 0, k, m, w, p->matrix, p->erased, p->decoding_matrix,
+                                            p->dm_ids, p->tmpmat) < 0) return -1;
+        memcpy(p->tmpids, p->dm_ids, sizeof(int)*k);
+        for (i = 0; i < k; i++) {
+          if (p->erased[i]) {
+            p->dest_ids[p->ndata] = i;
+            memcpy(p->rows+p->ndata*k, p->decoding_matrix+i*k, sizeof(int)*k);
+            p->ndata++;
+          }
+        }
+      }
+      p->ncoding = 0;
+      for (i = 0; i < m; i++) {
+        if (p->erased[k+i]) {
+          j = p->ndata + p->ncoding;
+          p->dest_ids[j] = k+i;
+          memcpy(p->rows+j*k, p->matrix+i*k, sizeof(int)*k);
+          p->ncoding++;
+        }
+      }
+      tb = galois_region_dotprod_table_bytes(w, k);
+      if (tb > 0) {
+        galois_context_region_dotprod_build_tables(p->ctx, w, p->rows, p->ndata*k, p->rtables);
+        for (i = 0; i < p->ncoding; i++) {
+          memcpy(p->rtables + (p->ndata+i)*tb, p->tables + (p->dest_ids[p->ndata+i]-k)*tb, tb);
+        }
+      }
+      break;
+
+    case JERASURE_PLAN_BITMATRIX:
+      if (!p->row_k_ones || p->erased[k]) p->lastdrive = k;
+      if (edd > 1 || (edd > 0 && (!p->row_k_ones || p->erased[k]))) {
+        if (jerasure_cached_decoding_matrix(p->ctx, 1, k, m, w, p->bitmatrix, p->erased, p->decoding_matrix,
+                                            p->dm_ids, p->tmpmat) < 0) return -1;
+      }
+      p->use_tmpids = (edd > 0 && p->lastdrive < k);
+      for (i = 0; i < k; i++) p->tmpids[i] = (i < p->lastdrive) ? i : i+1;
+      break;
+  }
+
+  memcpy(p->last_erased, p->erased, sizeof(int)*(k+m));
+  return 0;
+}
+
+int jerasure_plan_decode(jerasure_plan_t *p, int *erasures,
+                         char **data_ptrs, char **coding_ptrs, int size)
+{
+  int k, m, i, tb, tile, off, len;
+  unsigned char *ctables;
+  jerasure_decoding d;
+
+  if (jerasure_plan_check_size(p, size) < 0) return -1;
+  if (p->technique == JERASURE_PLAN_SCHEDULE) {
+    return jerasure_schedule_decode_lazy_cache(p->scache, erasures, data_ptrs, coding_ptrs,
+                                               size, p->packetsize);
+  }
+  k = p->k;
+  m = p->m;
+  if (jerasure_fill_erased(k, m, erasures, p->erased) < 0) return -1;
+  if (erasures[0] == -1) return 0;
+  if (jerasure_plan_setup_decoding(p) < 0) return -1;
+
+  switch (p->technique) {
+    case JERASURE_PLAN_MATRIX:
+      for (i = 0; i < p->ndata + p->ncoding; i++) jerasure_count_dotprod_bytes(k, p->w, p->rows+i*k, size);
+      tb = galois_region_dotprod_table_bytes(p->w, k);
+      ctables = (tb > 0) ? p->rtables + p->ndata*tb : NULL;
+      tile = jerasure_tile_bytes(k+m, JERASURE_TILE_UNIT, size);
+      for (off = 0; off < size; off += tile) {
+        len = (size - off < tile) ? size - off : tile;
+        if (p->ndata > 0) {
+          jerasure_plan_matrix_tile(p, p->ptrs, p->rows, p->rtables, p->tmpids, p->dest_ids, p->ndata,
+                                    data_ptrs, coding_ptrs, off, len);
+        }
+        if (p->ncoding > 0) {
+          jerasure_plan_matrix_tile(p, p->ptrs, p->rows+p->ndata*k, ctables, NULL, p->dest_ids+p->ndata,
+                                    p->ncoding, data_ptrs, coding_ptrs, off, len);
+        }
+      }
+      break;
+
+    case JERASURE_PLAN_BITMATRIX:
+      d.erased = p->erased;
+      d.decoding_matrix = p->decoding_matrix;
+      d.dm_ids = p->dm_ids;
+      d.tmpids = p->use_tmpids ? p->tmpids : NULL;
+      d.lastdrive = p->lastdrive;
+      jerasure_bitmatrix_decode_tiles(k, m, p->w, p->bitmatrix, &d, data_ptrs, coding_ptrs, size,
+                                      p->packetsize);
+      break;
+  }
+  return 0;
+}
+
+/* Batches.  A batch is cut into tasks:  every stripe of up to
+   JERASURE_BATCH_SLICE bytes is one task, and bigger stripes are cut
+   into slices of that size (in multiples of 64 bytes, or w*packetsize
+   for the bitmatrix and schedule techniques).  The tasks are dealt out,
+   in order, in equal ranges to the threads that work on the batch, which
+   are the parts of one pool call.  A thread takes tasks from the front of
+   its own range, as many as fit in JERASURE_BATCH_GROUP bytes of every
+   device, so that the small stripes that it encodes one after another
+   share the plan's tables in its cache.  When its range is empty, it
+   steals the back half of the range of another thread, trying them in
+   turn from its right, and stops when there is nothing left to steal.
+   A steal refills the thief's range, so ranges do not only shrink, but no
+   task is made once the batch has started, and every task that has not
+   been run is either in a range or held by the thread that took it (a
+   thief holds what it steals until it is in its own range), which runs it
+   before it looks for more.  So a thread that has found every other range
+   empty in one pass may stop:  any task that is left is held by a thread
+   that has not stopped, and the pool call returns only once every thread
+   has.  Each range has a lock of its own, which only its owner and its
+   thieves take.  Every thread has its own scratch for the plan. */
+
+#define JERASURE_BATCH_SLICE (64*1024)
+#define JERASURE_BATCH_GROUP (64*1024)
+
+typedef struct {
+  int stripe;
+  int off, len;
+} jerasure_batch_task;
+
+typedef struct {
+  int lo, hi;
+#ifdef JERASURE_PTHREADS
+  pthread_mutex_t mutex;
+#endif
+  char pad[64];
+} jerasure_batch_range;
+
+typedef struct {
+  jerasure_plan_t *p;
+  jerasure_stripe_t *stripes;
+  jerasure_batch_task *tasks;
+  jerasure_batch_range *ranges;
+  int nranges;
+} jerasure_batch;
+
+/* Takes the back half of the tasks of another range into range i.
+   Returns 0 if there were none. */
+
+static int jerasure_batch_steal(jerasure_batch *b, int i)
+{
+  jerasure_batch_range *r, *v;
+  int j, n, lo, hi;
+
+  r = b->ranges + i;
+  for (j = 1; j < b->nranges; j++) {
+    v = b->ranges + (i+j) % b->nranges;
+    JERASURE_LOCK(&v->mutex);
+    n = v->hi - v->lo;
+    hi = v->hi;
+    lo = hi - (n+1)/2;
+    if (n > 0) v->hi = lo;
+    JERASURE_UNLOCK(&v->mutex);
+    if (n > 0) {
+      JERASURE_LOCK(&r->mutex);
+      r->lo = lo;
+      r->hi = hi;
+      JERASURE_UNLOCK(&r->mutex);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Runs task t with the scratch in ptrs, which holds 3*(k+m) pointers:
+   2*(k+m) for the plan, and k+m for the devices of a slice. */
+
+static void jerasure_batch_run_task(jerasure_batch *b, jerasure_batch_task *t, char **ptrs, char *scratch)
+{
+  jerasure_stripe_t *s;
+  char **data, **coding, **devs;
+  int i, k, m;
+
+  k = b->p->k;
+  m = b->p->m;
+  s = b->stripes + t->stripe;
+  data = s->data_ptrs;
+  coding = s->coding_ptrs;
+  if (t->len != s->size) {
+    devs = ptrs + 2*(k+m);
+    for (i = 0; i < k; i++) devs[i] = data[i] + t->off;
+    for (i = 0; i < m; i++) devs[k+i] = coding[i] + t->off;
+    data = devs;
+    coding = devs + k;
+  }
+  if (jerasure_plan_encode_scratch(b->p, ptrs, scratch, data, coding, t->len) < 0) {
+    JERASURE_RELAXED_STORE(s->status, -1);
+  }
+}
+
+/* Part i of the pool call of a batch:  the thread that owns range i.  If
+   it cannot have scratch, it still takes its tasks, and fails their
+   stripes, so that every task is accounted for. */
+
+static int jerasure_batch_part(jerasure_parallel_call *c, int i)
+{
+  jerasure_batch *b;
+  jerasure_batch_range *r;
+  jerasure_plan_t *p;
+  char **ptrs, *scratch;
+  int first, n, bytes, temps, ok;
+
+  b = (jerasure_batch *) c->arg;
+  p = b->p;
+  r = b->ranges + i;
+  temps = (p->technique == JERASURE_PLAN_SCHEDULE) ? p->schedule->ntdevs : 0;
+  ptrs = talloc(char *, 3*(p->k+p->m));
+  scratch = (temps > 0) ? talloc(char, temps*p->w*p->packetsize) : NULL;
+  ok = (ptrs != NULL && (temps == 0 || scratch != NULL));
+
+  while (1) {
+    JERASURE_LOCK(&r->mutex);
+    first = r->lo;
+    bytes = 0;
+    for (n = 0; r->lo < r->hi && (n == 0 || bytes + b->tasks[r->lo].len <= JERASURE_BATCH_GROUP); n++) {
+      bytes += b->tasks[r->lo].len;
+      r->lo++;
+    }
+    JERASURE_UNLOCK(&r->mutex);
+    if (n == 0) {
+      if (jerasure_batch_steal(b, i)) continue;
+      break;
+    }
+    for (; n > 0; n--, first++) {
+      if (ok) {
+        jerasure_batch_run_task(b, b->tasks+first, ptrs, scratch);
+      } else {
+        JERASURE_RELAXED_STORE(b->stripes[b->tasks[first].stripe].status, -1);
+      }
+    }
+  }
+
+  if (ptrs != NULL) free(ptrs);
+  if (scratch != NULL) free(scratch);
+  return ok ? 0 : -1;
+}
+
+int jerasure_plan_encode_batch(jerasure_plan_t *p, jerasure_stripe_t *stripes, int nstripes)
+{
+  jerasure_parallel_call c;
+  jerasure_batch b;
+  int i, j, n, ntasks, unit, slice, off, failed;
+
+  unit = (p->technique == JERASURE_PLAN_MATRIX) ? JERASURE_TILE_UNIT : p->w*p->packetsize;
+  slice = JERASURE_BATCH_SLICE - JERASURE_BATCH_SLICE % unit;
+  if (slice < unit) slice = unit;
+
+  ntasks = 0;
+  for (i = 0; i < nstripes; i++) {
+    stripes[i].status = (jerasure_plan_check_size(p, stripes[i].size) < 0) ? -1 : 0;
+    if (stripes[i].status == 0) ntasks += (stripes[i].size > slice) ? (stripes[i].size + slice - 1) / slice : 1;
+  }
+
+  b.p = p;
+  b.stripes = stripes;
+  n = jerasure_get_threads();
+  b.nranges = (ntasks < n) ? ntasks : n;
+  if (b.nranges < 1) b.nranges = 1;
+  b.tasks = talloc(jerasure_batch_task, (ntasks > 0) ? ntasks : 1);
+  b.ranges = talloc(jerasure_batch_range, b.nranges);
+  if (b.tasks == NULL || b.ranges == NULL) {
+    for (i = 0; i < nstripes; i++) stripes[i].status = -1;
+    if (b.tasks != NULL) free(b.tasks);
+    if (b.ranges != NULL) free(b.ranges);
+    return nstripes;
+  }
+
+  n = 0;
+  for (i = 0; i < nstripes; i++) {
+    if (stripes[i].status != 0) continue;
+    off = 0;
+    do {
+      b.tasks[n].stripe = i;
+      b.tasks[n].off = off;
+      b.tasks[n].len = (stripes[i].size - off > slice) ? slice : stripes[i].size - off;
+      off += b.tasks[n].len;
+      n++;
+    } while (off < stripes[i].size);
+  }
+  for (j = 0; j < b.nranges; j++) {
+    b.ranges[j].lo = (int) ((long) ntasks * j / b.nranges);
+    b.ranges[j].hi = (int) ((long) ntasks * (j+1) / b.nranges);
+#ifdef JERASURE_PTHREADS
+    pthread_mutex_init(&b.ranges[j].mutex, NULL);
+#endif
+  }
+
+  memset(&c, 0, sizeof(jerasure_parallel_call));
+  c.part = jerasure_batch_part;
+  c.arg = &b;
+  c.nslices = b.nranges;
+  jerasure_pool_run(&c);
+
+#ifdef JERASURE_PTHREADS
+  for (j = 0; j < b.nranges; j++) pthread_mutex_destroy(&b.ranges[j].mutex);
+#endif
+  free(b.ranges);
+  free(b.tasks);
+
+  failed = 0;
+  for (i = 0; i < nstripes; i++) if (stripes[i].status != 0) failed++;
+  return failed;
+}
+
+/* Profiles.  A profile is a file that holds what a (k, m, w) code needs
+   to encode and decode:  the matrix, the bitmatrix, the encoding schedule,
+   and the decoding schedule and decoding matrix of every set of up to
+   max_erasures erasures.  It is written once, and loaded with a single
+   read-only mmap, so that processes share one copy from the page cache.
+   Everything is found by offset from the start of the file, so nothing is
+   parsed or fixed up when it is loaded.  The layout is:
+
+     jerasure_profile_header
+     matrix                  m*k ints (if there is a matrix)
+     bitmatrix               mw*kw ints (if there is a bitmatrix)
+     encoding schedule       encode_nops jerasure_schedule_op_t's
+     per erasure pattern:    decoding schedule, then the k*k decoding
+                             matrix and its k dm_ids
+     pattern table           npatterns jerasure_profile_pattern's
+
+   Every part starts on an 8 byte boundary, and numbers are in the byte
+   order of the machine that wrote the file; a profile from a machine with
+   another byte order, or another version of the format, is rejected.
+
+   The pattern table is indexed by the rank of the erasures:  the patterns
+   of e erasures follow those of fewer erasures, and a sorted pattern
+   c[0] < c[1] < ... < c[e-1] has rank sum C(c[i], i+1), so it is found
+   without a search. */
+
+#define JERASURE_PROFILE_MAGIC "JERASURE"
+#define JERASURE_PROFILE_VERSION 2
+#define JERASURE_PROFILE_BYTE_ORDER 0x01020304
+#define JERASURE_PROFILE_MAX_PATTERNS (1 << 24)
+
+#define JERASURE_PROFILE_HAS_SCHEDULE 1
+#define JERASURE_PROFILE_HAS_MATRIX 2
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t header_bytes;
+  int32_t k, m, w;
+  int32_t smart;
+  int32_t max_erasures;
+  uint64_t npatterns;
+  uint64_t file_bytes;
+  uint64_t matrix;              /* Offsets, or 0 if there is none */
+  uint64_t bitmatrix;
+  uint64_t encode;
+  uint64_t encode_nops;
+  uint32_t encode_tdev;         /* Temporaries of the encoding schedule */
+  uint32_t encode_ntdevs;
+  uint64_t patterns;
+} jerasure_profile_header;
+
+typedef struct {
+  uint64_t schedule;            /* Decoding schedule */
+  uint64_t decoding_matrix;     /* 0 if no data device is erased */
+  uint32_t nops;
+  uint32_t flags;               /* JERASURE_PROFILE_HAS_XXX */
+  uint32_t tdev;                /* Temporaries of the decoding schedule */
+  uint32_t ntdevs;
+} jerasure_profile_pattern;
+
+struct jerasure_profile {
+  char *map;
+  size_t bytes;
+  jerasure_profile_header *h;
+  jerasure_profile_pattern *patterns;
+  unsigned char *checked;       /* Per pattern:  0 until it is checked, then
+                                   1 if it is valid and 2 if it is not */
+};
+
+static uint64_t jerasure_binomial(int n, int r)
+{
+  uint64_t c;
+  int i;
+
+  if (r > n) return 0;
+  c = 1;
+  for (i = 1; i <= r; i++) c = c * (n-r+i) / i;
+  return c;
+}
+
+static uint64_t jerasure_profile_npatterns(int n, int max_erasures)
+{
+  uint64_t total;
+  int e;
+
+  total = 0;
+  for (e = 1; e <= max_erasures && total <= JERASURE_PROFILE_MAX_PATTERNS; e++) {
+    total += jerasure_binomial(n, e);
   }
+  return total;
+}
 
-  /* First -- convert into upper triangular */
+/* Writes bytes of buf at *off, and pads the file to 8 bytes. */
 
-  for (i = 0; i < cols; i++) {
+static int jerasure_profile_put(FILE *f, void *buf, size_t bytes, uint64_t *off)
+{
+  static const char zeros[8] = { 0 };
+  size_t pad;
 
-    /* Swap rows if we have a zero i,i element.  If we can't swap, then the 
-       matrix was not invertible */
+  pad = (8 - bytes % 8) % 8;
+  if (bytes > 0 && fwrite(buf, 1, bytes, f) != bytes) return -1;
+  if (pad > 0 && fwrite(zeros, 1, pad, f) != pad) return -1;
+  *off += bytes + pad;
+  return 0;
+}
 
-    if ((mat[i*cols+i]) == 0) { 
-      for (j = i+1; j < rows && (mat[j*cols+i]) == 0; j++) ;
-      if (j == rows) return -1;
-      for (k = 0; k < cols; k++) {
-        tmp = mat[i*cols+k]; mat[i*cols+k] = mat[j*cols+k]; mat[j*cols+k] = tmp;
-        tmp = inv[i*cols+k]; inv[i*cols+k] = inv[j*cols+k]; inv[j*cols+k] = tmp;
+static int jerasure_profile_write_patterns(FILE *f, int k, int m, int w, int *matrix,
+                                           int *bitmatrix, int smart, int max_erasures,
+                                           jerasure_profile_pattern *patterns, uint64_t *off)
+{
+  jerasure_flat_schedule_t *schedule;
+  jerasure_profile_pattern *r;
+  int *c, *erased, *dm, *tmpmat;
+  int i, e, n, rc;
+
+  n = k+m;
+  c = talloc(int, n+1);
+  erased = talloc(int, n);
+  dm = talloc(int, k*k+k);
+  tmpmat = talloc(int, k*k);
+  rc = -1;
+  if (c == NULL || erased == NULL || dm == NULL || tmpmat == NULL) goto done;
+
+  r = patterns;
+  for (e = 1; e <= max_erasures; e++) {
+    for (i = 0; i < e; i++) c[i] = i;
+    c[e] = -1;
+    while (1) {
+      for (i = 0; i < n; i++) erased[i] = 0;
+      for (i = 0; i < e; i++) erased[c[i]] = 1;
+      if (bitmatrix != NULL) {
+        schedule = jerasure_generate_flat_decoding_schedule(k, m, w, bitmatrix, c, smart);
+        if (schedule != NULL) {
+          r->schedule = *off;
+          r->nops = schedule->nops;
+          r->tdev = schedule->tdev;
+          r->ntdevs = schedule->ntdevs;
+          r->flags |= JERASURE_PROFILE_HAS_SCHEDULE;
+          i = jerasure_profile_put(f, schedule->ops, sizeof(jerasure_schedule_op_t)*schedule->nops, off);
+          jerasure_free_flat_schedule(schedule);
+          if (i < 0) goto done;
+        }
       }
-    }
- 
-    /* Now for each j>i, add A_ji*Ai to Aj */
-    for (j = i+1; j != rows; j++) {
-      if (mat[j*cols+i] != 0) {
-        for (k = 0; k < cols; k++) {
-          mat[j*cols+k] ^= mat[i*cols+k]; 
-          inv[j*cols+k] ^= inv[i*cols+k];
+      if (matrix != NULL && (w == 8 || w == 16 || w == 32)) {
+        if (c[0] >= k) {
+          r->flags |= JERASURE_PROFILE_HAS_MATRIX;
+        } else if (jerasure_decoding_matrix_tmp(NULL, k, w, matrix, erased, dm, dm+k*k, tmpmat) >= 0) {
+          r->decoding_matrix = *off;
+          r->flags |= JERASURE_PROFILE_HAS_MATRIX;
+          if (jerasure_profile_put(f, dm, sizeof(int)*(k*k+k), off) < 0) goto done;
         }
       }
+      r++;
+
+      /* The next pattern of e erasures, in rank order */
+
+      for (i = 0; i < e-1 && c[i]+1 == c[i+1]; i++) ;
+      if (i == e-1 && c[i]+1 == n) break;
+      c[i]++;
+      while (--i >= 0) c[i] = i;
     }
   }
+  rc = 0;
 
-  /* Now the matrix is upper triangular.  Start at the top and multiply down */
+done:
+  free(c);
+  free(erased);
+  free(dm);
+  free(tmpmat);
+  return rc;
+}
 
-  for (i = rows-1; i >= 0; i--) {
-    for (j = 0; j < i; j++) {
-      if (mat[j*cols+i]) {
-        for (k = 0; k < cols; k++) {
-          mat[j*cols+k] ^= mat[i*cols+k]; 
-          inv[j*cols+k] ^= inv[i*cols+k];
-        }
-      }
+int jerasure_write_profile(const char *path, int k, int m, int w, int *matrix, int *bitmatrix,
+                           int smart, int max_erasures)
+{
+  jerasure_profile_header h;
+  jerasure_profile_pattern *patterns;
+  jerasure_flat_schedule_t *schedule;
+  uint64_t off, npatterns;
+  char *tmp;
+  FILE *f;
+  int rc;
+
+  if (matrix == NULL && bitmatrix == NULL) return -1;
+  if (k <= 0 || m <= 0 || max_erasures < 0 || max_erasures > m) return -1;
+  if (sizeof(int) != sizeof(int32_t) || !jerasure_flat_schedule_fits(k, m, w)) return -1;
+  npatterns = jerasure_profile_npatterns(k+m, max_erasures);
+  if (npatterns > JERASURE_PROFILE_MAX_PATTERNS) return -1;
+
+  patterns = (jerasure_profile_pattern *) calloc(npatterns+1, sizeof(jerasure_profile_pattern));
+  tmp = talloc(char, strlen(path)+5);
+  if (patterns == NULL || tmp == NULL) {
+    free(patterns);
+    free(tmp);
+    return -1;
+  }
+  sprintf(tmp, "%s.tmp", path);
+
+  /* The header is written last, once the offsets are known.  The profile
+     is written to path.tmp and renamed, so that a process never maps a
+     partly written profile. */
+
+  rc = -1;
+  schedule = NULL;
+  f = fopen(tmp, "wb");
+  if (f == NULL) goto done;
+  memset(&h, 0, sizeof(h));
+  off = 0;
+  if (jerasure_profile_put(f, &h, sizeof(h), &off) < 0) goto done;
+  if (matrix != NULL) {
+    h.matrix = off;
+    if (jerasure_profile_put(f, matrix, sizeof(int)*k*m, &off) < 0) goto done;
+  }
+  if (bitmatrix != NULL) {
+    h.bitmatrix = off;
+    if (jerasure_profile_put(f, bitmatrix, sizeof(int)*k*m*w*w, &off) < 0) goto done;
+    if (smart == JERASURE_SCHEDULE_CSE) {
+      schedule = jerasure_cse_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
+    } else if (smart) {
+      schedule = jerasure_smart_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
+    } else {
+      schedule = jerasure_dumb_bitmatrix_to_flat_schedule(k, m, w, bitmatrix);
     }
-  } 
-  return 0;
+    if (schedule == NULL) goto done;
+    h.encode = off;
+    h.encode_nops = schedule->nops;
+    h.encode_tdev = schedule->tdev;
+    h.encode_ntdevs = schedule->ntdevs;
+    if (jerasure_profile_put(f, schedule->ops, sizeof(jerasure_schedule_op_t)*schedule->nops, &off) < 0) goto done;
+  }
+  if (jerasure_profile_write_patterns(f, k, m, w, matrix, bitmatrix, smart, max_erasures,
+                                      patterns, &off) < 0) goto done;
+  h.patterns = off;
+  if (jerasure_profile_put(f, patterns, sizeof(jerasure_profile_pattern)*npatterns, &off) < 0) goto done;
+
+  memcpy(h.magic, JERASURE_PROFILE_MAGIC, 8);
+  h.version = JERASURE_PROFILE_VERSION;
+  h.byte_order = JERASURE_PROFILE_BYTE_ORDER;
+  h.header_bytes = sizeof(h);
+  h.k = k;
+  h.m = m;
+  h.w = w;
+  h.smart = smart;
+  h.max_erasures = max_erasures;
+  h.npatterns = npatterns;
+  h.file_bytes = off;
+  if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, f) != 1) goto done;
+  if (fclose(f) != 0) {
+    f = NULL;
+    goto done;
+  }
+  f = NULL;
+  if (rename(tmp, path) == 0) rc = 0;
+
+done:
+  if (f != NULL) fclose(f);
+  if (rc < 0) unlink(tmp);
+  if (schedule != NULL) jerasure_free_flat_schedule(schedule);
+  free(patterns);
+  free(tmp);
+  return rc;
 }
 
-int jerasure_invertible_bitmatrix(int *mat, int rows)
-{
-  int cols, i, j, k;
-  int tmp;
- 
-  cols = rows;
+/* Whether n items of size bytes at off are within the profile, and off
+   is aligned.  n is checked by division, so that a huge n cannot wrap
+   around. */
 
-  /* First -- convert into upper triangular */
+static int jerasure_profile_holds(jerasure_profile_t *p, uint64_t off, uint64_t n, uint64_t size)
+{
+  return (off % 8 == 0 && off <= p->bytes && n <= (p->bytes - off) / size);
+}
 
-  for (i = 0; i < cols; i++) {
+/* Whether the n coefficients in v are elements of GF(2^w). */
 
-    /* Swap rows if we have a zero i,i element.  If we can't swap, then the 
-       matrix was not invertible */
+static int jerasure_profile_coefs_ok(jerasure_profile_t *p, int *v, uint64_t n)
+{
+  uint64_t i;
 
-    if ((mat[i*cols+i]) == 0) { 
-      for (j = i+1; j < rows && (mat[j*cols+i]) == 0; j++) ;
-      if (j == rows) return 0;
-      for (k = 0; k < cols; k++) {
-        tmp = mat[i*cols+k]; mat[i*cols+k] = mat[j*cols+k]; mat[j*cols+k] = tmp;
-      }
-    }
- 
-    /* Now for each j>i, add A_ji*Ai to Aj */
-    for (j = i+1; j != rows; j++) {
-      if (mat[j*cols+i] != 0) {
-        for (k = 0; k < cols; k++) {
-          mat[j*cols+k] ^= mat[i*cols+k]; 
-        }
-      }
-    }
+  if (p->h->w >= 32) return 1;
+  for (i = 0; i < n; i++) {
+    if ((uint32_t) v[i] >= ((uint32_t) 1 << p->h->w)) return 0;
   }
   return 1;
 }
 
-  
-int *jerasure_matrix_multiply(int *m1, int *m2, int r1, int c1, int r2, int c2, int w)
+/* Whether a schedule's temporaries follow the devices, as the executors
+   need. */
+
+static int jerasure_profile_temps_ok(jerasure_profile_t *p, uint32_t tdev, uint32_t ntdevs)
 {
-  int *product, i, j, k;
+  return (ntdevs == 0 || (tdev >= (uint32_t) (p->h->k + p->h->m) &&
+                          tdev + ntdevs <= JERASURE_FLAT_MAX_DEVICES));
+}
 
-  product = (int *) malloc(sizeof(int)*r1*c2);
-  for (i = 0; i < r1*c2; i++) product[i] = 0;
+/* Whether every operation of a schedule is a copy or an XOR of packets
+   below w, of the code's devices or the schedule's temporaries, so that
+   running it cannot go outside of them. */
 
-  for (i = 0; i < r1; i++) {
-    for (j = 0; j < c2; j++) {
-      for (k = 0; k < r2; k++) {
-        product[i*c2+j] ^= galois_single_multiply(m1[i*c1+k], m2[k*c2+j], w);
+static int jerasure_profile_ops_ok(jerasure_profile_t *p, jerasure_schedule_op_t *ops, uint64_t nops,
+                                   uint32_t tdev, uint32_t ntdevs)
+{
+  jerasure_schedule_op_t *o;
+  uint64_t i;
+  uint32_t n;
+
+  if (!jerasure_profile_temps_ok(p, tdev, ntdevs)) return 0;
+  n = p->h->k + p->h->m;
+  for (i = 0; i < nops; i++) {
+    o = ops + i;
+    if (o->op > 1 || o->from_pkt >= p->h->w || o->to_pkt >= p->h->w) return 0;
+    if (o->from_dev >= n && (o->from_dev < tdev || o->from_dev >= tdev + ntdevs)) return 0;
+    if (o->to_dev >= n && (o->to_dev < tdev || o->to_dev >= tdev + ntdevs)) return 0;
+  }
+  return 1;
+}
+
+/* Whether pattern r, of the erasures in erased, is valid:  its schedule
+   fits in the profile and only touches the devices, and, if it has
+   decoding matrices and a data device is erased, its decoding matrix is
+   there, its coefficients are elements of GF(2^w) and its dm_ids are
+   devices.  Each pattern is only checked the
+   first time it is used. */
+
+static int jerasure_profile_pattern_ok(jerasure_profile_t *p, jerasure_profile_pattern *r, int *erased)
+{
+  unsigned char *checked;
+  int *dm_ids;
+  int i, k, m, ok;
+
+  checked = p->checked + (r - p->patterns);
+  if (JERASURE_RELAXED_LOAD(*checked) != 0) return (JERASURE_RELAXED_LOAD(*checked) == 1);
+
+  k = p->h->k;
+  m = p->h->m;
+  ok = 1;
+  if (r->flags & JERASURE_PROFILE_HAS_SCHEDULE) {
+    ok = (r->nops <= INT_MAX &&
+          jerasure_profile_holds(p, r->schedule, r->nops, sizeof(jerasure_schedule_op_t)) &&
+          jerasure_profile_ops_ok(p, (jerasure_schedule_op_t *) (p->map + r->schedule), r->nops,
+                                  r->tdev, r->ntdevs));
+  }
+  if (ok && (r->flags & JERASURE_PROFILE_HAS_MATRIX)) {
+    for (i = 0; i < k && !erased[i]; i++) ;
+    if (i < k) {
+      ok = (r->decoding_matrix != 0 &&
+            jerasure_profile_holds(p, r->decoding_matrix, (uint64_t) k*k+k, sizeof(int)) &&
+            jerasure_profile_coefs_ok(p, (int *) (p->map + r->decoding_matrix), (uint64_t) k*k));
+      if (ok) {
+        dm_ids = (int *) (p->map + r->decoding_matrix) + (uint64_t) k*k;
+        for (i = 0; i < k && ok; i++) ok = (dm_ids[i] >= 0 && dm_ids[i] < k+m);
       }
     }
   }
-  return product;
+  JERASURE_RELAXED_STORE(*checked, ok ? 1 : 2);
+  return ok;
 }
 
-void jerasure_get_stats(double *fill_in)
+jerasure_profile_t *jerasure_map_profile(const char *path)
 {
-  fill_in[0] = jerasure_total_xor_bytes;
-  fill_in[1] = jerasure_total_gf_bytes;
-  fill_in[2] = jerasure_total_memcpy_bytes;
-  jerasure_total_xor_bytes = 0;
-  jerasure_total_gf_bytes = 0;
-  jerasure_total_memcpy_bytes = 0;
+  jerasure_profile_t *p;
+  jerasure_profile_header *h;
+  struct stat st;
+  uint64_t kmw;
+  void *map;
+  int fd, ok;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(jerasure_profile_header)) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  p = talloc(jerasure_profile_t, 1);
+  if (p == NULL) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  p->map = (char *) map;
+  p->bytes = st.st_size;
+  p->h = h = (jerasure_profile_header *) map;
+  p->patterns = NULL;
+  p->checked = NULL;
+
+  /* Only the header and the encoding schedule are checked here.  The
+     patterns are checked when they are first used, so that loading does
+     not touch all of them. */
+
+  kmw = (uint64_t) h->k * h->m;
+  ok = (memcmp(h->magic, JERASURE_PROFILE_MAGIC, 8) == 0 &&
+        h->version == JERASURE_PROFILE_VERSION &&
+        h->byte_order == JERASURE_PROFILE_BYTE_ORDER &&
+        h->header_bytes == sizeof(jerasure_profile_header) &&
+        sizeof(int) == sizeof(int32_t) &&
+        h->file_bytes == p->bytes &&
+        h->k > 0 && h->m > 0 && h->w > 0 &&
+        h->k <= JERASURE_FLAT_MAX_DEVICES && h->m <= JERASURE_FLAT_MAX_DEVICES &&
+        jerasure_flat_schedule_fits(h->k, h->m, h->w) &&
+        h->max_erasures >= 0 && h->max_erasures <= h->m &&
+        h->npatterns == jerasure_profile_npatterns(h->k+h->m, h->max_erasures) &&
+        h->npatterns <= JERASURE_PROFILE_MAX_PATTERNS);
+  if (ok) {
+    ok = (jerasure_profile_holds(p, h->patterns, h->npatterns, sizeof(jerasure_profile_pattern)) &&
+          (h->matrix == 0 || jerasure_profile_holds(p, h->matrix, kmw, sizeof(int))) &&
+          (h->bitmatrix == 0 || jerasure_profile_holds(p, h->bitmatrix, kmw*h->w*h->w, sizeof(int))) &&
+          (h->bitmatrix == 0 || (h->encode_nops <= INT_MAX &&
+                                 jerasure_profile_holds(p, h->encode, h->encode_nops,
+                                                        sizeof(jerasure_schedule_op_t)))) &&
+          (h->matrix != 0 || h->bitmatrix != 0));
+  }
+  if (ok && h->matrix != 0) ok = jerasure_profile_coefs_ok(p, (int *) (p->map + h->matrix), kmw);
+  if (ok && h->bitmatrix != 0) {
+    ok = jerasure_profile_ops_ok(p, (jerasure_schedule_op_t *) (p->map + h->encode), h->encode_nops,
+                                 h->encode_tdev, h->encode_ntdevs);
+  }
+  if (ok) {
+    p->patterns = (jerasure_profile_pattern *) (p->map + h->patterns);
+    p->checked = (unsigned char *) calloc(h->npatterns+1, 1);
+    ok = (p->checked != NULL);
+  }
+  if (!ok) {
+    jerasure_unmap_profile(p);
+    return NULL;
+  }
+  return p;
 }
 
-void jerasure_do_scheduled_operations(char **ptrs, int **operations, int packetsize)
+void jerasure_unmap_profile(jerasure_profile_t *p)
 {
-  char *sptr;
-  char *dptr;
-  int op;
+  if (p == NULL) return;
+  munmap(p->map, p->bytes);
+  free(p->checked);
+  free(p);
+}
 
-  for (op = 0; operations[op][0] >= 0; op++) {
-    sptr = ptrs[operations[op][0]] + operations[op][1]*packetsize;
-    dptr = ptrs[operations[op][2]] + operations[op][3]*packetsize;
-    if (operations[op][4]) {
-/*      printf("%d,%d %d,%d\n", operations[op][0], 
-      operations[op][1], 
-      operations[op][2], 
-      operations[op][3]); 
-      printf("xor(0x%x, 0x%x -> 0x%x, %d)\n", sptr, dptr, dptr, packetsize); */
-      galois_region_xor(sptr, dptr, packetsize);
-      jerasure_total_xor_bytes += packetsize;
-    } else {
-/*      printf("memcpy(0x%x <- 0x%x)\n", dptr, sptr); */
-      memcpy(dptr, sptr, packetsize);
-      jerasure_total_memcpy_bytes += packetsize;
-    }
-  }  
+void jerasure_get_profile_info(jerasure_profile_t *p, int *fill_in)
+{
+  fill_in[0] = p->h->k;
+  fill_in[1] = p->h->m;
+  fill_in[2] = p->h->w;
+  fill_in[3] = p->h->max_erasures;
 }
 
-void jerasure_schedule_encode(int k, int m, int w, int **schedule,
-                                   char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+int *jerasure_profile_matrix(jerasure_profile_t *p)
 {
-  char **ptr_copy;
-  int i, tdone;
+  return (p->h->matrix == 0) ? NULL : (int *) (p->map + p->h->matrix);
+}
 
-  ptr_copy = talloc(char *, (k+m));
-  for (i = 0; i < k; i++) ptr_copy[i] = data_ptrs[i];
-  for (i = 0; i < m; i++) ptr_copy[i+k] = coding_ptrs[i];
-  for (tdone = 0; tdone < size; tdone += packetsize*w) {
-    jerasure_do_scheduled_operations(ptr_copy, schedule, packetsize);
-    for (i = 0; i < k+m; i++) ptr_copy[i] += (packetsize*w);
-  }
-  free(ptr_copy);
+int *jerasure_profile_bitmatrix(jerasure_profile_t *p)
+{
+  return (p->h->bitmatrix == 0) ? NULL : (int *) (p->map + p->h->bitmatrix);
 }
-    
-int **jerasure_dumb_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+
+int jerasure_profile_encoding_schedule(jerasure_profile_t *p, jerasure_flat_schedule_t *fill_in)
 {
-  int **operations;
-  int op;
-  int index, optodo, i, j;
+  if (p->h->bitmatrix == 0) return -1;
+  fill_in->nops = p->h->encode_nops;
+  fill_in->tdev = p->h->encode_tdev;
+  fill_in->ntdevs = p->h->encode_ntdevs;
+  fill_in->ops = (jerasure_schedule_op_t *) (p->map + p->h->encode);
+  return 0;
+}
 
-  operations = talloc(int *, k*m*w*w+1);
-  if (!operations) return NULL;
-  op = 0;
-  
-  index = 0;
-  for (i = 0; i < m*w; i++) {
-    optodo = 0;
-    for (j = 0; j < k*w; j++) {
-      if (bitmatrix[index]) {
-        operations[op] = talloc(int, 5);
-	if (!operations[op]) {
-	  // -ENOMEM
-          goto error;
-        }
-        operations[op][4] = optodo;
-        operations[op][0] = j/w;
-        operations[op][1] = j%w;
-        operations[op][2] = k+i/w;
-        operations[op][3] = i%w;
-        optodo = 1;
-        op++;
-        
-      }
-      index++;
-    }
-  }
-  operations[op] = talloc(int, 5);
-  if (!operations[op]) {
-    // -ENOMEM
-    goto error;
-  }
-  operations[op][0] = -1;
-  return operations;
+/* Returns the pattern of erased, or NULL if the profile does not have it. */
 
-error:
-  for (i = 0; i <= op; i++) {
-    free(operations[op]);
+static jerasure_profile_pattern *jerasure_profile_find(jerasure_profile_t *p, int *erased)
+{
+  uint64_t rank;
+  int i, e, n;
+
+  n = p->h->k + p->h->m;
+  rank = 0;
+  e = 0;
+  for (i = 0; i < n; i++) {
+    if (erased[i]) {
+      e++;
+      if (e > p->h->max_erasures) return NULL;
+      rank += jerasure_binomial(i, e);
+    }
   }
-  free(operations);
-  return NULL;
+  if (e == 0) return NULL;
+  rank += jerasure_profile_npatterns(n, e-1);
+  return p->patterns + rank;
 }
 
-int **jerasure_smart_bitmatrix_to_schedule(int k, int m, int w, int *bitmatrix)
+static int jerasure_profile_pattern_schedule(jerasure_profile_t *p, int *erased,
+                                             jerasure_flat_schedule_t *fill_in)
 {
-  int **operations;
-  int op;
-  int i, j;
-  int *diff, *from, *b1, *flink, *blink;
-  int *ptr, no, row;
-  int optodo;
-  int bestrow = 0, bestdiff, top;
+  jerasure_profile_pattern *r;
+
+  r = jerasure_profile_find(p, erased);
+  if (r == NULL || !(r->flags & JERASURE_PROFILE_HAS_SCHEDULE)) return -1;
+  if (!jerasure_profile_pattern_ok(p, r, erased)) return -1;
+  fill_in->nops = r->nops;
+  fill_in->tdev = r->tdev;
+  fill_in->ntdevs = r->ntdevs;
+  fill_in->ops = (jerasure_schedule_op_t *) (p->map + r->schedule);
+  return 0;
+}
 
-/*   printf("Scheduling:\n\n");
-  jerasure_print_bitmatrix(bitmatrix, m*w, k*w, w); */
+int jerasure_profile_decoding_schedule(jerasure_profile_t *p, int *erasures,
+                                       jerasure_flat_schedule_t *fill_in)
+{
+  int erased_buf[JERASURE_DOTPROD_SRCS], *erased;
+  int rc, n;
 
-  operations = talloc(int *, k*m*w*w+1);
-  if (!operations) return NULL;
-  op = 0;
-  
-  diff = talloc(int, m*w);
-  if (!diff) {
-    free(operations);
-    return NULL;
-  }
-  from = talloc(int, m*w);
-  if (!from) {
-    free(operations);
-    free(diff);
-    return NULL;
-  }
-  flink = talloc(int, m*w);
-  if (!flink) {
-    free(operations);
-    free(diff);
-    free(from);
-    return NULL;
-  }
-  blink = talloc(int, m*w);
-  if (!blink) {
-    free(operations);
-    free(diff);
-    free(from);
-    free(flink);
-    return NULL;
+  n = p->h->k + p->h->m;
+  erased = (n <= JERASURE_DOTPROD_SRCS) ? erased_buf : talloc(int, n);
+  if (erased == NULL) return -1;
+  rc = -1;
+  if (jerasure_fill_erased(p->h->k, p->h->m, erasures, erased) == 0) {
+    rc = jerasure_profile_pattern_schedule(p, erased, fill_in);
   }
+  if (erased != erased_buf) free(erased);
+  return rc;
+}
 
-  ptr = bitmatrix;
+void jerasure_profile_schedule_encode(jerasure_profile_t *p, char **data_ptrs, char **coding_ptrs,
+                                      int size, int packetsize)
+{
+  jerasure_flat_schedule_t schedule;
 
-  bestdiff = k*w+1;
-  top = 0;
-  for (i = 0; i < m*w; i++) {
-    no = 0;
-    for (j = 0; j < k*w; j++) {
-      no += *ptr;
-      ptr++;
-    }
-    diff[i] = no;
-    from[i] = -1;
-    flink[i] = i+1;
-    blink[i] = i-1;
-    if (no < bestdiff) {
-      bestdiff = no;
-      bestrow = i;
-    }
+  if (jerasure_profile_encoding_schedule(p, &schedule) < 0) {
+    fprintf(stderr, "jerasure_profile_schedule_encode(): the profile has no bitmatrix\n");
+    assert(0);
   }
+  jerasure_flat_schedule_encode(p->h->k, p->h->m, p->h->w, &schedule, data_ptrs, coding_ptrs,
+                                size, packetsize);
+}
 
-  flink[m*w-1] = -1;
-  
-  while (top != -1) {
-    row = bestrow;
-    /* printf("Doing row %d - %d from %d\n", row, diff[row], from[row]);  */
-
-    if (blink[row] == -1) {
-      top = flink[row];
-      if (top != -1) blink[top] = -1;
-    } else {
-      flink[blink[row]] = flink[row];
-      if (flink[row] != -1) {
-        blink[flink[row]] = blink[row];
-      }
-    }
-
-    ptr = bitmatrix + row*k*w;
-    if (from[row] == -1) {
-      optodo = 0;
-      for (j = 0; j < k*w; j++) {
-        if (ptr[j]) {
-          operations[op] = talloc(int, 5);
-          if (!operations[op]) goto error;
-          operations[op][4] = optodo;
-          operations[op][0] = j/w;
-          operations[op][1] = j%w;
-          operations[op][2] = k+row/w;
-          operations[op][3] = row%w;
-          optodo = 1;
-          op++;
-        }
-      }
-    } else {
-      operations[op] = talloc(int, 5);
-      if (!operations[op]) goto error;
-      operations[op][4] = 0;
-      operations[op][0] = k+from[row]/w;
-      operations[op][1] = from[row]%w;
-      operations[op][2] = k+row/w;
-      operations[op][3] = row%w;
-      op++;
-      b1 = bitmatrix + from[row]*k*w;
-      for (j = 0; j < k*w; j++) {
-        if (ptr[j] ^ b1[j]) {
-          operations[op] = talloc(int, 5);
-          if (!operations[op]) goto error;
-          operations[op][4] = 1;
-          operations[op][0] = j/w;
-          operations[op][1] = j%w;
-          operations[op][2] = k+row/w;
-          operations[op][3] = row%w;
-          optodo = 1;
-          op++;
-        }
-      }
-    }
-    bestdiff = k*w+1;
-    for (i = top; i != -1; i = flink[i]) {
-      no = 1;
-      b1 = bitmatrix + i*k*w;
-      for (j = 0; j < k*w; j++) no += (ptr[j] ^ b1[j]);
-      if (no < diff[i]) {
-        from[i] = row;
-        diff[i] = no;
-      }
-      if (diff[i] < bestdiff) {
-        bestdiff = diff[i];
-        bestrow = i;
-      }
+int jerasure_profile_schedule_decode(jerasure_profile_t *p, int *erasures,
+                                     char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+{
+  int erased_buf[JERASURE_DOTPROD_SRCS], *erased;
+  char *ptrs_buf[JERASURE_DOTPROD_SRCS], **ptrs;
+  jerasure_flat_schedule_t schedule;
+  int k, m, w, rc;
+
+  k = p->h->k;
+  m = p->h->m;
+  w = p->h->w;
+  if (erasures[0] == -1) return 0;
+  if (k+m <= JERASURE_DOTPROD_SRCS) {
+    erased = erased_buf;
+    ptrs = ptrs_buf;
+  } else {
+    erased = talloc(int, k+m);
+    ptrs = talloc(char *, k+m);
+    if (erased == NULL || ptrs == NULL) {
+      free(erased);
+      free(ptrs);
+      return -1;
     }
   }
-  
-  operations[op] = talloc(int, 5);
-  if (!operations[op]) goto error;
-  operations[op][0] = -1;
-  free(from);
-  free(diff);
-  free(blink);
-  free(flink);
 
-  return operations;
+  rc = -1;
+  if (jerasure_fill_erased(k, m, erasures, erased) < 0) goto done;
+  if (jerasure_profile_pattern_schedule(p, erased, &schedule) < 0) goto done;
+  fill_ptrs_for_scheduled_decoding(k, m, erased, data_ptrs, coding_ptrs, ptrs);
+  rc = jerasure_run_flat_schedule(ptrs, k+m, w, &schedule, NULL, NULL, size, packetsize);
 
-error:
-  for (i = 0; i <= op; i++) {
-    free(operations[op]);
+done:
+  if (erased != erased_buf) {
+    free(erased);
+    free(ptrs);
   }
-  free(operations);
-  free(from);
-  free(diff);
-  free(blink);
-  free(flink);
-  return NULL;
+  return rc;
 }
 
-void jerasure_bitmatrix_encode(int k, int m, int w, int *bitmatrix,
-                            char **data_ptrs, char **coding_ptrs, int size, int packetsize)
+int jerasure_profile_matrix_decode(jerasure_profile_t *p, int *erasures,
+                                   char **data_ptrs, char **coding_ptrs, int size)
 {
-  int i;
+  int erased_buf[JERASURE_DOTPROD_SRCS], *erased;
+  jerasure_profile_pattern *r;
+  int *matrix, *dm, *dm_ids;
+  int i, k, m, w, tile, off, len, rc;
+
+  k = p->h->k;
+  m = p->h->m;
+  w = p->h->w;
+  matrix = jerasure_profile_matrix(p);
+  if (matrix == NULL) return -1;
+  if (erasures[0] == -1) return 0;
+  erased = (k+m <= JERASURE_DOTPROD_SRCS) ? erased_buf : talloc(int, k+m);
+  if (erased == NULL) return -1;
 
-  if (packetsize%sizeof(long) != 0) {
-    fprintf(stderr, "jerasure_bitmatrix_encode - packetsize(%d) %c sizeof(long) != 0\n", packetsize, '%');
-    assert(0);
-  }
-  if (size%(packetsize*w) != 0) {
-    fprintf(stderr, "jerasure_bitmatrix_encode - size(%d) %c (packetsize(%d)*w(%d))) != 0\n", 
-         size, '%', packetsize, w);
-    assert(0);
+  rc = -1;
+  if (jerasure_fill_erased(k, m, erasures, erased) < 0) goto done;
+  r = jerasure_profile_find(p, erased);
+  if (r == NULL || !(r->flags & JERASURE_PROFILE_HAS_MATRIX)) goto done;
+  if (!jerasure_profile_pattern_ok(p, r, erased)) goto done;
+  dm = NULL;
+  dm_ids = NULL;
+  if (r->decoding_matrix != 0) {
+    dm = (int *) (p->map + r->decoding_matrix);
+    dm_ids = dm + k*k;
   }
 
+  /* As jerasure_matrix_decode(), decoding every erased data device with
+     the decoding matrix, and then re-encoding the erased coding devices. */
+
+  for (i = 0; i < k; i++) {
+    if (erased[i]) jerasure_count_dotprod_bytes(k, w, dm+(i*k), size);
+  }
   for (i = 0; i < m; i++) {
-    jerasure_bitmatrix_dotprod(k, w, bitmatrix+i*k*w*w, NULL, k+i, data_ptrs, coding_ptrs, size, packetsize);
+    if (erased[k+i]) jerasure_count_dotprod_bytes(k, w, matrix+(i*k), size);
+  }
+  tile = jerasure_tile_bytes(k+m, JERASURE_TILE_UNIT, size);
+  for (off = 0; off < size; off += tile) {
+    len = (size - off < tile) ? size - off : tile;
+    for (i = 0; i < k; i++) {
+      if (erased[i]) {
+        jerasure_matrix_dotprod_range(k, w, dm+(i*k), dm_ids, i, data_ptrs, coding_ptrs, off, len);
+      }
+    }
+    for (i = 0; i < m; i++) {
+      if (erased[k+i]) {
+        jerasure_matrix_dotprod_range(k, w, matrix+(i*k), NULL, i+k, data_ptrs, coding_ptrs, off, len);
+      }
+    }
   }
+  rc = 0;
+
+done:
+  if (erased != erased_buf) free(erased);
+  return rc;
 }
 
 /*
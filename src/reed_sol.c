@@ -56,6 +56,15 @@
 
 #define talloc(type, num) (type *) malloc(sizeof(type)*(num))
 
+/* Native RAID-6 kernels, as in galois.c:  they are compiled for their own
+   instruction set and picked at run time by galois_get_region_kernel(). */
+
+#if !defined(JERASURE_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REED_SOL_X86_KERNELS
+#define REED_SOL_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
 int *reed_sol_r6_coding_matrix(int k, int w)
 {
   int *matrix;
@@ -76,6 +85,32 @@ int *reed_sol_r6_coding_matrix(int k, int w)
   return matrix;
 }
 
+/* Triple parity:  the rows are 1, 2^i and 4^i.  4^i = (2^i)^2, so any
+   square submatrix is a Vandermonde matrix, or one with a row of 2^i taken
+   out, and the code is MDS as long as the 2^i are distinct, i.e. for
+   k < 2^w. */
+
+int *reed_sol_r7_coding_matrix(int k, int w)
+{
+  int *matrix;
+  int i, tmp;
+
+  if (w != 8 && w != 16 && w != 32) return NULL;
+  if (w < 32 && k >= (1 << w)) return NULL;
+
+  matrix = talloc(int, 3*k);
+  if (matrix == NULL) return NULL;
+
+  tmp = 1;
+  for (i = 0; i < k; i++) {
+    if (i > 0) tmp = galois_single_multiply(tmp, 2, w);
+    matrix[i] = 1;
+    matrix[k+i] = tmp;
+    matrix[2*k+i] = galois_single_multiply(tmp, tmp, w);
+  }
+  return matrix;
+}
+
 int *reed_sol_vandermonde_coding_matrix(int k, int m, int w)
 {
   int i, j;
@@ -146,33 +181,700 @@ void reed_sol_galois_w32_region_multby_2(char *region, int nbytes)
   GF32.multiply_region.w32(&GF32, region, region, 2, nbytes, 0);
 }
 
+/* Fused RAID-6 and triple-parity kernels.  These compute up to three
+   syndromes of the data in one pass, reading each block of data once:
+
+     P' = D[0] + ... + D[k-1]                           (+ in[0])
+     Q' = D[0] + 2*D[1] + ... + 2^(k-1)*D[k-1]          (+ in[1])
+     R' = D[0] + 4*D[1] + ... + 4^(k-1)*D[k-1]          (+ in[2], rows = 3)
+
+   Data devices skip[0..2] are left out of the sums (-1 for none), in[r]
+   is added if it is not NULL, and the results go to out[r], which may
+   also be NULL.  Encoding is the case with nothing left out and no in.
+
+   Q' and R' are computed by Horner's rule.  Multiplying a vector of words
+   by 2 is a shift, plus the low bits of the primitive polynomial (prim) in
+   every word whose top bit was set:  the arithmetic shift of the top bit
+   makes a mask for prim.  For w=8 there is no byte shift, so the mask
+   comes from a signed compare with zero, and the shift is an add.
+   Multiplying by 4 is multiplying by 2 twice.
+
+   data[j] is read from byte off on, while in[] and out[] are read and
+   written from byte 0. */
+
+static uint32_t reed_sol_r6_get(unsigned char *p, int w)
+{
+  uint16_t x16;
+  uint32_t x32;
+
+  switch (w) {
+    case 8:  return *p;
+    case 16: memcpy(&x16, p, 2); return x16;
+    default: memcpy(&x32, p, 4); return x32;
+  }
+}
+
+static void reed_sol_r6_put(unsigned char *p, int w, uint32_t x)
+{
+  uint16_t x16;
+
+  switch (w) {
+    case 8:  *p = x; break;
+    case 16: x16 = x; memcpy(p, &x16, 2); break;
+    default: memcpy(p, &x, 4); break;
+  }
+}
+
+static uint32_t reed_sol_multby_2_scalar(uint32_t x, int w, uint32_t prim)
+{
+  uint32_t top;
+
+  top = (x >> (w-1)) & 1;
+  x = (w == 32) ? x << 1 : (x << 1) & ((((uint32_t) 1) << w) - 1);
+  return (top) ? x ^ prim : x;
+}
+
+static void reed_sol_syndromes_scalar(int k, int w, int rows, unsigned char **data, int *skip,
+                                      unsigned char **in, unsigned char **out,
+                                      uint32_t prim, int off, int start, int len)
+{
+  uint32_t s[3], d;
+  int i, j, r;
+
+  for (i = start; i < len; i += w/8) {
+    s[0] = s[1] = s[2] = 0;
+    for (j = k-1; j >= 0; j--) {
+      s[1] = reed_sol_multby_2_scalar(s[1], w, prim);
+      if (rows == 3) s[2] = reed_sol_multby_2_scalar(reed_sol_multby_2_scalar(s[2], w, prim), w, prim);
+      if (j == skip[0] || j == skip[1] || j == skip[2]) continue;
+      d = reed_sol_r6_get(data[j]+off+i, w);
+      for (r = 0; r < rows; r++) s[r] ^= d;
+    }
+    for (r = 0; r < rows; r++) {
+      if (in[r] != NULL) s[r] ^= reed_sol_r6_get(in[r]+i, w);
+      if (out[r] != NULL) reed_sol_r6_put(out[r]+i, w, s[r]);
+    }
+  }
+}
+
+#ifdef REED_SOL_X86_KERNELS
+
+REED_SOL_TARGET("sse2")
+static inline __m128i reed_sol_multby_2_sse2(__m128i v, int w, __m128i prim)
+{
+  switch (w) {
+    case 8:
+      return _mm_xor_si128(_mm_add_epi8(v, v),
+                           _mm_and_si128(_mm_cmplt_epi8(v, _mm_setzero_si128()), prim));
+    case 16:
+      return _mm_xor_si128(_mm_add_epi16(v, v), _mm_and_si128(_mm_srai_epi16(v, 15), prim));
+    default:
+      return _mm_xor_si128(_mm_add_epi32(v, v), _mm_and_si128(_mm_srai_epi32(v, 31), prim));
+  }
+}
+
+REED_SOL_TARGET("sse2")
+static void reed_sol_syndromes_sse2(int k, int w, int rows, unsigned char **data, int *skip,
+                                    unsigned char **in, unsigned char **out,
+                                    uint32_t prim, int off, int len)
+{
+  __m128i vprim, p0, p1, q0, q1, r0, r1, d0, d1;
+  int i, j;
+
+  switch (w) {
+    case 8:  vprim = _mm_set1_epi8(prim); break;
+    case 16: vprim = _mm_set1_epi16(prim); break;
+    default: vprim = _mm_set1_epi32(prim); break;
+  }
+  for (i = 0; i + 32 <= len; i += 32) {
+    p0 = p1 = q0 = q1 = r0 = r1 = _mm_setzero_si128();
+    for (j = k-1; j >= 0; j--) {
+      q0 = reed_sol_multby_2_sse2(q0, w, vprim);
+      q1 = reed_sol_multby_2_sse2(q1, w, vprim);
+      if (rows == 3) {
+        r0 = reed_sol_multby_2_sse2(reed_sol_multby_2_sse2(r0, w, vprim), w, vprim);
+        r1 = reed_sol_multby_2_sse2(reed_sol_multby_2_sse2(r1, w, vprim), w, vprim);
+      }
+      if (j == skip[0] || j == skip[1] || j == skip[2]) continue;
+      d0 = _mm_loadu_si128((__m128i *) (data[j]+off+i));
+      d1 = _mm_loadu_si128((__m128i *) (data[j]+off+i+16));
+      p0 = _mm_xor_si128(p0, d0);
+      p1 = _mm_xor_si128(p1, d1);
+      q0 = _mm_xor_si128(q0, d0);
+      q1 = _mm_xor_si128(q1, d1);
+      if (rows == 3) {
+        r0 = _mm_xor_si128(r0, d0);
+        r1 = _mm_xor_si128(r1, d1);
+      }
+    }
+    if (in[0] != NULL) {
+      p0 = _mm_xor_si128(p0, _mm_loadu_si128((__m128i *) (in[0]+i)));
+      p1 = _mm_xor_si128(p1, _mm_loadu_si128((__m128i *) (in[0]+i+16)));
+    }
+    if (out[0] != NULL) {
+      _mm_storeu_si128((__m128i *) (out[0]+i), p0);
+      _mm_storeu_si128((__m128i *) (out[0]+i+16), p1);
+    }
+    if (in[1] != NULL) {
+      q0 = _mm_xor_si128(q0, _mm_loadu_si128((__m128i *) (in[1]+i)));
+      q1 = _mm_xor_si128(q1, _mm_loadu_si128((__m128i *) (in[1]+i+16)));
+    }
+    if (out[1] != NULL) {
+      _mm_storeu_si128((__m128i *) (out[1]+i), q0);
+      _mm_storeu_si128((__m128i *) (out[1]+i+16), q1);
+    }
+    if (rows == 3) {
+      if (in[2] != NULL) {
+        r0 = _mm_xor_si128(r0, _mm_loadu_si128((__m128i *) (in[2]+i)));
+        r1 = _mm_xor_si128(r1, _mm_loadu_si128((__m128i *) (in[2]+i+16)));
+      }
+      if (out[2] != NULL) {
+        _mm_storeu_si128((__m128i *) (out[2]+i), r0);
+        _mm_storeu_si128((__m128i *) (out[2]+i+16), r1);
+      }
+    }
+  }
+  reed_sol_syndromes_scalar(k, w, rows, data, skip, in, out, prim, off, i, len);
+}
+
+REED_SOL_TARGET("avx2")
+static inline __m256i reed_sol_multby_2_avx2(__m256i v, int w, __m256i prim)
+{
+  switch (w) {
+    case 8:
+      return _mm256_xor_si256(_mm256_add_epi8(v, v),
+                              _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_setzero_si256(), v), prim));
+    case 16:
+      return _mm256_xor_si256(_mm256_add_epi16(v, v), _mm256_and_si256(_mm256_srai_epi16(v, 15), prim));
+    default:
+      return _mm256_xor_si256(_mm256_add_epi32(v, v), _mm256_and_si256(_mm256_srai_epi32(v, 31), prim));
+  }
+}
+
+REED_SOL_TARGET("avx2")
+static void reed_sol_syndromes_avx2(int k, int w, int rows, unsigned char **data, int *skip,
+                                    unsigned char **in, unsigned char **out,
+                                    uint32_t prim, int off, int len)
+{
+  __m256i vprim, p0, p1, q0, q1, r0, r1, d0, d1;
+  int i, j;
+
+  switch (w) {
+    case 8:  vprim = _mm256_set1_epi8(prim); break;
+    case 16: vprim = _mm256_set1_epi16(prim); break;
+    default: vprim = _mm256_set1_epi32(prim); break;
+  }
+  for (i = 0; i + 64 <= len; i += 64) {
+    p0 = p1 = q0 = q1 = r0 = r1 = _mm256_setzero_si256();
+    for (j = k-1; j >= 0; j--) {
+      q0 = reed_sol_multby_2_avx2(q0, w, vprim);
+      q1 = reed_sol_multby_2_avx2(q1, w, vprim);
+      if (rows == 3) {
+        r0 = reed_sol_multby_2_avx2(reed_sol_multby_2_avx2(r0, w, vprim), w, vprim);
+        r1 = reed_sol_multby_2_avx2(reed_sol_multby_2_avx2(r1, w, vprim), w, vprim);
+      }
+      if (j == skip[0] || j == skip[1] || j == skip[2]) continue;
+      d0 = _mm256_loadu_si256((__m256i *) (data[j]+off+i));
+      d1 = _mm256_loadu_si256((__m256i *) (data[j]+off+i+32));
+      p0 = _mm256_xor_si256(p0, d0);
+      p1 = _mm256_xor_si256(p1, d1);
+      q0 = _mm256_xor_si256(q0, d0);
+      q1 = _mm256_xor_si256(q1, d1);
+      if (rows == 3) {
+        r0 = _mm256_xor_si256(r0, d0);
+        r1 = _mm256_xor_si256(r1, d1);
+      }
+    }
+    if (in[0] != NULL) {
+      p0 = _mm256_xor_si256(p0, _mm256_loadu_si256((__m256i *) (in[0]+i)));
+      p1 = _mm256_xor_si256(p1, _mm256_loadu_si256((__m256i *) (in[0]+i+32)));
+    }
+    if (out[0] != NULL) {
+      _mm256_storeu_si256((__m256i *) (out[0]+i), p0);
+      _mm256_storeu_si256((__m256i *) (out[0]+i+32), p1);
+    }
+    if (in[1] != NULL) {
+      q0 = _mm256_xor_si256(q0, _mm256_loadu_si256((__m256i *) (in[1]+i)));
+      q1 = _mm256_xor_si256(q1, _mm256_loadu_si256((__m256i *) (in[1]+i+32)));
+    }
+    if (out[1] != NULL) {
+      _mm256_storeu_si256((__m256i *) (out[1]+i), q0);
+      _mm256_storeu_si256((__m256i *) (out[1]+i+32), q1);
+    }
+    if (rows == 3) {
+      if (in[2] != NULL) {
+        r0 = _mm256_xor_si256(r0, _mm256_loadu_si256((__m256i *) (in[2]+i)));
+        r1 = _mm256_xor_si256(r1, _mm256_loadu_si256((__m256i *) (in[2]+i+32)));
+      }
+      if (out[2] != NULL) {
+        _mm256_storeu_si256((__m256i *) (out[2]+i), r0);
+        _mm256_storeu_si256((__m256i *) (out[2]+i+32), r1);
+      }
+    }
+  }
+  reed_sol_syndromes_scalar(k, w, rows, data, skip, in, out, prim, off, i, len);
+}
+
+REED_SOL_TARGET("avx512f,avx512bw")
+static inline __m512i reed_sol_multby_2_avx512(__m512i v, int w, __m512i prim)
+{
+  switch (w) {
+    case 8:
+      return _mm512_xor_si512(_mm512_add_epi8(v, v), _mm512_maskz_mov_epi8(_mm512_movepi8_mask(v), prim));
+    case 16:
+      return _mm512_xor_si512(_mm512_add_epi16(v, v), _mm512_and_si512(_mm512_srai_epi16(v, 15), prim));
+    default:
+      return _mm512_xor_si512(_mm512_add_epi32(v, v), _mm512_and_si512(_mm512_srai_epi32(v, 31), prim));
+  }
+}
+
+REED_SOL_TARGET("avx512f,avx512bw")
+static void reed_sol_syndromes_avx512(int k, int w, int rows, unsigned char **data, int *skip,
+                                      unsigned char **in, unsigned char **out,
+                                      uint32_t prim, int off, int len)
+{
+  __m512i vprim, p0, p1, q0, q1, r0, r1, d0, d1;
+  int i, j;
+
+  switch (w) {
+    case 8:  vprim = _mm512_set1_epi8(prim); break;
+    case 16: vprim = _mm512_set1_epi16(prim); break;
+    default: vprim = _mm512_set1_epi32(prim); break;
+  }
+  for (i = 0; i + 128 <= len; i += 128) {
+    p0 = p1 = q0 = q1 = r0 = r1 = _mm512_setzero_si512();
+    for (j = k-1; j >= 0; j--) {
+      q0 = reed_sol_multby_2_avx512(q0, w, vprim);
+      q1 = reed_sol_multby_2_avx512(q1, w, vprim);
+      if (rows == 3) {
+        r0 = reed_sol_multby_2_avx512(reed_sol_multby_2_avx512(r0, w, vprim), w, vprim);
+        r1 = reed_sol_multby_2_avx512(reed_sol_multby_2_avx512(r1, w, vprim), w, vprim);
+      }
+      if (j == skip[0] || j == skip[1] || j == skip[2]) continue;
+      d0 = _mm512_loadu_si512((void *) (data[j]+off+i));
+      d1 = _mm512_loadu_si512((void *) (data[j]+off+i+64));
+      p0 = _mm512_xor_si512(p0, d0);
+      p1 = _mm512_xor_si512(p1, d1);
+      q0 = _mm512_xor_si512(q0, d0);
+      q1 = _mm512_xor_si512(q1, d1);
+      if (rows == 3) {
+        r0 = _mm512_xor_si512(r0, d0);
+        r1 = _mm512_xor_si512(r1, d1);
+      }
+    }
+    if (in[0] != NULL) {
+      p0 = _mm512_xor_si512(p0, _mm512_loadu_si512((void *) (in[0]+i)));
+      p1 = _mm512_xor_si512(p1, _mm512_loadu_si512((void *) (in[0]+i+64)));
+    }
+    if (out[0] != NULL) {
+      _mm512_storeu_si512((void *) (out[0]+i), p0);
+      _mm512_storeu_si512((void *) (out[0]+i+64), p1);
+    }
+    if (in[1] != NULL) {
+      q0 = _mm512_xor_si512(q0, _mm512_loadu_si512((void *) (in[1]+i)));
+      q1 = _mm512_xor_si512(q1, _mm512_loadu_si512((void *) (in[1]+i+64)));
+    }
+    if (out[1] != NULL) {
+      _mm512_storeu_si512((void *) (out[1]+i), q0);
+      _mm512_storeu_si512((void *) (out[1]+i+64), q1);
+    }
+    if (rows == 3) {
+      if (in[2] != NULL) {
+        r0 = _mm512_xor_si512(r0, _mm512_loadu_si512((void *) (in[2]+i)));
+        r1 = _mm512_xor_si512(r1, _mm512_loadu_si512((void *) (in[2]+i+64)));
+      }
+      if (out[2] != NULL) {
+        _mm512_storeu_si512((void *) (out[2]+i), r0);
+        _mm512_storeu_si512((void *) (out[2]+i+64), r1);
+      }
+    }
+  }
+  reed_sol_syndromes_scalar(k, w, rows, data, skip, in, out, prim, off, i, len);
+}
+
+#endif
+
+static uint32_t reed_sol_r6_prim(int w)
+{
+  uint32_t prim;
+
+  prim = galois_single_multiply((int) (1U << (w-1)), 2, w);
+  return (w < 32) ? prim & ((1U << w) - 1) : prim;
+}
+
+static void reed_sol_syndromes(int k, int w, int rows, char **data_ptrs, int *skip,
+                               char **in, char **out, int off, int len)
+{
+  unsigned char **d, **ip, **op;
+  uint32_t prim;
+
+  prim = reed_sol_r6_prim(w);
+  d = (unsigned char **) data_ptrs;
+  ip = (unsigned char **) in;
+  op = (unsigned char **) out;
+  switch (galois_get_region_kernel()) {
+#ifdef REED_SOL_X86_KERNELS
+    case GALOIS_KERNEL_AVX512: reed_sol_syndromes_avx512(k, w, rows, d, skip, ip, op, prim, off, len); break;
+    case GALOIS_KERNEL_AVX2:   reed_sol_syndromes_avx2(k, w, rows, d, skip, ip, op, prim, off, len); break;
+    case GALOIS_KERNEL_SSSE3:  reed_sol_syndromes_sse2(k, w, rows, d, skip, ip, op, prim, off, len); break;
+#endif
+    default: reed_sol_syndromes_scalar(k, w, rows, d, skip, ip, op, prim, off, 0, len); break;
+  }
+}
+
+static void reed_sol_r6_syndromes(int k, int w, char **data_ptrs, int x, int y,
+                                  char *pin, char *qin, char *pout, char *qout,
+                                  int off, int len)
+{
+  int skip[3];
+  char *in[3], *out[3];
+
+  skip[0] = x;
+  skip[1] = y;
+  skip[2] = -1;
+  in[0] = pin;
+  in[1] = qin;
+  in[2] = NULL;
+  out[0] = pout;
+  out[1] = qout;
+  out[2] = NULL;
+  reed_sol_syndromes(k, w, 2, data_ptrs, skip, in, out, off, len);
+}
+
+/* Without native kernels:  dest = sum of (2^(times*j))*Dj, by Horner's rule
+   over whole regions with GF-Complete. */
+
+static void reed_sol_horner(int k, int w, char **data_ptrs, char *dest, int size, int times)
+{
+  int i, t;
+
+  memcpy(dest, data_ptrs[k-1], size);
+
+  for (i = k-2; i >= 0; i--) {
+    for (t = 0; t < times; t++) {
+      switch (w) {
+        case 8:  reed_sol_galois_w08_region_multby_2(dest, size); break;
+        case 16: reed_sol_galois_w16_region_multby_2(dest, size); break;
+        case 32: reed_sol_galois_w32_region_multby_2(dest, size); break;
+      }
+    }
+    galois_region_xor(data_ptrs[i], dest, size);
+  }
+}
+
 int reed_sol_r6_encode(int k, int w, char **data_ptrs, char **coding_ptrs, int size)
 {
-  int i;
+  if (w != 8 && w != 16 && w != 32) return 0;
 
-  /* First, put the XOR into coding region 0 */
+  if (galois_get_region_kernel() != GALOIS_KERNEL_GF_COMPLETE) {
+    reed_sol_r6_syndromes(k, w, data_ptrs, -1, -1, NULL, NULL, coding_ptrs[0], coding_ptrs[1], 0, size);
+    return 1;
+  }
 
-  memcpy(coding_ptrs[0], data_ptrs[0], size);
+  /* Without native kernels, first put the XOR into coding region 0 */
 
-  for (i = 1; i < k; i++) galois_region_xor(data_ptrs[i], coding_ptrs[0], size);
+  galois_region_xor_n(data_ptrs, k, coding_ptrs[0], size);
 
   /* Next, put the sum of (2^j)*Dj into coding region 1 */
 
-  memcpy(coding_ptrs[1], data_ptrs[k-1], size);
+  reed_sol_horner(k, w, data_ptrs, coding_ptrs[1], size, 1);
+  return 1;
+}
+
+/* RAID-6 decoding, in closed form.  With data devices x (and y) lost, the
+   syndromes of the surviving devices are
 
-  for (i = k-2; i >= 0; i--) {
-    switch (w) {
-      case 8:  reed_sol_galois_w08_region_multby_2(coding_ptrs[1], size); break;
-      case 16: reed_sol_galois_w16_region_multby_2(coding_ptrs[1], size); break;
-      case 32: reed_sol_galois_w32_region_multby_2(coding_ptrs[1], size); break;
-      default: return 0;
+     Ps = P + sum of the surviving D[j]           = D[x] (+ D[y])
+     Qs = Q + sum of the surviving 2^j * D[j]     = 2^x*D[x] (+ 2^y*D[y])
+
+   so that one lost data device comes from Ps, or from Qs/2^x if P is lost
+   too, and two lost data devices come from
+
+     D[x] = A*Ps + B*Qs,   with A = 2^y/(2^x+2^y) and B = 1/(2^x+2^y),
+     D[y] = Ps + D[x].
+
+   The syndromes are computed REED_SOL_R6_TILE bytes at a time into two
+   buffers on the stack, so that nothing is allocated and the tiles are
+   still in cache when they are combined.  The buffers are offset to have
+   the same alignment as D[x], as GF-Complete's region multiplies need. */
+
+#define REED_SOL_R6_TILE 4096
+
+static int reed_sol_r6_power(int e, int w)
+{
+  int p;
+
+  p = 1;
+  while (e-- > 0) p = galois_single_multiply(p, 2, w);
+  return p;
+}
+
+static void reed_sol_r6_dotprod(int w, char **srcs, int *coeffs, int n, char *dest, int len)
+{
+  switch (w) {
+    case 8:  galois_w08_region_dotprod(srcs, coeffs, n, dest, len); break;
+    case 16: galois_w16_region_dotprod(srcs, coeffs, n, dest, len); break;
+    case 32: galois_w32_region_dotprod(srcs, coeffs, n, dest, len); break;
+  }
+}
+
+int reed_sol_r6_decode(int k, int w, int *erasures, char **data_ptrs, char **coding_ptrs, int size)
+{
+  char pbuf[REED_SOL_R6_TILE+16], qbuf[REED_SOL_R6_TILE+16];
+  char *ps, *qs, *dx, *dy, *srcs[2];
+  int x, y, perased, qerased, i, e, off, len, coeffs[2], gx, gy;
+
+  if (w != 8 && w != 16 && w != 32) return -1;
+
+  x = -1;
+  y = -1;
+  perased = 0;
+  qerased = 0;
+  for (i = 0; erasures[i] != -1; i++) {
+    e = erasures[i];
+    if (e < 0 || e >= k+2) return -1;
+    if (e == k) {
+      perased = 1;
+    } else if (e == k+1) {
+      qerased = 1;
+    } else if (e != x && e != y) {
+      if (x == -1) {
+        x = e;
+      } else if (y == -1) {
+        y = e;
+      } else {
+        return -1;
+      }
+    }
+  }
+  if ((x != -1) + (y != -1) + perased + qerased > 2) return -1;
+  if (y != -1 && y < x) {
+    e = x;
+    x = y;
+    y = e;
+  }
+
+  /* Only coding devices are lost:  re-encode them, and only them. */
+
+  if (x == -1) {
+    if (qerased && perased) {
+      reed_sol_r6_encode(k, w, data_ptrs, coding_ptrs, size);
+    } else if (qerased) {
+      if (galois_get_region_kernel() != GALOIS_KERNEL_GF_COMPLETE) {
+        reed_sol_r6_syndromes(k, w, data_ptrs, -1, -1, NULL, NULL, NULL, coding_ptrs[1], 0, size);
+      } else {
+        reed_sol_horner(k, w, data_ptrs, coding_ptrs[1], size, 1);
+      }
+    } else if (perased) {
+      galois_region_xor_n(data_ptrs, k, coding_ptrs[0], size);
+    }
+    return 0;
+  }
+
+  ps = pbuf + (((uintptr_t) data_ptrs[x] - (uintptr_t) pbuf) & 15);
+  qs = qbuf + (((uintptr_t) data_ptrs[x] - (uintptr_t) qbuf) & 15);
+  gx = reed_sol_r6_power(x, w);
+
+  if (y != -1) {
+    gy = reed_sol_r6_power(y, w);
+    coeffs[1] = galois_single_divide(1, gx ^ gy, w);
+    coeffs[0] = galois_single_multiply(gy, coeffs[1], w);
+  } else if (perased) {
+    coeffs[0] = galois_single_divide(1, gx, w);
+  }
+
+  for (off = 0; off < size; off += REED_SOL_R6_TILE) {
+    len = (size - off < REED_SOL_R6_TILE) ? size - off : REED_SOL_R6_TILE;
+    dx = data_ptrs[x] + off;
+
+    if (y != -1) {                       /* D[x] and D[y] */
+      dy = data_ptrs[y] + off;
+      reed_sol_r6_syndromes(k, w, data_ptrs, x, y, coding_ptrs[0]+off, coding_ptrs[1]+off,
+                            ps, qs, off, len);
+      srcs[0] = ps;
+      srcs[1] = qs;
+      reed_sol_r6_dotprod(w, srcs, coeffs, 2, dx, len);
+      srcs[1] = dx;
+      galois_region_xor_n(srcs, 2, dy, len);
+
+    } else if (perased) {                /* D[x] and P, from Q */
+      reed_sol_r6_syndromes(k, w, data_ptrs, x, -1, NULL, coding_ptrs[1]+off,
+                            ps, qs, off, len);
+      reed_sol_r6_dotprod(w, &qs, coeffs, 1, dx, len);
+      srcs[0] = ps;
+      srcs[1] = dx;
+      galois_region_xor_n(srcs, 2, coding_ptrs[0]+off, len);
+
+    } else if (qerased) {                /* D[x] and Q, from P */
+      reed_sol_r6_syndromes(k, w, data_ptrs, x, -1, coding_ptrs[0]+off, NULL,
+                            dx, qs, off, len);
+      switch (w) {
+        case 8:  galois_w08_region_multiply(dx, gx, len, qs, 1); break;
+        case 16: galois_w16_region_multiply(dx, gx, len, qs, 1); break;
+        case 32: galois_w32_region_multiply(dx, gx, len, qs, 1); break;
+      }
+      memcpy(coding_ptrs[1]+off, qs, len);
+
+    } else {                             /* D[x] alone, from P */
+      reed_sol_r6_syndromes(k, w, data_ptrs, x, -1, coding_ptrs[0]+off, NULL,
+                            dx, NULL, off, len);
     }
+  }
+  return 0;
+}
+
+int reed_sol_r7_encode(int k, int w, char **data_ptrs, char **coding_ptrs, int size)
+{
+  int skip[3];
+  char *in[3];
 
-    galois_region_xor(data_ptrs[i], coding_ptrs[1], size);
+  if (w != 8 && w != 16 && w != 32) return 0;
+
+  if (galois_get_region_kernel() != GALOIS_KERNEL_GF_COMPLETE) {
+    skip[0] = skip[1] = skip[2] = -1;
+    in[0] = in[1] = in[2] = NULL;
+    reed_sol_syndromes(k, w, 3, data_ptrs, skip, in, coding_ptrs, 0, size);
+    return 1;
   }
+
+  galois_region_xor_n(data_ptrs, k, coding_ptrs[0], size);
+  reed_sol_horner(k, w, data_ptrs, coding_ptrs[1], size, 1);
+  reed_sol_horner(k, w, data_ptrs, coding_ptrs[2], size, 2);
   return 1;
 }
 
+/* Triple-parity decoding.  With e <= 3 data devices lost, the syndromes of
+   the surviving devices against any e of the surviving parity rows are the
+   lost data times an e x e submatrix of the coding matrix.  That matrix
+   depends only on which devices are lost, so it is inverted once, with
+   single multiplies on the stack, and each lost device is then a dot
+   product of the syndrome tiles.  Lost parity is re-encoded from the
+   tile once its data is back.  As in reed_sol_r6_decode, the tiles live on
+   the stack, aligned like the first lost data device. */
+
+static int reed_sol_r7_invert(int *mat, int *inv, int n, int w)
+{
+  int i, j, r, t, pivot;
+
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) inv[i*n+j] = (i == j);
+  }
+  for (i = 0; i < n; i++) {
+    for (r = i; r < n && mat[r*n+i] == 0; r++) ;
+    if (r == n) return -1;
+    for (j = 0; j < n; j++) {
+      t = mat[i*n+j]; mat[i*n+j] = mat[r*n+j]; mat[r*n+j] = t;
+      t = inv[i*n+j]; inv[i*n+j] = inv[r*n+j]; inv[r*n+j] = t;
+    }
+    pivot = galois_single_divide(1, mat[i*n+i], w);
+    for (j = 0; j < n; j++) {
+      mat[i*n+j] = galois_single_multiply(mat[i*n+j], pivot, w);
+      inv[i*n+j] = galois_single_multiply(inv[i*n+j], pivot, w);
+    }
+    for (r = 0; r < n; r++) {
+      if (r == i || mat[r*n+i] == 0) continue;
+      t = mat[r*n+i];
+      for (j = 0; j < n; j++) {
+        mat[r*n+j] ^= galois_single_multiply(t, mat[i*n+j], w);
+        inv[r*n+j] ^= galois_single_multiply(t, inv[i*n+j], w);
+      }
+    }
+  }
+  return 0;
+}
+
+int reed_sol_r7_decode(int k, int w, int *erasures, char **data_ptrs, char **coding_ptrs, int size)
+{
+  char sbuf[3][REED_SOL_R6_TILE+16];
+  char *st[3], *in[3], *out[3], *srcs[3];
+  int lost[3], skip[3], none[3], rows[3], mat[9], inv[9];
+  int ne, nr, nrows, i, j, e, g, off, len;
+
+  if (w != 8 && w != 16 && w != 32) return -1;
+
+  ne = 0;
+  lost[0] = lost[1] = lost[2] = 0;
+  skip[0] = skip[1] = skip[2] = -1;
+  none[0] = none[1] = none[2] = -1;
+  for (i = 0; erasures[i] != -1; i++) {
+    e = erasures[i];
+    if (e < 0 || e >= k+3) return -1;
+    if (e >= k) {
+      lost[e-k] = 1;
+    } else if (e != skip[0] && e != skip[1] && e != skip[2]) {
+      if (ne == 3) return -1;
+      skip[ne++] = e;
+    }
+  }
+  if (ne + lost[0] + lost[1] + lost[2] > 3) return -1;
+
+  /* Only parity is lost:  re-encode it. */
+
+  in[0] = in[1] = in[2] = NULL;
+  if (ne == 0) {
+    for (i = 0; i < 3; i++) out[i] = (lost[i]) ? coding_ptrs[i] : NULL;
+    reed_sol_syndromes(k, w, (lost[2]) ? 3 : 2, data_ptrs, skip, in, out, 0, size);
+    return 0;
+  }
+
+  /* Pick ne surviving parity rows, and invert their submatrix */
+
+  nr = 0;
+  for (i = 0; i < 3 && nr < ne; i++) {
+    if (!lost[i]) rows[nr++] = i;
+  }
+  for (i = 0; i < ne; i++) {
+    g = reed_sol_r6_power(skip[i], w);
+    for (j = 0; j < ne; j++) {
+      switch (rows[j]) {
+        case 0:  mat[j*ne+i] = 1; break;
+        case 1:  mat[j*ne+i] = g; break;
+        default: mat[j*ne+i] = galois_single_multiply(g, g, w); break;
+      }
+    }
+  }
+  if (reed_sol_r7_invert(mat, inv, ne, w) < 0) return -1;
+
+  for (i = 0; i < 3; i++) {
+    st[i] = sbuf[i] + (((uintptr_t) data_ptrs[skip[0]] - (uintptr_t) sbuf[i]) & 15);
+  }
+  nrows = (rows[nr-1] == 2) ? 3 : 2;
+
+  for (off = 0; off < size; off += REED_SOL_R6_TILE) {
+    len = (size - off < REED_SOL_R6_TILE) ? size - off : REED_SOL_R6_TILE;
+
+    /* Syndromes of the chosen rows */
+
+    for (i = 0; i < 3; i++) {
+      in[i] = NULL;
+      out[i] = NULL;
+    }
+    for (j = 0; j < nr; j++) {
+      in[rows[j]] = coding_ptrs[rows[j]] + off;
+      out[rows[j]] = st[j];
+      srcs[j] = st[j];
+    }
+    reed_sol_syndromes(k, w, nrows, data_ptrs, skip, in, out, off, len);
+
+    /* The lost data */
+
+    for (i = 0; i < ne; i++) {
+      reed_sol_r6_dotprod(w, srcs, inv+i*ne, ne, data_ptrs[skip[i]]+off, len);
+    }
+
+    /* And then the lost parity */
+
+    if (lost[0] || lost[1] || lost[2]) {
+      for (i = 0; i < 3; i++) {
+        in[i] = NULL;
+        out[i] = (lost[i]) ? coding_ptrs[i] + off : NULL;
+      }
+      reed_sol_syndromes(k, w, (lost[2]) ? 3 : 2, data_ptrs, none, in, out, off, len);
+    }
+  }
+  return 0;
+}
+
 int *reed_sol_extended_vandermonde_matrix(int rows, int cols, int w)
 {
   int *vdm;